@@ -5,14 +5,26 @@
 #include "SFZero.h"
 #include "sfzero/RIFF.cpp" 
 #include "sfzero/SF2.cpp" 
+#include "sfzero/SF2Cache.cpp" 
 #include "sfzero/SF2Generator.cpp" 
 #include "sfzero/SF2Reader.cpp" 
 #include "sfzero/SF2Sound.cpp" 
+#include "sfzero/SFZArena.cpp" 
 #include "sfzero/SFZDebug.cpp" 
 #include "sfzero/SFZEG.cpp" 
+#include "sfzero/SFZHitCache.cpp" 
+#include "sfzero/SFZPerformance.cpp" 
 #include "sfzero/SFZReader.cpp" 
 #include "sfzero/SFZRegion.cpp" 
+#include "sfzero/SFZRegionIndex.cpp" 
+#include "sfzero/SFZRenderPool.cpp" 
 #include "sfzero/SFZSample.cpp" 
+#include "sfzero/SFZSampleCodec.cpp" 
+#include "sfzero/SFZSamplePool.cpp" 
+#include "sfzero/SFZSampleRateConverter.cpp" 
 #include "sfzero/SFZSound.cpp" 
+#include "sfzero/SFZStream.cpp" 
 #include "sfzero/SFZSynth.cpp" 
+#include "sfzero/SFZTrace.cpp" 
 #include "sfzero/SFZVoice.cpp" 
+#include "sfzero/SFZVoiceTable.cpp" 
@@ -25,21 +25,42 @@
 #ifndef INCLUDED_SFZERO_H
 #define INCLUDED_SFZERO_H
 
+/** Config: SFZERO_TRACE
+    Records what the synth does, block by block and voice by voice, into a
+    ring that Synth::getTrace() can write out for Perfetto or chrome://tracing.
+    Off by default, and costs nothing then.
+*/
+#ifndef SFZERO_TRACE
+ #define SFZERO_TRACE 0
+#endif
+
 #include "sfzero/RIFF.h"
 #include "sfzero/SF2.h"
+#include "sfzero/SF2Cache.h"
 #include "sfzero/SF2Generator.h"
 #include "sfzero/SF2Reader.h"
 #include "sfzero/SF2Sound.h"
 #include "sfzero/SF2WinTypes.h"
+#include "sfzero/SFZArena.h"
 #include "sfzero/SFZCommon.h"
 #include "sfzero/SFZDebug.h"
 #include "sfzero/SFZEG.h"
+#include "sfzero/SFZHitCache.h"
+#include "sfzero/SFZPerformance.h"
 #include "sfzero/SFZReader.h"
 #include "sfzero/SFZRegion.h"
+#include "sfzero/SFZRegionIndex.h"
+#include "sfzero/SFZRenderPool.h"
 #include "sfzero/SFZSample.h"
+#include "sfzero/SFZSampleCodec.h"
+#include "sfzero/SFZSamplePool.h"
+#include "sfzero/SFZSampleRateConverter.h"
 #include "sfzero/SFZSound.h"
+#include "sfzero/SFZStream.h"
 #include "sfzero/SFZSynth.h"
+#include "sfzero/SFZTrace.h"
 #include "sfzero/SFZVoice.h"
+#include "sfzero/SFZVoiceTable.h"
 
 
 #endif   // INCLUDED_SFZERO_H
@@ -0,0 +1,281 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#include "SF2Cache.h"
+#include "SF2Sound.h"
+#include "SFZRegion.h"
+#include "SFZSample.h"
+
+static const int cacheMagic = 0x43324653; // "SF2C"
+
+static void writeEG(juce::OutputStream &out, const sfzero::EGParameters &eg)
+{
+  out.writeFloat(eg.delay);
+  out.writeFloat(eg.start);
+  out.writeFloat(eg.attack);
+  out.writeFloat(eg.hold);
+  out.writeFloat(eg.decay);
+  out.writeFloat(eg.sustain);
+  out.writeFloat(eg.release);
+}
+
+static void readEG(juce::InputStream &in, sfzero::EGParameters &eg)
+{
+  eg.delay = in.readFloat();
+  eg.start = in.readFloat();
+  eg.attack = in.readFloat();
+  eg.hold = in.readFloat();
+  eg.decay = in.readFloat();
+  eg.sustain = in.readFloat();
+  eg.release = in.readFloat();
+}
+
+static void writeRegion(juce::OutputStream &out, const sfzero::Region &region)
+{
+  out.writeDouble(region.sample ? region.sample->getSampleRate() : 0.0);
+  out.writeInt(region.lokey);
+  out.writeInt(region.hikey);
+  out.writeInt(region.lovel);
+  out.writeInt(region.hivel);
+  out.writeInt(region.trigger);
+  out.writeInt(region.group);
+  out.writeInt64(region.off_by);
+  out.writeInt(region.off_mode);
+  out.writeInt64(region.offset);
+  out.writeInt64(region.end);
+  out.writeBool(region.negative_end);
+  out.writeInt(region.loop_mode);
+  out.writeInt64(region.loop_start);
+  out.writeInt64(region.loop_end);
+  out.writeInt(region.transpose);
+  out.writeInt(region.tune);
+  out.writeInt(region.pitch_keycenter);
+  out.writeInt(region.pitch_keytrack);
+  out.writeInt(region.bend_up);
+  out.writeInt(region.bend_down);
+  out.writeFloat(region.volume);
+  out.writeFloat(region.pan);
+  out.writeFloat(region.amp_veltrack);
+  out.writeFloat(region.cutoff);
+  out.writeFloat(region.resonance);
+  writeEG(out, region.ampeg);
+  writeEG(out, region.ampeg_veltrack);
+  writeEG(out, region.modeg);
+  out.writeFloat(region.modeg_to_pitch);
+  out.writeFloat(region.modeg_to_cutoff);
+  out.writeFloat(region.modlfo_delay);
+  out.writeFloat(region.modlfo_freq);
+  out.writeFloat(region.modlfo_to_pitch);
+  out.writeFloat(region.modlfo_to_cutoff);
+  out.writeFloat(region.modlfo_to_volume);
+  out.writeFloat(region.viblfo_delay);
+  out.writeFloat(region.viblfo_freq);
+  out.writeFloat(region.viblfo_to_pitch);
+}
+
+static void readRegion(juce::InputStream &in, sfzero::Region &region, double &sampleRate)
+{
+  sampleRate = in.readDouble();
+  region.lokey = in.readInt();
+  region.hikey = in.readInt();
+  region.lovel = in.readInt();
+  region.hivel = in.readInt();
+  region.trigger = static_cast<sfzero::Region::Trigger>(in.readInt());
+  region.group = in.readInt();
+  region.off_by = in.readInt64();
+  region.off_mode = static_cast<sfzero::Region::OffMode>(in.readInt());
+  region.offset = in.readInt64();
+  region.end = in.readInt64();
+  region.negative_end = in.readBool();
+  region.loop_mode = static_cast<sfzero::Region::LoopMode>(in.readInt());
+  region.loop_start = in.readInt64();
+  region.loop_end = in.readInt64();
+  region.transpose = in.readInt();
+  region.tune = in.readInt();
+  region.pitch_keycenter = in.readInt();
+  region.pitch_keytrack = in.readInt();
+  region.bend_up = in.readInt();
+  region.bend_down = in.readInt();
+  region.volume = in.readFloat();
+  region.pan = in.readFloat();
+  region.amp_veltrack = in.readFloat();
+  region.cutoff = in.readFloat();
+  region.resonance = in.readFloat();
+  readEG(in, region.ampeg);
+  readEG(in, region.ampeg_veltrack);
+  readEG(in, region.modeg);
+  region.modeg_to_pitch = in.readFloat();
+  region.modeg_to_cutoff = in.readFloat();
+  region.modlfo_delay = in.readFloat();
+  region.modlfo_freq = in.readFloat();
+  region.modlfo_to_pitch = in.readFloat();
+  region.modlfo_to_cutoff = in.readFloat();
+  region.modlfo_to_volume = in.readFloat();
+  region.viblfo_delay = in.readFloat();
+  region.viblfo_freq = in.readFloat();
+  region.viblfo_to_pitch = in.readFloat();
+}
+
+juce::File sfzero::SF2Cache::getCacheFile(const juce::File &directory, juce::uint64 hydraHash)
+{
+  return directory.getChildFile(juce::String::toHexString(static_cast<juce::int64>(hydraHash)) + ".sf2cache");
+}
+
+bool sfzero::SF2Cache::read(sfzero::SF2Sound &sound, const juce::File &cacheFile, juce::uint64 hydraHash)
+{
+  if (!cacheFile.existsAsFile())
+  {
+    return false;
+  }
+
+  // Parse straight out of the mapped file; it's only open for this call.
+  juce::MemoryMappedFile mapped(cacheFile, juce::MemoryMappedFile::readOnly);
+  if (mapped.getData() == nullptr)
+  {
+    return false;
+  }
+  juce::MemoryInputStream in(mapped.getData(), mapped.getSize(), false);
+
+  if (in.readInt() != cacheMagic || in.readInt() != formatVersion ||
+      static_cast<juce::uint64>(in.readInt64()) != hydraHash)
+  {
+    return false;
+  }
+
+  juce::StringArray warnings;
+  int numWarnings = in.readInt();
+  for (int i = 0; i < numWarnings && !in.isExhausted(); ++i)
+  {
+    warnings.add(in.readString());
+  }
+
+  // Build everything aside first, so a truncated file changes nothing.
+  juce::Array<sfzero::Region> pool;
+  juce::Array<double> poolSampleRates;
+  int numPooled = in.readInt();
+  if (numPooled < 0)
+  {
+    return false;
+  }
+  pool.ensureStorageAllocated(numPooled);
+  for (int i = 0; i < numPooled && !in.isExhausted(); ++i)
+  {
+    sfzero::Region region;
+    double sampleRate = 0.0;
+    readRegion(in, region, sampleRate);
+    pool.add(region);
+    poolSampleRates.add(sampleRate);
+  }
+
+  juce::OwnedArray<sfzero::SF2Sound::Preset> presets;
+  juce::Array<juce::Array<int>> presetRegions;
+  int numPresets = in.readInt();
+  if (pool.size() != numPooled || numPresets < 0)
+  {
+    return false;
+  }
+  for (int i = 0; i < numPresets; ++i)
+  {
+    juce::String name = in.readString();
+    int bank = in.readInt();
+    int number = in.readInt();
+    int numRegions = in.readInt();
+    if (in.isExhausted() || numRegions < 0)
+    {
+      return false;
+    }
+    presets.add(new sfzero::SF2Sound::Preset(name, bank, number));
+    juce::Array<int> regions;
+    regions.ensureStorageAllocated(numRegions);
+    for (int j = 0; j < numRegions; ++j)
+    {
+      int index = in.readInt();
+      if (!juce::isPositiveAndBelow(index, numPooled))
+      {
+        return false;
+      }
+      regions.add(index);
+    }
+    presetRegions.add(regions);
+  }
+  if (in.getPosition() > in.getTotalLength() || in.readInt() != cacheMagic)
+  {
+    return false;
+  }
+
+  for (int i = 0; i < pool.size(); ++i)
+  {
+    pool.getReference(i).sample = sound.sampleFor(poolSampleRates.getUnchecked(i));
+  }
+  for (int i = 0; i < presets.size(); ++i)
+  {
+    sfzero::SF2Sound::Preset *preset = presets.getUnchecked(i);
+    for (int index : presetRegions.getReference(i))
+    {
+      preset->addRegion(pool.getReference(index));
+    }
+  }
+  while (!presets.isEmpty())
+  {
+    sound.addPreset(presets.removeAndReturn(0));
+  }
+  for (const juce::String &warning : warnings)
+  {
+    sound.addWarning(warning);
+  }
+  return true;
+}
+
+bool sfzero::SF2Cache::write(const sfzero::SF2Sound &sound, const juce::File &cacheFile, juce::uint64 hydraHash)
+{
+  juce::MemoryOutputStream out;
+  out.writeInt(cacheMagic);
+  out.writeInt(formatVersion);
+  out.writeInt64(static_cast<juce::int64>(hydraHash));
+
+  const juce::StringArray &warnings = sound.getWarnings();
+  out.writeInt(warnings.size());
+  for (const juce::String &warning : warnings)
+  {
+    out.writeString(warning);
+  }
+
+  // The pooled regions once each, then each preset's as indices into them.
+  const sfzero::Region *pool = sound.getRegionPool();
+  out.writeInt(sound.getNumPooledRegions());
+  for (int i = 0; i < sound.getNumPooledRegions(); ++i)
+  {
+    writeRegion(out, pool[i]);
+  }
+
+  const juce::OwnedArray<sfzero::SF2Sound::Preset> &presets = sound.getPresets();
+  out.writeInt(presets.size());
+  for (sfzero::SF2Sound::Preset *preset : presets)
+  {
+    out.writeString(preset->name);
+    out.writeInt(preset->bank);
+    out.writeInt(preset->preset);
+    out.writeInt(preset->regionTable.size());
+    for (sfzero::Region *region : preset->regionTable)
+    {
+      out.writeInt(static_cast<int>(region - pool));
+    }
+  }
+  // Trailer, so a file cut short is caught.
+  out.writeInt(cacheMagic);
+
+  // Write beside the target and swap it in, so a reader never sees half a file.
+  if (!cacheFile.getParentDirectory().createDirectory())
+  {
+    return false;
+  }
+  juce::TemporaryFile temp(cacheFile);
+  if (!temp.getFile().replaceWithData(out.getData(), out.getDataSize()))
+  {
+    return false;
+  }
+  return temp.overwriteTargetFileWithTemporary();
+}
@@ -0,0 +1,36 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#ifndef SF2CACHE_H_INCLUDED
+#define SF2CACHE_H_INCLUDED
+
+#include "SFZCommon.h"
+
+namespace sfzero
+{
+
+class SF2Sound;
+
+// The presets and flattened regions SF2Reader::read() builds, saved so the
+// next load of the same bank can skip the hydra.  Files are keyed by
+// SF2Reader::hashHydra() and carry a format version; any mismatch just reads
+// as a miss.
+class SF2Cache
+{
+public:
+  static juce::File getCacheFile(const juce::File &directory, juce::uint64 hydraHash);
+
+  // Adds the cached presets to sound, which must have none yet.  Returns
+  // false, leaving sound untouched, if the file is missing, stale or damaged.
+  static bool read(SF2Sound &sound, const juce::File &cacheFile, juce::uint64 hydraHash);
+  static bool write(const SF2Sound &sound, const juce::File &cacheFile, juce::uint64 hydraHash);
+
+  // Bump whenever Region or the layout below changes.
+  static constexpr int formatVersion = 4;
+};
+}
+
+#endif // SF2CACHE_H_INCLUDED
@@ -15,6 +15,11 @@ sfzero::SF2Reader::SF2Reader(sfzero::SF2Sound *soundIn, const juce::File &fileIn
   file_ = fileIn.createInputStream().release();
 }
 
+sfzero::SF2Reader::SF2Reader(sfzero::SF2Sound *soundIn, const void *data, size_t dataSize) : sound_(soundIn)
+{
+  file_ = new juce::MemoryInputStream(data, dataSize, false);
+}
+
 sfzero::SF2Reader::~SF2Reader() { delete file_; }
 
 void sfzero::SF2Reader::read()
@@ -127,10 +132,8 @@ void sfzero::SF2Reader::read()
                     sound_->addUnsupportedOpcode("extreme gain in initialAttenuation");
                   }
 
-                  sfzero::Region *newRegion = new sfzero::Region();
-                  *newRegion = zoneRegion;
-                  newRegion->sample = sound_->sampleFor(shdr->sampleRate);
-                  preset->addRegion(newRegion);
+                  zoneRegion.sample = sound_->sampleFor(shdr->sampleRate);
+                  preset->addRegion(zoneRegion);
                   hadSampleID = true;
                 }
                 else
@@ -177,14 +180,51 @@ void sfzero::SF2Reader::read()
   }
 }
 
-juce::AudioSampleBuffer *sfzero::SF2Reader::readSamples(double *progressVar, juce::Thread *thread)
+juce::uint64 sfzero::SF2Reader::hashHydra()
 {
-  static const int bufferSize = 32768;
+  if (file_ == nullptr)
+  {
+    return 0;
+  }
+
+  file_->setPosition(0);
+  sfzero::RIFFChunk riffChunk;
+  riffChunk.readFrom(file_);
+  while (file_->getPosition() < riffChunk.end())
+  {
+    sfzero::RIFFChunk chunk;
+    chunk.readFrom(file_);
+    if (FourCCEquals(chunk.id, "pdta"))
+    {
+      juce::uint64 hash = 14695981039346656037ULL;
+      juce::HeapBlock<juce::uint8> buffer(65536);
+      juce::int64 bytesLeft = chunk.end() - file_->getPosition();
+      while (bytesLeft > 0)
+      {
+        int bytesRead = file_->read(buffer, static_cast<int>(juce::jmin<juce::int64>(65536, bytesLeft)));
+        if (bytesRead <= 0)
+        {
+          return 0;
+        }
+        for (int i = 0; i < bytesRead; ++i)
+        {
+          hash = (hash ^ buffer[i]) * 1099511628211ULL;
+        }
+        bytesLeft -= bytesRead;
+      }
+      return hash != 0 ? hash : 1;
+    }
+    chunk.seekAfter(file_);
+  }
+  return 0;
+}
 
+bool sfzero::SF2Reader::findSampleChunk(juce::int64 &dataStart, juce::int64 &numSamples)
+{
   if (file_ == nullptr)
   {
     sound_->addError("Couldn't open file.");
-    return nullptr;
+    return false;
   }
 
   // Find the "sdta" chunk.
@@ -218,11 +258,27 @@ juce::AudioSampleBuffer *sfzero::SF2Reader::readSamples(double *progressVar, juc
   if (!found)
   {
     sound_->addError("SF2 is missing its \"smpl\" chunk.");
+    return false;
+  }
+
+  dataStart = chunk.start;
+  numSamples = chunk.size / sizeof(short);
+  return true;
+}
+
+juce::AudioSampleBuffer *sfzero::SF2Reader::readSamples(double *progressVar, juce::Thread *thread)
+{
+  static const int bufferSize = 32768;
+
+  juce::int64 dataStart = 0, chunkSamples = 0;
+  if (!findSampleChunk(dataStart, chunkSamples))
+  {
     return nullptr;
   }
+  file_->setPosition(dataStart);
 
   // Allocate the AudioSampleBuffer.
-  int numSamples = int (chunk.size / sizeof(short));
+  int numSamples = static_cast<int>(chunkSamples);
   juce::AudioSampleBuffer *sampleBuffer = new juce::AudioSampleBuffer(1, numSamples);
 
   // Read and convert.
@@ -272,6 +328,34 @@ juce::AudioSampleBuffer *sfzero::SF2Reader::readSamples(double *progressVar, juc
   return sampleBuffer;
 }
 
+bool sfzero::SF2Reader::readSampleRange(float *out, juce::int64 dataStart, juce::int64 firstSample, int numSamples)
+{
+  juce::HeapBlock<short> buffer(numSamples);
+  if (!readPCMRange(buffer, dataStart, firstSample, numSamples))
+  {
+    return false;
+  }
+
+  // Same conversion (and little-endian assumption) as readSamples().
+  const short *in = buffer;
+  for (int i = 0; i < numSamples; ++i)
+  {
+    out[i] = in[i] / 32767.0f;
+  }
+  return true;
+}
+
+bool sfzero::SF2Reader::readPCMRange(juce::int16 *out, juce::int64 dataStart, juce::int64 firstSample, int numSamples)
+{
+  if (file_ == nullptr || !file_->setPosition(dataStart + firstSample * static_cast<juce::int64>(sizeof(short))))
+  {
+    return false;
+  }
+
+  int bytesToRead = numSamples * static_cast<int>(sizeof(short));
+  return file_->read(out, bytesToRead) == bytesToRead;
+}
+
 void sfzero::SF2Reader::addGeneratorToRegion(sfzero::word genOper, sfzero::SF2::genAmountType *amount, sfzero::Region *region)
 {
   switch (genOper)
@@ -381,34 +465,88 @@ void sfzero::SF2Reader::addGeneratorToRegion(sfzero::word genOper, sfzero::SF2::
     region->pitch_keycenter = amount->shortAmount;
     break;
 
-  case sfzero::SF2Generator::endOper:
-    // Ignore.
+  case sfzero::SF2Generator::initialFilterFc:
+    region->cutoff = amount->shortAmount;
+    break;
+
+  case sfzero::SF2Generator::initialFilterQ:
+    region->resonance = amount->shortAmount;
     break;
 
   case sfzero::SF2Generator::modLfoToPitch:
+    region->modlfo_to_pitch = amount->shortAmount;
+    break;
+
   case sfzero::SF2Generator::vibLfoToPitch:
+    region->viblfo_to_pitch = amount->shortAmount;
+    break;
+
   case sfzero::SF2Generator::modEnvToPitch:
-  case sfzero::SF2Generator::initialFilterFc:
-  case sfzero::SF2Generator::initialFilterQ:
+    region->modeg_to_pitch = amount->shortAmount;
+    break;
+
   case sfzero::SF2Generator::modLfoToFilterFc:
+    region->modlfo_to_cutoff = amount->shortAmount;
+    break;
+
   case sfzero::SF2Generator::modEnvToFilterFc:
+    region->modeg_to_cutoff = amount->shortAmount;
+    break;
+
   case sfzero::SF2Generator::modLfoToVolume:
-  case sfzero::SF2Generator::unused1:
-  case sfzero::SF2Generator::chorusEffectsSend:
-  case sfzero::SF2Generator::reverbEffectsSend:
-  case sfzero::SF2Generator::unused2:
-  case sfzero::SF2Generator::unused3:
-  case sfzero::SF2Generator::unused4:
+    region->modlfo_to_volume = amount->shortAmount;
+    break;
+
   case sfzero::SF2Generator::delayModLFO:
+    region->modlfo_delay = amount->shortAmount;
+    break;
+
   case sfzero::SF2Generator::freqModLFO:
+    region->modlfo_freq = amount->shortAmount;
+    break;
+
   case sfzero::SF2Generator::delayVibLFO:
+    region->viblfo_delay = amount->shortAmount;
+    break;
+
   case sfzero::SF2Generator::freqVibLFO:
+    region->viblfo_freq = amount->shortAmount;
+    break;
+
   case sfzero::SF2Generator::delayModEnv:
+    region->modeg.delay = amount->shortAmount;
+    break;
+
   case sfzero::SF2Generator::attackModEnv:
+    region->modeg.attack = amount->shortAmount;
+    break;
+
   case sfzero::SF2Generator::holdModEnv:
+    region->modeg.hold = amount->shortAmount;
+    break;
+
   case sfzero::SF2Generator::decayModEnv:
+    region->modeg.decay = amount->shortAmount;
+    break;
+
   case sfzero::SF2Generator::sustainModEnv:
+    region->modeg.sustain = amount->shortAmount;
+    break;
+
   case sfzero::SF2Generator::releaseModEnv:
+    region->modeg.release = amount->shortAmount;
+    break;
+
+  case sfzero::SF2Generator::endOper:
+    // Ignore.
+    break;
+
+  case sfzero::SF2Generator::unused1:
+  case sfzero::SF2Generator::chorusEffectsSend:
+  case sfzero::SF2Generator::reverbEffectsSend:
+  case sfzero::SF2Generator::unused2:
+  case sfzero::SF2Generator::unused3:
+  case sfzero::SF2Generator::unused4:
   case sfzero::SF2Generator::keynumToModEnvHold:
   case sfzero::SF2Generator::keynumToModEnvDecay:
   case sfzero::SF2Generator::keynumToVolEnvHold:
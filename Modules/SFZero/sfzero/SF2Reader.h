@@ -20,14 +20,27 @@ class SF2Reader
 {
 public:
   SF2Reader(SF2Sound *sound, const juce::File &file);
+  // Parses an SF2 image already in memory; the data must outlive the reader.
+  SF2Reader(SF2Sound *sound, const void *data, size_t dataSize);
   virtual ~SF2Reader();
 
   void read();
+  // FNV-1a hash of the "pdta" chunk, which holds everything read() builds
+  // regions from; 0 if there isn't one.
+  juce::uint64 hashHydra();
   juce::AudioSampleBuffer *readSamples(double *progressVar = nullptr, juce::Thread *thread = nullptr);
 
+  // Locates the "smpl" chunk, giving the file offset of its 16-bit PCM data and
+  // the number of samples in it.
+  bool findSampleChunk(juce::int64 &dataStart, juce::int64 &numSamples);
+  // Converts part of the "smpl" chunk found by findSampleChunk() to float.
+  bool readSampleRange(float *out, juce::int64 dataStart, juce::int64 firstSample, int numSamples);
+  // The same part, left as 16-bit PCM.
+  bool readPCMRange(juce::int16 *out, juce::int64 dataStart, juce::int64 firstSample, int numSamples);
+
 private:
   SF2Sound *sound_;
-  juce::FileInputStream *file_;
+  juce::InputStream *file_;
 
   void addGeneratorToRegion(word genOper, SF2::genAmountType *amount, Region *region);
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SF2Reader)
@@ -5,36 +5,39 @@
  * For license info please see the LICENSE file distributed with this source code
  *************************************************************************************/
 #include "SF2Sound.h"
+#include "SF2Cache.h"
 #include "SF2Reader.h"
 #include "SFZSample.h"
+#include "SFZSamplePool.h"
 
-sfzero::SF2Sound::SF2Sound(const juce::File &file) : sfzero::Sound(file), selectedPreset_(0) {}
+sfzero::SF2Sound::SF2Sound(const juce::File &file)
+    : sfzero::Sound(file), regionPool_(nullptr), numPooledRegions_(0), sampleDataStart_(0), numSampleFrames_(0),
+      numLoadedBlocks_(0), pager_(nullptr), data_(nullptr), dataSize_(0), selectedPreset_(0), memoryMapSamples_(false),
+      pagedSamples_(false), privateSamples_(false), sampleFormat_(sfzero::Sample::float32)
+{
+}
 
-sfzero::SF2Sound::~SF2Sound()
+sfzero::SF2Sound::SF2Sound(const void *data, size_t dataSize)
+    : sfzero::Sound(juce::File()), regionPool_(nullptr), numPooledRegions_(0), sampleDataStart_(0),
+      numSampleFrames_(0), numLoadedBlocks_(0), pager_(nullptr), data_(data), dataSize_(dataSize), selectedPreset_(0),
+      memoryMapSamples_(false), pagedSamples_(false), privateSamples_(false), sampleFormat_(sfzero::Sample::float32)
 {
-  // "presets" owns the regions, so clear them out of "regions" so ~SFZSound()
-  // doesn't try to delete them.
-  getRegions().clear();
+}
 
-  // The samples all share a single buffer, so make sure they don't all delete
-  // it.
-  juce::AudioSampleBuffer *buffer = nullptr;
-  
-  // First detach buffer from all samples
-  for (juce::HashMap<int, sfzero::Sample *>::Iterator i(samplesByRate_); i.next();)
-  {
-    buffer = i.getValue()->detachBuffer();
-  }
-  
-  // Delete the shared buffer
-  delete buffer;
-  
-  // Now delete all the samples
+sfzero::SF2Sound::~SF2Sound()
+{
+  // The samples all share the pool entry's buffer, which goes with the last
+  // reference to it, so none of them may delete it.
   for (juce::HashMap<int, sfzero::Sample *>::Iterator i(samplesByRate_); i.next();)
   {
+    i.getValue()->detachBuffer();
     delete i.getValue();
   }
   samplesByRate_.clear();
+  sharedSamples_ = nullptr;
+
+  // Only unmap once nothing can point into the mapping any more.
+  mappedSamples_.reset();
 }
 
 class PresetComparator
@@ -52,39 +55,530 @@ public:
   }
 };
 
+sfzero::SF2Reader *sfzero::SF2Sound::createReader()
+{
+  if (data_ != nullptr)
+  {
+    return new sfzero::SF2Reader(this, data_, dataSize_);
+  }
+  return new sfzero::SF2Reader(this, getFile());
+}
+
 void sfzero::SF2Sound::loadRegions()
 {
-  sfzero::SF2Reader reader(this, getFile());
+  std::unique_ptr<sfzero::SF2Reader> reader(createReader());
 
-  reader.read();
+  juce::uint64 hydraHash = 0;
+  juce::File cacheFile;
+  if (regionCacheDirectory_ != juce::File())
+  {
+    hydraHash = reader->hashHydra();
+    if (hydraHash != 0)
+    {
+      cacheFile = sfzero::SF2Cache::getCacheFile(regionCacheDirectory_, hydraHash);
+      if (sfzero::SF2Cache::read(*this, cacheFile, hydraHash))
+      {
+        buildRegionTables();
+        return;
+      }
+    }
+  }
+
+  reader->read();
 
   // Sort the presets.
   PresetComparator comparator;
   presets_.sort(comparator);
 
+  // Written from the pool, so after the tables are built.
+  buildRegionTables();
+  if (cacheFile != juce::File() && getErrors().isEmpty())
+  {
+    sfzero::SF2Cache::write(*this, cacheFile, hydraHash);
+  }
+}
+
+void sfzero::SF2Sound::buildRegionTables()
+{
+  // Give every preset a flat region table that voices can use directly.
+  poolRegions();
+  for (sfzero::SF2Sound::Preset *preset : presets_)
+  {
+    preset->regionIndex.build(preset->regionTable, getArena());
+  }
+
   useSubsound(0);
 }
 
+static juce::int64 hashRegion(const sfzero::Region &region)
+{
+  // Enough to tell most regions apart; operator== settles the rest.
+  juce::uint64 hash = 14695981039346656037ull;
+  auto mix = [&hash](juce::uint64 value) { hash = (hash ^ value) * 1099511628211ull; };
+  mix(static_cast<juce::uint64>(reinterpret_cast<juce::pointer_sized_uint>(region.sample)));
+  mix(static_cast<juce::uint64>(region.offset));
+  mix(static_cast<juce::uint64>(region.end));
+  mix(static_cast<juce::uint64>(region.loop_start));
+  mix(static_cast<juce::uint64>(region.lokey | (region.hikey << 8) | (region.lovel << 16) | (region.hivel << 24)));
+  mix(static_cast<juce::uint64>(region.tune + region.transpose * 100));
+  return static_cast<juce::int64>(hash);
+}
+
+void sfzero::SF2Sound::poolRegions()
+{
+  // First find the distinct regions: pooled lists each one the first time
+  // it's seen, and chains ones whose hashes collide.
+  struct Parsed
+  {
+    int preset, index;
+  };
+  juce::Array<Parsed> pooled;
+  juce::Array<int> sameHash;
+  juce::HashMap<juce::int64, int> firstWithHash;
+  juce::Array<juce::Array<int>> presetPoolIndices;
+  for (int p = 0; p < presets_.size(); ++p)
+  {
+    const juce::Array<sfzero::Region> &regions = presets_.getUnchecked(p)->parsedRegions;
+    juce::Array<int> indices;
+    indices.ensureStorageAllocated(regions.size());
+    for (int r = 0; r < regions.size(); ++r)
+    {
+      const sfzero::Region &region = regions.getReference(r);
+      juce::int64 hash = hashRegion(region);
+      int match = firstWithHash.contains(hash) ? firstWithHash[hash] : -1;
+      while (match >= 0)
+      {
+        const Parsed &candidate = pooled.getReference(match);
+        if (presets_.getUnchecked(candidate.preset)->parsedRegions.getReference(candidate.index) == region)
+        {
+          break;
+        }
+        match = sameHash[match];
+      }
+      if (match < 0)
+      {
+        match = pooled.size();
+        pooled.add({p, r});
+        sameHash.add(firstWithHash.contains(hash) ? firstWithHash[hash] : -1);
+        firstWithHash.set(hash, match);
+      }
+      indices.add(match);
+    }
+    presetPoolIndices.add(indices);
+  }
+
+  // Then copy them into the pool, in the arena, and point the tables at it.
+  numPooledRegions_ = pooled.size();
+  regionPool_ = getArena().allocate<sfzero::Region>(static_cast<size_t>(numPooledRegions_));
+  for (int i = 0; i < numPooledRegions_; ++i)
+  {
+    const Parsed &parsed = pooled.getReference(i);
+    regionPool_[i] = presets_.getUnchecked(parsed.preset)->parsedRegions.getReference(parsed.index);
+    regionPool_[i].precompute();
+  }
+  for (int p = 0; p < presets_.size(); ++p)
+  {
+    sfzero::SF2Sound::Preset *preset = presets_.getUnchecked(p);
+    const juce::Array<int> &indices = presetPoolIndices.getReference(p);
+    preset->regionTable.clearQuick();
+    preset->regionTable.ensureStorageAllocated(indices.size());
+    for (int index : indices)
+    {
+      preset->regionTable.add(regionPool_ + index);
+    }
+    preset->parsedRegions.clear();
+  }
+}
+
 void sfzero::SF2Sound::loadSamples(juce::AudioFormatManager * /*formatManager*/, double *progressVar, juce::Thread *thread)
 {
-  sfzero::SF2Reader reader(this, getFile());
-  juce::AudioSampleBuffer *buffer = reader.readSamples(progressVar, thread);
+  if (!privateSamples_ &&
+      (data_ != nullptr ? useInMemorySamples(progressVar) : (memoryMapSamples_ && mapSamples(progressVar))))
+  {
+    return;
+  }
+
+  if (sampleFormat_ != sfzero::Sample::float32)
+  {
+    loadEncodedSamples(progressVar, thread);
+    return;
+  }
+  loadSamplesProgressively(progressVar, thread);
+}
+
+static const int sampleBlockSize = 32768;
+
+// The bits of a Preset's note masks for the notes from low to high.
+static juce::uint64 noteMask(int lowNote, int highNote, int half)
+{
+  int first = juce::jmax(lowNote, half * 64);
+  int last = juce::jmin(highNote, half * 64 + 63);
+  if (first > last)
+  {
+    return 0;
+  }
+  juce::uint64 upTo = last - half * 64 == 63 ? ~juce::uint64(0) : (juce::uint64(1) << (last - half * 64 + 1)) - 1;
+  return upTo & ~((juce::uint64(1) << (first - half * 64)) - 1);
+}
+
+void sfzero::SF2Sound::loadSamplesProgressively(double *progressVar, juce::Thread *thread)
+{
+  std::unique_ptr<sfzero::SF2Reader> reader(createReader());
+  juce::int64 dataStart = 0, numSamples = 0;
+  if (!reader->findSampleChunk(dataStart, numSamples) || numSamples <= 0)
+  {
+    return;
+  }
 
-  if (buffer)
+  // Another sound loaded from the same file may have converted it already.
+  juce::String poolKey =
+      data_ == nullptr && !privateSamples_ ? sfzero::SamplePool::getKey(getFile()) : juce::String();
+  if (poolKey.isNotEmpty())
   {
-    // All the SFZSamples will share the buffer.
-    for (juce::HashMap<int, sfzero::Sample *>::Iterator i(samplesByRate_); i.next();)
+    sharedSamples_ = sfzero::SamplePool::find(poolKey);
+    if (sharedSamples_ != nullptr && sharedSamples_->buffer.getNumSamples() == numSamples)
     {
-      i.getValue()->setBuffer(buffer);
+      setSamplesBuffer(&sharedSamples_->buffer);
+      setAllPresetsReady();
+      if (progressVar)
+      {
+        *progressVar = 1.0;
+      }
+      return;
     }
   }
 
+  // All the SFZSamples share one buffer, which is filled a block at a time in
+  // preset order, requested presets first.  Each preset is marked ready once
+  // every block its regions touch has been converted.  A paged load leaves the
+  // buffer uncleared, so the OS only commits the blocks that are read.
+  sharedSamples_ = new sfzero::SamplePool::Entry(poolKey, 1, static_cast<int>(numSamples));
+  juce::AudioSampleBuffer *buffer = &sharedSamples_->buffer;
+  if (!pagedSamples_)
+  {
+    buffer->clear();
+  }
+  setSamplesBuffer(buffer);
+  sampleReader_ = std::move(reader);
+  sampleDataStart_ = dataStart;
+  numSampleFrames_ = numSamples;
+  loadedBlocks_.clear();
+  numLoadedBlocks_ = 0;
+
+  if (pagedSamples_)
+  {
+    pager_.store(thread);
+    loadRequestedSamples(thread);
+    if (progressVar)
+    {
+      *progressVar = 1.0;
+    }
+    return;
+  }
+
+  while (sfzero::SF2Sound::Preset *preset = nextPresetToLoad())
+  {
+    for (sfzero::Region *region : preset->regionTable)
+    {
+      if (!loadRegionSamples(*region, progressVar, thread))
+      {
+        return;
+      }
+    }
+    preset->ready.store(true, std::memory_order_release);
+  }
+
+  // Presets can leave parts of the chunk unread; fill those in before
+  // sharing it.
+  float *out = buffer->getWritePointer(0);
+  int numBlocks = static_cast<int>((numSamples + sampleBlockSize - 1) / sampleBlockSize);
+  for (int block = 0; block < numBlocks; ++block)
+  {
+    if (!loadedBlocks_[block])
+    {
+      juce::int64 blockStart = static_cast<juce::int64>(block) * sampleBlockSize;
+      int count = static_cast<int>(juce::jmin<juce::int64>(sampleBlockSize, numSamples - blockStart));
+      sampleReader_->readSampleRange(out + blockStart, dataStart, blockStart, count);
+      if (thread && thread->threadShouldExit())
+      {
+        return;
+      }
+    }
+  }
+  sampleReader_.reset();
+  if (poolKey.isNotEmpty())
+  {
+    sfzero::SamplePool::add(sharedSamples_.get());
+  }
+
   if (progressVar)
   {
     *progressVar = 1.0;
   }
 }
 
+void sfzero::SF2Sound::loadEncodedSamples(double *progressVar, juce::Thread *thread)
+{
+  std::unique_ptr<sfzero::SF2Reader> reader(createReader());
+  juce::int64 dataStart = 0, numSamples = 0;
+  if (!reader->findSampleChunk(dataStart, numSamples) || numSamples <= 0)
+  {
+    return;
+  }
+
+  // Pooled under a key of their own, so no sound finds samples in a format
+  // it didn't ask for.
+  bool compress = (sampleFormat_ == sfzero::Sample::compressed);
+  juce::String poolKey = data_ == nullptr && !privateSamples_
+                             ? sfzero::SamplePool::getKey(getFile()) + (compress ? ":compressed" : ":int16")
+                             : juce::String();
+  if (poolKey.isNotEmpty())
+  {
+    sharedSamples_ = sfzero::SamplePool::find(poolKey);
+    if (sharedSamples_ != nullptr &&
+        (compress ? sharedSamples_->compressed && sharedSamples_->compressed->getNumFrames() == numSamples
+                  : sharedSamples_->numPCMFrames == numSamples))
+    {
+      setSamplesData(*sharedSamples_);
+      setAllPresetsReady();
+      if (progressVar)
+      {
+        *progressVar = 1.0;
+      }
+      return;
+    }
+  }
+
+  // Read the PCM a block at a time; compressing then lets it go.
+  sfzero::SamplePool::Entry::Ptr entry = new sfzero::SamplePool::Entry(poolKey, 0, 0);
+  entry->pcm.malloc(static_cast<size_t>(numSamples));
+  int numBlocks = static_cast<int>((numSamples + sampleBlockSize - 1) / sampleBlockSize);
+  for (int block = 0; block < numBlocks; ++block)
+  {
+    juce::int64 blockStart = static_cast<juce::int64>(block) * sampleBlockSize;
+    int count = static_cast<int>(juce::jmin<juce::int64>(sampleBlockSize, numSamples - blockStart));
+    if (!reader->readPCMRange(entry->pcm + blockStart, dataStart, blockStart, count))
+    {
+      return;
+    }
+    if (progressVar)
+    {
+      *progressVar = static_cast<double>(block + 1) / numBlocks;
+    }
+    if (thread && thread->threadShouldExit())
+    {
+      return;
+    }
+  }
+  if (compress)
+  {
+    entry->compressed.reset(new sfzero::CompressedPCM(entry->pcm, numSamples));
+    entry->pcm.free();
+  }
+  else
+  {
+    entry->numPCMFrames = numSamples;
+  }
+
+  sharedSamples_ = entry;
+  setSamplesData(*sharedSamples_);
+  setAllPresetsReady();
+  if (poolKey.isNotEmpty())
+  {
+    sfzero::SamplePool::add(sharedSamples_.get());
+  }
+}
+
+void sfzero::SF2Sound::setSamplesData(const sfzero::SamplePool::Entry &entry)
+{
+  for (juce::HashMap<int, sfzero::Sample *>::Iterator i(samplesByRate_); i.next();)
+  {
+    if (entry.compressed)
+    {
+      i.getValue()->setCompressedData(entry.compressed.get());
+    }
+    else
+    {
+      i.getValue()->setPCMData(entry.pcm, static_cast<juce::uint64>(entry.numPCMFrames));
+    }
+  }
+}
+
+bool sfzero::SF2Sound::loadRegionSamples(const sfzero::Region &region, double *progressVar, juce::Thread *thread)
+{
+  float *out = sharedSamples_->buffer.getWritePointer(0);
+  int numBlocks = static_cast<int>((numSampleFrames_ + sampleBlockSize - 1) / sampleBlockSize);
+  juce::int64 first = juce::jlimit<juce::int64>(0, numSampleFrames_ - 1, region.offset);
+  juce::int64 last = juce::jlimit<juce::int64>(0, numSampleFrames_ - 1, juce::jmax(region.end, region.loop_end) + 1);
+  for (int block = static_cast<int>(first / sampleBlockSize); block <= static_cast<int>(last / sampleBlockSize); ++block)
+  {
+    if (loadedBlocks_[block])
+    {
+      continue;
+    }
+
+    juce::int64 blockStart = static_cast<juce::int64>(block) * sampleBlockSize;
+    int count = static_cast<int>(juce::jmin<juce::int64>(sampleBlockSize, numSampleFrames_ - blockStart));
+    sampleReader_->readSampleRange(out + blockStart, sampleDataStart_, blockStart, count);
+    loadedBlocks_.setBit(block);
+    ++numLoadedBlocks_;
+
+    if (progressVar)
+    {
+      *progressVar = static_cast<double>(numLoadedBlocks_) / numBlocks;
+    }
+    if (thread && thread->threadShouldExit())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool sfzero::SF2Sound::loadRequestedSamples(juce::Thread *thread)
+{
+  if (!pagedSamples_ || sampleReader_ == nullptr)
+  {
+    return false;
+  }
+
+  bool loadedAny = false;
+  for (sfzero::SF2Sound::Preset *preset : presets_)
+  {
+    juce::uint64 wanted[2];
+    for (int half = 0; half < 2; ++half)
+    {
+      wanted[half] = preset->requestedNotes[half].load(std::memory_order_relaxed) &
+                     ~preset->loadedNotes[half].load(std::memory_order_relaxed);
+    }
+    if (wanted[0] == 0 && wanted[1] == 0)
+    {
+      continue;
+    }
+
+    // Every region a wanted note can play, whatever its velocity.
+    for (sfzero::Region *region : preset->regionTable)
+    {
+      if ((noteMask(region->lokey, region->hikey, 0) & wanted[0]) == 0 &&
+          (noteMask(region->lokey, region->hikey, 1) & wanted[1]) == 0)
+      {
+        continue;
+      }
+      if (!loadRegionSamples(*region, nullptr, thread))
+      {
+        return loadedAny;
+      }
+    }
+
+    juce::uint64 loaded[2];
+    for (int half = 0; half < 2; ++half)
+    {
+      loaded[half] = preset->loadedNotes[half].fetch_or(wanted[half], std::memory_order_release) | wanted[half];
+    }
+    if (loaded[0] == ~juce::uint64(0) && loaded[1] == ~juce::uint64(0))
+    {
+      preset->ready.store(true, std::memory_order_release);
+    }
+    loadedAny = true;
+  }
+  return loadedAny;
+}
+
+sfzero::SF2Sound::Preset *sfzero::SF2Sound::nextPresetToLoad()
+{
+  for (sfzero::SF2Sound::Preset *preset : presets_)
+  {
+    if (preset->requested.load(std::memory_order_relaxed) && !preset->ready.load(std::memory_order_relaxed))
+    {
+      return preset;
+    }
+  }
+  for (sfzero::SF2Sound::Preset *preset : presets_)
+  {
+    if (!preset->ready.load(std::memory_order_relaxed))
+    {
+      return preset;
+    }
+  }
+  return nullptr;
+}
+
+void sfzero::SF2Sound::setAllPresetsReady()
+{
+  for (sfzero::SF2Sound::Preset *preset : presets_)
+  {
+    preset->ready.store(true, std::memory_order_release);
+  }
+}
+
+bool sfzero::SF2Sound::mapSamples(double *progressVar)
+{
+  juce::int64 dataStart = 0, numSamples = 0;
+  {
+    sfzero::SF2Reader reader(this, getFile());
+    if (!reader.findSampleChunk(dataStart, numSamples))
+    {
+      return false;
+    }
+  }
+
+  juce::Range<juce::int64> range(dataStart, dataStart + numSamples * static_cast<juce::int64>(sizeof(juce::int16)));
+  std::unique_ptr<juce::MemoryMappedFile> mapped(new juce::MemoryMappedFile(getFile(), range, juce::MemoryMappedFile::readOnly));
+  if (mapped->getData() == nullptr)
+  {
+    // Fall back to reading the samples into memory.
+    return false;
+  }
+
+  // The mapping is page-aligned, so it may start before the chunk does.  As in
+  // SF2Reader::readSamples(), this assumes a little-endian host.
+  const char *base = static_cast<const char *>(mapped->getData());
+  const juce::int16 *pcm = reinterpret_cast<const juce::int16 *>(base + (dataStart - mapped->getRange().getStart()));
+  for (juce::HashMap<int, sfzero::Sample *>::Iterator i(samplesByRate_); i.next();)
+  {
+    i.getValue()->setPCMData(pcm, static_cast<juce::uint64>(numSamples));
+  }
+  mappedSamples_ = std::move(mapped);
+  setAllPresetsReady();
+
+  if (progressVar)
+  {
+    *progressVar = 1.0;
+  }
+  return true;
+}
+
+bool sfzero::SF2Sound::useInMemorySamples(double *progressVar)
+{
+  juce::int64 dataStart = 0, numSamples = 0;
+  {
+    std::unique_ptr<sfzero::SF2Reader> reader(createReader());
+    if (!reader->findSampleChunk(dataStart, numSamples))
+    {
+      return false;
+    }
+  }
+
+  // Point the samples straight at the image.  The PCM needs 16-bit alignment to
+  // be read in place; otherwise fall back to converting a copy.
+  const char *pcm = static_cast<const char *>(data_) + dataStart;
+  if ((reinterpret_cast<juce::pointer_sized_uint>(pcm) % alignof(juce::int16)) != 0)
+  {
+    return false;
+  }
+  for (juce::HashMap<int, sfzero::Sample *>::Iterator i(samplesByRate_); i.next();)
+  {
+    i.getValue()->setPCMData(reinterpret_cast<const juce::int16 *>(pcm), static_cast<juce::uint64>(numSamples));
+  }
+  setAllPresetsReady();
+
+  if (progressVar)
+  {
+    *progressVar = 1.0;
+  }
+  return true;
+}
+
 void sfzero::SF2Sound::addPreset(sfzero::SF2Sound::Preset *preset) { presets_.add(preset); }
 
 int sfzero::SF2Sound::numSubsounds() { return presets_.size(); }
@@ -109,11 +603,92 @@ void sfzero::SF2Sound::useSubsound(int whichSubsound)
 {
   selectedPreset_ = whichSubsound;
   getRegions().clear();
-  getRegions().addArray(presets_[whichSubsound]->regions);
+  getRegions().addArray(presets_[whichSubsound]->regionTable);
 }
 
 int sfzero::SF2Sound::selectedSubsound() { return selectedPreset_; }
 
+const juce::Array<sfzero::Region *> &sfzero::SF2Sound::getRegionsForSubsound(int whichSubsound)
+{
+  static const juce::Array<sfzero::Region *> noRegions;
+
+  Preset *preset = presets_[whichSubsound];
+  return preset ? preset->regionTable : noRegions;
+}
+
+const sfzero::RegionIndex &sfzero::SF2Sound::getRegionIndex(int whichSubsound)
+{
+  static const sfzero::RegionIndex noIndex;
+
+  Preset *preset = presets_[whichSubsound];
+  return preset ? preset->regionIndex : noIndex;
+}
+
+bool sfzero::SF2Sound::isSubsoundReady(int whichSubsound)
+{
+  Preset *preset = presets_[whichSubsound];
+  return preset && preset->ready.load(std::memory_order_acquire);
+}
+
+bool sfzero::SF2Sound::isNoteReady(int whichSubsound, int note)
+{
+  Preset *preset = presets_[whichSubsound];
+  if (preset == nullptr || !juce::isPositiveAndBelow(note, 128))
+  {
+    return false;
+  }
+  return preset->ready.load(std::memory_order_acquire) ||
+         (preset->loadedNotes[note / 64].load(std::memory_order_acquire) & (juce::uint64(1) << (note % 64))) != 0;
+}
+
+void sfzero::SF2Sound::requestNotes(int whichSubsound, int lowNote, int highNote)
+{
+  Preset *preset = presets_[whichSubsound];
+  if (preset == nullptr || lowNote > highNote)
+  {
+    return;
+  }
+  preset->requested.store(true, std::memory_order_relaxed);
+
+  bool added = false;
+  for (int half = 0; half < 2; ++half)
+  {
+    juce::uint64 mask = noteMask(juce::jmax(0, lowNote), juce::jmin(127, highNote), half);
+    if ((mask & ~preset->requestedNotes[half].fetch_or(mask, std::memory_order_relaxed)) != 0)
+    {
+      added = true;
+    }
+  }
+  if (added)
+  {
+    if (juce::Thread *pager = pager_.load())
+    {
+      pager->notify();
+    }
+  }
+}
+
+void sfzero::SF2Sound::prioritizeSubsound(int whichSubsound) { requestNotes(whichSubsound, 0, 127); }
+
+bool sfzero::SF2Sound::convertSamples(double sampleRate, juce::Thread *thread)
+{
+  // Each rate's sample converts the whole shared pool, since regions address
+  // it by offset; those already at sampleRate cost nothing.  A paged buffer
+  // is still being read into, so a copy of it would miss what comes later.
+  if (pagedSamples_ && sampleReader_ != nullptr)
+  {
+    return false;
+  }
+  for (juce::HashMap<int, sfzero::Sample *>::Iterator i(samplesByRate_); i.next();)
+  {
+    if (!i.getValue()->convertTo(sampleRate, thread))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
 sfzero::Sample *sfzero::SF2Sound::sampleFor(double sampleRate)
 {
   sfzero::Sample *sample = samplesByRate_[static_cast<int>(sampleRate)];
@@ -7,45 +7,150 @@
 #ifndef SF2SOUND_H_INCLUDED
 #define SF2SOUND_H_INCLUDED
 
+#include "SFZSample.h"
+#include "SFZSamplePool.h"
 #include "SFZSound.h"
 
 namespace sfzero
 {
 
+class SF2Reader;
+
 class SF2Sound : public Sound
 {
 public:
   explicit SF2Sound(const juce::File &file);
+  // Uses an SF2 image in memory (e.g. BinaryData) in place, without copying it;
+  // the data must stay valid for the lifetime of the sound.
+  SF2Sound(const void *data, size_t dataSize);
   virtual ~SF2Sound() override;
 
   void loadRegions() override;
   void loadSamples(juce::AudioFormatManager *formatManager, double *progressVar = nullptr, juce::Thread *thread = nullptr) override;
+  bool convertSamples(double sampleRate, juce::Thread *thread = nullptr) override;
 
   struct Preset
   {
     juce::String name;
     int bank;
     int preset;
-    juce::OwnedArray<Region> regions;
+    juce::Array<Region> parsedRegions; // As read, until loadRegions() pools them.
+    juce::Array<Region *> regionTable; // Into the sound's region pool, filled by loadRegions().
+    RegionIndex regionIndex;           // Over regionTable, also built by loadRegions().
+    std::atomic<bool> ready{false};     // Set once the samples the regions use are loaded.
+    std::atomic<bool> requested{false}; // Load ahead of the other presets.
+    // Paged loads only: bit n set for each note asked for, and for each
+    // whose regions' samples are in.
+    std::atomic<juce::uint64> requestedNotes[2] = {{0}, {0}};
+    std::atomic<juce::uint64> loadedNotes[2] = {{0}, {0}};
 
     Preset(juce::String nameIn, int bankIn, int presetIn) : name(nameIn), bank(bankIn), preset(presetIn) {}
     ~Preset() {}
-    void addRegion(Region *region) { regions.add(region); }
+    void addRegion(const Region &region) { parsedRegions.add(region); }
   };
   void addPreset(Preset *preset);
+  const juce::OwnedArray<Preset> &getPresets() const { return presets_; }
+
+  // Every distinct region the presets use, in one allocation.  GM banks play
+  // the same instrument from many presets, so most repeat; each is pooled
+  // once and the presets' tables share it.
+  const Region *getRegionPool() const { return regionPool_; }
+  int getNumPooledRegions() const { return numPooledRegions_; }
 
   int numSubsounds() override;
   juce::String subsoundName(int whichSubsound) override;
   void useSubsound(int whichSubsound) override;
   int selectedSubsound() override;
+  const juce::Array<Region *> &getRegionsForSubsound(int whichSubsound) override;
+  const RegionIndex &getRegionIndex(int whichSubsound) override;
+  bool isSubsoundReady(int whichSubsound) override;
+  bool isNoteReady(int whichSubsound, int note) override;
+  void requestNotes(int whichSubsound, int lowNote, int highNote) override;
+
+  // Asks a loadSamples() running on another thread to load this preset next.
+  // Lock-free, so it's safe to call from the audio thread.
+  void prioritizeSubsound(int whichSubsound);
 
   Sample *sampleFor(double sampleRate);
   void setSamplesBuffer(juce::AudioSampleBuffer *buffer);
 
+  // When set before loadSamples(), the "smpl" chunk is memory-mapped and voices
+  // read its 16-bit PCM directly instead of a float copy of the whole bank.
+  void setMemoryMapSamples(bool shouldMap) { memoryMapSamples_ = shouldMap; }
+  bool getMemoryMapSamples() const { return memoryMapSamples_; }
+
+  // When set before loadSamples(), only the samples of the notes requested
+  // through requestNotes() are read, so memory and load time go with what's
+  // played rather than the size of the bank.  loadSamples() reads what's been
+  // requested so far and returns; its thread is notified of later requests
+  // and should then call loadRequestedSamples().  Pages of the buffer that
+  // are never read into stay uncommitted.  A paged sound uses a complete
+  // copy from the SamplePool if there is one, but doesn't add its own, and
+  // can't be converted with convertSamples().
+  void setPagedSamples(bool shouldPage) { pagedSamples_ = shouldPage; }
+  bool getPagedSamples() const { return pagedSamples_; }
+
+  // When set before loadSamples(), the sound converts a copy of its own (in
+  // the format setSampleFormat() asks for) even if it could map the chunk,
+  // read it in place or share a SamplePool copy, and doesn't add that copy
+  // to the pool.  The OS commits the copy's pages as the loading thread
+  // first writes them, so loading on a thread bound to one NUMA node puts it
+  // in that node's memory.
+  void setPrivateSamples(bool shouldCopy) { privateSamples_ = shouldCopy; }
+  bool getPrivateSamples() const { return privateSamples_; }
+
+  // When set before loadSamples(), a copy of the chunk is held as 16-bit PCM
+  // (half the size of float) or CompressedPCM (roughly half that again)
+  // rather than converted to float.  Voices read either through their own
+  // fetch routine.  Mapped and in-place banks are already 16-bit and cost no
+  // heap, so they're left as they are.  An encoded copy is read whole before
+  // any preset is ready, and ignores setPagedSamples().
+  void setSampleFormat(Sample::Format format) { sampleFormat_ = format; }
+  Sample::Format getSampleFormat() const { return sampleFormat_; }
+
+  // Reads the samples of notes requested since the last call.  Returns
+  // whether there were any.
+  bool loadRequestedSamples(juce::Thread *thread = nullptr);
+
+  // When set before loadRegions(), the parsed presets are cached in this
+  // directory and later loads of the same bank read them from there.
+  void setRegionCacheDirectory(const juce::File &directory) { regionCacheDirectory_ = directory; }
+
 private:
+  SF2Reader *createReader();
+  bool mapSamples(double *progressVar);
+  bool useInMemorySamples(double *progressVar);
+  void loadSamplesProgressively(double *progressVar, juce::Thread *thread);
+  void loadEncodedSamples(double *progressVar, juce::Thread *thread);
+  void setSamplesData(const SamplePool::Entry &entry);
+  bool loadRegionSamples(const Region &region, double *progressVar, juce::Thread *thread);
+  Preset *nextPresetToLoad();
+  void setAllPresetsReady();
+  void buildRegionTables();
+  void poolRegions();
+
   juce::OwnedArray<Preset> presets_;
+  Region *regionPool_; // In the arena, like the presets' indexes.
+  int numPooledRegions_;
   juce::HashMap<int, Sample *> samplesByRate_;
+  std::unique_ptr<juce::MemoryMappedFile> mappedSamples_;
+  SamplePool::Entry::Ptr sharedSamples_; // The converted samples, when they're loaded into memory.
+  // While loading into sharedSamples_: the reader (kept open between pages),
+  // where the chunk is, and which of its blocks are in so far.
+  std::unique_ptr<SF2Reader> sampleReader_;
+  juce::int64 sampleDataStart_;
+  juce::int64 numSampleFrames_;
+  juce::BigInteger loadedBlocks_;
+  int numLoadedBlocks_;
+  std::atomic<juce::Thread *> pager_; // Notified of requests while paging.
+  juce::File regionCacheDirectory_;
+  const void *data_;
+  size_t dataSize_;
   int selectedPreset_;
+  bool memoryMapSamples_;
+  bool pagedSamples_;
+  bool privateSamples_;
+  Sample::Format sampleFormat_;
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SF2Sound)
 };
 }
@@ -0,0 +1,36 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#include "SFZArena.h"
+
+sfzero::Arena::Arena(size_t blockSize) : blockSize_(blockSize), bytesAllocated_(0) {}
+
+void *sfzero::Arena::allocateBytes(size_t numBytes, size_t alignment)
+{
+  Block *block = blocks_.getLast();
+  size_t start = 0;
+  if (block != nullptr)
+  {
+    juce::pointer_sized_uint address = reinterpret_cast<juce::pointer_sized_uint>(block->data.get()) + block->used;
+    start = block->used + (alignment - address % alignment) % alignment;
+  }
+
+  if (block == nullptr || start + numBytes > block->size)
+  {
+    // Ones bigger than a block get a block of their own.  Heap blocks are
+    // aligned for any type, so these start at 0.
+    block = new Block;
+    block->size = juce::jmax(blockSize_, numBytes);
+    block->used = 0;
+    block->data.malloc(block->size);
+    blocks_.add(block);
+    start = 0;
+  }
+
+  block->used = start + numBytes;
+  bytesAllocated_ += numBytes;
+  return block->data.get() + start;
+}
@@ -0,0 +1,62 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#ifndef SFZARENA_H_INCLUDED
+#define SFZARENA_H_INCLUDED
+
+#include "SFZCommon.h"
+
+#include <type_traits>
+
+namespace sfzero
+{
+
+// A monotonic allocator for what a sound builds as it loads and keeps until
+// it goes: its regions and their indexes.  Allocations are carved out of
+// large blocks and never freed one at a time; the blocks all go together
+// when the arena does, so destructors never run and only trivially
+// destructible types may live here.  Not thread-safe; sounds only allocate
+// while they load.
+class Arena
+{
+public:
+  explicit Arena(size_t blockSize = 64 * 1024);
+
+  // count default-constructed Ts, or nullptr if count is 0.
+  template <typename T> T *allocate(size_t count)
+  {
+    static_assert(std::is_trivially_destructible<T>::value, "the arena never runs destructors");
+    if (count == 0)
+    {
+      return nullptr;
+    }
+    T *items = static_cast<T *>(allocateBytes(sizeof(T) * count, alignof(T)));
+    for (size_t i = 0; i < count; ++i)
+    {
+      new (items + i) T();
+    }
+    return items;
+  }
+
+  size_t getBytesAllocated() const { return bytesAllocated_; }
+
+private:
+  void *allocateBytes(size_t numBytes, size_t alignment);
+
+  struct Block
+  {
+    juce::HeapBlock<char> data;
+    size_t size, used;
+  };
+  juce::OwnedArray<Block> blocks_;
+  size_t blockSize_;
+  size_t bytesAllocated_;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Arena)
+};
+}
+
+#endif // SFZARENA_H_INCLUDED
@@ -82,6 +82,55 @@ void sfzero::EG::fastRelease()
   segmentIsExponential_ = false;
 }
 
+int sfzero::EG::render(float *gains, int numSamples)
+{
+  int numWritten = 0;
+  float level = level_;
+
+  while (numWritten < numSamples && segment_ != Done)
+  {
+    // Frames left in this segment, including the one on which it ends.
+    int remaining = numSamples - numWritten;
+    int segmentFrames = (samplesUntilNextSegment_ >= remaining) ? remaining : juce::jmax(1, samplesUntilNextSegment_ + 1);
+    float *dest = gains + numWritten;
+    if (segmentIsExponential_)
+    {
+      for (int i = 0; i < segmentFrames; ++i)
+      {
+        dest[i] = level;
+        level *= slope_;
+      }
+      if (level < BottomLevel)
+      {
+        // The rest of the tail is inaudible, and left to run on it would
+        // sink into subnormals, so the segment ends here.
+        level = 0.0f;
+        samplesUntilNextSegment_ = segmentFrames - 1;
+      }
+    }
+    else
+    {
+      for (int i = 0; i < segmentFrames; ++i)
+      {
+        dest[i] = level;
+        level += slope_;
+      }
+    }
+    numWritten += segmentFrames;
+    samplesUntilNextSegment_ -= segmentFrames;
+
+    if (samplesUntilNextSegment_ < 0)
+    {
+      level_ = level;
+      nextSegment();
+      level = level_;
+    }
+  }
+
+  level_ = level;
+  return numWritten;
+}
+
 void sfzero::EG::startDelay()
 {
   if (parameters_.delay <= 0)
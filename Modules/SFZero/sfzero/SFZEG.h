@@ -22,8 +22,16 @@ public:
   void nextSegment();
   void noteOff();
   void fastRelease();
+
+  // Writes the gain for each of the next numSamples frames into gains,
+  // stepping through segment changes exactly as per-sample updates would.
+  // Returns the number of frames written, which is less than numSamples
+  // only if the envelope finished (isDone()) part way through.
+  int render(float *gains, int numSamples);
   bool isDone() { return (segment_ == Done); }
   bool isReleasing() { return (segment_ == Release); }
+  // After the attack and hold the level never rises again.
+  bool isPastPeak() const { return (segment_ == Decay) || (segment_ == Sustain) || (segment_ == Release); }
   int segmentIndex() { return static_cast<int>(segment_); }
   float getLevel() const { return level_; }
   void setLevel(float v) { level_ = v; }
@@ -61,7 +69,7 @@ private:
   float slope_;
   int samplesUntilNextSegment_;
   bool segmentIsExponential_;
-  static const float BottomLevel;
+  static const float BottomLevel; // where exponential segments end, at -60dB
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(EG)
 };
 }
@@ -0,0 +1,105 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#include "SFZHitCache.h"
+
+sfzero::HitCache::HitCache() : poolSize_(0), poolUsed_(0), numHits_(0)
+{
+  hits_.calloc(static_cast<size_t>(maxHits));
+  slots_.calloc(static_cast<size_t>(numSlots));
+}
+
+void sfzero::HitCache::setSize(int numFrames)
+{
+  poolSize_ = juce::jmax(0, numFrames);
+  pool_.free();
+  if (poolSize_ > 0)
+  {
+    pool_.malloc(static_cast<size_t>(poolSize_));
+  }
+  clear();
+}
+
+void sfzero::HitCache::clear()
+{
+  poolUsed_ = 0;
+  numHits_ = 0;
+  slots_.clear(static_cast<size_t>(numSlots));
+}
+
+juce::uint32 sfzero::HitCache::hashOf(const Region *region, double pitchRatio)
+{
+  juce::uint64 bits;
+  std::memcpy(&bits, &pitchRatio, sizeof(bits));
+  juce::uint64 hash = static_cast<juce::uint64>(reinterpret_cast<juce::pointer_sized_uint>(region)) * 0x9e3779b97f4a7c15ULL;
+  hash ^= bits + 0x7f4a7c159e3779b9ULL + (hash << 6) + (hash >> 2);
+  return static_cast<juce::uint32>(hash ^ (hash >> 32));
+}
+
+sfzero::HitCache::Hit *sfzero::HitCache::find(const Region *region, const void *source, double pitchRatio,
+                                              int interpolation)
+{
+  if (numHits_ == 0)
+  {
+    return nullptr;
+  }
+  for (juce::uint32 slot = hashOf(region, pitchRatio) & (numSlots - 1);; slot = (slot + 1) & (numSlots - 1))
+  {
+    int index = slots_[slot];
+    if (index == 0)
+    {
+      return nullptr;
+    }
+    Hit &hit = hits_[index - 1];
+    if ((hit.region == region) && (hit.source == source) && (hit.pitchRatio == pitchRatio) &&
+        (hit.interpolation == interpolation))
+    {
+      return &hit;
+    }
+  }
+}
+
+sfzero::HitCache::Hit *sfzero::HitCache::startRecording(const Region *region, const void *source, double pitchRatio,
+                                                        int interpolation, int numChannels, int maxFrames)
+{
+  numChannels = juce::jlimit(1, 2, numChannels);
+  // A single hit may take at most a sixteenth of the pool.
+  if ((numHits_ >= maxHits) || (maxFrames <= 0) || (maxFrames > poolSize_ / 16) ||
+      (static_cast<juce::int64>(maxFrames) * numChannels > poolSize_ - poolUsed_))
+  {
+    return nullptr;
+  }
+
+  Hit &hit = hits_[numHits_++];
+  hit.region = region;
+  hit.source = source;
+  hit.pitchRatio = pitchRatio;
+  hit.interpolation = interpolation;
+  hit.numChannels = numChannels;
+  hit.capacity = maxFrames;
+  hit.numFrames = 0;
+  hit.recording = true;
+  hit.complete = false;
+  for (int channel = 0; channel < 2; ++channel)
+  {
+    hit.frames[channel] = pool_.get() + poolUsed_ + juce::jmin(channel, numChannels - 1) * maxFrames;
+  }
+  poolUsed_ += maxFrames * numChannels;
+
+  juce::uint32 slot = hashOf(region, pitchRatio) & (numSlots - 1);
+  while (slots_[slot] != 0)
+  {
+    slot = (slot + 1) & (numSlots - 1);
+  }
+  slots_[slot] = numHits_;
+  return &hit;
+}
+
+void sfzero::HitCache::finishRecording(Hit *hit, int numFrames)
+{
+  hit->numFrames = juce::jlimit(0, hit->capacity, numFrames);
+  hit->recording = false;
+}
@@ -0,0 +1,82 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#ifndef SFZHITCACHE_H_INCLUDED
+#define SFZHITCACHE_H_INCLUDED
+
+#include "SFZCommon.h"
+
+namespace sfzero
+{
+
+struct Region;
+
+// Interpolated frames of unlooped notes, e.g. drum hits, kept so the next
+// note of the same region at the same pitch reads them instead of
+// resampling again.  The first such note records its frames as it plays;
+// later ones only apply their envelope and gains, so note-offs, chokes and
+// velocity-tracked envelopes behave exactly as before.
+//
+// Frames come from one block allocated up front and are never freed one at a
+// time: once it's full, nothing new is cached until clear().  Hits are looked
+// up and started on the audio thread only; a recording voice may finish its
+// hit from a render worker, but only touches that hit.
+class HitCache
+{
+public:
+  struct Hit
+  {
+    const Region *region;
+    const void *source; // Sample::Conversion the frames came from, if any
+    double pitchRatio;
+    int interpolation;
+
+    float *frames[2];
+    int numChannels;
+    int capacity;
+    int numFrames;
+    bool recording;
+    bool complete; // numFrames reaches the end of the sample
+  };
+
+  HitCache();
+
+  // Not on the audio thread, and with no voice playing a hit.  Zero turns
+  // the cache off.
+  void setSize(int numFrames);
+  int getSize() const { return poolSize_; }
+  bool isEnabled() const { return poolSize_ > 0; }
+  // Forgets every hit; the same conditions as setSize().
+  void clear();
+
+  // A recorded or still-recording hit matching the note, or nullptr.
+  Hit *find(const Region *region, const void *source, double pitchRatio, int interpolation);
+  // Room for a new hit of up to maxFrames frames, or nullptr if it doesn't
+  // fit.  The caller writes its frames and then calls finishRecording().
+  Hit *startRecording(const Region *region, const void *source, double pitchRatio, int interpolation,
+                      int numChannels, int maxFrames);
+  static void finishRecording(Hit *hit, int numFrames);
+
+  int getNumHits() const { return numHits_; }
+  int getNumFramesUsed() const { return poolUsed_; }
+
+private:
+  static constexpr int maxHits = 1024;
+  static constexpr int numSlots = 2 * maxHits; // open addressing, power of two
+
+  static juce::uint32 hashOf(const Region *region, double pitchRatio);
+
+  juce::HeapBlock<float> pool_;
+  int poolSize_, poolUsed_;
+  juce::HeapBlock<Hit> hits_;
+  int numHits_;
+  juce::HeapBlock<int> slots_; // hit index + 1, or 0 for empty
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(HitCache)
+};
+}
+
+#endif // SFZHITCACHE_H_INCLUDED
@@ -0,0 +1,144 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#include "SFZPerformance.h"
+
+sfzero::PerformanceCounters::PerformanceCounters() : sampleRate_(44100.0), resetRequested_(false), blockEvents_(0)
+{
+  clear();
+}
+
+void sfzero::PerformanceCounters::clear()
+{
+  store<juce::int64>(numCallbacks_, 0);
+  store<juce::int64>(totalTicks_, 0);
+  store<juce::int64>(totalSamples_, 0);
+  store<juce::int64>(worstTicks_, 0);
+  store<juce::int64>(lastTicks_, 0);
+  store(lastNumSamples_, 0);
+  store(worstLoad_, 0.0f);
+  store(lastLoad_, 0.0f);
+  for (std::atomic<juce::uint32> &bucket : loadHistogram_)
+  {
+    store<juce::uint32>(bucket, 0);
+  }
+  for (std::atomic<int> &count : voicesPerChannel_)
+  {
+    store(count, 0);
+  }
+  store(peakVoices_, 0);
+  store<juce::int64>(voicesStolen_, 0);
+  store<juce::int64>(voicesShed_, 0);
+  store<juce::int64>(notesDropped_, 0);
+  store(voiceLimit_, 0);
+  store(eventsLastBlock_, 0);
+  store(maxEventsPerBlock_, 0);
+  store<juce::int64>(totalEvents_, 0);
+}
+
+void sfzero::PerformanceCounters::addCallback(juce::int64 elapsedTicks, int numSamples)
+{
+  if (resetRequested_.exchange(false, std::memory_order_relaxed))
+  {
+    clear();
+  }
+
+  double bufferTicks =
+      numSamples / sampleRate_.load(std::memory_order_relaxed) * juce::Time::getHighResolutionTicksPerSecond();
+  float load = bufferTicks > 0.0 ? static_cast<float>(elapsedTicks / bufferTicks) : 0.0f;
+  int bucket = juce::jlimit(0, numLoadBuckets - 1, static_cast<int>(load * 100.0f));
+
+  store(numCallbacks_, numCallbacks_.load(std::memory_order_relaxed) + 1);
+  store(totalTicks_, totalTicks_.load(std::memory_order_relaxed) + elapsedTicks);
+  store(totalSamples_, totalSamples_.load(std::memory_order_relaxed) + numSamples);
+  store(lastTicks_, elapsedTicks);
+  store(lastNumSamples_, numSamples);
+  store(worstTicks_, juce::jmax(worstTicks_.load(std::memory_order_relaxed), elapsedTicks));
+  store(worstLoad_, juce::jmax(worstLoad_.load(std::memory_order_relaxed), load));
+  store(lastLoad_, load);
+  store(loadHistogram_[bucket], loadHistogram_[bucket].load(std::memory_order_relaxed) + 1);
+
+  store(eventsLastBlock_, blockEvents_);
+  store(maxEventsPerBlock_, juce::jmax(maxEventsPerBlock_.load(std::memory_order_relaxed), blockEvents_));
+  store(totalEvents_, totalEvents_.load(std::memory_order_relaxed) + blockEvents_);
+  blockEvents_ = 0;
+}
+
+void sfzero::PerformanceCounters::setVoicesPerChannel(const int *counts)
+{
+  int total = 0;
+  for (int channel = 0; channel < 16; ++channel)
+  {
+    store(voicesPerChannel_[channel], counts[channel]);
+    total += counts[channel];
+  }
+  store(peakVoices_, juce::jmax(peakVoices_.load(std::memory_order_relaxed), total));
+}
+
+sfzero::PerformanceCounters::Snapshot sfzero::PerformanceCounters::getSnapshot() const
+{
+  Snapshot snapshot;
+  double ticksPerMs = juce::Time::getHighResolutionTicksPerSecond() / 1000.0;
+  double sampleRate = sampleRate_.load(std::memory_order_relaxed);
+
+  snapshot.numCallbacks = numCallbacks_.load(std::memory_order_relaxed);
+  juce::int64 totalSamples = totalSamples_.load(std::memory_order_relaxed);
+  if (totalSamples > 0)
+  {
+    double totalMs = totalTicks_.load(std::memory_order_relaxed) / ticksPerMs;
+    snapshot.averageLoad = totalMs / (totalSamples * 1000.0 / sampleRate);
+    snapshot.renderSeconds = totalMs / 1000.0;
+    snapshot.audioSeconds = totalSamples / sampleRate;
+  }
+  snapshot.worstLoad = worstLoad_.load(std::memory_order_relaxed);
+  snapshot.worstCallbackMs = worstTicks_.load(std::memory_order_relaxed) / ticksPerMs;
+  snapshot.lastCallbackMs = lastTicks_.load(std::memory_order_relaxed) / ticksPerMs;
+  snapshot.lastBufferMs = lastNumSamples_.load(std::memory_order_relaxed) * 1000.0 / sampleRate;
+  for (int channel = 0; channel < 16; ++channel)
+  {
+    snapshot.voicesPerChannel[channel] = voicesPerChannel_[channel].load(std::memory_order_relaxed);
+    snapshot.activeVoices += snapshot.voicesPerChannel[channel];
+  }
+  snapshot.peakVoices = peakVoices_.load(std::memory_order_relaxed);
+  snapshot.voicesStolen = voicesStolen_.load(std::memory_order_relaxed);
+  snapshot.voiceLimit = voiceLimit_.load(std::memory_order_relaxed);
+  snapshot.voicesShed = voicesShed_.load(std::memory_order_relaxed);
+  snapshot.notesDropped = notesDropped_.load(std::memory_order_relaxed);
+  snapshot.eventsLastBlock = eventsLastBlock_.load(std::memory_order_relaxed);
+  snapshot.maxEventsPerBlock = maxEventsPerBlock_.load(std::memory_order_relaxed);
+  snapshot.totalEvents = totalEvents_.load(std::memory_order_relaxed);
+  for (int i = 0; i < numLoadBuckets; ++i)
+  {
+    snapshot.loadHistogram[i] = loadHistogram_[i].load(std::memory_order_relaxed);
+  }
+  return snapshot;
+}
+
+double sfzero::PerformanceCounters::Snapshot::getLoadAtPercentile(double fraction) const
+{
+  juce::uint64 total = 0;
+  for (juce::uint32 count : loadHistogram)
+  {
+    total += count;
+  }
+  if (total == 0)
+  {
+    return 0.0;
+  }
+
+  // The upper edge of the bucket the wanted callback falls in.
+  juce::uint64 wanted = static_cast<juce::uint64>(std::ceil(juce::jlimit(0.0, 1.0, fraction) * total));
+  juce::uint64 seen = 0;
+  for (int i = 0; i < numLoadBuckets; ++i)
+  {
+    seen += loadHistogram[i];
+    if (seen >= wanted && seen > 0)
+    {
+      return juce::jmin((i + 1) / 100.0, worstLoad);
+    }
+  }
+  return worstLoad;
+}
@@ -0,0 +1,129 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#ifndef SFZPERFORMANCE_H_INCLUDED
+#define SFZPERFORMANCE_H_INCLUDED
+
+#include "SFZCommon.h"
+
+namespace sfzero
+{
+
+// Measurements of the audio callback: how long each one took against the
+// length of audio it produced, how many voices each channel had sounding, and
+// how many voices were stolen, notes dropped and MIDI events dispatched.  The
+// audio thread is the only writer and never blocks; any other thread can take
+// a snapshot.
+class PerformanceCounters
+{
+public:
+  // Callback load (time taken over buffer duration) in 1% steps; the last
+  // bucket also counts everything slower.
+  static constexpr int numLoadBuckets = 256;
+
+  struct Snapshot
+  {
+    juce::int64 numCallbacks = 0;
+    double averageLoad = 0.0; // 1.0 means a callback takes as long as it plays
+    double worstLoad = 0.0;
+    double worstCallbackMs = 0.0;
+    double lastCallbackMs = 0.0;
+    double lastBufferMs = 0.0;
+    int voicesPerChannel[16] = {};
+    int activeVoices = 0;
+    int peakVoices = 0;
+    juce::int64 voicesStolen = 0;
+    int voiceLimit = 0; // The load limiter's, or 0 while it's off.
+    juce::int64 voicesShed = 0;
+    juce::int64 notesDropped = 0; // Before the synth saw them, from bursts.
+    int eventsLastBlock = 0;
+    int maxEventsPerBlock = 0;
+    juce::int64 totalEvents = 0;
+    juce::uint32 loadHistogram[numLoadBuckets] = {};
+    double renderSeconds = 0.0; // Spent in callbacks, all told.
+    double audioSeconds = 0.0;  // Of audio they produced.
+
+    // The load that this fraction (0-1) of callbacks came in under, to the
+    // histogram's 1% resolution.
+    double getLoadAtPercentile(double fraction) const;
+
+    // Stand-ins for energy use, per minute of audio: the CPU time spent
+    // rendering it, and how often the audio thread woke to do so.
+    double getRenderSecondsPerMinute() const { return audioSeconds > 0.0 ? renderSeconds * 60.0 / audioSeconds : 0.0; }
+    double getCallbacksPerMinute() const { return audioSeconds > 0.0 ? numCallbacks * 60.0 / audioSeconds : 0.0; }
+  };
+
+  PerformanceCounters();
+
+  // Buffer durations are worked out at this rate.
+  void setSampleRate(double sampleRate) { sampleRate_.store(sampleRate, std::memory_order_relaxed); }
+
+  // Audio thread.  Times one callback of numSamples samples from construction
+  // to destruction, so early returns are counted too.
+  class ScopedCallback
+  {
+  public:
+    ScopedCallback(PerformanceCounters &counters, int numSamples)
+        : counters_(counters), numSamples_(numSamples), startTicks_(juce::Time::getHighResolutionTicks())
+    {
+    }
+    ~ScopedCallback() { counters_.addCallback(juce::Time::getHighResolutionTicks() - startTicks_, numSamples_); }
+
+  private:
+    PerformanceCounters &counters_;
+    int numSamples_;
+    juce::int64 startTicks_;
+
+    JUCE_DECLARE_NON_COPYABLE(ScopedCallback)
+  };
+
+  // Audio thread.
+  void addCallback(juce::int64 elapsedTicks, int numSamples);
+  void addEvent() { ++blockEvents_; }
+  void addStolenVoice() { store(voicesStolen_, voicesStolen_.load(std::memory_order_relaxed) + 1); }
+  void addShedVoices(int numVoices) { store(voicesShed_, voicesShed_.load(std::memory_order_relaxed) + numVoices); }
+  void addDroppedNotes(int numNotes) { store(notesDropped_, notesDropped_.load(std::memory_order_relaxed) + numNotes); }
+  void setVoiceLimit(int numVoices) { store(voiceLimit_, numVoices); }
+  // Audio thread: the callbacks timed so far and the last one's load, for
+  // whatever adapts to it.
+  juce::int64 getNumCallbacks() const { return numCallbacks_.load(std::memory_order_relaxed); }
+  float getLastLoad() const { return lastLoad_.load(std::memory_order_relaxed); }
+  void setVoicesPerChannel(const int *counts);
+
+  // Any thread.  The fields are read one by one, so a snapshot taken during a
+  // callback can mix that callback's figures with the previous one's.
+  Snapshot getSnapshot() const;
+  // Starts the figures again from the next callback.
+  void reset() { resetRequested_.store(true, std::memory_order_relaxed); }
+
+private:
+  // Only the audio thread writes, so updates needn't be read-modify-write.
+  template <typename T> static void store(std::atomic<T> &counter, T value)
+  {
+    counter.store(value, std::memory_order_relaxed);
+  }
+  void clear();
+
+  std::atomic<double> sampleRate_;
+  std::atomic<bool> resetRequested_;
+  std::atomic<juce::int64> numCallbacks_, totalTicks_, totalSamples_;
+  std::atomic<juce::int64> worstTicks_, lastTicks_;
+  std::atomic<int> lastNumSamples_;
+  std::atomic<float> worstLoad_, lastLoad_;
+  std::atomic<juce::uint32> loadHistogram_[numLoadBuckets];
+  std::atomic<int> voicesPerChannel_[16];
+  std::atomic<int> peakVoices_;
+  std::atomic<juce::int64> voicesStolen_, voicesShed_, notesDropped_;
+  std::atomic<int> voiceLimit_;
+  std::atomic<int> eventsLastBlock_, maxEventsPerBlock_;
+  std::atomic<juce::int64> totalEvents_;
+  int blockEvents_; // Audio thread only.
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PerformanceCounters)
+};
+}
+
+#endif // SFZPERFORMANCE_H_INCLUDED
@@ -8,12 +8,210 @@
 #include "SFZRegion.h"
 #include "SFZSound.h"
 
+namespace
+{
+// Every region opcode the reader understands.  Opcodes are looked up by hash
+// rather than compared against each name in turn.
+enum Opcode
+{
+  unknownOpcode,
+  opLokey,
+  opHikey,
+  opKey,
+  opLovel,
+  opHivel,
+  opTrigger,
+  opGroup,
+  opOffBy,
+  opOffset,
+  opEnd,
+  opLoopMode,
+  opLoopStart,
+  opLoopEnd,
+  opTranspose,
+  opTune,
+  opPitchKeycenter,
+  opPitchKeytrack,
+  opBendUp,
+  opBendDown,
+  opVolume,
+  opPan,
+  opAmpVeltrack,
+  opCutoff,
+  opResonance,
+  opAmpegDelay,
+  opAmpegStart,
+  opAmpegAttack,
+  opAmpegHold,
+  opAmpegDecay,
+  opAmpegSustain,
+  opAmpegRelease,
+  opAmpegVel2Delay,
+  opAmpegVel2Attack,
+  opAmpegVel2Hold,
+  opAmpegVel2Decay,
+  opAmpegVel2Sustain,
+  opAmpegVel2Release,
+  opDefaultPath,
+  opSample
+};
+
+struct OpcodeName
+{
+  const char *name;
+  Opcode opcode;
+};
+
+const OpcodeName opcodeNames[] = {
+    {"lokey", opLokey},
+    {"hikey", opHikey},
+    {"key", opKey},
+    {"lovel", opLovel},
+    {"hivel", opHivel},
+    {"trigger", opTrigger},
+    {"group", opGroup},
+    {"off_by", opOffBy},
+    {"offset", opOffset},
+    {"end", opEnd},
+    {"loop_mode", opLoopMode},
+    {"loop_start", opLoopStart},
+    {"loop_end", opLoopEnd},
+    {"transpose", opTranspose},
+    {"tune", opTune},
+    {"pitch_keycenter", opPitchKeycenter},
+    {"pitch_keytrack", opPitchKeytrack},
+    {"bend_up", opBendUp},
+    {"bend_down", opBendDown},
+    {"volume", opVolume},
+    {"pan", opPan},
+    {"amp_veltrack", opAmpVeltrack},
+    {"cutoff", opCutoff},
+    {"resonance", opResonance},
+    {"ampeg_delay", opAmpegDelay},
+    {"ampeg_start", opAmpegStart},
+    {"ampeg_attack", opAmpegAttack},
+    {"ampeg_hold", opAmpegHold},
+    {"ampeg_decay", opAmpegDecay},
+    {"ampeg_sustain", opAmpegSustain},
+    {"ampeg_release", opAmpegRelease},
+    {"ampeg_vel2delay", opAmpegVel2Delay},
+    {"ampeg_vel2attack", opAmpegVel2Attack},
+    {"ampeg_vel2hold", opAmpegVel2Hold},
+    {"ampeg_vel2decay", opAmpegVel2Decay},
+    {"ampeg_vel2sustain", opAmpegVel2Sustain},
+    {"ampeg_vel2release", opAmpegVel2Release},
+    {"default_path", opDefaultPath},
+    {"sample", opSample},
+};
+
+juce::uint32 hashOpcode(const char *start, const char *end)
+{
+  // FNV-1a.
+  juce::uint32 hash = 2166136261u;
+  for (const char *p = start; p < end; ++p)
+  {
+    hash = (hash ^ static_cast<juce::uint8>(*p)) * 16777619u;
+  }
+  return hash;
+}
+
+// Open-addressed table of indices into opcodeNames, built on first use.
+class OpcodeTable
+{
+public:
+  static const OpcodeTable &get()
+  {
+    static const OpcodeTable table;
+    return table;
+  }
+
+  Opcode lookup(const sfzero::StringSlice &opcode) const
+  {
+    for (juce::uint32 slot = hashOpcode(opcode.getStart(), opcode.getEnd()) & slotMask;; slot = (slot + 1) & slotMask)
+    {
+      int entry = slots_[slot];
+      if (entry < 0)
+      {
+        return unknownOpcode;
+      }
+      if (opcode == opcodeNames[entry].name)
+      {
+        return opcodeNames[entry].opcode;
+      }
+    }
+  }
+
+private:
+  static constexpr juce::uint32 numSlots = 128;
+  static constexpr juce::uint32 slotMask = numSlots - 1;
+
+  OpcodeTable()
+  {
+    static_assert(sizeof(opcodeNames) / sizeof(opcodeNames[0]) < numSlots / 2, "Opcode table too full");
+    for (int &slot : slots_)
+    {
+      slot = -1;
+    }
+    for (int i = 0; i < static_cast<int>(sizeof(opcodeNames) / sizeof(opcodeNames[0])); ++i)
+    {
+      const char *name = opcodeNames[i].name;
+      juce::uint32 slot = hashOpcode(name, name + strlen(name)) & slotMask;
+      while (slots_[slot] >= 0)
+      {
+        slot = (slot + 1) & slotMask;
+      }
+      slots_[slot] = i;
+    }
+  }
+
+  int slots_[numSlots];
+};
+}
+
+juce::int64 sfzero::StringSlice::getLargeIntValue() const
+{
+  const char *p = start_;
+  while (p < end_ && (*p == ' ' || *p == '\t'))
+  {
+    ++p;
+  }
+  bool negative = false;
+  if (p < end_ && (*p == '-' || *p == '+'))
+  {
+    negative = *p++ == '-';
+  }
+  juce::int64 value = 0;
+  for (; p < end_ && *p >= '0' && *p <= '9'; ++p)
+  {
+    value = value * 10 + (*p - '0');
+  }
+  return negative ? -value : value;
+}
+
+float sfzero::StringSlice::getFloatValue() const
+{
+  // Values are short, so a copy on the stack gives the parser its terminator.
+  char text[64];
+  size_t numChars = juce::jmin(static_cast<size_t>(length()), sizeof(text) - 1);
+  memcpy(text, start_, numChars);
+  text[numChars] = '\0';
+  return static_cast<float>(juce::CharacterFunctions::getDoubleValue(juce::CharPointer_ASCII(text)));
+}
+
 sfzero::Reader::Reader(sfzero::Sound *soundIn) : sound_(soundIn), line_(1) {}
 
 sfzero::Reader::~Reader() {}
 
 void sfzero::Reader::read(const juce::File &file)
 {
+  // Parse the file in place where it can be mapped; empty files can't be.
+  juce::MemoryMappedFile mapped(file, juce::MemoryMappedFile::readOnly);
+  if (mapped.getData() != nullptr)
+  {
+    read(static_cast<const char *>(mapped.getData()), static_cast<unsigned int>(mapped.getSize()));
+    return;
+  }
+
   juce::MemoryBlock contents;
   bool ok = file.loadFileAsData(contents);
 
@@ -37,6 +235,7 @@ void sfzero::Reader::read(const char *text, unsigned int length)
   sfzero::Region *buildingRegion = nullptr;
   bool inControl = false;
   juce::String defaultPath;
+  const OpcodeTable &opcodeTable = OpcodeTable::get();
 
   while (p < end)
   {
@@ -59,22 +258,22 @@ void sfzero::Reader::read(const char *text, unsigned int length)
     if (c == '/')
     {
       // Skip to end of line.
-      while (p < end)
+      while (++p < end)
       {
-        c = *++p;
+        c = *p;
         if ((c == '\n') || (c == '\r'))
         {
           break;
         }
       }
-      p = handleLineEnd(p);
+      p = handleLineEnd(p, end);
       continue;
     }
 
     // Check if it's a blank line.
     if ((c == '\r') || (c == '\n'))
     {
-      p = handleLineEnd(p);
+      p = handleLineEnd(p, end);
       continue;
     }
 
@@ -175,15 +374,16 @@ void sfzero::Reader::read(const char *text, unsigned int length)
           goto nextElement;
         }
         sfzero::StringSlice opcode(parameterStart, p - 1);
+        Opcode op = opcodeTable.lookup(opcode);
         if (inControl)
         {
-          if (opcode == "default_path")
+          if (op == opDefaultPath)
           {
             p = readPathInto(&defaultPath, p, end);
           }
           else
           {
-            const char *valueStart = p;
+            // Skip the value.
             while (p < end)
             {
               c = *p;
@@ -193,12 +393,11 @@ void sfzero::Reader::read(const char *text, unsigned int length)
               }
               p++;
             }
-            juce::String value(valueStart, p - valueStart);
-            juce::String fauxOpcode = juce::String(opcode.getStart(), opcode.length()) + " (in <control>)";
+            juce::String fauxOpcode = opcode.toString() + " (in <control>)";
             sound_->addUnsupportedOpcode(fauxOpcode);
           }
         }
-        else if (opcode == "sample")
+        else if (op == opSample)
         {
           juce::String path;
           p = readPathInto(&path, p, end);
@@ -230,48 +429,42 @@ void sfzero::Reader::read(const char *text, unsigned int length)
             }
             p++;
           }
-          juce::String value(valueStart, p - valueStart);
+          sfzero::StringSlice value(valueStart, p);
           if (buildingRegion == nullptr)
           {
             error("Setting a parameter outside a region or group");
+            goto nextElement;
           }
-          else if (opcode == "lokey")
+          switch (op)
           {
+          case opLokey:
             buildingRegion->lokey = keyValue(value);
-          }
-          else if (opcode == "hikey")
-          {
+            break;
+          case opHikey:
             buildingRegion->hikey = keyValue(value);
-          }
-          else if (opcode == "key")
-          {
+            break;
+          case opKey:
             buildingRegion->hikey = buildingRegion->lokey = buildingRegion->pitch_keycenter = keyValue(value);
-          }
-          else if (opcode == "lovel")
-          {
+            break;
+          case opLovel:
             buildingRegion->lovel = value.getIntValue();
-          }
-          else if (opcode == "hivel")
-          {
+            break;
+          case opHivel:
             buildingRegion->hivel = value.getIntValue();
-          }
-          else if (opcode == "trigger")
-          {
+            break;
+          case opTrigger:
             buildingRegion->trigger = static_cast<sfzero::Region::Trigger>(triggerValue(value));
-          }
-          else if (opcode == "group")
-          {
+            break;
+          case opGroup:
             buildingRegion->group = static_cast<int>(value.getLargeIntValue());
-          }
-          else if (opcode == "off_by")
-          {
+            break;
+          case opOffBy:
             buildingRegion->off_by = value.getLargeIntValue();
-          }
-          else if (opcode == "offset")
-          {
+            break;
+          case opOffset:
             buildingRegion->offset = value.getLargeIntValue();
-          }
-          else if (opcode == "end")
+            break;
+          case opEnd:
           {
             juce::int64 end2 = value.getLargeIntValue();
             if (end2 < 0)
@@ -282,8 +475,9 @@ void sfzero::Reader::read(const char *text, unsigned int length)
             {
               buildingRegion->end = end2;
             }
+            break;
           }
-          else if (opcode == "loop_mode")
+          case opLoopMode:
           {
             bool modeIsSupported = value == "no_loop" || value == "one_shot" || value == "loop_continuous";
             if (modeIsSupported)
@@ -292,113 +486,97 @@ void sfzero::Reader::read(const char *text, unsigned int length)
             }
             else
             {
-              juce::String fauxOpcode = juce::String(opcode.getStart(), opcode.length()) + "=" + value;
+              juce::String fauxOpcode = opcode.toString() + "=" + value.toString();
               sound_->addUnsupportedOpcode(fauxOpcode);
             }
+            break;
           }
-          else if (opcode == "loop_start")
-          {
+          case opLoopStart:
             buildingRegion->loop_start = value.getLargeIntValue();
-          }
-          else if (opcode == "loop_end")
-          {
+            break;
+          case opLoopEnd:
             buildingRegion->loop_end = value.getLargeIntValue();
-          }
-          else if (opcode == "transpose")
-          {
+            break;
+          case opTranspose:
             buildingRegion->transpose = value.getIntValue();
-          }
-          else if (opcode == "tune")
-          {
+            break;
+          case opTune:
             buildingRegion->tune = value.getIntValue();
-          }
-          else if (opcode == "pitch_keycenter")
-          {
+            break;
+          case opPitchKeycenter:
             buildingRegion->pitch_keycenter = keyValue(value);
-          }
-          else if (opcode == "pitch_keytrack")
-          {
+            break;
+          case opPitchKeytrack:
             buildingRegion->pitch_keytrack = value.getIntValue();
-          }
-          else if (opcode == "bend_up")
-          {
+            break;
+          case opBendUp:
             buildingRegion->bend_up = value.getIntValue();
-          }
-          else if (opcode == "bend_down")
-          {
+            break;
+          case opBendDown:
             buildingRegion->bend_down = value.getIntValue();
-          }
-          else if (opcode == "volume")
-          {
+            break;
+          case opVolume:
             buildingRegion->volume = value.getFloatValue();
-          }
-          else if (opcode == "pan")
-          {
+            break;
+          case opPan:
             buildingRegion->pan = value.getFloatValue();
-          }
-          else if (opcode == "amp_veltrack")
-          {
+            break;
+          case opAmpVeltrack:
             buildingRegion->amp_veltrack = value.getFloatValue();
-          }
-          else if (opcode == "ampeg_delay")
-          {
+            break;
+          case opCutoff:
+            buildingRegion->cutoff = value.getFloatValue();
+            break;
+          case opResonance:
+            buildingRegion->resonance = value.getFloatValue();
+            break;
+          case opAmpegDelay:
             buildingRegion->ampeg.delay = value.getFloatValue();
-          }
-          else if (opcode == "ampeg_start")
-          {
+            break;
+          case opAmpegStart:
             buildingRegion->ampeg.start = value.getFloatValue();
-          }
-          else if (opcode == "ampeg_attack")
-          {
+            break;
+          case opAmpegAttack:
             buildingRegion->ampeg.attack = value.getFloatValue();
-          }
-          else if (opcode == "ampeg_hold")
-          {
+            break;
+          case opAmpegHold:
             buildingRegion->ampeg.hold = value.getFloatValue();
-          }
-          else if (opcode == "ampeg_decay")
-          {
+            break;
+          case opAmpegDecay:
             buildingRegion->ampeg.decay = value.getFloatValue();
-          }
-          else if (opcode == "ampeg_sustain")
-          {
+            break;
+          case opAmpegSustain:
             buildingRegion->ampeg.sustain = value.getFloatValue();
-          }
-          else if (opcode == "ampeg_release")
-          {
+            break;
+          case opAmpegRelease:
             buildingRegion->ampeg.release = value.getFloatValue();
-          }
-          else if (opcode == "ampeg_vel2delay")
-          {
+            break;
+          case opAmpegVel2Delay:
             buildingRegion->ampeg_veltrack.delay = value.getFloatValue();
-          }
-          else if (opcode == "ampeg_vel2attack")
-          {
+            break;
+          case opAmpegVel2Attack:
             buildingRegion->ampeg_veltrack.attack = value.getFloatValue();
-          }
-          else if (opcode == "ampeg_vel2hold")
-          {
+            break;
+          case opAmpegVel2Hold:
             buildingRegion->ampeg_veltrack.hold = value.getFloatValue();
-          }
-          else if (opcode == "ampeg_vel2decay")
-          {
+            break;
+          case opAmpegVel2Decay:
             buildingRegion->ampeg_veltrack.decay = value.getFloatValue();
-          }
-          else if (opcode == "ampeg_vel2sustain")
-          {
+            break;
+          case opAmpegVel2Sustain:
             buildingRegion->ampeg_veltrack.sustain = value.getFloatValue();
-          }
-          else if (opcode == "ampeg_vel2release")
-          {
+            break;
+          case opAmpegVel2Release:
             buildingRegion->ampeg_veltrack.release = value.getFloatValue();
-          }
-          else if (opcode == "default_path")
-          {
+            break;
+          case opDefaultPath:
             error("\"default_path\" outside of <control> tag");
-          }
-          else
-          {
-            sound_->addUnsupportedOpcode(juce::String(opcode.getStart(), opcode.length()));
+            break;
+          case opSample:
+          case unknownOpcode:
+          default:
+            sound_->addUnsupportedOpcode(opcode.toString());
+            break;
           }
         }
       }
@@ -417,7 +595,7 @@ void sfzero::Reader::read(const char *text, unsigned int length)
       }
       if ((c == '\r') || (c == '\n'))
       {
-        p = handleLineEnd(p);
+        p = handleLineEnd(p, end);
         break;
       }
     }
@@ -430,12 +608,17 @@ fatalError:
   }
 }
 
-const char *sfzero::Reader::handleLineEnd(const char *p)
+const char *sfzero::Reader::handleLineEnd(const char *p, const char *end)
 {
+  if (p >= end)
+  {
+    return p;
+  }
+
   // Check for DOS-style line ending.
   char lineEndChar = *p++;
 
-  if ((lineEndChar == '\r') && (*p == '\n'))
+  if ((lineEndChar == '\r') && (p < end) && (*p == '\n'))
   {
     p += 1;
   }
@@ -495,9 +678,14 @@ const char *sfzero::Reader::readPathInto(juce::String *pathOut, const char *pIn,
   return p;
 }
 
-int sfzero::Reader::keyValue(const juce::String &str)
+int sfzero::Reader::keyValue(const sfzero::StringSlice &str)
 {
-  auto chars = str.toRawUTF8();
+  const char *chars = str.getStart();
+  int length = static_cast<int>(str.length());
+  if (length == 0)
+  {
+    return 0;
+  }
 
   char c = chars[0];
 
@@ -520,7 +708,7 @@ int sfzero::Reader::keyValue(const juce::String &str)
   }
   int octaveStart = 1;
 
-  c = chars[1];
+  c = length > 1 ? chars[1] : 0;
   if ((c == 'b') || (c == '#'))
   {
     octaveStart += 1;
@@ -534,13 +722,13 @@ int sfzero::Reader::keyValue(const juce::String &str)
     }
   }
 
-  int octave = str.substring(octaveStart).getIntValue();
+  int octave = sfzero::StringSlice(chars + juce::jmin(octaveStart, length), str.getEnd()).getIntValue();
   // A3 == 57.
   int result = octave * 12 + note + (57 - 4 * 12);
   return result;
 }
 
-int sfzero::Reader::triggerValue(const juce::String &str)
+int sfzero::Reader::triggerValue(const sfzero::StringSlice &str)
 {
   if (str == "release")
   {
@@ -557,7 +745,7 @@ int sfzero::Reader::triggerValue(const juce::String &str)
   return sfzero::Region::attack;
 }
 
-int sfzero::Reader::loopModeValue(const juce::String &str)
+int sfzero::Reader::loopModeValue(const sfzero::StringSlice &str)
 {
   if (str == "no_loop")
   {
@@ -580,10 +768,7 @@ int sfzero::Reader::loopModeValue(const juce::String &str)
 
 void sfzero::Reader::finishRegion(sfzero::Region *region)
 {
-  sfzero::Region *newRegion = new sfzero::Region();
-
-  *newRegion = *region;
-  sound_->addRegion(newRegion);
+  sound_->addRegion(*region)->precompute();
 }
 
 void sfzero::Reader::error(const juce::String &message)
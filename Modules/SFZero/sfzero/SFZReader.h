@@ -14,6 +14,7 @@ namespace sfzero
 
 struct Region;
 class Sound;
+class StringSlice;
 
 class Reader
 {
@@ -25,11 +26,11 @@ public:
   void read(const char *text, unsigned int length);
 
 private:
-  const char *handleLineEnd(const char *p);
+  const char *handleLineEnd(const char *p, const char *end);
   const char *readPathInto(juce::String *pathOut, const char *p, const char *end);
-  int keyValue(const juce::String &str);
-  int triggerValue(const juce::String &str);
-  int loopModeValue(const juce::String &str);
+  int keyValue(const StringSlice &str);
+  int triggerValue(const StringSlice &str);
+  int loopModeValue(const StringSlice &str);
   void finishRegion(Region *region);
   void error(const juce::String &message);
 
@@ -45,11 +46,22 @@ public:
   StringSlice(const char *startIn, const char *endIn) : start_(startIn), end_(endIn) {}
   virtual ~StringSlice() {}
 
-  unsigned int length() { return static_cast<int>(end_ - start_); }
-  bool operator==(const char *other) { return (strncmp(start_, other, length()) == 0); }
-  bool operator!=(const char *other) { return (strncmp(start_, other, length()) != 0); }
+  unsigned int length() const { return static_cast<unsigned int>(end_ - start_); }
+  // Whole-slice comparisons; a prefix of other doesn't match.
+  bool operator==(const char *other) const
+  {
+    return (strncmp(start_, other, length()) == 0) && (other[length()] == '\0');
+  }
+  bool operator!=(const char *other) const { return !operator==(other); }
   const char *getStart() const { return start_; }
   const char *getEnd() const { return end_; }
+  juce::String toString() const { return juce::String(start_, length()); }
+
+  // Number parsing straight off the text, like juce::String's getIntValue()
+  // and friends but without making a String first.
+  int getIntValue() const { return static_cast<int>(getLargeIntValue()); }
+  juce::int64 getLargeIntValue() const;
+  float getFloatValue() const;
 private:
   const char *start_;
   const char *end_;
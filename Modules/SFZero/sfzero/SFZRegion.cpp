@@ -7,6 +7,27 @@
 #include "SFZRegion.h"
 #include "SFZSample.h"
 
+static const float globalGain = -1.0;
+
+// (v / 127)^2 for every velocity v, the curve at the default amp_veltrack.
+static const float *getVelocityTable()
+{
+  struct Table
+  {
+    float gains[128];
+
+    Table()
+    {
+      for (int velocity = 0; velocity < 128; ++velocity)
+      {
+        gains[velocity] = static_cast<float>((velocity * velocity) / (127.0 * 127.0));
+      }
+    }
+  };
+  static const Table table;
+  return table.gains;
+}
+
 void sfzero::EGParameters::clear()
 {
   delay = 0.0;
@@ -24,6 +45,12 @@ void sfzero::EGParameters::clearMod()
   delay = start = attack = hold = decay = sustain = release = 0.0;
 }
 
+bool sfzero::EGParameters::operator==(const sfzero::EGParameters &other) const
+{
+  return delay == other.delay && start == other.start && attack == other.attack && hold == other.hold &&
+         decay == other.decay && sustain == other.sustain && release == other.release;
+}
+
 sfzero::Region::Region() { clear(); }
 
 void sfzero::Region::clear()
@@ -39,6 +66,7 @@ void sfzero::Region::clear()
   amp_veltrack = 100.0;
   ampeg.clear();
   ampeg_veltrack.clearMod();
+  modeg.clear();
 }
 
 void sfzero::Region::clearForSF2()
@@ -46,6 +74,7 @@ void sfzero::Region::clearForSF2()
   clear();
   pitch_keycenter = -1;
   loop_mode = no_loop;
+  cutoff = 13500.0f; // cents, which is the filter off
 
   // SF2 defaults in timecents.
   ampeg.delay = -12000.0;
@@ -54,6 +83,9 @@ void sfzero::Region::clearForSF2()
   ampeg.decay = -12000.0;
   ampeg.sustain = 0.0;
   ampeg.release = -12000.0;
+  modeg = ampeg;
+  modlfo_delay = -12000.0;
+  viblfo_delay = -12000.0;
 }
 
 void sfzero::Region::clearForRelativeSF2()
@@ -62,6 +94,7 @@ void sfzero::Region::clearForRelativeSF2()
   pitch_keytrack = 0;
   amp_veltrack = 0.0;
   ampeg.sustain = 0.0;
+  modeg.sustain = 0.0;
 }
 
 void sfzero::Region::addForSF2(sfzero::Region *other)
@@ -75,6 +108,8 @@ void sfzero::Region::addForSF2(sfzero::Region *other)
   pitch_keytrack += other->pitch_keytrack;
   volume += other->volume;
   pan += other->pan;
+  cutoff += other->cutoff;
+  resonance += other->resonance;
 
   ampeg.delay += other->ampeg.delay;
   ampeg.attack += other->ampeg.attack;
@@ -82,6 +117,23 @@ void sfzero::Region::addForSF2(sfzero::Region *other)
   ampeg.decay += other->ampeg.decay;
   ampeg.sustain += other->ampeg.sustain;
   ampeg.release += other->ampeg.release;
+
+  modeg.delay += other->modeg.delay;
+  modeg.attack += other->modeg.attack;
+  modeg.hold += other->modeg.hold;
+  modeg.decay += other->modeg.decay;
+  modeg.sustain += other->modeg.sustain;
+  modeg.release += other->modeg.release;
+  modeg_to_pitch += other->modeg_to_pitch;
+  modeg_to_cutoff += other->modeg_to_cutoff;
+  modlfo_delay += other->modlfo_delay;
+  modlfo_freq += other->modlfo_freq;
+  modlfo_to_pitch += other->modlfo_to_pitch;
+  modlfo_to_cutoff += other->modlfo_to_cutoff;
+  modlfo_to_volume += other->modlfo_to_volume;
+  viblfo_delay += other->viblfo_delay;
+  viblfo_freq += other->viblfo_freq;
+  viblfo_to_pitch += other->viblfo_to_pitch;
 }
 
 void sfzero::Region::sf2ToSFZ()
@@ -98,6 +150,41 @@ void sfzero::Region::sf2ToSFZ()
   ampeg.sustain = 100.0f * juce::Decibels::decibelsToGain(-ampeg.sustain / 10.0f);
   ampeg.release = timecents2Secs(static_cast<int>(ampeg.release));
 
+  // The filter cutoff is in absolute cents, and 13500 or more is none; the
+  // resonance is in centibels.
+  if (cutoff >= 13500.0f)
+  {
+    cutoff = 0.0f;
+  }
+  else
+  {
+    cutoff = static_cast<float>(8.176 * pow(2.0, juce::jmax(1500.0f, cutoff) / 1200.0));
+  }
+  resonance = juce::jlimit(0.0f, 96.0f, resonance / 10.0f);
+
+  // The mod envelope's times are timecents too, but its sustain is the drop
+  // from full in tenths of a percent.  The LFOs' delays are timecents, their
+  // frequencies absolute cents, and the volume depth is centibels.
+  modeg.delay = timecents2Secs(static_cast<int>(modeg.delay));
+  modeg.attack = timecents2Secs(static_cast<int>(modeg.attack));
+  modeg.hold = timecents2Secs(static_cast<int>(modeg.hold));
+  modeg.decay = timecents2Secs(static_cast<int>(modeg.decay));
+  modeg.sustain = juce::jlimit(0.0f, 100.0f, 100.0f - modeg.sustain / 10.0f);
+  modeg.release = timecents2Secs(static_cast<int>(modeg.release));
+  modlfo_delay = timecents2Secs(static_cast<int>(modlfo_delay));
+  modlfo_freq = static_cast<float>(8.176 * pow(2.0, modlfo_freq / 1200.0));
+  modlfo_to_volume /= 10.0f;
+  viblfo_delay = timecents2Secs(static_cast<int>(viblfo_delay));
+  viblfo_freq = static_cast<float>(8.176 * pow(2.0, viblfo_freq / 1200.0));
+  for (float *time : {&modeg.delay, &modeg.attack, &modeg.hold, &modeg.decay, &modeg.release, &modlfo_delay,
+                      &viblfo_delay})
+  {
+    if (*time < 0.01f)
+    {
+      *time = 0.0f;
+    }
+  }
+
   // Pin very short EG segments.  Timecents don't get to zero, and our EG is
   // happier with zero values.
   if (ampeg.delay < 0.01f)
@@ -132,6 +219,69 @@ void sfzero::Region::sf2ToSFZ()
   }
 }
 
+bool sfzero::Region::operator==(const sfzero::Region &other) const
+{
+  return sample == other.sample && lokey == other.lokey && hikey == other.hikey && lovel == other.lovel &&
+         hivel == other.hivel && trigger == other.trigger && offset == other.offset && end == other.end &&
+         negative_end == other.negative_end && loop_mode == other.loop_mode && loop_start == other.loop_start &&
+         loop_end == other.loop_end && transpose == other.transpose && tune == other.tune &&
+         pitch_keycenter == other.pitch_keycenter && pitch_keytrack == other.pitch_keytrack &&
+         bend_up == other.bend_up && bend_down == other.bend_down && volume == other.volume && pan == other.pan &&
+         amp_veltrack == other.amp_veltrack && cutoff == other.cutoff && resonance == other.resonance && ampeg == other.ampeg && ampeg_veltrack == other.ampeg_veltrack &&
+         modeg == other.modeg && modeg_to_pitch == other.modeg_to_pitch && modeg_to_cutoff == other.modeg_to_cutoff &&
+         modlfo_delay == other.modlfo_delay && modlfo_freq == other.modlfo_freq &&
+         modlfo_to_pitch == other.modlfo_to_pitch && modlfo_to_cutoff == other.modlfo_to_cutoff &&
+         modlfo_to_volume == other.modlfo_to_volume && viblfo_delay == other.viblfo_delay &&
+         viblfo_freq == other.viblfo_freq && viblfo_to_pitch == other.viblfo_to_pitch &&
+         group == other.group && off_by == other.off_by && off_mode == other.off_mode;
+}
+
+void sfzero::Region::precompute()
+{
+  // Thanks to <http:://www.drealm.info/sfz/plj-sfz.xhtml> for explaining the
+  // velocity curve in a way that I could understand, although they mean
+  // "log10" when they say "log".  Its -20 * log10(127^2 / v^2) dB, scaled by
+  // amp_veltrack, is just a power of v / 127.
+  velocity_exponent = amp_veltrack / 50.0f;
+
+  // The SFZ spec is silent about the pan curve, but a 3dB pan law seems
+  // common.  This sqrt() curve matches what Dimension LE does; Alchemy Free
+  // seems closer to sin(adjustedPan * pi/2).
+  float noteGain = juce::Decibels::decibelsToGain(globalGain + volume);
+  double adjustedPan = (pan + 100.0) / 200.0;
+  gain_left = noteGain * static_cast<float>(sqrt(1.0 - adjustedPan));
+  gain_right = noteGain * static_cast<float>(sqrt(adjustedPan));
+
+  // Transpose and tune are keytracked along with the note.
+  pitch_cents_per_key = pitch_keytrack;
+  pitch_offset_cents = (transpose * 100.0 + tune) * (pitch_keytrack / 100.0);
+
+  // The resonance is the peak's height above the passband, taken, as
+  // FluidSynth does, from a flat 0dB at Q = 1/sqrt(2).
+  filter_cents = cutoff > 0.0f ? static_cast<float>(1200.0 * log2(cutoff / 8.176)) : 0.0f;
+  filter_k = static_cast<float>(1.0 / juce::Decibels::decibelsToGain(resonance - 3.01));
+
+  // Modulating the cutoff of an unfiltered region filters it from 13500
+  // cents, the SF2 default, as FluidSynth does.
+  pitch_modulated = modeg_to_pitch != 0.0f || modlfo_to_pitch != 0.0f || viblfo_to_pitch != 0.0f;
+  bool cutoffModulated = modeg_to_cutoff != 0.0f || modlfo_to_cutoff != 0.0f;
+  modulated = pitch_modulated || cutoffModulated || modlfo_to_volume != 0.0f;
+  if (cutoffModulated && filter_cents == 0.0f)
+  {
+    filter_cents = 13500.0f;
+  }
+}
+
+float sfzero::Region::velocityGain(int velocity) const
+{
+  velocity = juce::jlimit(0, 127, velocity);
+  if (velocity_exponent == 2.0f)
+  {
+    return getVelocityTable()[velocity];
+  }
+  return std::pow(velocity / 127.0f, velocity_exponent);
+}
+
 juce::String sfzero::Region::dump()
 {
   juce::String info = juce::String::formatted("%d - %d, vel %d - %d", lokey, hikey, lovel, hivel);
@@ -22,6 +22,7 @@ struct EGParameters
 
   void clear();
   void clearMod();
+  bool operator==(const EGParameters &other) const;
 };
 
 struct Region
@@ -56,6 +57,14 @@ struct Region
   void addForSF2(Region *other);
   void sf2ToSFZ();
   juce::String dump();
+  // Every field the same, so one copy can stand in for both.
+  bool operator==(const Region &other) const;
+  // Works out the note-on constants at the end from the fields before them,
+  // once those are final, so starting a note needs no log10(), sqrt() or
+  // decibel conversion.
+  void precompute();
+  // The velocity curve's gain at velocity, 0-127.
+  float velocityGain(int velocity) const;
 
   bool matches(int note, int velocity, Trigger trig)
   {
@@ -63,13 +72,12 @@ struct Region
             (trig == this->trigger || (this->trigger == attack && (trig == first || trig == legato))));
   }
 
+  // What matching and starting a note read come first, so they share cache
+  // lines; the rest is only read by particular voices.
   Sample *sample;
   int lokey, hikey;
   int lovel, hivel;
   Trigger trigger;
-  int group;
-  juce::int64 off_by;
-  OffMode off_mode;
 
   juce::int64 offset;
   juce::int64 end;
@@ -83,9 +91,32 @@ struct Region
 
   float volume, pan;
   float amp_veltrack;
+  // Low-pass filter: cutoff in Hz, 0 for none, and resonance in dB.
+  float cutoff, resonance;
 
   EGParameters ampeg, ampeg_veltrack;
 
+  // Modulation, so far only from SF2 files: the mod envelope and its depths
+  // in cents, the mod LFO (delay in seconds, frequency in Hz) to pitch and
+  // cutoff in cents and to volume in dB, and the vibrato LFO to pitch.
+  EGParameters modeg;
+  float modeg_to_pitch, modeg_to_cutoff;
+  float modlfo_delay, modlfo_freq, modlfo_to_pitch, modlfo_to_cutoff, modlfo_to_volume;
+  float viblfo_delay, viblfo_freq, viblfo_to_pitch;
+
+  int group;
+  juce::int64 off_by;
+  OffMode off_mode;
+
+  // Set by precompute().
+  float gain_left, gain_right; // Volume and the pan law, before velocity.
+  float velocity_exponent;    // Velocity gain is (velocity / 127) to this power.
+  double pitch_cents_per_key, pitch_offset_cents; // Keytracked, from pitch_keycenter.
+  float filter_cents; // The cutoff in cents above MIDI note 0, or 0 for none.
+  float filter_k;     // The filter's damping, 1 / Q.
+  bool modulated;       // Anything above moves pitch, cutoff or volume.
+  bool pitch_modulated; // Pitch, so a note can't play from the hit cache.
+
   static float timecents2Secs(int timecents);
 };
 }
@@ -0,0 +1,153 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#include "SFZRegionIndex.h"
+
+// Numbers each value 0..127 by the range between edges it falls in; edges[v]
+// is set where a range starts.  Returns the number of ranges.
+static int numberSegments(const bool *edges, juce::uint8 *segments)
+{
+  int segment = -1;
+  for (int value = 0; value < 128; ++value)
+  {
+    if (edges[value] || value == 0)
+    {
+      ++segment;
+    }
+    segments[value] = static_cast<juce::uint8>(segment);
+  }
+  return segment + 1;
+}
+
+sfzero::RegionIndex::RegionIndex() : numVelocitySegments_(1), hasFirstOrLegato_(false) { clear(); }
+
+void sfzero::RegionIndex::clear()
+{
+  memset(keySegment_, 0, sizeof(keySegment_));
+  memset(velocitySegment_, 0, sizeof(velocitySegment_));
+  numVelocitySegments_ = 1;
+  hasFirstOrLegato_ = false;
+  for (int trigger = 0; trigger < numTriggers; ++trigger)
+  {
+    cellStart_[trigger] = nullptr;
+    regions_[trigger] = nullptr;
+    numEntries_[trigger] = 0;
+  }
+}
+
+void sfzero::RegionIndex::build(const juce::Array<sfzero::Region *> &regions, sfzero::Arena &arena)
+{
+  clear();
+
+  bool keyEdges[128] = {}, velocityEdges[128] = {};
+  for (sfzero::Region *region : regions)
+  {
+    if (region->lokey > 0 && region->lokey < 128)
+    {
+      keyEdges[region->lokey] = true;
+    }
+    if (region->hikey >= 0 && region->hikey < 127)
+    {
+      keyEdges[region->hikey + 1] = true;
+    }
+    if (region->lovel > 0 && region->lovel < 128)
+    {
+      velocityEdges[region->lovel] = true;
+    }
+    if (region->hivel >= 0 && region->hivel < 127)
+    {
+      velocityEdges[region->hivel + 1] = true;
+    }
+    hasFirstOrLegato_ = hasFirstOrLegato_ || region->trigger == sfzero::Region::first ||
+                        region->trigger == sfzero::Region::legato;
+  }
+  int numKeySegments = numberSegments(keyEdges, keySegment_);
+  numVelocitySegments_ = numberSegments(velocityEdges, velocitySegment_);
+
+  // Each region is entered in the cells its key and velocity ranges cover,
+  // for every trigger it answers to: counted first, then filled in region
+  // order so each cell keeps the table's order.
+  int numCells = numKeySegments * numVelocitySegments_;
+  for (int trigger = 0; trigger < numTriggers; ++trigger)
+  {
+    cellStart_[trigger] = arena.allocate<int>(static_cast<size_t>(numCells + 1));
+  }
+
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    for (sfzero::Region *region : regions)
+    {
+      int lokey = juce::jmax(0, region->lokey), hikey = juce::jmin(127, region->hikey);
+      int lovel = juce::jmax(0, region->lovel), hivel = juce::jmin(127, region->hivel);
+      if (lokey > hikey || lovel > hivel)
+      {
+        continue;
+      }
+
+      for (int trigger = 0; trigger < numTriggers; ++trigger)
+      {
+        if (!region->matches(lokey, lovel, static_cast<sfzero::Region::Trigger>(trigger)))
+        {
+          continue;
+        }
+        int *cellStart = cellStart_[trigger];
+        for (int key = keySegment_[lokey]; key <= keySegment_[hikey]; ++key)
+        {
+          for (int velocity = velocitySegment_[lovel]; velocity <= velocitySegment_[hivel]; ++velocity)
+          {
+            int cell = key * numVelocitySegments_ + velocity;
+            if (pass == 0)
+            {
+              cellStart[cell + 1] += 1;
+            }
+            else
+            {
+              regions_[trigger][cellStart[cell]++] = region;
+            }
+          }
+        }
+      }
+    }
+
+    for (int trigger = 0; trigger < numTriggers; ++trigger)
+    {
+      int *cellStart = cellStart_[trigger];
+      if (pass == 0)
+      {
+        // Counts to start offsets, then size the region lists.
+        for (int cell = 0; cell < numCells; ++cell)
+        {
+          cellStart[cell + 1] += cellStart[cell];
+        }
+        numEntries_[trigger] = cellStart[numCells];
+        regions_[trigger] = arena.allocate<sfzero::Region *>(static_cast<size_t>(numEntries_[trigger]));
+      }
+      else
+      {
+        // Filling advanced each start to the next cell's; shift them back.
+        for (int cell = numCells; cell > 0; --cell)
+        {
+          cellStart[cell] = cellStart[cell - 1];
+        }
+        cellStart[0] = 0;
+      }
+    }
+  }
+}
+
+sfzero::RegionIndex::Matches sfzero::RegionIndex::getMatches(int note, int velocity,
+                                                             sfzero::Region::Trigger trigger) const
+{
+  if (note < 0 || note > 127 || velocity < 0 || velocity > 127 || numEntries_[trigger] == 0)
+  {
+    return {nullptr, nullptr};
+  }
+
+  const int *cellStart = cellStart_[trigger];
+  int cell = keySegment_[note] * numVelocitySegments_ + velocitySegment_[velocity];
+  sfzero::Region *const *data = regions_[trigger];
+  return {data + cellStart[cell], data + cellStart[cell + 1]};
+}
@@ -0,0 +1,63 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#ifndef SFZREGIONINDEX_H_INCLUDED
+#define SFZREGIONINDEX_H_INCLUDED
+
+#include "SFZArena.h"
+#include "SFZRegion.h"
+
+namespace sfzero
+{
+
+// The regions of one region table that match each key, velocity and trigger,
+// worked out once so a note doesn't have to test every region.  The key and
+// velocity axes are cut into the ranges between region edges, so a 128x128
+// grid only needs a cell per distinct pair of ranges.
+class RegionIndex
+{
+public:
+  // A run of matching regions, in region table order.
+  struct Matches
+  {
+    Region *const *begin() const { return begin_; }
+    Region *const *end() const { return end_; }
+    bool isEmpty() const { return begin_ == end_; }
+    Region *getFirst() const { return isEmpty() ? nullptr : *begin_; }
+
+    Region *const *begin_;
+    Region *const *end_;
+  };
+
+  RegionIndex();
+
+  // Not thread-safe; call from loadRegions() before anything plays.  The
+  // cells are allocated from arena, which must outlive the index.
+  void build(const juce::Array<Region *> &regions, Arena &arena);
+  void clear();
+
+  Matches getMatches(int note, int velocity, Region::Trigger trigger) const;
+  // Whether any region has a first or legato trigger, i.e. whether it's worth
+  // finding out if other notes are playing.
+  bool hasFirstOrLegato() const { return hasFirstOrLegato_; }
+
+private:
+  static constexpr int numTriggers = 4;
+
+  juce::uint8 keySegment_[128];
+  juce::uint8 velocitySegment_[128];
+  int numVelocitySegments_;
+  // Per trigger: cell c's regions are regions_[cellStart_[c] .. cellStart_[c + 1]).
+  int *cellStart_[numTriggers];
+  Region **regions_[numTriggers];
+  int numEntries_[numTriggers];
+  bool hasFirstOrLegato_;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RegionIndex)
+};
+}
+
+#endif // SFZREGIONINDEX_H_INCLUDED
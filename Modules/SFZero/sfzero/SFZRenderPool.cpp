@@ -0,0 +1,168 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#include "SFZRenderPool.h"
+#include "SFZVoice.h"
+
+static const juce::uint32 jobThreadsMask = 0xff;
+// How long an idle worker polls for the next block before going to sleep.
+static const int workerSpinCount = 2000;
+
+sfzero::RenderPool::RenderPool()
+    : job_(0), jobCounter_(0), workersBusy_(0), voices_(nullptr), numVoices_(0), numThreads_(0), numSamples_(0)
+{
+}
+
+sfzero::RenderPool::~RenderPool() { stop(); }
+
+void sfzero::RenderPool::stop()
+{
+  for (Worker *worker : workers_)
+  {
+    worker->signalThreadShouldExit();
+    worker->wake();
+  }
+  for (Worker *worker : workers_)
+  {
+    worker->stopThread(1000);
+  }
+  workers_.clear();
+}
+
+void sfzero::RenderPool::prepare(int numWorkers, int numChannels, int maximumBlockSize)
+{
+  stop();
+
+  numWorkers = juce::jlimit(0, static_cast<int>(jobThreadsMask) - 1, numWorkers);
+  for (int i = 0; i < numWorkers; ++i)
+  {
+    Worker *worker = workers_.add(new Worker(*this, i, numChannels, maximumBlockSize));
+    worker->startThread(juce::Thread::Priority::highest);
+  }
+}
+
+void sfzero::RenderPool::render(sfzero::Voice *const *voices, int numVoices, juce::AudioSampleBuffer &output,
+                                int startSample, int numSamples)
+{
+  int numThreads = juce::jmin(workers_.size() + 1, numVoices / minVoicesPerThread);
+  bool fitsScratch = !workers_.isEmpty() &&
+                     output.getNumChannels() == workers_.getUnchecked(0)->scratch.getNumChannels() &&
+                     workers_.getUnchecked(0)->scratch.getNumSamples() > 0;
+  if (numThreads < 2 || numSamples < minParallelSamples || !fitsScratch)
+  {
+    for (int i = 0; i < numVoices; ++i)
+    {
+      voices[i]->renderNextBlock(output, startSample, numSamples);
+    }
+    return;
+  }
+
+  // A block longer than the scratch buffers goes out in scratch-sized pieces.
+  int maximumBlockSize = workers_.getUnchecked(0)->scratch.getNumSamples();
+  for (int done = 0; done < numSamples;)
+  {
+    int chunk = juce::jmin(numSamples - done, maximumBlockSize);
+    renderJob(voices, numVoices, numThreads, output, startSample + done, chunk);
+    done += chunk;
+  }
+}
+
+void sfzero::RenderPool::renderJob(sfzero::Voice *const *voices, int numVoices, int numThreads,
+                                   juce::AudioSampleBuffer &output, int startSample, int numSamples)
+{
+  voices_ = voices;
+  numVoices_ = numVoices;
+  numThreads_ = numThreads;
+  numSamples_ = numSamples;
+  workersBusy_.store(numThreads - 1, std::memory_order_relaxed);
+  job_.store((++jobCounter_ << 8) | static_cast<juce::uint32>(numThreads));
+  for (int i = 0; i < numThreads - 1; ++i)
+  {
+    workers_.getUnchecked(i)->wake();
+  }
+
+  // Our own share goes straight into the output.
+  renderShare(0, output, startSample);
+
+  // The workers are mid-block by now, so spinning beats sleeping here.
+  while (workersBusy_.load(std::memory_order_acquire) > 0)
+  {
+    juce::Thread::yield();
+  }
+
+  for (int i = 0; i < numThreads - 1; ++i)
+  {
+    const juce::AudioSampleBuffer &scratch = workers_.getUnchecked(i)->scratch;
+    for (int channel = 0; channel < output.getNumChannels(); ++channel)
+    {
+      output.addFrom(channel, startSample, scratch, channel, 0, numSamples);
+    }
+  }
+}
+
+void sfzero::RenderPool::renderShare(int thread, juce::AudioSampleBuffer &buffer, int startSample)
+{
+  int end = (thread + 1) * numVoices_ / numThreads_;
+  for (int i = thread * numVoices_ / numThreads_; i < end; ++i)
+  {
+    voices_[i]->renderNextBlock(buffer, startSample, numSamples_);
+  }
+}
+
+sfzero::RenderPool::Worker::Worker(RenderPool &pool, int index, int numChannels, int maximumBlockSize)
+    : juce::Thread("SFZero Render " + juce::String(index + 1)), scratch(numChannels, maximumBlockSize), pool_(pool),
+      index_(index), lastJob_(pool.job_.load()), sleeping_(false)
+{
+}
+
+void sfzero::RenderPool::Worker::wake()
+{
+  // Pairs with the store to sleeping_ in run(): either we see the worker is
+  // asleep, or it sees the new job before it waits.
+  if (sleeping_.load())
+  {
+    wakeEvent_.signal();
+  }
+}
+
+void sfzero::RenderPool::Worker::run()
+{
+  // Flush-to-zero for the thread's life, as the audio callback has it.
+  juce::ScopedNoDenormals noDenormals;
+  int spins = 0;
+  while (!threadShouldExit())
+  {
+    juce::uint32 job = pool_.job_.load();
+    if (job == lastJob_)
+    {
+      if (++spins < workerSpinCount)
+      {
+        juce::Thread::yield();
+        continue;
+      }
+      sleeping_.store(true);
+      if (pool_.job_.load() == lastJob_)
+      {
+        wakeEvent_.wait(100);
+      }
+      sleeping_.store(false);
+      spins = 0;
+      continue;
+    }
+
+    lastJob_ = job;
+    spins = 0;
+    int thread = index_ + 1;
+    if (thread < static_cast<int>(job & jobThreadsMask))
+    {
+      // Workers render from the start of their scratch, whatever the job's
+      // offset in the output.
+      scratch.clear(0, pool_.numSamples_);
+      pool_.renderShare(thread, scratch, 0);
+      pool_.workersBusy_.fetch_sub(1, std::memory_order_release);
+    }
+  }
+}
@@ -0,0 +1,86 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#ifndef SFZRENDERPOOL_H_INCLUDED
+#define SFZRENDERPOOL_H_INCLUDED
+
+#include "SFZCommon.h"
+
+namespace sfzero
+{
+
+class Voice;
+
+// Worker threads that render a block's active voices in parallel.  The audio
+// thread takes a share of the voices itself, each worker renders the rest of
+// its share into its own scratch buffer, and the audio thread sums them.
+// Handing over a block and waiting for it take no locks; a worker that has
+// gone to sleep between blocks is woken with a WaitableEvent.
+class RenderPool
+{
+public:
+  RenderPool();
+  ~RenderPool();
+
+  // Not on the audio thread.  Zero workers renders everything serially.
+  void prepare(int numWorkers, int numChannels, int maximumBlockSize);
+  int getNumWorkers() const { return workers_.size(); }
+
+  // Audio thread.  Adds voices[0..numVoices) into output; falls back to
+  // rendering them serially when the block is too small to be worth
+  // splitting.  Blocks of any length are fine: ones longer than
+  // maximumBlockSize are split into pieces that fit the scratch buffers.
+  void render(Voice *const *voices, int numVoices, juce::AudioSampleBuffer &output, int startSample,
+              int numSamples);
+
+  // Blocks shorter than this, or with fewer voices per thread, stay serial.
+  static constexpr int minParallelSamples = 32;
+  static constexpr int minVoicesPerThread = 2;
+
+private:
+  class Worker : public juce::Thread
+  {
+  public:
+    Worker(RenderPool &pool, int index, int numChannels, int maximumBlockSize);
+    void run() override;
+    void wake();
+
+    juce::AudioSampleBuffer scratch;
+
+  private:
+    RenderPool &pool_;
+    int index_;
+    juce::uint32 lastJob_;
+    std::atomic<bool> sleeping_;
+    juce::WaitableEvent wakeEvent_;
+  };
+
+  // Renders the thread-th of numThreads runs of consecutive voices, keeping
+  // voices the synth put next to each other for their sample data on one
+  // core.  The split depends only on the voice order, so a given worker count
+  // sums the same way every time.
+  void renderShare(int thread, juce::AudioSampleBuffer &buffer, int startSample);
+  void renderJob(Voice *const *voices, int numVoices, int numThreads, juce::AudioSampleBuffer &output,
+                 int startSample, int numSamples);
+  void stop();
+
+  juce::OwnedArray<Worker> workers_;
+  // The job counter in the top 24 bits and the number of threads sharing the
+  // job in the low 8, so a worker can't see one job's thread count with
+  // another's number.
+  std::atomic<juce::uint32> job_;
+  juce::uint32 jobCounter_;
+  std::atomic<int> workersBusy_;
+
+  // The current job; written before job_ is published.
+  Voice *const *voices_;
+  int numVoices_, numThreads_, numSamples_;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RenderPool)
+};
+}
+
+#endif // SFZRENDERPOOL_H_INCLUDED
@@ -6,6 +6,7 @@
  *************************************************************************************/
 #include "SFZSample.h"
 #include "SFZDebug.h"
+#include "SFZSampleRateConverter.h"
 
 bool sfzero::Sample::load(juce::AudioFormatManager *formatManager)
 {
@@ -17,6 +18,7 @@ bool sfzero::Sample::load(juce::AudioFormatManager *formatManager)
   }
   sampleRate_ = reader->sampleRate;
   sampleLength_ = reader->lengthInSamples;
+  numChannels_ = static_cast<int>(reader->numChannels);
   // Read some extra samples, which will be filled with zeros, so interpolation
   // can be done without having to check for the edge all the time.
   jassert(sampleLength_ < std::numeric_limits<int>::max());
@@ -35,6 +37,79 @@ bool sfzero::Sample::load(juce::AudioFormatManager *formatManager)
   return true;
 }
 
+bool sfzero::Sample::loadForStreaming(juce::AudioFormatManager *formatManager, double preloadSeconds,
+                                      const juce::Array<juce::int64> &startFrames,
+                                      const juce::Array<juce::Range<juce::int64>> &loops)
+{
+  std::unique_ptr<juce::AudioFormatReader> reader(formatManager->createReaderFor(file_));
+
+  if (reader == nullptr)
+  {
+    return false;
+  }
+  sampleRate_ = reader->sampleRate;
+  sampleLength_ = reader->lengthInSamples;
+  numChannels_ = juce::jlimit(1, 2, static_cast<int>(reader->numChannels));
+  jassert(sampleLength_ < std::numeric_limits<int>::max());
+
+  juce::StringPairArray *metadata = &reader->metadataValues;
+  int numLoops = metadata->getValue("NumSampleLoops", "0").getIntValue();
+  if (numLoops > 0)
+  {
+    loopStart_ = metadata->getValue("Loop0Start", "0").getLargeIntValue();
+    loopEnd_ = metadata->getValue("Loop0End", "0").getLargeIntValue();
+  }
+
+  // Work out which pages stay resident.
+  numPages_ = static_cast<int>((sampleLength_ + streamPageSize - 1) >> streamPageShift) + 1;
+  juce::BigInteger resident;
+  auto markResident = [&](juce::int64 first, juce::int64 last) {
+    first = juce::jlimit<juce::int64>(0, numPages_ - 1, first >> streamPageShift);
+    last = juce::jlimit<juce::int64>(0, numPages_ - 1, last >> streamPageShift);
+    resident.setRange(static_cast<int>(first), static_cast<int>(last - first + 1), true);
+  };
+  juce::int64 preloadFrames = static_cast<juce::int64>(preloadSeconds * sampleRate_);
+  markResident(0, preloadFrames);
+  for (juce::int64 start : startFrames)
+  {
+    markResident(start, start + preloadFrames);
+  }
+  for (const juce::Range<juce::int64> &loop : loops)
+  {
+    markResident(loop.getStart(), loop.getEnd() + 1);
+  }
+  if (loopStart_ < loopEnd_)
+  {
+    markResident(static_cast<juce::int64>(loopStart_), static_cast<juce::int64>(loopEnd_) + 1);
+  }
+  // The page past the end reads as zeros, like the padding load() adds.
+  resident.setBit(numPages_ - 1);
+
+  // Read them, and point the page table at them.
+  residentPages_.setSize(numChannels_, resident.countNumberOfSetBits() * streamPageSize);
+  residentPages_.clear();
+  pageTable_.calloc(static_cast<size_t>(numChannels_ * numPages_));
+  int nextResident = 0;
+  for (int page = resident.findNextSetBit(0); page >= 0; page = resident.findNextSetBit(page + 1))
+  {
+    int offset = nextResident++ * streamPageSize;
+    reader->read(&residentPages_, offset, streamPageSize, static_cast<juce::int64>(page) << streamPageShift, true,
+                 numChannels_ > 1);
+    for (int channel = 0; channel < numChannels_; ++channel)
+    {
+      pageTable_[channel * numPages_ + page] = residentPages_.getReadPointer(channel, offset);
+    }
+  }
+
+  streamReader_ = std::move(reader);
+  return true;
+}
+
+bool sfzero::Sample::readStreamFrames(float *const *dest, int numChannels, juce::int64 startFrame, int numFrames)
+{
+  return streamReader_ && streamReader_->read(dest, juce::jmin(numChannels, numChannels_), startFrame, numFrames);
+}
+
 sfzero::Sample::~Sample() { delete buffer_; }
 
 juce::String sfzero::Sample::getShortName() { return (file_.getFileName()); }
@@ -52,6 +127,86 @@ juce::AudioSampleBuffer *sfzero::Sample::detachBuffer()
   return result;
 }
 
+void sfzero::Sample::setPCMData(const juce::int16 *data, juce::uint64 numSamples)
+{
+  pcmData_ = data;
+  sampleLength_ = numSamples;
+}
+
+void sfzero::Sample::setCompressedData(const sfzero::CompressedPCM *data)
+{
+  compressed_ = data;
+  sampleLength_ = static_cast<juce::uint64>(data->getNumFrames());
+}
+
+bool sfzero::Sample::convertTo(double sampleRate, juce::Thread *thread)
+{
+  if ((sampleRate <= 0.0) || (sampleRate == sampleRate_) || isStreamed() || !hasData())
+  {
+    conversion_.store(nullptr, std::memory_order_release);
+    return true;
+  }
+  for (const Conversion *conversion : conversions_)
+  {
+    if (conversion->sampleRate == sampleRate)
+    {
+      conversion_.store(conversion, std::memory_order_release);
+      return true;
+    }
+  }
+
+  std::unique_ptr<Conversion> conversion(new Conversion);
+  conversion->sampleRate = sampleRate;
+  conversion->ratio = sampleRate / sampleRate_;
+  if (compressed_ != nullptr)
+  {
+    // Decoded whole and encoded again, so only the load has both in memory.
+    juce::int64 numIn = compressed_->getNumFrames();
+    juce::HeapBlock<juce::int16> decoded(static_cast<size_t>(numIn));
+    compressed_->decode(decoded.get());
+    conversion->numFrames = sfzero::SampleRateConverter::getNumOutputFrames(numIn, conversion->ratio);
+    juce::HeapBlock<juce::int16> pcm(static_cast<size_t>(conversion->numFrames));
+    if (!sfzero::SampleRateConverter::convert(decoded.get(), numIn, pcm.get(), conversion->numFrames, conversion->ratio,
+                                              thread))
+    {
+      return false;
+    }
+    decoded.free();
+    conversion->compressed.reset(new sfzero::CompressedPCM(pcm.get(), conversion->numFrames));
+  }
+  else if (pcmData_ != nullptr)
+  {
+    juce::int64 numIn = static_cast<juce::int64>(sampleLength_);
+    conversion->numFrames = sfzero::SampleRateConverter::getNumOutputFrames(numIn, conversion->ratio);
+    conversion->pcm.malloc(static_cast<size_t>(conversion->numFrames));
+    if (!sfzero::SampleRateConverter::convert(pcmData_, numIn, conversion->pcm.get(), conversion->numFrames,
+                                              conversion->ratio, thread))
+    {
+      return false;
+    }
+  }
+  else
+  {
+    // The input's zero padding converts too, so the copy keeps some.
+    juce::int64 numIn = buffer_->getNumSamples();
+    conversion->numFrames = sfzero::SampleRateConverter::getNumOutputFrames(numIn, conversion->ratio);
+    jassert(conversion->numFrames < std::numeric_limits<int>::max());
+    conversion->buffer.setSize(buffer_->getNumChannels(), static_cast<int>(conversion->numFrames));
+    for (int channel = 0; channel < buffer_->getNumChannels(); ++channel)
+    {
+      if (!sfzero::SampleRateConverter::convert(buffer_->getReadPointer(channel), numIn,
+                                                conversion->buffer.getWritePointer(channel), conversion->numFrames,
+                                                conversion->ratio, thread))
+      {
+        return false;
+      }
+    }
+  }
+
+  conversion_.store(conversions_.add(conversion.release()), std::memory_order_release);
+  return true;
+}
+
 juce::String sfzero::Sample::dump() { return file_.getFullPathName() + "\n"; }
 
 #ifdef JUCE_DEBUG
@@ -8,6 +8,7 @@
 #define SFZSAMPLE_H_INCLUDED
 
 #include "SFZCommon.h"
+#include "SFZSampleCodec.h"
 
 namespace sfzero
 {
@@ -15,10 +16,25 @@ namespace sfzero
 class Sample
 {
 public:
-  explicit Sample(const juce::File &fileIn) : file_(fileIn), buffer_(nullptr), sampleRate_(0), sampleLength_(0), loopStart_(0), loopEnd_(0) {}
-  explicit Sample(double sampleRateIn) : buffer_(nullptr), sampleRate_(sampleRateIn), sampleLength_(0), loopStart_(0), loopEnd_(0) {}
+  explicit Sample(const juce::File &fileIn)
+      : file_(fileIn), buffer_(nullptr), pcmData_(nullptr), compressed_(nullptr), sampleRate_(0), sampleLength_(0), loopStart_(0), loopEnd_(0)
+  {
+  }
+  explicit Sample(double sampleRateIn)
+      : buffer_(nullptr), pcmData_(nullptr), compressed_(nullptr), sampleRate_(sampleRateIn), sampleLength_(0), loopStart_(0), loopEnd_(0)
+  {
+  }
   virtual ~Sample();
 
+  // How the sample's frames are held in memory, which decides the routine
+  // voices fetch them through.  Streamed samples are float32.
+  enum Format
+  {
+    float32,   // an AudioSampleBuffer
+    int16,     // mono 16-bit PCM, read in place
+    compressed // mono 16-bit PCM in CompressedPCM blocks, decoded per voice
+  };
+
   bool load(juce::AudioFormatManager *formatManager);
 
   juce::File getFile() { return (file_); }
@@ -27,11 +43,66 @@ public:
   juce::String getShortName();
   void setBuffer(juce::AudioSampleBuffer *newBuffer);
   juce::AudioSampleBuffer *detachBuffer();
+
+  // Mono 16-bit PCM that voices read in place of a float buffer, e.g. straight
+  // out of a memory-mapped SF2.  The sample doesn't own the data.
+  void setPCMData(const juce::int16 *data, juce::uint64 numSamples);
+  const juce::int16 *getPCMData() const { return pcmData_; }
+  // The same for CompressedPCM, which the sample doesn't own either.
+  void setCompressedData(const CompressedPCM *data);
+  const CompressedPCM *getCompressedData() const { return compressed_; }
+  bool hasData() const
+  {
+    return (buffer_ != nullptr) || (pcmData_ != nullptr) || (compressed_ != nullptr) || isStreamed();
+  }
+  Format getFormat() const { return compressed_ ? compressed : (pcmData_ ? int16 : float32); }
+
+  // Disk streaming: only the pages holding the first preloadSeconds after each
+  // start frame, and every loop, stay in memory.  Voices get the rest from a
+  // StreamBuffer, which the SampleStreamer fills via readStreamFrames().
+  static constexpr int streamPageShift = 12;
+  static constexpr int streamPageSize = 1 << streamPageShift;
+  bool loadForStreaming(juce::AudioFormatManager *formatManager, double preloadSeconds,
+                        const juce::Array<juce::int64> &startFrames, const juce::Array<juce::Range<juce::int64>> &loops);
+  bool isStreamed() const { return streamReader_ != nullptr; }
+  int getNumChannels() const { return numChannels_; }
+  // Per-page pointers into the resident data; nullptr for streamed pages.
+  const float *const *getResidentPages(int channel) const { return pageTable_ + juce::jmin(channel, numChannels_ - 1) * numPages_; }
+  // I/O thread only.
+  bool readStreamFrames(float *const *dest, int numChannels, juce::int64 startFrame, int numFrames);
   juce::String dump();
   juce::uint64 getSampleLength() const { return sampleLength_; }
   juce::uint64 getLoopStart() const { return loopStart_; }
   juce::uint64 getLoopEnd() const { return loopEnd_; }
 
+  // A copy resampled to a device rate at load time, which voices at that
+  // rate play in place of the original, so they only have to pitch it.
+  // Source positions scale by ratio.  Each format converts to the same
+  // format.
+  struct Conversion
+  {
+    double sampleRate = 0.0;
+    double ratio = 1.0; // sampleRate / the sample's own rate
+    juce::int64 numFrames = 0;
+    juce::AudioSampleBuffer buffer;
+    juce::HeapBlock<juce::int16> pcm;
+    std::unique_ptr<CompressedPCM> compressed;
+
+    Format getFormat() const { return compressed ? Sample::compressed : (pcm ? Sample::int16 : float32); }
+  };
+  // Resamples to sampleRate, or reuses an earlier conversion to it, and
+  // publishes the result; 0 withdraws it.  Streamed samples, and ones already
+  // at sampleRate, are left alone.  One thread at a time, never the audio
+  // thread.  Returns false if thread was asked to exit first.
+  bool convertTo(double sampleRate, juce::Thread *thread = nullptr);
+  // The published conversion if it's to sampleRate, else nullptr.  Any
+  // thread; a conversion stays valid as long as the sample does.
+  const Conversion *getConversion(double sampleRate) const
+  {
+    const Conversion *conversion = conversion_.load(std::memory_order_acquire);
+    return (conversion != nullptr && conversion->sampleRate == sampleRate) ? conversion : nullptr;
+  }
+
 #ifdef JUCE_DEBUG
   void checkIfZeroed(const char *where);
 
@@ -40,8 +111,19 @@ public:
 private:
   juce::File file_;
   juce::AudioSampleBuffer *buffer_;
+  const juce::int16 *pcmData_;
+  const CompressedPCM *compressed_;
   double sampleRate_;
   juce::uint64 sampleLength_, loopStart_, loopEnd_;
+  int numChannels_ = 1;
+
+  std::unique_ptr<juce::AudioFormatReader> streamReader_;
+  juce::AudioSampleBuffer residentPages_;
+  juce::HeapBlock<const float *> pageTable_;
+  int numPages_ = 0;
+
+  juce::OwnedArray<Conversion> conversions_; // one per rate converted to
+  std::atomic<const Conversion *> conversion_{nullptr};
 
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Sample)
 };
@@ -0,0 +1,161 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#include "SFZSampleCodec.h"
+
+// A block is its first frame (two bytes, little-endian), a byte holding the
+// residuals' width in its low five bits and the predictor's order in its top
+// bit, and then the residuals of the rest of its frames, packed LSB first.
+static const int blockHeaderBytes = 3;
+static const juce::uint8 secondOrderBit = 0x80;
+static const juce::uint8 widthMask = 0x1f;
+
+static inline juce::uint32 zigzag(juce::int32 value)
+{
+  return (static_cast<juce::uint32>(value) << 1) ^ static_cast<juce::uint32>(value >> 31);
+}
+
+static inline juce::int32 unzigzag(juce::uint32 value)
+{
+  return static_cast<juce::int32>(value >> 1) ^ -static_cast<juce::int32>(value & 1);
+}
+
+// The prediction of frame i of a block from the ones before it.  The second
+// frame only has one before it, so both orders predict it the same way.
+static inline juce::int32 predict(const juce::int16 *frames, int i, bool secondOrder)
+{
+  return (secondOrder && i >= 2) ? 2 * frames[i - 1] - frames[i - 2] : frames[i - 1];
+}
+
+static int bitWidth(juce::uint32 value)
+{
+  int width = 0;
+  while (value != 0)
+  {
+    ++width;
+    value >>= 1;
+  }
+  return width;
+}
+
+// The narrower order for count frames, and its width.
+static void chooseOrder(const juce::int16 *frames, int count, bool &secondOrder, int &width)
+{
+  juce::uint32 widest[2] = {0, 0};
+  for (int i = 1; i < count; ++i)
+  {
+    widest[0] |= zigzag(frames[i] - predict(frames, i, false));
+    widest[1] |= zigzag(frames[i] - predict(frames, i, true));
+  }
+  int firstWidth = bitWidth(widest[0]), secondWidth = bitWidth(widest[1]);
+  secondOrder = secondWidth < firstWidth;
+  width = secondOrder ? secondWidth : firstWidth;
+}
+
+static size_t getBlockBytes(int count, int width)
+{
+  return blockHeaderBytes + (static_cast<size_t>(count - 1) * static_cast<size_t>(width) + 7) / 8;
+}
+
+sfzero::CompressedPCM::CompressedPCM(const juce::int16 *pcm, juce::int64 numFrames)
+    : numFrames_(numFrames), numBlocks_(static_cast<int>((numFrames + blockSize - 1) >> blockShift)), dataSize_(0)
+{
+  // Widths first, to size the data exactly.
+  offsets_.malloc(static_cast<size_t>(numBlocks_ + 1));
+  juce::HeapBlock<juce::uint8> headers(static_cast<size_t>(juce::jmax(1, numBlocks_)));
+  for (int block = 0; block < numBlocks_; ++block)
+  {
+    juce::int64 start = static_cast<juce::int64>(block) << blockShift;
+    int count = static_cast<int>(juce::jmin<juce::int64>(blockSize, numFrames_ - start));
+    bool secondOrder;
+    int width;
+    chooseOrder(pcm + start, count, secondOrder, width);
+    headers[block] = static_cast<juce::uint8>(width | (secondOrder ? secondOrderBit : 0));
+    jassert(dataSize_ < std::numeric_limits<juce::uint32>::max());
+    offsets_[block] = static_cast<juce::uint32>(dataSize_);
+    dataSize_ += getBlockBytes(count, width);
+  }
+  offsets_[numBlocks_] = static_cast<juce::uint32>(dataSize_);
+
+  data_.malloc(juce::jmax<size_t>(1, dataSize_));
+  for (int block = 0; block < numBlocks_; ++block)
+  {
+    juce::int64 start = static_cast<juce::int64>(block) << blockShift;
+    int count = static_cast<int>(juce::jmin<juce::int64>(blockSize, numFrames_ - start));
+    const juce::int16 *frames = pcm + start;
+    bool secondOrder = (headers[block] & secondOrderBit) != 0;
+    int width = headers[block] & widthMask;
+
+    juce::uint8 *out = data_ + offsets_[block];
+    juce::uint16 first = static_cast<juce::uint16>(frames[0]);
+    *out++ = static_cast<juce::uint8>(first & 0xff);
+    *out++ = static_cast<juce::uint8>(first >> 8);
+    *out++ = headers[block];
+
+    juce::uint64 bits = 0;
+    int numBits = 0;
+    for (int i = 1; i < count; ++i)
+    {
+      bits |= static_cast<juce::uint64>(zigzag(frames[i] - predict(frames, i, secondOrder))) << numBits;
+      numBits += width;
+      for (; numBits >= 8; numBits -= 8, bits >>= 8)
+      {
+        *out++ = static_cast<juce::uint8>(bits);
+      }
+    }
+    if (numBits > 0)
+    {
+      *out++ = static_cast<juce::uint8>(bits);
+    }
+    jassert(out == data_ + offsets_[block + 1]);
+  }
+}
+
+void sfzero::CompressedPCM::decodeBlock(int block, juce::int16 *out) const
+{
+  if (!juce::isPositiveAndBelow(block, numBlocks_))
+  {
+    std::fill(out, out + blockSize, static_cast<juce::int16>(0));
+    return;
+  }
+
+  juce::int64 start = static_cast<juce::int64>(block) << blockShift;
+  int count = static_cast<int>(juce::jmin<juce::int64>(blockSize, numFrames_ - start));
+  const juce::uint8 *in = data_ + offsets_[block];
+  out[0] = static_cast<juce::int16>(in[0] | (in[1] << 8));
+  bool secondOrder = (in[2] & secondOrderBit) != 0;
+  int width = in[2] & widthMask;
+  juce::uint32 mask = (juce::uint32(1) << width) - 1;
+  in += blockHeaderBytes;
+
+  juce::uint64 bits = 0;
+  int numBits = 0;
+  for (int i = 1; i < count; ++i)
+  {
+    while (numBits < width)
+    {
+      bits |= static_cast<juce::uint64>(*in++) << numBits;
+      numBits += 8;
+    }
+    juce::int32 residual = unzigzag(static_cast<juce::uint32>(bits) & mask);
+    bits >>= width;
+    numBits -= width;
+    out[i] = static_cast<juce::int16>(predict(out, i, secondOrder) + residual);
+  }
+  std::fill(out + count, out + blockSize, static_cast<juce::int16>(0));
+}
+
+void sfzero::CompressedPCM::decode(juce::int16 *out) const
+{
+  juce::int16 frames[blockSize];
+  for (int block = 0; block < numBlocks_; ++block)
+  {
+    juce::int64 start = static_cast<juce::int64>(block) << blockShift;
+    int count = static_cast<int>(juce::jmin<juce::int64>(blockSize, numFrames_ - start));
+    decodeBlock(block, frames);
+    std::copy(frames, frames + count, out + start);
+  }
+}
@@ -0,0 +1,92 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#ifndef SFZSAMPLECODEC_H_INCLUDED
+#define SFZSAMPLECODEC_H_INCLUDED
+
+#include "SFZCommon.h"
+
+namespace sfzero
+{
+
+// Mono 16-bit PCM, losslessly compressed in blocks of blockSize frames that
+// decode independently.  Each block stores its first frame, then the
+// residuals of whichever of a first- or second-order predictor suits it
+// better, zigzagged and packed at the block's widest residual's width.
+// Sampled instruments are smooth enough that this usually takes 40-60% of
+// the space of plain 16-bit PCM.
+class CompressedPCM
+{
+public:
+  static constexpr int blockShift = 8;
+  static constexpr int blockSize = 1 << blockShift;
+
+  CompressedPCM(const juce::int16 *pcm, juce::int64 numFrames);
+
+  juce::int64 getNumFrames() const { return numFrames_; }
+  int getNumBlocks() const { return numBlocks_; }
+  size_t getBytesUsed() const { return dataSize_ + static_cast<size_t>(numBlocks_ + 1) * sizeof(juce::uint32); }
+  // Where block's data starts, for ordering voices by what they read.
+  const juce::uint8 *getBlockData(int block) const { return data_ + offsets_[juce::jlimit(0, numBlocks_ - 1, block)]; }
+
+  // Decodes block into out's blockSize frames; those past the end are zero.
+  void decodeBlock(int block, juce::int16 *out) const;
+  // Decodes every frame into out, which holds getNumFrames().
+  void decode(juce::int16 *out) const;
+
+  // The last few blocks a voice decoded, by block number.  Direct-mapped on
+  // the low bits, so a run of numSlots consecutive blocks (interpolation taps
+  // straddling a boundary, a short loop) stays resident.
+  struct Cache
+  {
+    static constexpr int numSlots = 4;
+
+    const CompressedPCM *source = nullptr;
+    int blocks[numSlots] = {-1, -1, -1, -1};
+    juce::int16 frames[numSlots][blockSize];
+
+    void reset(const CompressedPCM *newSource)
+    {
+      source = newSource;
+      for (int &block : blocks)
+      {
+        block = -1;
+      }
+    }
+  };
+
+private:
+  juce::int64 numFrames_;
+  int numBlocks_;
+  juce::HeapBlock<juce::uint32> offsets_; // numBlocks_ + 1 of them, into data_
+  juce::HeapBlock<juce::uint8> data_;
+  size_t dataSize_;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CompressedPCM)
+};
+
+// What a voice reads a compressed sample through, decoding blocks into its
+// cache as it reaches them.  Values are scaled like uncompressed PCM.
+struct CompressedChannel
+{
+  const CompressedPCM *data;
+  CompressedPCM::Cache *cache;
+
+  float valueAt(int index) const
+  {
+    int block = index >> CompressedPCM::blockShift;
+    int slot = block & (CompressedPCM::Cache::numSlots - 1);
+    if (cache->blocks[slot] != block)
+    {
+      data->decodeBlock(block, cache->frames[slot]);
+      cache->blocks[slot] = block;
+    }
+    return cache->frames[slot][index & (CompressedPCM::blockSize - 1)] / 32767.0f;
+  }
+};
+}
+
+#endif // SFZSAMPLECODEC_H_INCLUDED
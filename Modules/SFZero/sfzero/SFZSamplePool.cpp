@@ -0,0 +1,75 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#include "SFZSamplePool.h"
+
+juce::CriticalSection &sfzero::SamplePool::getLock()
+{
+  static juce::CriticalSection lock;
+  return lock;
+}
+
+juce::ReferenceCountedArray<sfzero::SamplePool::Entry> &sfzero::SamplePool::getEntries()
+{
+  static juce::ReferenceCountedArray<Entry> entries;
+  return entries;
+}
+
+juce::String sfzero::SamplePool::getKey(const juce::File &file)
+{
+  return file.getFullPathName() + ":" + juce::String(file.getSize()) + ":" +
+         juce::String(file.getLastModificationTime().toMilliseconds());
+}
+
+sfzero::SamplePool::Entry::Ptr sfzero::SamplePool::find(const juce::String &key)
+{
+  // References are only taken under the lock, and purgeUnused() only drops
+  // entries while it holds it, so nothing can find an entry being freed.
+  const juce::ScopedLock locker(getLock());
+  for (Entry *entry : getEntries())
+  {
+    if (entry->key == key)
+    {
+      return entry;
+    }
+  }
+  return nullptr;
+}
+
+void sfzero::SamplePool::add(Entry *entry)
+{
+  const juce::ScopedLock locker(getLock());
+  getEntries().addIfNotAlreadyThere(entry);
+}
+
+int sfzero::SamplePool::purgeUnused()
+{
+  const juce::ScopedLock locker(getLock());
+  juce::ReferenceCountedArray<Entry> &entries = getEntries();
+  int numPurged = 0;
+  for (int i = entries.size(); --i >= 0;)
+  {
+    if (entries.getObjectPointerUnchecked(i)->getReferenceCount() == 1)
+    {
+      entries.remove(i);
+      ++numPurged;
+    }
+  }
+  return numPurged;
+}
+
+juce::int64 sfzero::SamplePool::getBytesUsed()
+{
+  const juce::ScopedLock locker(getLock());
+  juce::int64 bytes = 0;
+  for (Entry *entry : getEntries())
+  {
+    bytes += static_cast<juce::int64>(entry->buffer.getNumChannels()) * entry->buffer.getNumSamples() * sizeof(float);
+    bytes += entry->numPCMFrames * static_cast<juce::int64>(sizeof(juce::int16));
+    bytes += entry->compressed ? static_cast<juce::int64>(entry->compressed->getBytesUsed()) : 0;
+  }
+  return bytes;
+}
@@ -0,0 +1,59 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#ifndef SFZSAMPLEPOOL_H_INCLUDED
+#define SFZSAMPLEPOOL_H_INCLUDED
+
+#include "SFZCommon.h"
+#include "SFZSampleCodec.h"
+
+namespace sfzero
+{
+
+// Sample data shared between sounds: a SoundFont's whole sample chunk,
+// converted to float (or kept as 16-bit PCM, or compressed) once and handed
+// to every sound loaded from the same file in the same format.  Entries are reference counted, and the pool keeps a reference of
+// its own, so a font that's unloaded and loaded again, or layered twice,
+// finds its samples still here until purgeUnused() drops them.
+class SamplePool
+{
+public:
+  class Entry : public juce::ReferenceCountedObject
+  {
+  public:
+    typedef juce::ReferenceCountedObjectPtr<Entry> Ptr;
+
+    Entry(const juce::String &keyIn, int numChannels, int numSamples) : key(keyIn), buffer(numChannels, numSamples) {}
+
+    const juce::String key;
+    juce::AudioSampleBuffer buffer;
+    // Entries in the other formats leave buffer empty and hold one of these.
+    juce::HeapBlock<juce::int16> pcm;
+    juce::int64 numPCMFrames = 0;
+    std::unique_ptr<CompressedPCM> compressed;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Entry)
+  };
+
+  // Identifies a file's samples by its path, size and modification time, so
+  // an edited file isn't matched to its old samples.
+  static juce::String getKey(const juce::File &file);
+
+  // The entry added under key, or nullptr.
+  static Entry::Ptr find(const juce::String &key);
+  // Shares an entry once its buffer is completely filled.
+  static void add(Entry *entry);
+  // Drops the entries only the pool still holds, returning how many.
+  static int purgeUnused();
+  static juce::int64 getBytesUsed();
+
+private:
+  static juce::CriticalSection &getLock();
+  static juce::ReferenceCountedArray<Entry> &getEntries();
+};
+}
+
+#endif // SFZSAMPLEPOOL_H_INCLUDED
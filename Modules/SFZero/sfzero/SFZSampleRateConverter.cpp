@@ -0,0 +1,129 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#include "SFZSampleRateConverter.h"
+
+// Kernel values per zero crossing; positions between them are interpolated.
+static const int srcKernelStepsPerCrossing = 512;
+// Stopband attenuation of about 90dB.
+static const double srcKaiserBeta = 9.0;
+// Cut off a little below Nyquist, so the transition band stays clear of
+// aliasing.
+static const double srcCutoff = 0.95;
+
+static double besselI0(double x)
+{
+  double sum = 1.0, term = 1.0;
+  for (int k = 1; k < 50 && term > sum * 1.0e-12; ++k)
+  {
+    double half = x / (2.0 * k);
+    term *= half * half;
+    sum += term;
+  }
+  return sum;
+}
+
+// One side of the windowed sinc, from the centre out to the last zero
+// crossing, plus a guard entry so interpolation never reads past the end.
+static const float *getSrcKernel()
+{
+  struct Kernel
+  {
+    float values[sfzero::SampleRateConverter::zeroCrossings * srcKernelStepsPerCrossing + 2];
+
+    Kernel()
+    {
+      const int numSteps = sfzero::SampleRateConverter::zeroCrossings * srcKernelStepsPerCrossing;
+      const double i0Beta = besselI0(srcKaiserBeta);
+      for (int step = 0; step <= numSteps; ++step)
+      {
+        double x = static_cast<double>(step) / srcKernelStepsPerCrossing;
+        double px = juce::MathConstants<double>::pi * x;
+        double sinc = (step == 0) ? 1.0 : sin(px) / px;
+        double w = x / sfzero::SampleRateConverter::zeroCrossings;
+        double window = besselI0(srcKaiserBeta * sqrt(juce::jmax(0.0, 1.0 - w * w))) / i0Beta;
+        values[step] = static_cast<float>(sinc * window);
+      }
+      values[numSteps + 1] = 0.0f;
+    }
+  };
+
+  static const Kernel kernel;
+  return kernel.values;
+}
+
+static inline float srcReadFrame(const float *in, juce::int64 numIn, juce::int64 index)
+{
+  return (index >= 0 && index < numIn) ? in[index] : 0.0f;
+}
+
+static inline float srcReadFrame(const juce::int16 *in, juce::int64 numIn, juce::int64 index)
+{
+  return (index >= 0 && index < numIn) ? in[index] / 32767.0f : 0.0f;
+}
+
+static inline void srcWriteFrame(float *out, double value) { *out = static_cast<float>(value); }
+
+static inline void srcWriteFrame(juce::int16 *out, double value)
+{
+  *out = static_cast<juce::int16>(juce::jlimit(-32768, 32767, juce::roundToInt(value * 32767.0)));
+}
+
+template <typename SampleType>
+static bool convertFrames(const SampleType *in, juce::int64 numIn, SampleType *out, juce::int64 numOut, double ratio,
+                   juce::Thread *thread)
+{
+  const float *kernel = getSrcKernel();
+  // The kernel is stretched by 1 / scale to band-limit a downsample.
+  const double scale = juce::jmin(1.0, ratio) * srcCutoff;
+  const double halfWidth = sfzero::SampleRateConverter::zeroCrossings / scale;
+  const double stepsPerFrame = scale * srcKernelStepsPerCrossing;
+  const int maxStep = sfzero::SampleRateConverter::zeroCrossings * srcKernelStepsPerCrossing;
+
+  for (juce::int64 frame = 0; frame < numOut; ++frame)
+  {
+    if (thread != nullptr && (frame & 0xffff) == 0 && thread->threadShouldExit())
+    {
+      return false;
+    }
+
+    const double position = frame / ratio;
+    const juce::int64 first = static_cast<juce::int64>(std::ceil(position - halfWidth));
+    const juce::int64 last = static_cast<juce::int64>(std::floor(position + halfWidth));
+    double sum = 0.0;
+    for (juce::int64 index = first; index <= last; ++index)
+    {
+      double step = std::abs(position - index) * stepsPerFrame;
+      int whole = static_cast<int>(step);
+      if (whole >= maxStep)
+      {
+        continue;
+      }
+      double mix = step - whole;
+      double tap = kernel[whole] + (kernel[whole + 1] - kernel[whole]) * mix;
+      sum += tap * srcReadFrame(in, numIn, index);
+    }
+    srcWriteFrame(out + frame, sum * scale);
+  }
+  return true;
+}
+
+juce::int64 sfzero::SampleRateConverter::getNumOutputFrames(juce::int64 numIn, double ratio)
+{
+  return static_cast<juce::int64>(std::ceil(numIn * ratio));
+}
+
+bool sfzero::SampleRateConverter::convert(const float *in, juce::int64 numIn, float *out, juce::int64 numOut,
+                                          double ratio, juce::Thread *thread)
+{
+  return convertFrames(in, numIn, out, numOut, ratio, thread);
+}
+
+bool sfzero::SampleRateConverter::convert(const juce::int16 *in, juce::int64 numIn, juce::int16 *out,
+                                          juce::int64 numOut, double ratio, juce::Thread *thread)
+{
+  return convertFrames(in, numIn, out, numOut, ratio, thread);
+}
@@ -0,0 +1,40 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#ifndef SFZSAMPLERATECONVERTER_H_INCLUDED
+#define SFZSAMPLERATECONVERTER_H_INCLUDED
+
+#include "SFZCommon.h"
+
+namespace sfzero
+{
+
+// Offline band-limited resampling: a Kaiser-windowed sinc evaluated from a
+// finely sampled table, so any ratio gets its own polyphase kernel.  When
+// downsampling the kernel is widened to cut off below the new Nyquist.  Far
+// too slow for the audio thread; Sample::convertTo() runs it at load time.
+class SampleRateConverter
+{
+public:
+  // Zero crossings of the kernel on each side of the centre, at the source
+  // rate (more when downsampling).
+  static constexpr int zeroCrossings = 16;
+
+  // The frames numIn source frames become at ratio (new rate / old rate).
+  static juce::int64 getNumOutputFrames(juce::int64 numIn, double ratio);
+
+  // Fills numOut frames of out from in, which holds numIn frames; reads
+  // beyond either end are zeros.  16-bit input is scaled as Voice reads it,
+  // and 16-bit output is rounded and clipped.  Returns false, leaving out
+  // partly written, if thread was asked to exit.
+  static bool convert(const float *in, juce::int64 numIn, float *out, juce::int64 numOut, double ratio,
+                      juce::Thread *thread = nullptr);
+  static bool convert(const juce::int16 *in, juce::int64 numIn, juce::int16 *out, juce::int64 numOut, double ratio,
+                      juce::Thread *thread = nullptr);
+};
+}
+
+#endif // SFZSAMPLERATECONVERTER_H_INCLUDED
@@ -9,17 +9,10 @@
 #include "SFZRegion.h"
 #include "SFZSample.h"
 
-sfzero::Sound::Sound(const juce::File &fileIn) : file_(fileIn) {}
+sfzero::Sound::Sound(const juce::File &fileIn) : file_(fileIn), streaming_(false), streamPreloadSeconds_(0.5) {}
 sfzero::Sound::~Sound()
 {
-  int numRegions = regions_.size();
-
-  for (int i = 0; i < numRegions; ++i)
-  {
-    delete regions_[i];
-    regions_.set(i, nullptr);
-  }
-
+  // The regions go with the arena.
   for (juce::HashMap<juce::String, sfzero::Sample *>::Iterator i(samples_); i.next();)
   {
     delete i.getValue();
@@ -33,7 +26,13 @@ bool sfzero::Sound::appliesToNote(int /*midiNoteNumber*/)
 }
 
 bool sfzero::Sound::appliesToChannel(int /*midiChannel*/) { return true; }
-void sfzero::Sound::addRegion(sfzero::Region *region) { regions_.add(region); }
+sfzero::Region *sfzero::Sound::addRegion(const sfzero::Region &region)
+{
+  sfzero::Region *copy = arena_.allocate<sfzero::Region>(1);
+  *copy = region;
+  regions_.add(copy);
+  return copy;
+}
 sfzero::Sample *sfzero::Sound::addSample(juce::String path, juce::String defaultPath)
 {
   path = path.replaceCharacter('\\', '/');
@@ -76,6 +75,7 @@ void sfzero::Sound::loadRegions()
   sfzero::Reader reader(this);
 
   reader.read(file_);
+  regionIndex_.build(regions_, arena_);
 }
 
 void sfzero::Sound::loadSamples(juce::AudioFormatManager *formatManager, double *progressVar, juce::Thread *thread)
@@ -85,24 +85,97 @@ void sfzero::Sound::loadSamples(juce::AudioFormatManager *formatManager, double
     *progressVar = 0.0;
   }
 
-  double numSamplesLoaded = 1.0, numSamples = samples_.size();
+  juce::Array<sfzero::Sample *> samples;
+  juce::HashMap<sfzero::Sample *, int> sampleIndices;
   for (juce::HashMap<juce::String, sfzero::Sample *>::Iterator i(samples_); i.next();)
   {
-    sfzero::Sample *sample = i.getValue();
-    bool ok = sample->load(formatManager);
-    if (!ok)
+    sampleIndices.set(i.getValue(), samples.size());
+    samples.add(i.getValue());
+  }
+  int numSamples = samples.size();
+
+  // When streaming, keep the pages every region starts or loops in resident.
+  // One pass over the regions gathers them for every sample.
+  struct StreamPoints
+  {
+    juce::Array<juce::int64> startFrames;
+    juce::Array<juce::Range<juce::int64>> loops;
+  };
+  juce::OwnedArray<StreamPoints> streamPoints;
+  if (streaming_)
+  {
+    for (int i = 0; i < numSamples; ++i)
+    {
+      streamPoints.add(new StreamPoints());
+    }
+    for (sfzero::Region *region : regions_)
+    {
+      if (region->sample == nullptr || !sampleIndices.contains(region->sample))
+      {
+        continue;
+      }
+      StreamPoints *points = streamPoints[sampleIndices[region->sample]];
+      points->startFrames.addIfNotAlreadyThere(region->offset);
+      if (region->loop_start < region->loop_end)
+      {
+        points->loops.add(juce::Range<juce::int64>(region->loop_start, region->loop_end));
+      }
+    }
+  }
+
+  // Decode the samples on a pool of threads; this thread just reports
+  // progress and watches for cancellation.
+  juce::HeapBlock<bool> loaded(numSamples, true);
+  std::atomic<int> numFinished(0);
+  std::atomic<bool> cancelled(false);
+  auto loadSample = [&](int index) {
+    if (!cancelled.load())
+    {
+      sfzero::Sample *sample = samples.getUnchecked(index);
+      if (streaming_)
+      {
+        const StreamPoints *points = streamPoints.getUnchecked(index);
+        loaded[index] =
+            sample->loadForStreaming(formatManager, streamPreloadSeconds_, points->startFrames, points->loops);
+      }
+      else
+      {
+        loaded[index] = sample->load(formatManager);
+      }
+    }
+    numFinished.fetch_add(1);
+  };
+
+  {
+    juce::ThreadPool pool(juce::jmax(1, juce::jmin(juce::SystemStats::getNumCpus(), numSamples)));
+    for (int i = 0; i < numSamples; ++i)
     {
-      addError("Couldn't load sample \"" + sample->getShortName() + "\"");
+      pool.addJob([&loadSample, i] { loadSample(i); });
     }
 
-    numSamplesLoaded += 1.0;
-    if (progressVar)
+    while (numFinished.load() < numSamples)
     {
-      *progressVar = numSamplesLoaded / numSamples;
+      if (progressVar)
+      {
+        *progressVar = static_cast<double>(numFinished.load()) / numSamples;
+      }
+      if (thread && thread->threadShouldExit())
+      {
+        cancelled.store(true);
+      }
+      juce::Thread::sleep(10);
     }
-    if (thread && thread->threadShouldExit())
+  }
+
+  if (cancelled.load())
+  {
+    return;
+  }
+  for (int i = 0; i < numSamples; ++i)
+  {
+    if (!loaded[i])
     {
-      return;
+      addError("Couldn't load sample \"" + samples.getUnchecked(i)->getShortName() + "\"");
     }
   }
 
@@ -112,6 +185,24 @@ void sfzero::Sound::loadSamples(juce::AudioFormatManager *formatManager, double
   }
 }
 
+bool sfzero::Sound::convertSamples(double sampleRate, juce::Thread *thread)
+{
+  for (juce::HashMap<juce::String, sfzero::Sample *>::Iterator i(samples_); i.next();)
+  {
+    if (!i.getValue()->convertTo(sampleRate, thread))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void sfzero::Sound::setStreaming(bool shouldStream, double preloadSeconds)
+{
+  streaming_ = shouldStream;
+  streamPreloadSeconds_ = preloadSeconds;
+}
+
 sfzero::Region *sfzero::Sound::getRegionFor(int note, int velocity, sfzero::Region::Trigger trigger)
 {
   int numRegions = regions_.size();
@@ -128,6 +219,15 @@ sfzero::Region *sfzero::Sound::getRegionFor(int note, int velocity, sfzero::Regi
   return nullptr;
 }
 
+const juce::Array<sfzero::Region *> &sfzero::Sound::getRegionsForSubsound(int /*whichSubsound*/) { return regions_; }
+
+const sfzero::RegionIndex &sfzero::Sound::getRegionIndex(int /*whichSubsound*/) { return regionIndex_; }
+
+sfzero::Region *sfzero::Sound::getRegionFor(int note, int velocity, sfzero::Region::Trigger trigger, int whichSubsound)
+{
+  return getMatchingRegions(note, velocity, trigger, whichSubsound).getFirst();
+}
+
 int sfzero::Sound::getNumRegions() { return regions_.size(); }
 
 sfzero::Region *sfzero::Sound::regionAt(int index) { return regions_[index]; }
@@ -7,7 +7,9 @@
 #ifndef SFZSOUND_H_INCLUDED
 #define SFZSOUND_H_INCLUDED
 
+#include "SFZArena.h"
 #include "SFZRegion.h"
+#include "SFZRegionIndex.h"
 
 namespace sfzero
 {
@@ -25,21 +27,55 @@ public:
   bool appliesToNote(int midiNoteNumber) override;
   bool appliesToChannel(int midiChannel) override;
 
-  void addRegion(Region *region); // Takes ownership of the region.
+  Region *addRegion(const Region &region); // Copies it into the sound's arena.
   Sample *addSample(juce::String path, juce::String defaultPath = {});
   void addError(const juce::String &message);
   void addUnsupportedOpcode(const juce::String &opcode);
+  void addWarning(const juce::String &message) { warnings_.add(message); }
 
   virtual void loadRegions();
   virtual void loadSamples(juce::AudioFormatManager *formatManager, double *progressVar = nullptr,
                            juce::Thread *thread = nullptr);
 
+  // Once the samples are loaded, resamples them all to sampleRate, so voices
+  // at that rate only have to pitch them (see Sample::convertTo()); 0 goes
+  // back to converting as they play.  Returns false if thread was asked to
+  // exit first.
+  virtual bool convertSamples(double sampleRate, juce::Thread *thread = nullptr);
+
+  // Set before loadSamples() to stream samples from disk: only preloadSeconds
+  // from each start point, and the loops, are kept in memory.  Voices play the
+  // rest through the buffers Synth::setStreamingEnabled() gives them.
+  void setStreaming(bool shouldStream, double preloadSeconds = 0.5);
+  bool isStreaming() const { return streaming_; }
+
   Region *getRegionFor(int note, int velocity, Region::Trigger trigger = Region::attack);
   int getNumRegions();
   Region *regionAt(int index);
 
-  const juce::StringArray &getErrors() { return errors_; }
-  const juce::StringArray &getWarnings() { return warnings_; }
+  // Lookups against a given subsound's region table. Unlike useSubsound(),
+  // these never modify the sound, so any thread may call them once loaded.
+  virtual const juce::Array<Region *> &getRegionsForSubsound(int whichSubsound);
+  Region *getRegionFor(int note, int velocity, Region::Trigger trigger, int whichSubsound);
+  // The index built over a subsound's region table by loadRegions().
+  virtual const RegionIndex &getRegionIndex(int whichSubsound);
+  RegionIndex::Matches getMatchingRegions(int note, int velocity, Region::Trigger trigger, int whichSubsound)
+  {
+    return getRegionIndex(whichSubsound).getMatches(note, velocity, trigger);
+  }
+
+  // Whether a subsound's samples are in memory yet. Sounds that load
+  // progressively return false until then, and the synth skips their notes.
+  virtual bool isSubsoundReady(int /*whichSubsound*/) { return true; }
+  // The same for one note of a subsound.  Sounds that page their samples in
+  // can have some notes ready before the rest.
+  virtual bool isNoteReady(int whichSubsound, int /*note*/) { return isSubsoundReady(whichSubsound); }
+  // Asks for a range of a subsound's notes to be loaded ahead of the rest,
+  // or at all when only the notes asked for are loaded.  Lock-free.
+  virtual void requestNotes(int /*whichSubsound*/, int /*lowNote*/, int /*highNote*/) {}
+
+  const juce::StringArray &getErrors() const { return errors_; }
+  const juce::StringArray &getWarnings() const { return warnings_; }
 
   virtual int numSubsounds();
   virtual juce::String subsoundName(int whichSubsound);
@@ -50,13 +86,21 @@ public:
   juce::Array<Region *> &getRegions() { return regions_; }
   juce::File &getFile() { return file_; }
 
+protected:
+  // Holds the regions and their indexes, so they're all freed together.
+  Arena &getArena() { return arena_; }
+
 private:
+  Arena arena_;
   juce::File file_;
   juce::Array<Region *> regions_;
+  RegionIndex regionIndex_;
   juce::HashMap<juce::String, Sample *> samples_;
   juce::StringArray errors_;
   juce::StringArray warnings_;
   juce::HashMap<juce::String, juce::String> unsupportedOpcodes_;
+  bool streaming_;
+  double streamPreloadSeconds_;
 
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Sound)
 };
@@ -0,0 +1,134 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#include "SFZStream.h"
+#include "SFZSample.h"
+
+static const juce::uint64 fillPositionMask = (static_cast<juce::uint64>(1) << 48) - 1;
+
+sfzero::StreamBuffer::StreamBuffer(int capacity)
+    : ring_(2, capacity), ringMask_(capacity - 1), fillState_(0), sample_(nullptr), readPosition_(0), underruns_(0),
+      generation_(0), startFrame_(0)
+{
+  jassert(juce::isPowerOfTwo(capacity));
+  ring_.clear();
+}
+
+juce::uint64 sfzero::StreamBuffer::packFillState(juce::uint64 generation, juce::int64 position)
+{
+  return (generation << positionBits) | (static_cast<juce::uint64>(position) & fillPositionMask);
+}
+
+void sfzero::StreamBuffer::start(sfzero::Sample *sample, juce::int64 startFrame)
+{
+  startFrame_ = startFrame;
+  readPosition_.store(startFrame, std::memory_order_relaxed);
+  sample_.store(sample, std::memory_order_release);
+  fillState_.store(packFillState(++generation_, startFrame), std::memory_order_release);
+}
+
+void sfzero::StreamBuffer::stop()
+{
+  sample_.store(nullptr, std::memory_order_release);
+  fillState_.store(packFillState(++generation_, 0), std::memory_order_release);
+}
+
+void sfzero::StreamBuffer::getChannels(sfzero::StreamChannel *channels, int numChannels, bool *underrun) const
+{
+  sfzero::Sample *sample = sample_.load(std::memory_order_relaxed);
+  juce::int64 fill = static_cast<juce::int64>(fillState_.load(std::memory_order_acquire) & fillPositionMask);
+  juce::int64 ringStart = juce::jmax(startFrame_, fill - ring_.getNumSamples() + guardFrames);
+
+  for (int channel = 0; channel < numChannels; ++channel)
+  {
+    sfzero::StreamChannel &result = channels[channel];
+    result.pages = sample->getResidentPages(channel);
+    result.pageShift = sfzero::Sample::streamPageShift;
+    result.pageMask = sfzero::Sample::streamPageSize - 1;
+    result.ring = ring_.getReadPointer(juce::jmin(channel, ring_.getNumChannels() - 1));
+    result.ringMask = ringMask_;
+    result.ringStart = ringStart;
+    result.ringEnd = fill;
+    result.underrun = underrun;
+  }
+}
+
+bool sfzero::StreamBuffer::service()
+{
+  static const int chunkFrames = 8192;
+
+  juce::uint64 state = fillState_.load(std::memory_order_acquire);
+  sfzero::Sample *sample = sample_.load(std::memory_order_acquire);
+  if (sample == nullptr)
+  {
+    return false;
+  }
+
+  juce::int64 fill = static_cast<juce::int64>(state & fillPositionMask);
+  juce::int64 limit = juce::jmin(readPosition_.load(std::memory_order_relaxed) + ring_.getNumSamples() - guardFrames,
+                                 static_cast<juce::int64>(sample->getSampleLength()));
+  if (fill >= limit)
+  {
+    return false;
+  }
+
+  // Never let a read wrap around the end of the ring.
+  int ringPos = static_cast<int>(fill & ringMask_);
+  int count = static_cast<int>(juce::jmin<juce::int64>(chunkFrames, limit - fill, ring_.getNumSamples() - ringPos));
+  float *dest[2] = {ring_.getWritePointer(0, ringPos), ring_.getWritePointer(1, ringPos)};
+  sample->readStreamFrames(dest, juce::jmin(2, sample->getNumChannels()), fill, count);
+
+  // Publish only if the voice hasn't restarted or stopped the stream meanwhile.
+  fillState_.compare_exchange_strong(state, packFillState(state >> positionBits, fill + count),
+                                     std::memory_order_release, std::memory_order_relaxed);
+  return true;
+}
+
+sfzero::SampleStreamer::SampleStreamer() : juce::Thread("SFZero Streamer") {}
+
+sfzero::SampleStreamer::~SampleStreamer() { stopThread(2000); }
+
+void sfzero::SampleStreamer::addBuffer(sfzero::StreamBuffer *buffer)
+{
+  const juce::ScopedLock locker(buffersLock_);
+  buffers_.addIfNotAlreadyThere(buffer);
+}
+
+void sfzero::SampleStreamer::removeBuffer(sfzero::StreamBuffer *buffer)
+{
+  const juce::ScopedLock locker(buffersLock_);
+  buffers_.removeFirstMatchingValue(buffer);
+}
+
+int sfzero::SampleStreamer::getNumUnderruns() const
+{
+  const juce::ScopedLock locker(buffersLock_);
+  int result = 0;
+  for (sfzero::StreamBuffer *buffer : buffers_)
+  {
+    result += buffer->getNumUnderruns();
+  }
+  return result;
+}
+
+void sfzero::SampleStreamer::run()
+{
+  while (!threadShouldExit())
+  {
+    bool didWork = false;
+    {
+      const juce::ScopedLock locker(buffersLock_);
+      for (sfzero::StreamBuffer *buffer : buffers_)
+      {
+        didWork = buffer->service() || didWork;
+      }
+    }
+    if (!didWork)
+    {
+      wait(2);
+    }
+  }
+}
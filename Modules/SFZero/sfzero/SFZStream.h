@@ -0,0 +1,111 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#ifndef SFZSTREAM_H_INCLUDED
+#define SFZSTREAM_H_INCLUDED
+
+#include "SFZCommon.h"
+
+namespace sfzero
+{
+
+class Sample;
+
+// What a voice reads one channel of a streamed sample through: the sample's
+// resident pages first, then the frames the I/O thread has put in the voice's
+// ring.  Anything else is an underrun and reads as silence.
+struct StreamChannel
+{
+  const float *const *pages;
+  int pageShift, pageMask;
+  const float *ring;
+  int ringMask;
+  juce::int64 ringStart, ringEnd;
+  bool *underrun;
+
+  float valueAt(int index) const
+  {
+    if (const float *page = pages[index >> pageShift])
+    {
+      return page[index & pageMask];
+    }
+    if (index >= ringStart && index < ringEnd)
+    {
+      return ring[index & ringMask];
+    }
+    *underrun = true;
+    return 0.0f;
+  }
+};
+
+// A voice's window onto a streamed sample.  The voice (audio thread) starts and
+// stops it and publishes how far it has read; the SampleStreamer's thread
+// fills it ahead of that point.
+class StreamBuffer
+{
+public:
+  static constexpr int defaultCapacity = 32768; // Frames; must be a power of two.
+  // Frames behind the read position that are never overwritten, so
+  // interpolation taps before the current frame stay valid.
+  static constexpr int guardFrames = 64;
+
+  explicit StreamBuffer(int capacity = defaultCapacity);
+
+  // Audio thread.
+  void start(Sample *sample, juce::int64 startFrame);
+  void stop();
+  void setReadPosition(juce::int64 frame) { readPosition_.store(frame, std::memory_order_relaxed); }
+  // Fills channels[0..numChannels) for one render block.
+  void getChannels(StreamChannel *channels, int numChannels, bool *underrun) const;
+  void addUnderrun() { underruns_.fetch_add(1, std::memory_order_relaxed); }
+
+  int getNumUnderruns() const { return underruns_.load(std::memory_order_relaxed); }
+
+  // I/O thread.  Reads the next chunk if the voice needs it; returns false if
+  // there was nothing to do.
+  bool service();
+
+private:
+  static constexpr int positionBits = 48;
+  static juce::uint64 packFillState(juce::uint64 generation, juce::int64 position);
+
+  juce::AudioSampleBuffer ring_;
+  int ringMask_;
+  // The fill position and the generation of the stream it belongs to share one
+  // atomic, so a chunk read for a stream that has since been restarted can't be
+  // published.
+  std::atomic<juce::uint64> fillState_;
+  std::atomic<Sample *> sample_;
+  std::atomic<juce::int64> readPosition_;
+  std::atomic<int> underruns_;
+  juce::uint64 generation_;
+  juce::int64 startFrame_;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StreamBuffer)
+};
+
+// The I/O thread that keeps every registered StreamBuffer filled.
+class SampleStreamer : public juce::Thread
+{
+public:
+  SampleStreamer();
+  virtual ~SampleStreamer() override;
+
+  void addBuffer(StreamBuffer *buffer);
+  void removeBuffer(StreamBuffer *buffer);
+  int getNumUnderruns() const;
+
+  void run() override;
+
+private:
+  juce::CriticalSection buffersLock_;
+  juce::Array<StreamBuffer *> buffers_;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SampleStreamer)
+};
+}
+
+#endif // SFZSTREAM_H_INCLUDED
@@ -8,123 +8,935 @@
 #include "SFZSound.h"
 #include "SFZVoice.h"
 
-sfzero::Synth::Synth() : Synthesiser() {}
+sfzero::Synth::Synth()
+    : Synthesiser(), renderWorkers_(0), renderBlockSize_(0), stemOutput_(false), loadBudget_(0.0f), voiceLimit_(0),
+      lastLimitedCallback_(-1), interpolation_(sfzero::Voice::linear)
+{
+  for (int i = 0; i < 16; ++i)
+  {
+    channelPresets_[i] = 0;
+    channelLayers_[i] = 0;
+    channelGains_[i][0] = channelGains_[i][1] = 1.0f;
+    voiceChannelGains_[i][0] = voiceChannelGains_[i][1] = 0.0f;
+    // General MIDI's power-on defaults.
+    channelVolumes_[i] = 100;
+    channelPans_[i] = 64;
+    channelExpressions_[i] = 127;
+    channelVibratos_[i] = 0.0f;
+    sustainPedals_[i] = false;
+    for (int j = 0; j < 128; ++j)
+    {
+      noteVelocities_[i][j] = 0;
+    }
+  }
+  for (int channel = 1; channel <= 16; ++channel)
+  {
+    updateChannelGain(channel);
+  }
+}
 
-void sfzero::Synth::noteOn(int midiChannel, int midiNoteNumber, float velocity)
+void sfzero::Synth::setPolyphony(int numVoices)
 {
-  int i;
+  const juce::ScopedLock locker(lock);
 
+  clearVoices();
+  voiceTable_.setSize(numVoices);
+  voicePool_.clearQuick();
+  voicePool_.ensureStorageAllocated(numVoices);
+  activeVoices_.clearQuick();
+  activeVoices_.ensureStorageAllocated(numVoices);
+  shedding_.clearQuick();
+  shedding_.insertMultiple(0, false, numVoices);
+  audibilities_.clearQuick();
+  audibilities_.insertMultiple(0, 0.0f, numVoices);
+  shedCandidates_.clearQuick();
+  shedCandidates_.ensureStorageAllocated(numVoices);
+  sourceAddresses_.clearQuick();
+  sourceAddresses_.insertMultiple(0, 0, numVoices);
+  renderOrder_.clearQuick();
+  renderOrder_.ensureStorageAllocated(numVoices);
+  renderOrderDirty_ = true;
+  voiceLimit_ = numVoices;
+  noteVoices_.setSize(16 * 128, numVoices);
+  chokeVoices_.setSize(numChokeLists, numVoices);
+  sustainedVoices_.setSize(16, numVoices);
+  for (int i = 0; i < numVoices; ++i)
+  {
+    sfzero::Voice *voice = new sfzero::Voice(voiceTable_, i);
+    voice->setInterpolation(interpolation_);
+    voice->setStemOutput(stemOutput_);
+    voice->setHitCache(&hitCache_);
+    voice->setTrace(getTrace());
+    voicePool_.add(voice);
+    addVoice(voice);
+  }
+  if (streamer_)
+  {
+    attachStreamBuffers();
+  }
+}
+
+void sfzero::Synth::setStreamingEnabled(bool enabled)
+{
+  if (enabled == (streamer_ != nullptr))
+  {
+    return;
+  }
+
+  if (enabled)
+  {
+    streamer_.reset(new sfzero::SampleStreamer());
+    const juce::ScopedLock locker(lock);
+    attachStreamBuffers();
+    streamer_->startThread();
+  }
+  else
+  {
+    {
+      const juce::ScopedLock locker(lock);
+      for (sfzero::Voice *voice : voicePool_)
+      {
+        voice->setStreamBuffer(nullptr);
+      }
+    }
+    streamer_.reset();
+    streamBuffers_.clear();
+  }
+}
+
+void sfzero::Synth::attachStreamBuffers()
+{
+  // One ring per voice, so streaming memory follows polyphony rather than the
+  // size of the library.  Called with the lock held.
+  for (sfzero::StreamBuffer *buffer : streamBuffers_)
+  {
+    streamer_->removeBuffer(buffer);
+  }
+  streamBuffers_.clear();
+  for (sfzero::Voice *voice : voicePool_)
+  {
+    sfzero::StreamBuffer *buffer = streamBuffers_.add(new sfzero::StreamBuffer());
+    voice->setStreamBuffer(buffer);
+    streamer_->addBuffer(buffer);
+  }
+}
+
+void sfzero::Synth::setHitCacheSize(int numFrames)
+{
   const juce::ScopedLock locker(lock);
+  for (sfzero::Voice *voice : voicePool_)
+  {
+    voice->detachHitCache();
+  }
+  hitCache_.setSize(numFrames);
+}
 
-  int midiVelocity = static_cast<int>(velocity * 127);
+void sfzero::Synth::clearHitCache()
+{
+  for (sfzero::Voice *voice : voicePool_)
+  {
+    voice->detachHitCache();
+  }
+  hitCache_.clear();
+}
 
-  // First, stop any currently-playing sounds in the group.
-  //*** Currently, this only pays attention to the first matching region.
-  int group = 0;
-  sfzero::Sound *sound = dynamic_cast<sfzero::Sound *>(getSound(0).get());
+void sfzero::Synth::setRenderThreads(int numWorkers, int maximumBlockSize)
+{
+  const juce::ScopedLock locker(lock);
+  renderWorkers_ = numWorkers;
+  renderBlockSize_ = maximumBlockSize;
+  renderPool_.prepare(numWorkers, stemOutput_ ? stemChannels : 2, maximumBlockSize);
+}
 
-  if (sound)
+void sfzero::Synth::setStemOutput(bool enabled)
+{
+  const juce::ScopedLock locker(lock);
+  if (enabled == stemOutput_)
   {
-    sfzero::Region *region = sound->getRegionFor(midiNoteNumber, midiVelocity);
-    if (region)
+    return;
+  }
+  stemOutput_ = enabled;
+  for (sfzero::Voice *voice : voicePool_)
+  {
+    voice->setStemOutput(enabled);
+  }
+  // The workers' scratch buffers need as many channels as the output.
+  if (renderWorkers_ > 0)
+  {
+    renderPool_.prepare(renderWorkers_, enabled ? stemChannels : 2, renderBlockSize_);
+  }
+}
+
+void sfzero::Synth::setLoadBudget(float maximumLoad)
+{
+  const juce::ScopedLock locker(lock);
+  loadBudget_ = juce::jmax(0.0f, maximumLoad);
+  voiceLimit_ = voicePool_.size();
+  performance_.setVoiceLimit(loadBudget_ > 0.0f ? voiceLimit_ : 0);
+}
+
+void sfzero::Synth::updateVoiceLimit()
+{
+  juce::int64 callbacks = performance_.getNumCallbacks();
+  if (loadBudget_ <= 0.0f || callbacks == lastLimitedCallback_)
+  {
+    return;
+  }
+  lastLimitedCallback_ = callbacks;
+
+  // Voices are most of the cost, so the limit scales with the overshoot;
+  // it's won back a few percent a callback, so it doesn't oscillate.
+  float load = loadBudgetSuspended_.load() ? 0.0f : performance_.getLastLoad();
+  int numVoices = voicePool_.size();
+  int sounding = countSoundingVoices();
+  if (load > loadBudget_)
+  {
+    int target = static_cast<int>(sounding * (loadBudget_ / load));
+    voiceLimit_ = juce::jlimit(juce::jmin(minimumVoiceLimit, numVoices), numVoices, juce::jmin(voiceLimit_, target));
+  }
+  else if (load < loadBudget_ * 0.75f && voiceLimit_ < numVoices)
+  {
+    voiceLimit_ = juce::jmin(numVoices, voiceLimit_ + juce::jmax(1, voiceLimit_ / 32));
+  }
+  performance_.setVoiceLimit(voiceLimit_);
+
+  if (sounding > voiceLimit_)
+  {
+    shedVoices(sounding - voiceLimit_);
+  }
+}
+
+int sfzero::Synth::countSoundingVoices() const
+{
+  int sounding = 0;
+  for (int i = 0; i < voiceTable_.getNumActive(); ++i)
+  {
+    int slot = voiceTable_.getActiveSlot(i);
+    if (voiceTable_.isPlaying(slot) && !shedding_.getUnchecked(slot))
     {
-      group = region->group;
+      sounding += 1;
     }
   }
-  if (group != 0)
+  return sounding;
+}
+
+float sfzero::Synth::getAudibility(int index) const
+{
+  sfzero::Voice *voice = voicePool_.getUnchecked(index);
+  float level = voice->getCurrentLevel();
+  float audibility = voice->isReleasing() ? level * 0.25f : level;
+
+  // A layer well under another of the same note is mostly masked by it.
+  int midiChannel = voiceTable_.getChannel(index);
+  int note = voice->getCurrentlyPlayingNote();
+  if (midiChannel >= 1 && midiChannel <= 16 && note >= 0 && note < 128)
   {
-    for (i = voices.size(); --i >= 0;)
+    for (int i = noteVoices_.first(noteList(midiChannel, note)); i >= 0; i = noteVoices_.next(i))
     {
-      sfzero::Voice *voice = dynamic_cast<sfzero::Voice *>(voices.getUnchecked(i));
-      if (voice == nullptr)
+      if (i != index && voiceTable_.isPlaying(i) && voicePool_.getUnchecked(i)->getCurrentLevel() > 2.0f * level)
       {
-        continue;
+        audibility *= 0.5f;
+        break;
       }
-      if (voice->getOffBy() == group)
+    }
+  }
+  return audibility;
+}
+
+void sfzero::Synth::shedVoices(int numVoices)
+{
+  shedCandidates_.clearQuick();
+  for (int i = 0; i < voiceTable_.getNumActive(); ++i)
+  {
+    int slot = voiceTable_.getActiveSlot(i);
+    if (voiceTable_.isPlaying(slot) && !shedding_.getUnchecked(slot))
+    {
+      audibilities_.setUnchecked(slot, getAudibility(slot));
+      shedCandidates_.add(slot);
+    }
+  }
+  numVoices = juce::jmin(numVoices, shedCandidates_.size());
+  if (numVoices <= 0)
+  {
+    return;
+  }
+
+  // The least audible first, each faded over the EG's quick release.
+  int *first = shedCandidates_.begin();
+  std::nth_element(first, first + numVoices - 1, shedCandidates_.end(),
+                   [this](int a, int b) { return audibilities_.getUnchecked(a) < audibilities_.getUnchecked(b); });
+  for (int i = 0; i < numVoices; ++i)
+  {
+    voicePool_.getUnchecked(first[i])->stopNoteQuick();
+    SFZERO_TRACE_EVENT(getTrace(), Trace::voiceShed, first[i], voiceTable_.getChannel(first[i]),
+                       voicePool_.getUnchecked(first[i])->getCurrentlyPlayingNote(), 0,
+                       voicePool_.getUnchecked(first[i])->getRegion());
+    shedding_.setUnchecked(first[i], true);
+  }
+  performance_.addShedVoices(numVoices);
+}
+
+void sfzero::Synth::renderVoices(juce::AudioSampleBuffer &outputAudio, int startSample, int numSamples)
+{
+  updateVoiceLimit();
+
+  // Only the voices in the table's active list are visited; idle voices
+  // would only return straight away.
+  int channelVoices[16] = {};
+  int numListed = voiceTable_.getNumActive();
+  voiceTable_.removeFinished();
+  for (int i = 0; i < voiceTable_.getNumActive(); ++i)
+  {
+    int channel = voiceTable_.getChannel(voiceTable_.getActiveSlot(i));
+    if (channel >= 1 && channel <= 16)
+    {
+      channelVoices[channel - 1] += 1;
+    }
+  }
+  performance_.setVoicesPerChannel(channelVoices);
+
+  // In the order they read the sample data, so a layered or unison note's
+  // voices, all on the same stretch of it, go one after another while it's
+  // still in cache.  Equal addresses keep their slot order, so the mix sums
+  // the same way every time.  Addresses only creep on as voices play, which
+  // seldom reorders them, so the order is only worked out again once voices
+  // have started or stopped; blocks split at each MIDI event mostly render
+  // the same ones.
+  if (renderOrderDirty_ || voiceTable_.getNumActive() != numListed)
+  {
+    renderOrderDirty_ = false;
+    renderOrder_.clearQuick();
+    for (int i = 0; i < voiceTable_.getNumActive(); ++i)
+    {
+      int slot = voiceTable_.getActiveSlot(i);
+      renderOrder_.add(slot);
+      sourceAddresses_.setUnchecked(slot, voicePool_.getUnchecked(slot)->getSourceAddress());
+    }
+    std::sort(renderOrder_.begin(), renderOrder_.end(), [this](int a, int b) {
+      juce::pointer_sized_uint addressA = sourceAddresses_.getUnchecked(a);
+      juce::pointer_sized_uint addressB = sourceAddresses_.getUnchecked(b);
+      return addressA != addressB ? addressA < addressB : a < b;
+    });
+    activeVoices_.clearQuick();
+    for (int slot : renderOrder_)
+    {
+      activeVoices_.add(voicePool_.getUnchecked(slot));
+    }
+  }
+  SFZERO_TRACE_EVENT(getTrace(), Trace::renderStart, -1, 0, 0, numSamples);
+  renderPool_.render(activeVoices_.getRawDataPointer(), activeVoices_.size(), outputAudio, startSample, numSamples);
+  SFZERO_TRACE_EVENT(getTrace(), Trace::renderEnd, -1, 0, 0, activeVoices_.size());
+}
+
+void sfzero::Synth::handleMidiEvent(const juce::MidiMessage &message)
+{
+  performance_.addEvent();
+  Synthesiser::handleMidiEvent(message);
+}
+
+void sfzero::Synth::handleController(int midiChannel, int controllerNumber, int controllerValue)
+{
+  if (midiChannel < 1 || midiChannel > 16)
+  {
+    return;
+  }
+
+  const juce::ScopedLock locker(lock);
+  switch (controllerNumber)
+  {
+  case 1:
+    updateChannelVibrato(midiChannel, controllerValue);
+    break;
+  case 7:
+    channelVolumes_[midiChannel - 1] = controllerValue;
+    updateChannelGain(midiChannel);
+    break;
+  case 10:
+    channelPans_[midiChannel - 1] = controllerValue;
+    updateChannelGain(midiChannel);
+    break;
+  case 11:
+    channelExpressions_[midiChannel - 1] = controllerValue;
+    updateChannelGain(midiChannel);
+    break;
+  case 64:
+    handleSustainPedal(midiChannel, controllerValue >= 64);
+    break;
+  case 66:
+    handleSostenutoPedal(midiChannel, controllerValue >= 64);
+    break;
+  case 67:
+    handleSoftPedal(midiChannel, controllerValue >= 64);
+    break;
+  case 121:
+    channelExpressions_[midiChannel - 1] = 127;
+    updateChannelGain(midiChannel);
+    updateChannelVibrato(midiChannel, 0);
+    handleSustainPedal(midiChannel, false);
+    break;
+  default:
+    break;
+  }
+}
+
+void sfzero::Synth::handleSustainPedal(int midiChannel, bool isDown)
+{
+  if (midiChannel < 1 || midiChannel > 16)
+  {
+    return;
+  }
+
+  const juce::ScopedLock locker(lock);
+  sustainPedals_[midiChannel - 1] = isDown;
+  if (isDown)
+  {
+    // Nothing is held until a key is released (see noteOff()).
+    return;
+  }
+
+  for (int i = sustainedVoices_.first(midiChannel - 1); i >= 0;)
+  {
+    int next = sustainedVoices_.next(i);
+    sfzero::Voice *voice = voicePool_.getUnchecked(i);
+    sustainedVoices_.remove(i);
+    if (voiceTable_.isPlaying(i) && voice->isPlayingChannel(midiChannel) && voice->isSustainPedalDown())
+    {
+      voice->setSustainPedalDown(false);
+      if (!voice->isKeyDown() && !voice->isSostenutoPedalDown())
       {
-        voice->stopNoteForGroup();
+        stopVoice(voice, 1.0f, true);
       }
     }
+    i = next;
   }
+}
 
-  // Are any notes playing?  (Needed for first/legato trigger handling.)
-  // Also stop any voices still playing this note.
-  bool anyNotesPlaying = false;
-  for (i = voices.size(); --i >= 0;)
+void sfzero::Synth::handlePitchWheel(int midiChannel, int wheelValue)
+{
+  const juce::ScopedLock locker(lock);
+  for (int i = 0; i < voiceTable_.getNumActive(); ++i)
   {
-    sfzero::Voice *voice = dynamic_cast<sfzero::Voice *>(voices.getUnchecked(i));
-    if (voice == nullptr)
+    int slot = voiceTable_.getActiveSlot(i);
+    if (voiceTable_.isPlaying(slot) && (midiChannel <= 0 || voiceTable_.getChannel(slot) == midiChannel))
+    {
+      voicePool_.getUnchecked(slot)->pitchWheelMoved(wheelValue);
+    }
+  }
+}
+
+void sfzero::Synth::allNotesOff(int midiChannel, bool allowTailOff)
+{
+  const juce::ScopedLock locker(lock);
+  Synthesiser::allNotesOff(midiChannel, allowTailOff);
+  for (int channel = 1; channel <= 16; ++channel)
+  {
+    if (midiChannel <= 0 || midiChannel == channel)
+    {
+      sustainPedals_[channel - 1] = false;
+    }
+  }
+}
+
+void sfzero::Synth::updateChannelGain(int midiChannel)
+{
+  // Volume and expression follow the usual squared curve, so 100 is about
+  // -4dB.  Pan is a balance control: the far side fades out while the near
+  // side stays at unity, leaving the note's own pan intact at centre.
+  int channel = midiChannel - 1;
+  float volume = channelVolumes_[channel] / 127.0f;
+  float expression = channelExpressions_[channel] / 127.0f;
+  float level = volume * volume * expression * expression;
+  int pan = channelPans_[channel];
+  float balanceLeft = pan > 64 ? (127 - pan) / 63.0f : 1.0f;
+  float balanceRight = pan < 64 ? pan / 64.0f : 1.0f;
+  float gainLeft = channelGains_[channel][0] * level * balanceLeft;
+  float gainRight = channelGains_[channel][1] * level * balanceRight;
+  if (gainLeft == voiceChannelGains_[channel][0] && gainRight == voiceChannelGains_[channel][1])
+  {
+    return;
+  }
+  voiceChannelGains_[channel][0] = gainLeft;
+  voiceChannelGains_[channel][1] = gainRight;
+
+  for (int i = 0; i < voiceTable_.getNumActive(); ++i)
+  {
+    int slot = voiceTable_.getActiveSlot(i);
+    if (voiceTable_.isPlaying(slot) && voiceTable_.getChannel(slot) == midiChannel)
+    {
+      voicePool_.getUnchecked(slot)->rampChannelGain(gainLeft, gainRight);
+    }
+  }
+}
+
+void sfzero::Synth::updateChannelVibrato(int midiChannel, int modWheel)
+{
+  // SF2's default modulator: the wheel adds up to 50 cents of vibrato LFO.
+  // It's the one channel-wide modulation source; the LFOs themselves start
+  // with each note.
+  float cents = 50.0f * modWheel / 127.0f;
+  if (cents == channelVibratos_[midiChannel - 1])
+  {
+    return;
+  }
+  channelVibratos_[midiChannel - 1] = cents;
+  for (int i = 0; i < voiceTable_.getNumActive(); ++i)
+  {
+    int slot = voiceTable_.getActiveSlot(i);
+    if (voiceTable_.isPlaying(slot) && voiceTable_.getChannel(slot) == midiChannel)
+    {
+      voicePool_.getUnchecked(slot)->setModWheelDepth(cents);
+    }
+  }
+}
+
+void sfzero::Synth::setCurrentPlaybackSampleRate(double sampleRate)
+{
+  Synthesiser::setCurrentPlaybackSampleRate(sampleRate);
+  performance_.setSampleRate(sampleRate);
+
+  const juce::ScopedLock locker(lock);
+  clearHitCache();
+}
+
+int sfzero::Synth::getStreamUnderruns() const { return streamer_ ? streamer_->getNumUnderruns() : 0; }
+
+void sfzero::Synth::setInterpolation(sfzero::Voice::Interpolation newInterpolation)
+{
+  sfzero::Voice::prepareInterpolationTables();
+
+  const juce::ScopedLock locker(lock);
+
+  interpolation_ = newInterpolation;
+  for (sfzero::Voice *voice : voicePool_)
+  {
+    voice->detachHitCache();
+    voice->setInterpolation(newInterpolation);
+  }
+}
+
+bool sfzero::Synth::setChannelPreset(int midiChannel, int subsoundIndex, int layer)
+{
+  if (midiChannel < 1 || midiChannel > 16 || !juce::isPositiveAndBelow(layer, maxLayers))
+  {
+    return false;
+  }
+
+  const juce::ScopedLock locker(lock);
+  if (layer != 0 && layers_[layer] == nullptr)
+  {
+    return false;
+  }
+  channelPresets_[midiChannel - 1] = subsoundIndex;
+  channelLayers_[midiChannel - 1] = layer;
+  return true;
+}
+
+void sfzero::Synth::setChannelGain(int midiChannel, float gainLeft, float gainRight)
+{
+  if (midiChannel < 1 || midiChannel > 16)
+  {
+    return;
+  }
+
+  const juce::ScopedLock locker(lock);
+  channelGains_[midiChannel - 1][0] = gainLeft;
+  channelGains_[midiChannel - 1][1] = gainRight;
+  updateChannelGain(midiChannel);
+}
+
+int sfzero::Synth::getChannelPreset(int midiChannel) const
+{
+  return (midiChannel >= 1 && midiChannel <= 16) ? channelPresets_[midiChannel - 1] : 0;
+}
+
+int sfzero::Synth::getChannelLayer(int midiChannel) const
+{
+  return (midiChannel >= 1 && midiChannel <= 16) ? channelLayers_[midiChannel - 1] : 0;
+}
+
+void sfzero::Synth::setLayerSound(int layer, sfzero::Sound *sound)
+{
+  if (!juce::isPositiveAndBelow(layer, maxLayers))
+  {
+    return;
+  }
+
+  const juce::ScopedLock locker(lock);
+  sfzero::Sound *oldSound = layers_[layer].get();
+  if (oldSound == sound)
+  {
+    return;
+  }
+
+  // Voices keep their sound alive until they finish, so the old one's can
+  // fade out.
+  if (oldSound != nullptr)
+  {
+    for (int i = 0; i < voiceTable_.getNumActive(); ++i)
+    {
+      int slot = voiceTable_.getActiveSlot(i);
+      sfzero::Voice *voice = voicePool_.getUnchecked(slot);
+      if (voiceTable_.isPlaying(slot) && voice->getCurrentlyPlayingSound().get() == oldSound)
+      {
+        voice->stopNoteQuick();
+      }
+    }
+  }
+
+  clearSounds();
+  clearHitCache(); // it points into the old sound's regions
+  layers_[layer] = sound;
+  for (const juce::ReferenceCountedObjectPtr<sfzero::Sound> &layerSound : layers_)
+  {
+    if (layerSound != nullptr)
+    {
+      addSound(layerSound.get());
+    }
+  }
+}
+
+sfzero::Sound *sfzero::Synth::getLayerSound(int layer) const
+{
+  const juce::ScopedLock locker(lock);
+  return juce::isPositiveAndBelow(layer, maxLayers) ? layers_[layer].get() : nullptr;
+}
+
+bool sfzero::Synth::isLayerInUse(int layer) const
+{
+  const juce::ScopedLock locker(lock);
+  for (int channel = 0; channel < 16; ++channel)
+  {
+    if (channelLayers_[channel] == layer)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool sfzero::Synth::clearLayerIfUnused(int layer)
+{
+  const juce::ScopedLock locker(lock);
+  if (isLayerInUse(layer))
+  {
+    return false;
+  }
+  setLayerSound(layer, nullptr);
+  return true;
+}
+
+void sfzero::Synth::VoiceLists::setSize(int numLists, int numVoices)
+{
+  heads_.clearQuick();
+  heads_.insertMultiple(0, -1, numLists);
+  next_.clearQuick();
+  next_.insertMultiple(0, -1, numVoices);
+  prev_.clearQuick();
+  prev_.insertMultiple(0, -1, numVoices);
+  listOf_.clearQuick();
+  listOf_.insertMultiple(0, -1, numVoices);
+}
+
+void sfzero::Synth::VoiceLists::insert(int list, int voice)
+{
+  remove(voice);
+  int head = heads_.getUnchecked(list);
+  next_.set(voice, head);
+  if (head >= 0)
+  {
+    prev_.set(head, voice);
+  }
+  heads_.set(list, voice);
+  listOf_.set(voice, list);
+}
+
+void sfzero::Synth::VoiceLists::remove(int voice)
+{
+  int list = listOf_.getUnchecked(voice);
+  if (list < 0)
+  {
+    return;
+  }
+  int before = prev_.getUnchecked(voice), after = next_.getUnchecked(voice);
+  if (before >= 0)
+  {
+    next_.set(before, after);
+  }
+  else
+  {
+    heads_.set(list, after);
+  }
+  if (after >= 0)
+  {
+    prev_.set(after, before);
+  }
+  next_.set(voice, -1);
+  prev_.set(voice, -1);
+  listOf_.set(voice, -1);
+}
+
+int sfzero::Synth::chokeList(int midiChannel, juce::int64 offBy)
+{
+  juce::uint64 hash = static_cast<juce::uint64>(offBy) * 0x9E3779B97F4A7C15ULL + static_cast<juce::uint64>(midiChannel);
+  return static_cast<int>((hash >> 32) & (numChokeLists - 1));
+}
+
+int sfzero::Synth::findFreeVoiceIndex(bool stealIfNoneAvailable) const
+{
+  // Past the load limiter's cap a new note takes over a voice instead.  The
+  // cap counts what's still sounding, not voices that have finished since
+  // the last prune or are already fading out.
+  if (voiceLimit_ < voicePool_.size() && countSoundingVoices() >= voiceLimit_)
+  {
+    return stealIfNoneAvailable ? findVoiceIndexToSteal() : -1;
+  }
+
+  int index = voiceTable_.findIdleSlot();
+  if (index < 0 && stealIfNoneAvailable)
+  {
+    index = findVoiceIndexToSteal();
+  }
+  return index;
+}
+
+void sfzero::Synth::startPoolVoice(int index, sfzero::Region *region, int midiChannel, int midiNoteNumber,
+                                   float velocity)
+{
+  sfzero::Voice *voice = voicePool_.getUnchecked(index);
+
+  // Synthesiser is too locked-down (ivars are private rt protected), so
+  // we have to use a "setRegion()" mechanism.
+  voice->setRegion(region);
+  voice->setChannelAndPreset(midiChannel, getChannelPreset(midiChannel));
+  voice->setChannelGain(voiceChannelGains_[midiChannel - 1][0], voiceChannelGains_[midiChannel - 1][1]);
+  voice->setModWheelDepth(channelVibratos_[midiChannel - 1]);
+  SFZERO_TRACE_EVENT(getTrace(), Trace::voiceStart, index, midiChannel, midiNoteNumber,
+                     static_cast<int>(velocity * 127), region);
+  startVoice(voice, getChannelSound(midiChannel), midiChannel, midiNoteNumber, velocity);
+  voiceTable_.addActive(index);
+  renderOrderDirty_ = true; // Started or stolen, it reads somewhere new.
+  sustainedVoices_.remove(index);
+  shedding_.setUnchecked(index, false);
+
+  noteVoices_.insert(noteList(midiChannel, midiNoteNumber), index);
+  if (region->off_by != 0)
+  {
+    chokeVoices_.insert(chokeList(midiChannel, region->off_by), index);
+  }
+  else
+  {
+    chokeVoices_.remove(index);
+  }
+}
+
+bool sfzero::Synth::anyOtherNotesPlaying(int midiChannel, int midiNoteNumber)
+{
+  for (int note = 0; note < 128; ++note)
+  {
+    if (note == midiNoteNumber)
     {
       continue;
     }
-    if (voice->isPlayingChannel(midiChannel))
+    for (int i = noteVoices_.first(noteList(midiChannel, note)); i >= 0; i = noteVoices_.next(i))
     {
-      if (voice->isPlayingNoteDown())
+      sfzero::Voice *voice = voicePool_.getUnchecked(i);
+      if (voiceTable_.isPlaying(i) && voice->isPlayingChannel(midiChannel) && voice->isPlayingNoteDown())
       {
-        if (voice->getCurrentlyPlayingNote() == midiNoteNumber)
-        {
-          if (!voice->isPlayingOneShot())
-          {
-            voice->stopNoteQuick();
-          }
-        }
-        else
-        {
-          anyNotesPlaying = true;
-        }
+        return true;
       }
     }
   }
+  return false;
+}
 
-  // Play *all* matching regions.
-  sfzero::Region::Trigger trigger = (anyNotesPlaying ? sfzero::Region::legato : sfzero::Region::first);
-  if (sound)
+void sfzero::Synth::noteOn(int midiChannel, int midiNoteNumber, float velocity)
+{
+  if (midiChannel < 1 || midiChannel > 16)
   {
-    int numRegions = sound->getNumRegions();
-    for (i = 0; i < numRegions; ++i)
+    return;
+  }
+  sfzero::Sound *sound = getChannelSound(midiChannel);
+  if (sound == nullptr)
+  {
+    return;
+  }
+
+  int midiVelocity = static_cast<int>(velocity * 127);
+  int preset = getChannelPreset(midiChannel);
+  SFZERO_TRACE_EVENT(getTrace(), Trace::noteOn, -1, midiChannel, midiNoteNumber, midiVelocity);
+
+  // Presets still loading in the background are silent until they're ready,
+  // and notes a paged sound hasn't read yet are asked for.
+  if (!sound->isNoteReady(preset, midiNoteNumber))
+  {
+    sound->requestNotes(preset, midiNoteNumber, midiNoteNumber);
+    return;
+  }
+
+  // First, stop any currently-playing sounds in the group.
+  //*** Currently, this only pays attention to the first matching region.
+  sfzero::Region *firstRegion =
+      sound->getMatchingRegions(midiNoteNumber, midiVelocity, sfzero::Region::attack, preset).getFirst();
+  int group = firstRegion ? firstRegion->group : 0;
+  if (group != 0)
+  {
+    for (int i = chokeVoices_.first(chokeList(midiChannel, group)); i >= 0;)
     {
-      sfzero::Region *region = sound->regionAt(i);
-      if (region->matches(midiNoteNumber, midiVelocity, trigger))
+      int next = chokeVoices_.next(i);
+      sfzero::Voice *voice = voicePool_.getUnchecked(i);
+      if (!voiceTable_.isPlaying(i))
+      {
+        chokeVoices_.remove(i);
+      }
+      else if (voice->isPlayingChannel(midiChannel) && voice->getOffBy() == static_cast<juce::uint64>(group))
       {
-        sfzero::Voice *voice =
-            dynamic_cast<sfzero::Voice *>(findFreeVoice(sound, midiNoteNumber, midiChannel, isNoteStealingEnabled()));
-        if (voice)
-        {
-          voice->setRegion(region);
-          startVoice(voice, sound, midiChannel, midiNoteNumber, velocity);
-        }
+        voice->stopNoteForGroup();
       }
+      i = next;
     }
   }
 
-  noteVelocities_[midiNoteNumber] = midiVelocity;
+  // Stop any voices still playing this note.
+  for (int i = noteVoices_.first(noteList(midiChannel, midiNoteNumber)); i >= 0;)
+  {
+    int next = noteVoices_.next(i);
+    sfzero::Voice *voice = voicePool_.getUnchecked(i);
+    if (!voiceTable_.isPlaying(i))
+    {
+      noteVoices_.remove(i);
+    }
+    else if (voice->isPlayingChannel(midiChannel) && voice->isPlayingNoteDown() && !voice->isPlayingOneShot())
+    {
+      voice->stopNoteQuick();
+    }
+    i = next;
+  }
+
+  // Play *all* matching regions.  Whether other notes are playing only
+  // matters to first/legato regions, so it's only worked out for those.
+  const sfzero::RegionIndex &index = sound->getRegionIndex(preset);
+  sfzero::Region::Trigger trigger = sfzero::Region::attack;
+  if (index.hasFirstOrLegato())
+  {
+    trigger = anyOtherNotesPlaying(midiChannel, midiNoteNumber) ? sfzero::Region::legato : sfzero::Region::first;
+  }
+  for (sfzero::Region *region : index.getMatches(midiNoteNumber, midiVelocity, trigger))
+  {
+    int voiceIndex = findFreeVoiceIndex(isNoteStealingEnabled());
+    if (voiceIndex >= 0)
+    {
+      if (voiceTable_.isPlaying(voiceIndex))
+      {
+        performance_.addStolenVoice();
+        SFZERO_TRACE_EVENT(getTrace(), Trace::voiceSteal, voiceIndex, voiceTable_.getChannel(voiceIndex),
+                           voicePool_.getUnchecked(voiceIndex)->getCurrentlyPlayingNote(), 0,
+                           voicePool_.getUnchecked(voiceIndex)->getRegion());
+      }
+      startPoolVoice(voiceIndex, region, midiChannel, midiNoteNumber, velocity);
+    }
+  }
+
+  noteVelocities_[midiChannel - 1][midiNoteNumber] = midiVelocity;
 }
 
 void sfzero::Synth::noteOff(int midiChannel, int midiNoteNumber, float velocity, bool allowTailOff)
 {
   const juce::ScopedLock locker(lock);
 
-  Synthesiser::noteOff(midiChannel, midiNoteNumber, velocity, allowTailOff);
+  if (midiChannel < 1 || midiChannel > 16)
+  {
+    Synthesiser::noteOff(midiChannel, midiNoteNumber, velocity, allowTailOff);
+    return;
+  }
+  SFZERO_TRACE_EVENT(getTrace(), Trace::noteOff, -1, midiChannel, midiNoteNumber, static_cast<int>(velocity * 127));
+
+  // Only this note's voices are visited.  Under the sustain pedal they're
+  // listed by channel, so lifting it visits just those.
+  for (int i = noteVoices_.first(noteList(midiChannel, midiNoteNumber)); i >= 0; i = noteVoices_.next(i))
+  {
+    sfzero::Voice *voice = voicePool_.getUnchecked(i);
+    if (!voiceTable_.isPlaying(i) || voice->getCurrentlyPlayingNote() != midiNoteNumber ||
+        !voice->isPlayingChannel(midiChannel) || !voice->isKeyDown())
+    {
+      continue;
+    }
+    voice->setKeyDown(false);
+    if (sustainPedals_[midiChannel - 1])
+    {
+      voice->setSustainPedalDown(true);
+      sustainedVoices_.insert(midiChannel - 1, i);
+    }
+    else if (!voice->isSostenutoPedalDown())
+    {
+      stopVoice(voice, velocity, allowTailOff);
+    }
+  }
 
   // Start release region.
-  sfzero::Sound *sound = dynamic_cast<sfzero::Sound *>(getSound(0).get());
-  if (sound)
+  int preset = getChannelPreset(midiChannel);
+  int noteVelocity = noteVelocities_[midiChannel - 1][midiNoteNumber];
+  sfzero::Sound *sound = getChannelSound(midiChannel);
+  if (sound && sound->isNoteReady(preset, midiNoteNumber))
   {
-    sfzero::Region *region = sound->getRegionFor(midiNoteNumber, noteVelocities_[midiNoteNumber], sfzero::Region::release);
+    sfzero::Region *region = sound->getRegionFor(midiNoteNumber, noteVelocity, sfzero::Region::release, preset);
     if (region)
     {
-      sfzero::Voice *voice = dynamic_cast<sfzero::Voice *>(findFreeVoice(sound, midiNoteNumber, midiChannel, false));
-      if (voice)
+      int index = findFreeVoiceIndex(false);
+      if (index >= 0)
       {
-        // Synthesiser is too locked-down (ivars are private rt protected), so
-        // we have to use a "setRegion()" mechanism.
-        voice->setRegion(region);
-        startVoice(voice, sound, midiChannel, midiNoteNumber, noteVelocities_[midiNoteNumber] / 127.0f);
+        startPoolVoice(index, region, midiChannel, midiNoteNumber, noteVelocity / 127.0f);
       }
     }
   }
 }
 
+int sfzero::Synth::findVoiceIndexToSteal() const
+{
+  // Steal across all channels: a voice that is already releasing goes first,
+  // otherwise whichever voice is currently the quietest.  Only sounding
+  // voices are candidates, which is every voice unless the load limiter has
+  // capped them.
+  int releasing = -1, quietest = -1;
+  float releasingLevel = 0.0f, quietestLevel = 0.0f;
+
+  for (int n = 0; n < voiceTable_.getNumActive(); ++n)
+  {
+    int i = voiceTable_.getActiveSlot(n);
+    if (!voiceTable_.isPlaying(i))
+    {
+      continue;
+    }
+    sfzero::Voice *voice = voicePool_.getUnchecked(i);
+    float level = voice->getCurrentLevel();
+    if (voice->isReleasing())
+    {
+      if (releasing < 0 || level < releasingLevel)
+      {
+        releasing = i;
+        releasingLevel = level;
+      }
+    }
+    else if (quietest < 0 || level < quietestLevel)
+    {
+      quietest = i;
+      quietestLevel = level;
+    }
+  }
+
+  return releasing >= 0 ? releasing : quietest;
+}
+
+juce::SynthesiserVoice *sfzero::Synth::findVoiceToSteal(juce::SynthesiserSound *soundToPlay, int midiChannel,
+                                                        int midiNoteNumber) const
+{
+  int index = findVoiceIndexToSteal();
+  if (index < 0)
+  {
+    return Synthesiser::findVoiceToSteal(soundToPlay, midiChannel, midiNoteNumber);
+  }
+  return voicePool_.getUnchecked(index);
+}
+
 int sfzero::Synth::numVoicesUsed()
 {
   int numUsed = 0;
@@ -148,9 +960,9 @@ juce::String sfzero::Synth::voiceInfoString()
 
   juce::StringArray lines;
   int numUsed = 0, numShown = 0;
-  for (int i = voices.size(); --i >= 0;)
+  for (int i = voicePool_.size(); --i >= 0;)
   {
-    sfzero::Voice *voice = dynamic_cast<sfzero::Voice *>(voices.getUnchecked(i));
+    sfzero::Voice *voice = voicePool_.getUnchecked(i);
     if (voice->getCurrentlyPlayingNote() < 0)
     {
       continue;
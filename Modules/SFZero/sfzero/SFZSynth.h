@@ -8,6 +8,14 @@
 #define SFZSYNTH_H_INCLUDED
 
 #include "SFZCommon.h"
+#include "SFZHitCache.h"
+#include "SFZPerformance.h"
+#include "SFZRenderPool.h"
+#include "SFZSound.h"
+#include "SFZStream.h"
+#include "SFZTrace.h"
+#include "SFZVoice.h"
+#include "SFZVoiceTable.h"
 
 namespace sfzero
 {
@@ -18,14 +26,194 @@ public:
   Synth();
   virtual ~Synth() override {}
 
+  // Called from renderNextBlock(), which already holds lock.
   void noteOn(int midiChannel, int midiNoteNumber, float velocity) override;
   void noteOff(int midiChannel, int midiNoteNumber, float velocity, bool allowTailOff) override;
+  void handleMidiEvent(const juce::MidiMessage &message) override;
+  void setCurrentPlaybackSampleRate(double sampleRate) override;
+
+  // Volume (7), pan (10) and expression (11) set the channel's controller
+  // gain, which is ramped into its voices; the sustain pedal (64) holds the
+  // notes released while it's down, and lets only those go when it's lifted.
+  // Reset all controllers (121) resets expression and the pedal.  Channel
+  // controllers never reach the voices.
+  void handleController(int midiChannel, int controllerNumber, int controllerValue) override;
+  void handleSustainPedal(int midiChannel, bool isDown) override;
+  // Only the sounding voices are visited, rather than the whole pool.
+  void handlePitchWheel(int midiChannel, int wheelValue) override;
+  void allNotesOff(int midiChannel, bool allowTailOff) override;
+
+  // The synth plays up to maxLayers sounds, kept here with their real type;
+  // each MIDI channel plays one of them, layer 0 unless setChannelPreset()
+  // picks another.  Use these rather than addSound().  Replacing or clearing
+  // a layer's sound quickly releases the voices still playing the old one.
+  static constexpr int maxLayers = 8;
+  void setSound(Sound *sound) { setLayerSound(0, sound); }
+  void setLayerSound(int layer, Sound *sound);
+  Sound *getSfzSound() const { return layers_[0].get(); }
+  Sound *getLayerSound(int layer) const;
+  // Whether any channel has a preset from layer selected.
+  bool isLayerInUse(int layer) const;
+  // Clears a layer unless a channel has a preset from it selected; returns
+  // whether it did.
+  bool clearLayerIfUnused(int layer);
 
   int numVoicesUsed();
   juce::String voiceInfoString();
 
+  // Replaces the voice pool with numVoices voices shared by all 16 channels.
+  void setPolyphony(int numVoices);
+
+  // Interpolation used by every voice; can be changed while playing.
+  void setInterpolation(Voice::Interpolation newInterpolation);
+  Voice::Interpolation getInterpolation() const { return interpolation_; }
+
+  // Selects the subsound, of the given layer's sound, each MIDI channel
+  // (1-16) plays when a note starts.  Returns false, changing nothing, for a
+  // layer other than 0 that has no sound.
+  bool setChannelPreset(int midiChannel, int subsoundIndex, int layer = 0);
+  int getChannelPreset(int midiChannel) const;
+  int getChannelLayer(int midiChannel) const;
+
+  // A MIDI channel's (1-16) left and right gain, on top of its controllers'.
+  // There is no channel bus: it's folded into the gains of the channel's
+  // voices, sounding ones too.
+  void setChannelGain(int midiChannel, float gainLeft, float gainRight);
+
+  // Stem mode writes each MIDI channel to its own output pair, straight from
+  // its voices, so the output buffer needs stemChannels channels.  Without it
+  // every voice mixes into channels 0 and 1.
+  static constexpr int stemChannels = 32;
+  void setStemOutput(bool enabled);
+  bool isStemOutput() const { return stemOutput_; }
+
+  // Gives every voice a StreamBuffer and runs the I/O thread that fills them,
+  // so sounds loaded with Sound::setStreaming() play past their preload.
+  void setStreamingEnabled(bool enabled);
+  bool isStreamingEnabled() const { return streamer_ != nullptr; }
+  // How many render blocks ran out of streamed data since streaming started.
+  int getStreamUnderruns() const;
+
+  // Frames set aside for caching unlooped notes' interpolated output, so
+  // repeated drum hits and the like skip the interpolator (see HitCache).
+  // Zero, the default, turns it off.  Changing it or the sound or rate
+  // empties the cache.
+  void setHitCacheSize(int numFrames);
+  int getHitCacheSize() const { return hitCache_.getSize(); }
+
+  // Renders the active voices on numWorkers extra threads as well as the
+  // audio thread; zero (the default) renders serially.  Blocks too small to
+  // be worth splitting stay serial; longer ones than maximumBlockSize are
+  // split into pieces of that size.
+  void setRenderThreads(int numWorkers, int maximumBlockSize);
+  int getNumRenderThreads() const { return renderPool_.getNumWorkers(); }
+
+  // Keeps the audio callback's load (its time over the audio it produces, as
+  // PerformanceCounters measures it) under maximumLoad by trading polyphony.
+  // Over budget, the voice limit drops in proportion and the least audible
+  // voices are faded out: released notes first, then the quietest, and
+  // layers under a louder one of the same note.  Well under it, the limit
+  // creeps back up to the pool size.  Past the limit a new note steals
+  // rather than taking an idle voice.  Zero, the default, turns it off, as
+  // rendering offline wants.
+  void setLoadBudget(float maximumLoad);
+  float getLoadBudget() const { return loadBudget_; }
+  // While suspended no voices are shed, whatever the load, and the limit
+  // creeps back up: for whoever renders ahead of the device, with audio
+  // buffered to ride out a slow block.  Any thread.
+  void setLoadBudgetSuspended(bool suspended) { loadBudgetSuspended_.store(suspended); }
+  int getVoiceLimit() const { return voiceLimit_; }
+
+  // Voices per channel, steals and events dispatched are counted here as the
+  // synth renders.  Whoever drives the audio callback times it with a
+  // PerformanceCounters::ScopedCallback.
+  PerformanceCounters &getPerformanceCounters() { return performance_; }
+
+  // The voice-level trace, or nullptr unless it's built with SFZERO_TRACE.
+#if SFZERO_TRACE
+  Trace *getTrace() { return &trace_; }
+#else
+  Trace *getTrace() { return nullptr; }
+#endif
+
+protected:
+  juce::SynthesiserVoice *findVoiceToSteal(juce::SynthesiserSound *soundToPlay, int midiChannel,
+                                           int midiNoteNumber) const override;
+  using Synthesiser::renderVoices;
+  void renderVoices(juce::AudioSampleBuffer &outputAudio, int startSample, int numSamples) override;
+
 private:
-  int noteVelocities_[128];
+  // Intrusive lists of voice pool indices.  A voice is in at most one list of
+  // each kind, and is only moved when it's started, so lists can hold voices
+  // that have since finished; walkers drop those as they find them.
+  class VoiceLists
+  {
+  public:
+    void setSize(int numLists, int numVoices);
+    void insert(int list, int voice);
+    void remove(int voice);
+    int first(int list) const { return heads_.getUnchecked(list); }
+    int next(int voice) const { return next_.getUnchecked(voice); }
+
+  private:
+    juce::Array<int> heads_, next_, prev_, listOf_;
+  };
+
+  static constexpr int numChokeLists = 256;
+  static int noteList(int midiChannel, int midiNoteNumber) { return (midiChannel - 1) * 128 + midiNoteNumber; }
+  static int chokeList(int midiChannel, juce::int64 offBy);
+
+  int findFreeVoiceIndex(bool stealIfNoneAvailable) const;
+  int findVoiceIndexToSteal() const;
+  void startPoolVoice(int index, Region *region, int midiChannel, int midiNoteNumber, float velocity);
+  bool anyOtherNotesPlaying(int midiChannel, int midiNoteNumber);
+  void updateChannelGain(int midiChannel); // Called with the lock held.
+  void updateChannelVibrato(int midiChannel, int modWheel); // Likewise.
+  void attachStreamBuffers();
+  void clearHitCache(); // Called with the lock held.
+  Sound *getChannelSound(int midiChannel) const { return layers_[channelLayers_[midiChannel - 1]].get(); }
+  static constexpr int minimumVoiceLimit = 8;
+  void updateVoiceLimit(); // Called with the lock held, once per callback.
+  void shedVoices(int numVoices);
+  int countSoundingVoices() const; // Playing and not being shed.
+  float getAudibility(int index) const;
+
+  juce::ReferenceCountedObjectPtr<Sound> layers_[maxLayers];
+  VoiceTable voiceTable_; // The pool's render state, by pool index.
+  juce::Array<Voice *> voicePool_;
+  VoiceLists noteVoices_;  // By channel and note.
+  VoiceLists chokeVoices_; // By channel and the group that cuts them off.
+  VoiceLists sustainedVoices_; // By channel, if released under the pedal.
+  juce::OwnedArray<StreamBuffer> streamBuffers_;
+  std::unique_ptr<SampleStreamer> streamer_;
+  HitCache hitCache_;
+  RenderPool renderPool_;
+  int renderWorkers_, renderBlockSize_;
+  bool stemOutput_;
+  PerformanceCounters performance_;
+#if SFZERO_TRACE
+  Trace trace_;
+#endif
+  juce::Array<Voice *> activeVoices_; // Reserved to the pool size.
+  float loadBudget_;
+  std::atomic<bool> loadBudgetSuspended_{false};
+  int voiceLimit_;
+  juce::int64 lastLimitedCallback_;
+  juce::Array<bool> shedding_;      // By pool index: being faded by the limiter.
+  juce::Array<float> audibilities_; // By pool index, scratch for shedVoices().
+  juce::Array<int> shedCandidates_; // Reserved to the pool size.
+  juce::Array<juce::pointer_sized_uint> sourceAddresses_; // By pool index, scratch for renderVoices().
+  juce::Array<int> renderOrder_;    // Reserved to the pool size.
+  bool renderOrderDirty_ = true;    // Voices have started since it was sorted.
+  Voice::Interpolation interpolation_;
+  int channelPresets_[16];
+  int channelLayers_[16];
+  float channelGains_[16][2];     // As set by setChannelGain().
+  float voiceChannelGains_[16][2]; // Times the controllers', for the voices.
+  int channelVolumes_[16], channelPans_[16], channelExpressions_[16];
+  float channelVibratos_[16]; // The mod wheel's vibrato depth, in cents.
+  bool sustainPedals_[16];
+  int noteVelocities_[16][128];
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Synth)
 };
 }
@@ -0,0 +1,158 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#include "SFZTrace.h"
+
+sfzero::Trace::Trace() : next_(0), recording_(false) {}
+
+sfzero::Trace::~Trace() {}
+
+void sfzero::Trace::setRecording(bool shouldRecord)
+{
+  if (!shouldRecord)
+  {
+    recording_.store(false, std::memory_order_relaxed);
+    return;
+  }
+
+  // Writers only touch the slots once they see recording set, so the first
+  // allocation is published by that store.
+  if (slots_ == nullptr)
+  {
+    slots_.reset(new Slot[capacity]);
+  }
+  for (int i = 0; i < capacity; ++i)
+  {
+    slots_[i].sequence.store(0, std::memory_order_relaxed);
+  }
+  next_.store(0, std::memory_order_relaxed);
+  recording_.store(true, std::memory_order_release);
+}
+
+void sfzero::Trace::record(Type type, int voice, int channel, int note, int value, const sfzero::Region *region)
+{
+  if (!recording_.load(std::memory_order_acquire))
+  {
+    return;
+  }
+
+  juce::uint64 index = next_.fetch_add(1, std::memory_order_relaxed);
+  Slot &slot = slots_[static_cast<int>(index & (capacity - 1))];
+  slot.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  Event &event = slot.event;
+  event.ticks = juce::Time::getHighResolutionTicks();
+  event.region = static_cast<juce::uint64>(reinterpret_cast<juce::pointer_sized_uint>(region));
+  event.thread = static_cast<juce::uint32>(reinterpret_cast<juce::pointer_sized_uint>(juce::Thread::getCurrentThreadId()));
+  event.value = value;
+  event.voice = static_cast<juce::int16>(voice);
+  event.type = type;
+  event.channel = static_cast<juce::uint8>(channel);
+  event.note = static_cast<juce::uint8>(note);
+  slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+void sfzero::Trace::writeChromeTrace(juce::OutputStream &out) const
+{
+  static const char *const segmentNames[] = {"delay", "attack", "hold", "decay", "sustain", "release", "done"};
+
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  if (slots_ == nullptr)
+  {
+    out << "]}\n";
+    return;
+  }
+
+  juce::uint64 end = next_.load(std::memory_order_acquire);
+  juce::uint64 start = end > static_cast<juce::uint64>(capacity) ? end - capacity : 0;
+  double microsecondsPerTick = 1.0e6 / static_cast<double>(juce::Time::getHighResolutionTicksPerSecond());
+  juce::int64 firstTicks = 0;
+  bool first = true;
+
+  for (juce::uint64 index = start; index < end; ++index)
+  {
+    // Copy it and check it wasn't rewritten meanwhile.
+    const Slot &slot = slots_[static_cast<int>(index & (capacity - 1))];
+    if (slot.sequence.load(std::memory_order_acquire) != index + 1)
+    {
+      continue;
+    }
+    Event event = slot.event;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != index + 1)
+    {
+      continue;
+    }
+
+    if (first)
+    {
+      firstTicks = event.ticks;
+    }
+    else
+    {
+      out << ",";
+    }
+    first = false;
+
+    out << "\n{\"pid\":1,\"tid\":" << juce::String(event.thread)
+        << ",\"ts\":" << juce::String((event.ticks - firstTicks) * microsecondsPerTick, 3);
+    juce::String voiceArgs = "\"voice\":" + juce::String(event.voice) + ",\"channel\":" + juce::String(event.channel) +
+                             ",\"note\":" + juce::String(event.note);
+    juce::String region = "\"region\":\"0x" + juce::String::toHexString(static_cast<juce::int64>(event.region)) + "\"";
+    switch (event.type)
+    {
+    case renderStart:
+      out << ",\"ph\":\"B\",\"name\":\"render\",\"args\":{\"frames\":" << juce::String(event.value) << "}}";
+      break;
+    case renderEnd:
+      out << ",\"ph\":\"E\",\"name\":\"render\",\"args\":{\"voices\":" << juce::String(event.value) << "}}";
+      break;
+    case noteOn:
+    case noteOff:
+      out << ",\"ph\":\"i\",\"s\":\"t\",\"name\":\"" << (event.type == noteOn ? "note on" : "note off")
+          << "\",\"args\":{\"channel\":" << juce::String(event.channel) << ",\"note\":" << juce::String(event.note)
+          << ",\"velocity\":" << juce::String(event.value) << "}}";
+      break;
+    case voiceStart:
+      out << ",\"ph\":\"b\",\"cat\":\"voice\",\"id\":" << juce::String(event.voice)
+          << ",\"name\":\"voice\",\"args\":{" << voiceArgs << ",\"velocity\":" << juce::String(event.value) << ","
+          << region << "}}";
+      break;
+    case voiceEnd:
+      out << ",\"ph\":\"e\",\"cat\":\"voice\",\"id\":" << juce::String(event.voice)
+          << ",\"name\":\"voice\",\"args\":{" << region << "}}";
+      break;
+    case voiceSteal:
+    case voiceShed:
+      out << ",\"ph\":\"i\",\"s\":\"t\",\"name\":\"" << (event.type == voiceSteal ? "steal" : "shed")
+          << "\",\"args\":{" << voiceArgs << "," << region << "}}";
+      break;
+    case envelopeSegment:
+      out << ",\"ph\":\"n\",\"cat\":\"voice\",\"id\":" << juce::String(event.voice) << ",\"name\":\""
+          << (juce::isPositiveAndBelow(event.value, 7) ? segmentNames[event.value] : "segment") << "\"}";
+      break;
+    default:
+      out << ",\"ph\":\"i\",\"s\":\"t\",\"name\":\"unknown\"}";
+      break;
+    }
+  }
+  out << "\n]}\n";
+}
+
+bool sfzero::Trace::writeChromeTrace(const juce::File &file) const
+{
+  juce::FileOutputStream out(file);
+  if (!out.openedOk())
+  {
+    return false;
+  }
+  out.setPosition(0);
+  out.truncate();
+  writeChromeTrace(out);
+  out.flush();
+  return out.getStatus().wasOk();
+}
@@ -0,0 +1,93 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#ifndef SFZTRACE_H_INCLUDED
+#define SFZTRACE_H_INCLUDED
+
+#include "SFZCommon.h"
+
+#ifndef SFZERO_TRACE
+#define SFZERO_TRACE 0
+#endif
+
+namespace sfzero
+{
+
+struct Region;
+
+// A flight recorder for dropouts: what the synth did, render by render and
+// voice by voice, in a ring that keeps the last capacity events.  The audio
+// and render threads write to it without locking or allocating; the message
+// thread writes what's in it out as Chrome trace events, which Perfetto and
+// chrome://tracing open.  It's only built in with SFZERO_TRACE set, and
+// SFZERO_TRACE_EVENT() compiles to nothing otherwise.
+class Trace
+{
+public:
+  enum Type : juce::uint8
+  {
+    renderStart, // value: frames
+    renderEnd,   // value: voices rendered
+    noteOn,      // value: velocity
+    noteOff,
+    voiceStart, // value: velocity
+    voiceSteal,
+    voiceShed,
+    voiceEnd,
+    envelopeSegment // value: the segment entered, as EG numbers them
+  };
+
+  static constexpr int capacity = 1 << 16;
+
+  Trace();
+  ~Trace();
+
+  // Message thread.  Recording starts from an empty ring.
+  void setRecording(bool shouldRecord);
+  bool isRecording() const { return recording_.load(std::memory_order_relaxed); }
+
+  // Any thread.  Voice is a pool index, or -1; channel 1-16, or 0.
+  void record(Type type, int voice, int channel, int note, int value, const Region *region = nullptr);
+
+  // Message thread.  The events still in the ring, oldest first.  Ones being
+  // overwritten as they're read are left out.
+  void writeChromeTrace(juce::OutputStream &out) const;
+  bool writeChromeTrace(const juce::File &file) const;
+
+private:
+  struct Event
+  {
+    juce::int64 ticks;
+    juce::uint64 region;
+    juce::uint32 thread;
+    juce::int32 value;
+    juce::int16 voice;
+    juce::uint8 type, channel, note;
+  };
+
+  // Each slot's sequence is the event's index plus one once it's written,
+  // and 0 while it's being written.
+  struct Slot
+  {
+    std::atomic<juce::uint64> sequence{0};
+    Event event;
+  };
+
+  std::unique_ptr<Slot[]> slots_; // Allocated the first time recording starts.
+  std::atomic<juce::uint64> next_;
+  std::atomic<bool> recording_;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Trace)
+};
+}
+
+#if SFZERO_TRACE
+#define SFZERO_TRACE_EVENT(trace, ...) ((trace) != nullptr ? (trace)->record(__VA_ARGS__) : (void)0)
+#else
+#define SFZERO_TRACE_EVENT(trace, ...) ((void)0)
+#endif
+
+#endif // SFZTRACE_H_INCLUDED
@@ -8,14 +8,333 @@
 #include "SFZRegion.h"
 #include "SFZSample.h"
 #include "SFZSound.h"
+#include "SFZStream.h"
 #include "SFZVoice.h"
 #include <math.h>
 
-static const float globalGain = -1.0;
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SFZERO_VOICE_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SFZERO_VOICE_NEON 1
+#endif
 
-sfzero::Voice::Voice()
-    : region_(nullptr), trigger_(0), curMidiNote_(0), curPitchWheel_(0), pitchRatio_(0), noteGainLeft_(0), noteGainRight_(0),
-      sourceSamplePosition_(0), sampleEnd_(0), loopStart_(0), loopEnd_(0), numLoops_(0), curVelocity_(0)
+
+// Frames handled per step by the vector path of Voice::renderNextBlock().
+static const int voiceKernelWidth = 4;
+
+// Frames of envelope rendered ahead by Voice::renderNextBlock().
+static const int envelopeBlockSize = 64;
+
+// Once its envelope is past the peak, a voice whose output has fallen below
+// this (about -90dB) is retired rather than rendered on to the envelope's end.
+static const float silentGain = 3.0e-5f;
+
+// Linear interpolation of four frames, scaled by noteGain times the per-frame
+// envelope and added to out.  The operation order matches the scalar path, so
+// results are identical unless the compiler contracts the scalar code into
+// FMAs (which clang does by default on ARM); the difference is then at most a
+// few ulps per frame.
+static inline void mixVoiceFrames(float *out, const float *cur, const float *next, const float *alpha,
+                                  const float *envelope, float noteGain)
+{
+#if SFZERO_VOICE_SSE
+  __m128 a = _mm_loadu_ps(alpha);
+  __m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(cur), _mm_sub_ps(_mm_set1_ps(1.0f), a)), _mm_mul_ps(_mm_loadu_ps(next), a));
+  __m128 gain = _mm_mul_ps(_mm_set1_ps(noteGain), _mm_loadu_ps(envelope));
+  _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), _mm_mul_ps(v, gain)));
+#elif SFZERO_VOICE_NEON
+  float32x4_t a = vld1q_f32(alpha);
+  float32x4_t v = vaddq_f32(vmulq_f32(vld1q_f32(cur), vsubq_f32(vdupq_n_f32(1.0f), a)), vmulq_f32(vld1q_f32(next), a));
+  float32x4_t gain = vmulq_f32(vdupq_n_f32(noteGain), vld1q_f32(envelope));
+  vst1q_f32(out, vaddq_f32(vld1q_f32(out), vmulq_f32(v, gain)));
+#else
+  for (int i = 0; i < voiceKernelWidth; ++i)
+  {
+    out[i] += (cur[i] * (1.0f - alpha[i]) + next[i] * alpha[i]) * (noteGain * envelope[i]);
+  }
+#endif
+}
+
+// As mixVoiceFrames() with an alpha of zero, for a voice stepping exactly one
+// source frame per output frame, e.g. a sample converted to the device rate
+// played at its root key.  It skips the interpolation, not the result: the
+// two agree exactly.
+static inline void mixVoiceFramesDirect(float *out, const float *cur, const float *envelope, float noteGain)
+{
+  for (int i = 0; i < voiceKernelWidth; ++i)
+  {
+    out[i] += cur[i] * (noteGain * envelope[i]);
+  }
+}
+
+// As mixVoiceFrames(), but folds both channels down into a mono output.
+static inline void mixVoiceFramesMono(float *out, const float *curL, const float *nextL, const float *curR,
+                                      const float *nextR, const float *alpha, const float *envelope, float noteGainL,
+                                      float noteGainR)
+{
+#if SFZERO_VOICE_SSE
+  __m128 a = _mm_loadu_ps(alpha);
+  __m128 invA = _mm_sub_ps(_mm_set1_ps(1.0f), a);
+  __m128 eg = _mm_loadu_ps(envelope);
+  __m128 l = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(curL), invA), _mm_mul_ps(_mm_loadu_ps(nextL), a)),
+                        _mm_mul_ps(_mm_set1_ps(noteGainL), eg));
+  __m128 r = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(curR), invA), _mm_mul_ps(_mm_loadu_ps(nextR), a)),
+                        _mm_mul_ps(_mm_set1_ps(noteGainR), eg));
+  _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), _mm_mul_ps(_mm_add_ps(l, r), _mm_set1_ps(0.5f))));
+#elif SFZERO_VOICE_NEON
+  float32x4_t a = vld1q_f32(alpha);
+  float32x4_t invA = vsubq_f32(vdupq_n_f32(1.0f), a);
+  float32x4_t eg = vld1q_f32(envelope);
+  float32x4_t l = vmulq_f32(vaddq_f32(vmulq_f32(vld1q_f32(curL), invA), vmulq_f32(vld1q_f32(nextL), a)),
+                            vmulq_f32(vdupq_n_f32(noteGainL), eg));
+  float32x4_t r = vmulq_f32(vaddq_f32(vmulq_f32(vld1q_f32(curR), invA), vmulq_f32(vld1q_f32(nextR), a)),
+                            vmulq_f32(vdupq_n_f32(noteGainR), eg));
+  vst1q_f32(out, vaddq_f32(vld1q_f32(out), vmulq_f32(vaddq_f32(l, r), vdupq_n_f32(0.5f))));
+#else
+  for (int i = 0; i < voiceKernelWidth; ++i)
+  {
+    float l = (curL[i] * (1.0f - alpha[i]) + nextL[i] * alpha[i]) * (noteGainL * envelope[i]);
+    float r = (curR[i] * (1.0f - alpha[i]) + nextR[i] * alpha[i]) * (noteGainR * envelope[i]);
+    out[i] += (l + r) * 0.5f;
+  }
+#endif
+}
+
+// Polyphase windowed-sinc kernels.  Row p holds the taps for a fractional
+// position of p / sincNumPhases; there is one extra row so the kernel can be
+// interpolated between phases.
+static const int sincNumPhases = 256;
+
+template <int numTaps> static const float *getSincTable()
+{
+  struct Table
+  {
+    float taps[(sincNumPhases + 1) * numTaps];
+
+    Table()
+    {
+      const double halfWidth = numTaps / 2;
+      for (int phase = 0; phase <= sincNumPhases; ++phase)
+      {
+        double frac = static_cast<double>(phase) / sincNumPhases;
+        float *row = taps + phase * numTaps;
+        double sum = 0.0;
+        for (int i = 0; i < numTaps; ++i)
+        {
+          // Tap i sits at offset (i - numTaps / 2 + 1) from the integer position.
+          double x = (i - numTaps / 2 + 1) - frac;
+          double sinc = (x == 0.0) ? 1.0 : sin(juce::MathConstants<double>::pi * x) / (juce::MathConstants<double>::pi * x);
+          double w = x / halfWidth;
+          double window = (fabs(w) >= 1.0) ? 0.0
+                                           : 0.42 + 0.5 * cos(juce::MathConstants<double>::pi * w) +
+                                                 0.08 * cos(2.0 * juce::MathConstants<double>::pi * w);
+          row[i] = static_cast<float>(sinc * window);
+          sum += row[i];
+        }
+        // Normalize for unity gain at DC.
+        for (int i = 0; i < numTaps; ++i)
+        {
+          row[i] = static_cast<float>(row[i] / sum);
+        }
+      }
+    }
+  };
+
+  static const Table table;
+  return table.taps;
+}
+
+// Source samples are floats, 16-bit PCM read in place (see
+// Sample::setPCMData()), or 16-bit PCM decoded through the voice's block cache
+// (see Sample::setCompressedData()); PCM is scaled exactly as
+// SF2Reader::readSamples() does.
+static inline float voiceSampleValue(const float *in, int index) { return in[index]; }
+static inline float voiceSampleValue(const juce::int16 *in, int index) { return in[index] / 32767.0f; }
+static inline float voiceSampleValue(const sfzero::StreamChannel *in, int index) { return in->valueAt(index); }
+static inline float voiceSampleValue(const sfzero::CompressedChannel *in, int index) { return in->valueAt(index); }
+
+// Reads the source at index, following the loop the same way the linear path
+// does (the frame after loopEnd is loopStart) and clamping at the buffer edges.
+template <typename SampleType>
+static inline float voiceTapAt(const SampleType *in, int index, int numSamples, bool looping, int loopStart, int loopEnd)
+{
+  if (looping && index > loopEnd)
+  {
+    index = loopStart + (index - loopEnd - 1) % (loopEnd - loopStart + 1);
+  }
+  return voiceSampleValue(in, juce::jlimit(0, numSamples - 1, index));
+}
+
+template <int numTaps, typename SampleType>
+static inline float voiceSincAt(const SampleType *in, int pos, float alpha, int numSamples, bool looping, int loopStart,
+                                int loopEnd)
+{
+  float phase = alpha * sincNumPhases;
+  int row = juce::jmin(static_cast<int>(phase), sincNumPhases - 1);
+  float mix = phase - row;
+  const float *taps0 = getSincTable<numTaps>() + row * numTaps;
+  const float *taps1 = taps0 + numTaps;
+
+  float result = 0.0f;
+  int first = pos - numTaps / 2 + 1;
+  for (int i = 0; i < numTaps; ++i)
+  {
+    float tap = taps0[i] + (taps1[i] - taps0[i]) * mix;
+    result += tap * voiceTapAt(in, first + i, numSamples, looping, loopStart, loopEnd);
+  }
+  return result;
+}
+
+// Interpolated source value at pos + alpha for the non-linear modes.
+template <typename SampleType>
+static inline float voiceInterpolate(sfzero::Voice::Interpolation interpolation, const SampleType *in, int pos, float alpha,
+                                     int numSamples, bool looping, int loopStart, int loopEnd)
+{
+  switch (interpolation)
+  {
+  case sfzero::Voice::hermite:
+  {
+    float xm1 = voiceTapAt(in, pos - 1, numSamples, looping, loopStart, loopEnd);
+    float x0 = voiceTapAt(in, pos, numSamples, looping, loopStart, loopEnd);
+    float x1 = voiceTapAt(in, pos + 1, numSamples, looping, loopStart, loopEnd);
+    float x2 = voiceTapAt(in, pos + 2, numSamples, looping, loopStart, loopEnd);
+    float c1 = 0.5f * (x1 - xm1);
+    float c2 = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+    float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+    return ((c3 * alpha + c2) * alpha + c1) * alpha + x0;
+  }
+  case sfzero::Voice::sinc8:
+    return voiceSincAt<8>(in, pos, alpha, numSamples, looping, loopStart, loopEnd);
+  case sfzero::Voice::sinc16:
+    return voiceSincAt<16>(in, pos, alpha, numSamples, looping, loopStart, loopEnd);
+  case sfzero::Voice::linear:
+  default:
+  {
+    float x0 = voiceTapAt(in, pos, numSamples, looping, loopStart, loopEnd);
+    float x1 = voiceTapAt(in, pos + 1, numSamples, looping, loopStart, loopEnd);
+    return x0 + (x1 - x0) * alpha;
+  }
+  }
+}
+
+// 2^(c / 1200) for whole cents c from 0 to 1200, so pitch changes need no
+// pow().
+static const double *getCentsTable()
+{
+  struct Table
+  {
+    double ratios[1201];
+
+    Table()
+    {
+      for (int cents = 0; cents <= 1200; ++cents)
+      {
+        ratios[cents] = pow(2.0, cents / 1200.0);
+      }
+    }
+  };
+  static const Table table;
+  return table.ratios;
+}
+
+// The frequency ratio of an interval in cents.  Whole octaves go to the
+// exponent and the rest is interpolated between whole cents, which is within
+// 1e-4 cents of pow().
+static double centsToRatio(double cents)
+{
+  double octaves = std::floor(cents / 1200.0);
+  double rest = cents - octaves * 1200.0;
+  int index = juce::jmin(static_cast<int>(rest), 1199);
+  const double *ratios = getCentsTable();
+  double ratio = ratios[index] + (ratios[index + 1] - ratios[index]) * (rest - index);
+  return std::ldexp(ratio, static_cast<int>(octaves));
+}
+
+// The low-pass filter's prewarped cutoff, tan(pi * f / fs), for cutoffs in
+// cents relative to the sample rate, every 10 cents from filterLowestCents (a
+// 20Hz cutoff at 192kHz and then some) to filterHighestCents (0.47 fs).
+// Coefficient updates then need no tan() or pow(), only a lookup.
+static const int filterLowestCents = -18000;
+static const int filterHighestCents = -1300;
+static const int filterCentsStep = 10;
+static const int filterTableSize = (filterHighestCents - filterLowestCents) / filterCentsStep + 1;
+
+static const float *getFilterTable()
+{
+  struct Table
+  {
+    float warped[filterTableSize];
+
+    Table()
+    {
+      for (int i = 0; i < filterTableSize; ++i)
+      {
+        double ratio = pow(2.0, (filterLowestCents + i * filterCentsStep) / 1200.0);
+        warped[i] = static_cast<float>(tan(juce::MathConstants<double>::pi * ratio));
+      }
+    }
+  };
+  static const Table table;
+  return table.warped;
+}
+
+// Interpolated between the table's steps, and clamped to its ends.
+static float filterWarp(float relativeCents)
+{
+  float index = (juce::jlimit(static_cast<float>(filterLowestCents), static_cast<float>(filterHighestCents),
+                              relativeCents) -
+                 filterLowestCents) /
+                filterCentsStep;
+  int i = juce::jmin(static_cast<int>(index), filterTableSize - 2);
+  const float *warped = getFilterTable();
+  return warped[i] + (warped[i + 1] - warped[i]) * (index - i);
+}
+
+// A triangle wave from 0 rising to 1, starting delaySeconds after the note,
+// as both SF2 LFOs are.  Worked out from the note's age rather than stepped, so
+// there's no phase to keep.
+static float triangleLfo(juce::int64 noteFrames, double sampleRate, float delaySeconds, float frequency)
+{
+  double seconds = noteFrames / sampleRate - delaySeconds;
+  if (seconds <= 0.0)
+  {
+    return 0.0f;
+  }
+  double phase = seconds * frequency;
+  float t = static_cast<float>(phase - std::floor(phase));
+  return t < 0.25f ? 4.0f * t : (t < 0.75f ? 2.0f - 4.0f * t : 4.0f * t - 4.0f);
+}
+
+// One frame of a trapezoidal state-variable low-pass (Zavalishin's), which
+// stays stable however fast its coefficients change.
+static inline float filterFrame(float in, float *state, const float *coefficients)
+{
+  float v3 = in - state[1];
+  float v1 = coefficients[0] * state[0] + coefficients[1] * v3;
+  float v2 = state[1] + coefficients[1] * state[0] + coefficients[2] * v3;
+  state[0] = 2.0f * v1 - state[0];
+  state[1] = 2.0f * v2 - state[1];
+  return v2;
+}
+
+void sfzero::Voice::prepareInterpolationTables()
+{
+  getSincTable<8>();
+  getSincTable<16>();
+  getCentsTable();
+  getFilterTable();
+}
+
+sfzero::Voice::Voice(sfzero::VoiceTable &table, int slot)
+    : region_(nullptr), nextRegion_(nullptr), table_(table), slot_(slot), preset_(0), interpolation_(linear),
+      stemOutput_(false), stream_(nullptr), conversion_(nullptr), sourceSampleRate_(44100.0), hitCache_(nullptr), hit_(nullptr),
+      recordingHit_(false), hitFrame_(0), hitStartPosition_(0), trigger_(0), curMidiNote_(0), curPitchWheel_(0), noteGainLeft_(0), noteGainRight_(0),
+      channelGainLeft_(1), channelGainRight_(1), gainRampBlocks_(0), gainStepLeft_(0), gainStepRight_(0), basePitchRatio_(1),
+      pitchRampBlocks_(0), pitchStep_(0), pitchTarget_(1), filtering_(false), filterBuiltCents_(0), filterRate_(0),
+      filterRateCents_(0), modulating_(false), noteFrames_(0), modegFrames_(0), modPitchFactor_(1), modGain_(1),
+      modWheelCents_(0), numLoops_(0), curVelocity_(0)
 {
   ampeg_.setExponentialDecay(true);
 }
@@ -27,8 +346,11 @@ bool sfzero::Voice::canPlaySound(juce::SynthesiserSound *sound) { return dynamic
 void sfzero::Voice::startNote(int midiNoteNumber, float floatVelocity, juce::SynthesiserSound *soundIn,
                               int currentPitchWheelPosition)
 {
-  sfzero::Sound *sound = dynamic_cast<sfzero::Sound *>(soundIn);
+  // canPlaySound() only lets sfzero::Sounds through.
+  sfzero::Sound *sound = static_cast<sfzero::Sound *>(soundIn);
 
+  region_ = nextRegion_;
+  nextRegion_ = nullptr;
   if (sound == nullptr)
   {
     killNote();
@@ -39,9 +361,9 @@ void sfzero::Voice::startNote(int midiNoteNumber, float floatVelocity, juce::Syn
   curVelocity_ = velocity;
   if (region_ == nullptr)
   {
-    region_ = sound->getRegionFor(midiNoteNumber, velocity);
+    region_ = sound->getRegionFor(midiNoteNumber, velocity, sfzero::Region::attack, preset_);
   }
-  if ((region_ == nullptr) || (region_->sample == nullptr) || (region_->sample->getBuffer() == nullptr))
+  if ((region_ == nullptr) || (region_->sample == nullptr) || !region_->sample->hasData())
   {
     killNote();
     return;
@@ -52,38 +374,39 @@ void sfzero::Voice::startNote(int midiNoteNumber, float floatVelocity, juce::Syn
     return;
   }
 
-  // Pitch.
-  curMidiNote_ = midiNoteNumber;
-  curPitchWheel_ = currentPitchWheelPosition;
-  calcPitchRatio();
-
-  // Gain.
-  double noteGainDB = globalGain + region_->volume;
-  // Thanks to <http:://www.drealm.info/sfz/plj-sfz.xhtml> for explaining the
-  // velocity curve in a way that I could understand, although they mean
-  // "log10" when they say "log".
-  double velocityGainDB = -20.0 * log10((127.0 * 127.0) / (velocity * velocity));
-  velocityGainDB *= region_->amp_veltrack / 100.0;
-  noteGainDB += velocityGainDB;
-  noteGainLeft_ = noteGainRight_ = static_cast<float>(juce::Decibels::decibelsToGain(noteGainDB));
-  // The SFZ spec is silent about the pan curve, but a 3dB pan law seems
-  // common.  This sqrt() curve matches what Dimension LE does; Alchemy Free
-  // seems closer to sin(adjustedPan * pi/2).
-  double adjustedPan = (region_->pan + 100.0) / 200.0;
-  noteGainLeft_ *= static_cast<float>(sqrt(1.0 - adjustedPan));
-  noteGainRight_ *= static_cast<float>(sqrt(adjustedPan));
+  // Gain: the region's volume and pan were worked out as it loaded.
+  float velocityGain = region_->velocityGain(velocity);
+  noteGainLeft_ = region_->gain_left * velocityGain;
+  noteGainRight_ = region_->gain_right * velocityGain;
+  table_.gainLeft(slot_) = noteGainLeft_ * channelGainLeft_;
+  table_.gainRight(slot_) = noteGainRight_ * channelGainRight_;
+  gainRampBlocks_ = 0;
   ampeg_.startNote(&region_->ampeg, floatVelocity, getSampleRate(), &region_->ampeg_veltrack);
 
-  // Offset/end.
-  sourceSamplePosition_ = static_cast<double>(region_->offset);
-  sampleEnd_ = region_->sample->getSampleLength();
-  if ((region_->end > 0) && (region_->end < sampleEnd_))
+  // Offset/end.  A converted sample's positions scale with its rate.
+  sfzero::Sample *sample = region_->sample;
+  conversion_ = sample->getConversion(getSampleRate());
+  const double positionScale = conversion_ ? conversion_->ratio : 1.0;
+  auto toPlayedFrame = [positionScale](juce::int64 frame) {
+    return static_cast<juce::int64>(std::round(frame * positionScale));
+  };
+  table_.position(slot_) = static_cast<double>(toPlayedFrame(region_->offset));
+  if (stream_ && sample->isStreamed())
+  {
+    stream_->start(sample, region_->offset);
+  }
+  juce::int64 &sampleEnd = table_.sampleEnd(slot_);
+  sampleEnd = static_cast<juce::int64>(sample->getSampleLength());
+  if ((region_->end > 0) && (region_->end < sampleEnd))
   {
-    sampleEnd_ = region_->end + 1;
+    sampleEnd = region_->end + 1;
   }
+  sampleEnd = conversion_ ? juce::jmin(toPlayedFrame(sampleEnd), conversion_->numFrames) : sampleEnd;
 
   // Loop.
-  loopStart_ = loopEnd_ = 0;
+  juce::int64 &loopStart = table_.loopStart(slot_);
+  juce::int64 &loopEnd = table_.loopEnd(slot_);
+  loopStart = loopEnd = 0;
   sfzero::Region::LoopMode loopMode = region_->loop_mode;
   if (loopMode == sfzero::Region::sample_loop)
   {
@@ -100,18 +423,103 @@ void sfzero::Voice::startNote(int midiNoteNumber, float floatVelocity, juce::Syn
   {
     if (region_->loop_start < region_->loop_end)
     {
-      loopStart_ = region_->loop_start;
-      loopEnd_ = region_->loop_end;
+      loopStart = region_->loop_start;
+      loopEnd = region_->loop_end;
     }
     else
     {
-      loopStart_ = region_->sample->getLoopStart();
-      loopEnd_ = region_->sample->getLoopEnd();
+      loopStart = region_->sample->getLoopStart();
+      loopEnd = region_->sample->getLoopEnd();
     }
   }
+
+  // Pitch.  A converted loop's ends are rounded to whole frames, so the
+  // pitch is corrected for its length to keep the loop's period exact.
+  sourceSampleRate_ = sample->getSampleRate();
+  if (conversion_ && (loopStart < loopEnd))
+  {
+    juce::int64 sourceLength = loopEnd - loopStart;
+    loopStart = toPlayedFrame(loopStart);
+    loopEnd = toPlayedFrame(loopEnd);
+    sourceSampleRate_ *= static_cast<double>(loopEnd - loopStart) / sourceLength;
+  }
+  else if (conversion_)
+  {
+    sourceSampleRate_ = conversion_->sampleRate;
+  }
+  curMidiNote_ = midiNoteNumber;
+  curPitchWheel_ = currentPitchWheelPosition;
+  calcPitchRatio();
+  startModulation(floatVelocity);
+  startFilter();
   numLoops_ = 0;
+  startHit();
+  table_.setPlaying(slot_, true);
+#if SFZERO_TRACE
+  tracedSegment_ = -1;
+#endif
+  traceSegment();
 }
 
+void sfzero::Voice::startHit()
+{
+  hit_ = nullptr;
+  recordingHit_ = false;
+  hitFrame_ = 0;
+  double pitchRatio = table_.pitchRatio(slot_);
+  sfzero::Sample *sample = region_->sample;
+  if (!hitCache_ || !hitCache_->isEnabled() || sample->isStreamed() || (pitchRatio <= 0.0) ||
+      region_->pitch_modulated || (modWheelCents_ != 0.0f) ||
+      (table_.loopStart(slot_) < table_.loopEnd(slot_)))
+  {
+    return;
+  }
+
+  hitStartPosition_ = table_.position(slot_);
+  hit_ = hitCache_->find(region_, conversion_, pitchRatio, interpolation_);
+  if (hit_ == nullptr)
+  {
+    int numChannels = 1;
+    if (conversion_)
+    {
+      numChannels = conversion_->getFormat() == sfzero::Sample::float32 ? conversion_->buffer.getNumChannels() : 1;
+    }
+    else if (sample->getFormat() == sfzero::Sample::float32)
+    {
+      numChannels = sample->getBuffer()->getNumChannels();
+    }
+    double maxFrames = std::ceil((table_.sampleEnd(slot_) - hitStartPosition_) / pitchRatio) + 1.0;
+    if (maxFrames < std::numeric_limits<int>::max())
+    {
+      hit_ = hitCache_->startRecording(region_, conversion_, pitchRatio, interpolation_, numChannels,
+                                       static_cast<int>(maxFrames));
+      recordingHit_ = (hit_ != nullptr);
+    }
+  }
+  else if (hit_->recording)
+  {
+    // Another voice is still recording it.
+    hit_ = nullptr;
+  }
+}
+
+void sfzero::Voice::leaveHit()
+{
+  if (recordingHit_)
+  {
+    sfzero::HitCache::finishRecording(hit_, hitFrame_);
+  }
+  else if (hit_)
+  {
+    // Carry on from where the recording would have been.
+    table_.position(slot_) = hitStartPosition_ + hitFrame_ * table_.pitchRatio(slot_);
+  }
+  hit_ = nullptr;
+  recordingHit_ = false;
+}
+
+void sfzero::Voice::detachHitCache() { leaveHit(); }
+
 void sfzero::Voice::stopNote(float /*velocity*/, bool allowTailOff)
 {
   if (!allowTailOff || (region_ == nullptr))
@@ -123,11 +531,12 @@ void sfzero::Voice::stopNote(float /*velocity*/, bool allowTailOff)
   if (region_->loop_mode != sfzero::Region::one_shot)
   {
     ampeg_.noteOff();
+    modeg_.noteOff();
   }
   if (region_->loop_mode == sfzero::Region::loop_sustain)
   {
     // Continue playing, but stop looping.
-    loopEnd_ = loopStart_;
+    table_.loopEnd(slot_) = table_.loopStart(slot_);
   }
 }
 
@@ -152,10 +561,18 @@ void sfzero::Voice::pitchWheelMoved(int newValue)
   }
 
   curPitchWheel_ = newValue;
-  calcPitchRatio();
+  // A bent note no longer matches what's cached.
+  leaveHit();
+  // Glide there a step per envelope block, rather than jumping.
+  pitchTarget_ = calcBentPitchRatio();
+  pitchRampBlocks_ =
+      juce::jmax(1, static_cast<int>(std::ceil(pitchRampSeconds * getSampleRate() / getControlBlockSize())));
+  pitchStep_ = (pitchTarget_ - table_.pitchRatio(slot_)) / pitchRampBlocks_;
 }
 
-void sfzero::Voice::controllerMoved(int /*controllerNumber*/, int /*newValue*/) { /***/}
+// Channel controllers are handled by the synth, which folds them into the
+// channel gain (see Synth::handleController()).
+void sfzero::Voice::controllerMoved(int /*controllerNumber*/, int /*newValue*/) {}
 void sfzero::Voice::renderNextBlock(juce::AudioSampleBuffer &outputBuffer, int startSample, int numSamples)
 {
   if (region_ == nullptr)
@@ -163,101 +580,483 @@ void sfzero::Voice::renderNextBlock(juce::AudioSampleBuffer &outputBuffer, int s
     return;
   }
 
-  juce::AudioSampleBuffer *buffer = region_->sample->getBuffer();
-  const float *inL = buffer->getReadPointer(0, 0);
-  const float *inR = buffer->getNumChannels() > 1 ? buffer->getReadPointer(1, 0) : nullptr;
+  if (hit_ && !recordingHit_ && renderHit(outputBuffer, startSample, numSamples))
+  {
+    return;
+  }
 
-  float *outL = outputBuffer.getWritePointer(0, startSample);
-  float *outR = outputBuffer.getNumChannels() > 1 ? outputBuffer.getWritePointer(1, startSample) : nullptr;
+  sfzero::Sample *sample = region_->sample;
+  if (conversion_)
+  {
+    if (const sfzero::CompressedPCM *compressed = conversion_->compressed.get())
+    {
+      renderCompressed(compressed, outputBuffer, startSample, numSamples);
+    }
+    else if (const juce::int16 *pcm = conversion_->pcm.get())
+    {
+      renderSamples(pcm, static_cast<const juce::int16 *>(nullptr), static_cast<int>(conversion_->numFrames),
+                    outputBuffer, startSample, numSamples);
+    }
+    else
+    {
+      const juce::AudioSampleBuffer &buffer = conversion_->buffer;
+      const float *inL = buffer.getReadPointer(0, 0);
+      const float *inR = buffer.getNumChannels() > 1 ? buffer.getReadPointer(1, 0) : nullptr;
+      renderSamples(inL, inR, buffer.getNumSamples(), outputBuffer, startSample, numSamples);
+    }
+  }
+  else if (sample->isStreamed())
+  {
+    renderStreamed(outputBuffer, startSample, numSamples);
+  }
+  else if (const sfzero::CompressedPCM *compressed = sample->getCompressedData())
+  {
+    renderCompressed(compressed, outputBuffer, startSample, numSamples);
+  }
+  else if (const juce::int16 *pcm = sample->getPCMData())
+  {
+    renderSamples(pcm, static_cast<const juce::int16 *>(nullptr), static_cast<int>(sample->getSampleLength()), outputBuffer,
+                  startSample, numSamples);
+  }
+  else
+  {
+    juce::AudioSampleBuffer *buffer = sample->getBuffer();
+    const float *inL = buffer->getReadPointer(0, 0);
+    const float *inR = buffer->getNumChannels() > 1 ? buffer->getReadPointer(1, 0) : nullptr;
+    renderSamples(inL, inR, buffer->getNumSamples(), outputBuffer, startSample, numSamples);
+  }
+}
 
-  int bufferNumSamples = buffer->getNumSamples(); // leoo
+bool sfzero::Voice::renderHit(juce::AudioSampleBuffer &outputBuffer, int startSample, int numSamples)
+{
+  // A partial recording that runs out during this block hands the whole
+  // block over to the interpolator.
+  if (!hit_->complete && (hit_->numFrames - hitFrame_ < numSamples))
+  {
+    leaveHit();
+    return false;
+  }
 
-  // Cache some values, to give them at least some chance of ending up in
-  // registers.
-  double sourceSamplePosition = this->sourceSamplePosition_;
-  float ampegGain = ampeg_.getLevel();
-  float ampegSlope = ampeg_.getSlope();
-  int samplesUntilNextAmpSegment = ampeg_.getSamplesUntilNextSegment();
-  bool ampSegmentIsExponential = ampeg_.getSegmentIsExponential();
-  float loopStart = static_cast<float>(this->loopStart_);
-  float loopEnd = static_cast<float>(this->loopEnd_);
-  float sampleEnd = static_cast<float>(this->sampleEnd_);
+  int firstChannel = getFirstOutputChannel(outputBuffer);
+  float *outL = outputBuffer.getWritePointer(firstChannel, startSample);
+  float *outR =
+      outputBuffer.getNumChannels() > firstChannel + 1 ? outputBuffer.getWritePointer(firstChannel + 1, startSample) : nullptr;
+  float noteGainLeft = table_.gainLeft(slot_);
+  float noteGainRight = table_.gainRight(slot_);
+  const float *inL = hit_->frames[0];
+  const float *inR = hit_->frames[1];
 
-  while (--numSamples >= 0)
+  alignas(16) float envelope[envelopeBlockSize];
+  alignas(16) float unfiltered[2][envelopeBlockSize];
+  bool finished = false;
+  while (numSamples > 0 && !finished)
   {
-    int pos = static_cast<int>(sourceSamplePosition);
-    jassert(pos >= 0 && pos < bufferNumSamples); // leoo
-    float alpha = static_cast<float>(sourceSamplePosition - pos);
-    float invAlpha = 1.0f - alpha;
-    int nextPos = pos + 1;
-    if ((loopStart < loopEnd) && (nextPos > loopEnd))
+    if (gainRampBlocks_ > 0)
     {
-      nextPos = static_cast<int>(loopStart);
+      stepGainRamp(noteGainLeft, noteGainRight);
+    }
+    int blockSize = juce::jmin(numSamples, getControlBlockSize());
+    int numFrames = ampeg_.render(envelope, blockSize);
+    finished = ampeg_.isDone();
+    traceSegment();
+    numSamples -= blockSize;
+    noteFrames_ += blockSize;
+    if (modulating_)
+    {
+      // Hits are never pitch modulated (see startHit()).
+      double frameRatio, ratioStep;
+      stepModulation(envelope, numFrames, 1.0, frameRatio, ratioStep);
     }
 
-    // Simple linear interpolation with buffer overrun check
-    float nextL = nextPos < bufferNumSamples ? inL[nextPos] : inL[pos];
-    float nextR = inR ? (nextPos < bufferNumSamples ? inR[nextPos] : inR[pos]) : nextL;
-    float l = (inL[pos] * invAlpha + nextL * alpha);
-    float r = inR ? (inR[pos] * invAlpha + nextR * alpha) : l;
-
-    //// Simple linear interpolation, old version (possible buffer overrun with non-loop??)
-    // float l = (inL[pos] * invAlpha + inL[nextPos] * alpha);
-    // float r = inR ? (inR[pos] * invAlpha + inR[nextPos] * alpha) : l;
-
-    float gainLeft = noteGainLeft_ * ampegGain;
-    float gainRight = noteGainRight_ * ampegGain;
-    l *= gainLeft;
-    r *= gainRight;
-    // Shouldn't we dither here?
+    // A filtered note mixes the block into unfiltered and filters that into
+    // the output.
+    float *mixL = outL, *mixR = outR;
+    if (filtering_)
+    {
+      updateFilter();
+      juce::FloatVectorOperations::clear(unfiltered[0], blockSize);
+      juce::FloatVectorOperations::clear(unfiltered[1], blockSize);
+      outL = unfiltered[0];
+      outR = mixR ? unfiltered[1] : nullptr;
+    }
 
+    // The same products as renderSamples(), from the recorded frames.
+    int count = juce::jmin(numFrames, hit_->numFrames - hitFrame_);
+    const float *l = inL + hitFrame_;
+    const float *r = inR + hitFrame_;
     if (outR)
     {
-      *outL++ += l;
-      *outR++ += r;
+      for (int i = 0; i < count; ++i)
+      {
+        outL[i] += l[i] * (noteGainLeft * envelope[i]);
+        outR[i] += r[i] * (noteGainRight * envelope[i]);
+      }
+      outR += count;
     }
     else
     {
-      *outL++ += (l + r) * 0.5f;
+      for (int i = 0; i < count; ++i)
+      {
+        outL[i] += (l[i] * (noteGainLeft * envelope[i]) + r[i] * (noteGainRight * envelope[i])) * 0.5f;
+      }
+    }
+    outL += count;
+    hitFrame_ += count;
+    if (filtering_)
+    {
+      filterInto(mixL, mixR, unfiltered[0], unfiltered[1], count);
+      outL = mixL + count;
+      outR = mixR ? mixR + count : nullptr;
+    }
+    if (hitFrame_ >= hit_->numFrames)
+    {
+      finished = true; // the end of the sample
+    }
+
+    if (ampeg_.isPastPeak() && ampeg_.getLevel() * juce::jmax(noteGainLeft_, noteGainRight_) < silentGain)
+    {
+      finished = true;
+    }
+  }
+
+  table_.gainLeft(slot_) = noteGainLeft;
+  table_.gainRight(slot_) = noteGainRight;
+  if (finished)
+  {
+    killNote();
+  }
+  return true;
+}
+
+int sfzero::Voice::getFirstOutputChannel(const juce::AudioSampleBuffer &outputBuffer) const
+{
+  int numPairs = outputBuffer.getNumChannels() / 2;
+  int midiChannel = table_.getChannel(slot_);
+  if (!stemOutput_ || numPairs < 2 || midiChannel < 1)
+  {
+    return 0;
+  }
+  return 2 * ((midiChannel - 1) % numPairs);
+}
+
+void sfzero::Voice::renderStreamed(juce::AudioSampleBuffer &outputBuffer, int startSample, int numSamples)
+{
+  sfzero::Sample *sample = region_->sample;
+  bool underrun = false;
+  sfzero::StreamChannel channels[2];
+  int numChannels = juce::jmin(2, sample->getNumChannels());
+
+  if (stream_)
+  {
+    stream_->getChannels(channels, numChannels, &underrun);
+  }
+  else
+  {
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+      channels[channel] = {sample->getResidentPages(channel), sfzero::Sample::streamPageShift,
+                           sfzero::Sample::streamPageSize - 1, nullptr, 0, 0, 0, &underrun};
     }
+  }
+
+  renderSamples(&channels[0], numChannels > 1 ? &channels[1] : nullptr, static_cast<int>(sample->getSampleLength()),
+                outputBuffer, startSample, numSamples);
 
-    // Next sample.
-    sourceSamplePosition += pitchRatio_;
-    if ((loopStart < loopEnd) && (sourceSamplePosition > loopEnd))
+  if (stream_)
+  {
+    if (underrun)
     {
-      sourceSamplePosition = loopStart;
-      numLoops_ += 1;
+      stream_->addUnderrun();
     }
+    // Leave room behind the position for the widest interpolation kernel.
+    stream_->setReadPosition(static_cast<juce::int64>(table_.position(slot_)) - 16);
+  }
+}
+
+void sfzero::Voice::renderCompressed(const sfzero::CompressedPCM *data, juce::AudioSampleBuffer &outputBuffer,
+                                    int startSample, int numSamples)
+{
+  // Blocks decoded for another note on the same data are still good.
+  if (decodeCache_.source != data)
+  {
+    decodeCache_.reset(data);
+  }
+  sfzero::CompressedChannel channel = {data, &decodeCache_};
+  renderSamples(&channel, static_cast<const sfzero::CompressedChannel *>(nullptr), static_cast<int>(data->getNumFrames()),
+                outputBuffer, startSample, numSamples);
+}
 
-    // Update EG.
-    if (ampSegmentIsExponential)
+template <typename SampleType>
+void sfzero::Voice::renderSamples(const SampleType *inL, const SampleType *inR, int bufferNumSamples,
+                                  juce::AudioSampleBuffer &outputBuffer, int startSample, int numSamples)
+{
+  int firstChannel = getFirstOutputChannel(outputBuffer);
+  float *outL = outputBuffer.getWritePointer(firstChannel, startSample);
+  float *outR =
+      outputBuffer.getNumChannels() > firstChannel + 1 ? outputBuffer.getWritePointer(firstChannel + 1, startSample) : nullptr;
+
+  // Picks the variant once, so the frame loops test none of this.
+  using Variant = void (sfzero::Voice::*)(const SampleType *, const SampleType *, int, float *, float *, int);
+  static const Variant variants[8] = {
+      &sfzero::Voice::renderVariant<SampleType, false, false, false>,
+      &sfzero::Voice::renderVariant<SampleType, false, false, true>,
+      &sfzero::Voice::renderVariant<SampleType, false, true, false>,
+      &sfzero::Voice::renderVariant<SampleType, false, true, true>,
+      &sfzero::Voice::renderVariant<SampleType, true, false, false>,
+      &sfzero::Voice::renderVariant<SampleType, true, false, true>,
+      &sfzero::Voice::renderVariant<SampleType, true, true, false>,
+      &sfzero::Voice::renderVariant<SampleType, true, true, true>,
+  };
+  bool looping = static_cast<float>(table_.loopStart(slot_)) < static_cast<float>(table_.loopEnd(slot_));
+  int variant = (inR ? 4 : 0) + (outR ? 2 : 0) + (looping ? 1 : 0);
+  (this->*variants[variant])(inL, inR, bufferNumSamples, outL, outR, numSamples);
+}
+
+template <typename SampleType, bool stereoSource, bool stereoOutput, bool looping>
+void sfzero::Voice::renderVariant(const SampleType *inL, const SampleType *inR, int bufferNumSamples, float *outL,
+                                  float *outR, int numSamples)
+{
+  // Copy the voice's slot into locals, to give them at least some chance of
+  // ending up in registers.
+  double sourceSamplePosition = table_.position(slot_);
+  double pitchRatio = table_.pitchRatio(slot_);
+  float noteGainLeft = table_.gainLeft(slot_);
+  float noteGainRight = table_.gainRight(slot_);
+  float loopStart = static_cast<float>(table_.loopStart(slot_));
+  float loopEnd = static_cast<float>(table_.loopEnd(slot_));
+  float sampleEnd = static_cast<float>(table_.sampleEnd(slot_));
+  bool linearInterpolation = (interpolation_ == linear);
+  int loopStartIndex = static_cast<int>(table_.loopStart(slot_));
+  int loopEndIndex = static_cast<int>(table_.loopEnd(slot_));
+  const SampleType *srcR = stereoSource ? inR : inL;
+  // A hit being recorded takes the scalar path, which keeps each frame
+  // before its gains.
+  sfzero::HitCache::Hit *recording = recordingHit_ ? hit_ : nullptr;
+
+  alignas(16) float envelope[envelopeBlockSize];
+  alignas(16) float unfiltered[2][envelopeBlockSize];
+  bool finished = false;
+
+  while (numSamples > 0 && !finished)
+  {
+    if (gainRampBlocks_ > 0)
     {
-      ampegGain *= ampegSlope;
+      stepGainRamp(noteGainLeft, noteGainRight);
     }
-    else
+    if (pitchRampBlocks_ > 0)
+    {
+      stepPitchRamp(pitchRatio);
+    }
+
+    // The amp envelope is rendered a block ahead; it only changes between
+    // calls (note-off etc.), so this matches stepping it per sample.
+    int blockSize = juce::jmin(numSamples, getControlBlockSize());
+    int numFrames = ampeg_.render(envelope, blockSize);
+    finished = ampeg_.isDone();
+    traceSegment();
+    numSamples -= blockSize;
+    noteFrames_ += blockSize;
+
+    // Modulation scales the envelope and ramps the pitch across the block,
+    // a step of ratioStep per frame; unmodulated notes step by nothing.
+    double frameRatio = pitchRatio, ratioStep = 0.0;
+    if (modulating_)
+    {
+      stepModulation(envelope, numFrames, pitchRatio, frameRatio, ratioStep);
+    }
+
+    // A filtered note mixes the block into unfiltered as usual, then filters
+    // that into the output, with the coefficients updated once per block.
+    float *mixL = outL, *mixR = outR;
+    if (filtering_)
     {
-      ampegGain += ampegSlope;
+      updateFilter();
+      juce::FloatVectorOperations::clear(unfiltered[0], blockSize);
+      outL = unfiltered[0];
+      if (stereoOutput)
+      {
+        juce::FloatVectorOperations::clear(unfiltered[1], blockSize);
+        outR = unfiltered[1];
+      }
+    }
+
+    int frame = 0;
+    while (frame < numFrames)
+    {
+      // Vector path: runs of frames that cross no loop point or sample end
+      // are interpolated voiceKernelWidth at a time.  Positions are still
+      // stepped one frame at a time, exactly as the scalar path does, so both
+      // paths agree on every boundary decision.
+      while (linearInterpolation && !recording && numFrames - frame >= voiceKernelWidth && frameRatio > 0.0)
+      {
+        double positions[voiceKernelWidth + 1];
+        positions[0] = sourceSamplePosition;
+        double ratio = frameRatio;
+        for (int i = 0; i < voiceKernelWidth; ++i)
+        {
+          positions[i + 1] = positions[i] + ratio;
+          ratio += ratioStep;
+        }
+        int lastPos = static_cast<int>(positions[voiceKernelWidth - 1]);
+        if ((positions[voiceKernelWidth] >= sampleEnd) || (lastPos + 1 >= bufferNumSamples) ||
+            (looping && ((lastPos + 1 > loopEnd) || (positions[voiceKernelWidth] > loopEnd))))
+        {
+          break;
+        }
+
+        float curL[voiceKernelWidth], nextL[voiceKernelWidth], curR[voiceKernelWidth], nextR[voiceKernelWidth];
+        float alpha[voiceKernelWidth];
+        if (stereoOutput && (frameRatio == 1.0) && (ratioStep == 0.0) && (positions[0] == std::floor(positions[0])))
+        {
+          int pos = static_cast<int>(positions[0]);
+          for (int i = 0; i < voiceKernelWidth; ++i)
+          {
+            curL[i] = voiceSampleValue(inL, pos + i);
+            curR[i] = stereoSource ? voiceSampleValue(srcR, pos + i) : curL[i];
+          }
+          mixVoiceFramesDirect(outL, curL, envelope + frame, noteGainLeft);
+          mixVoiceFramesDirect(outR, curR, envelope + frame, noteGainRight);
+          outL += voiceKernelWidth;
+          outR += voiceKernelWidth;
+          sourceSamplePosition = positions[voiceKernelWidth];
+          frame += voiceKernelWidth;
+          continue;
+        }
+        for (int i = 0; i < voiceKernelWidth; ++i)
+        {
+          int pos = static_cast<int>(positions[i]);
+          alpha[i] = static_cast<float>(positions[i] - pos);
+          curL[i] = voiceSampleValue(inL, pos);
+          nextL[i] = voiceSampleValue(inL, pos + 1);
+          curR[i] = stereoSource ? voiceSampleValue(srcR, pos) : curL[i];
+          nextR[i] = stereoSource ? voiceSampleValue(srcR, pos + 1) : nextL[i];
+        }
+
+        if (stereoOutput)
+        {
+          mixVoiceFrames(outL, curL, nextL, alpha, envelope + frame, noteGainLeft);
+          mixVoiceFrames(outR, curR, nextR, alpha, envelope + frame, noteGainRight);
+          outR += voiceKernelWidth;
+        }
+        else
+        {
+          mixVoiceFramesMono(outL, curL, nextL, curR, nextR, alpha, envelope + frame, noteGainLeft, noteGainRight);
+        }
+        outL += voiceKernelWidth;
+
+        sourceSamplePosition = positions[voiceKernelWidth];
+        frameRatio = ratio;
+        frame += voiceKernelWidth;
+      }
+      if (frame >= numFrames)
+      {
+        break;
+      }
+
+      // Scalar path: a single frame, handling loop wrap and the end of the
+      // sample.  The higher-quality interpolation modes always take this path.
+      int pos = static_cast<int>(sourceSamplePosition);
+      jassert(pos >= 0 && pos < bufferNumSamples); // leoo
+      float alpha = static_cast<float>(sourceSamplePosition - pos);
+      float l, r;
+      if (linearInterpolation)
+      {
+        float invAlpha = 1.0f - alpha;
+        int nextPos = pos + 1;
+        if (looping && (nextPos > loopEnd))
+        {
+          nextPos = static_cast<int>(loopStart);
+        }
+
+        // Simple linear interpolation with buffer overrun check
+        float nextL = voiceSampleValue(inL, nextPos < bufferNumSamples ? nextPos : pos);
+        float nextR = stereoSource ? voiceSampleValue(inR, nextPos < bufferNumSamples ? nextPos : pos) : nextL;
+        l = (voiceSampleValue(inL, pos) * invAlpha + nextL * alpha);
+        r = stereoSource ? (voiceSampleValue(inR, pos) * invAlpha + nextR * alpha) : l;
+      }
+      else
+      {
+        l = voiceInterpolate(interpolation_, inL, pos, alpha, bufferNumSamples, looping, loopStartIndex, loopEndIndex);
+        r = stereoSource ? voiceInterpolate(interpolation_, inR, pos, alpha, bufferNumSamples, looping, loopStartIndex,
+                                   loopEndIndex)
+                : l;
+      }
+
+      if (recording)
+      {
+        if (hitFrame_ < recording->capacity)
+        {
+          recording->frames[0][hitFrame_] = l;
+          recording->frames[1][hitFrame_] = r;
+          ++hitFrame_;
+        }
+        else
+        {
+          leaveHit();
+          recording = nullptr;
+        }
+      }
+
+      float gainLeft = noteGainLeft * envelope[frame];
+      float gainRight = noteGainRight * envelope[frame];
+      l *= gainLeft;
+      r *= gainRight;
+      // Shouldn't we dither here?
+
+      if (stereoOutput)
+      {
+        *outL++ += l;
+        *outR++ += r;
+      }
+      else
+      {
+        *outL++ += (l + r) * 0.5f;
+      }
+      ++frame;
+
+      // Next sample.
+      sourceSamplePosition += frameRatio;
+      frameRatio += ratioStep;
+      if (looping && (sourceSamplePosition > loopEnd))
+      {
+        sourceSamplePosition = loopStart;
+        numLoops_ += 1;
+      }
+
+      if (sourceSamplePosition >= sampleEnd)
+      {
+        if (recording)
+        {
+          recording->complete = true;
+        }
+        finished = true;
+        break;
+      }
     }
-    if (--samplesUntilNextAmpSegment < 0)
+    if (filtering_)
     {
-      ampeg_.setLevel(ampegGain);
-      ampeg_.nextSegment();
-      ampegGain = ampeg_.getLevel();
-      ampegSlope = ampeg_.getSlope();
-      samplesUntilNextAmpSegment = ampeg_.getSamplesUntilNextSegment();
-      ampSegmentIsExponential = ampeg_.getSegmentIsExponential();
+      int rendered = static_cast<int>(outL - unfiltered[0]);
+      filterInto(mixL, stereoOutput ? mixR : nullptr, unfiltered[0], unfiltered[1], rendered);
+      outL = mixL + rendered;
+      outR = stereoOutput ? mixR + rendered : outR;
     }
 
-    if ((sourceSamplePosition >= sampleEnd) || ampeg_.isDone())
+    // Judged before the channel gain, so turning a channel down and up
+    // again doesn't lose its held notes.
+    if (ampeg_.isPastPeak() && ampeg_.getLevel() * juce::jmax(noteGainLeft_, noteGainRight_) < silentGain)
     {
-      killNote();
-      break;
+      finished = true;
     }
   }
 
-  this->sourceSamplePosition_ = sourceSamplePosition;
-  ampeg_.setLevel(ampegGain);
-  ampeg_.setSamplesUntilNextSegment(samplesUntilNextAmpSegment);
+  table_.position(slot_) = sourceSamplePosition;
+  table_.pitchRatio(slot_) = pitchRatio;
+  table_.gainLeft(slot_) = noteGainLeft;
+  table_.gainRight(slot_) = noteGainRight;
+  if (finished)
+  {
+    killNote();
+  }
 }
 
 bool sfzero::Voice::isPlayingNoteDown() { return region_ && region_->trigger != sfzero::Region::release; }
@@ -268,7 +1067,125 @@ int sfzero::Voice::getGroup() { return region_ ? region_->group : 0; }
 
 juce::uint64 sfzero::Voice::getOffBy() { return region_ ? region_->off_by : 0; }
 
-void sfzero::Voice::setRegion(sfzero::Region *nextRegion) { region_ = nextRegion; }
+bool sfzero::Voice::isReleasing() { return ampeg_.isReleasing() || isPlayingButReleased(); }
+
+float sfzero::Voice::getCurrentLevel() const
+{
+  return ampeg_.getLevel() * juce::jmax(table_.getGainLeft(slot_), table_.getGainRight(slot_));
+}
+
+juce::pointer_sized_uint sfzero::Voice::getSourceAddress()
+{
+  if (region_ == nullptr)
+  {
+    return 0;
+  }
+  // The same choice of source as renderNextBlock(), with the left channel
+  // standing for both.
+  const void *base = nullptr;
+  size_t frameBytes = sizeof(float);
+  juce::int64 frame = static_cast<juce::int64>(table_.position(slot_));
+  sfzero::Sample *sample = region_->sample;
+  if (hit_ && !recordingHit_)
+  {
+    base = hit_->frames[0];
+    frame = hitFrame_;
+  }
+  else if (conversion_ && conversion_->compressed)
+  {
+    // Blocks are decoded whole, so a voice reads from its block's start.
+    base = conversion_->compressed->getBlockData(static_cast<int>(frame >> sfzero::CompressedPCM::blockShift));
+    frameBytes = 0;
+  }
+  else if (conversion_)
+  {
+    base = conversion_->pcm ? static_cast<const void *>(conversion_->pcm.get())
+                            : static_cast<const void *>(conversion_->buffer.getReadPointer(0));
+    frameBytes = conversion_->pcm ? sizeof(juce::int16) : sizeof(float);
+  }
+  else if (sample->isStreamed())
+  {
+    // Each stream has its own ring, so only its voice reads it.
+    base = stream_ ? static_cast<const void *>(stream_) : static_cast<const void *>(sample);
+    frame = 0;
+  }
+  else if (const sfzero::CompressedPCM *compressed = sample->getCompressedData())
+  {
+    base = compressed->getBlockData(static_cast<int>(frame >> sfzero::CompressedPCM::blockShift));
+    frameBytes = 0;
+  }
+  else if (const juce::int16 *pcm = sample->getPCMData())
+  {
+    base = pcm;
+    frameBytes = sizeof(juce::int16);
+  }
+  else
+  {
+    base = sample->getBuffer()->getReadPointer(0);
+  }
+  return reinterpret_cast<juce::pointer_sized_uint>(base) +
+         static_cast<juce::pointer_sized_uint>(juce::jmax<juce::int64>(0, frame)) * frameBytes;
+}
+
+void sfzero::Voice::setRegion(sfzero::Region *nextRegion) { nextRegion_ = nextRegion; }
+
+void sfzero::Voice::setChannelGain(float gainLeft, float gainRight)
+{
+  channelGainLeft_ = gainLeft;
+  channelGainRight_ = gainRight;
+  table_.gainLeft(slot_) = noteGainLeft_ * channelGainLeft_;
+  table_.gainRight(slot_) = noteGainRight_ * channelGainRight_;
+  gainRampBlocks_ = 0;
+}
+
+void sfzero::Voice::rampChannelGain(float gainLeft, float gainRight)
+{
+  if (region_ == nullptr)
+  {
+    setChannelGain(gainLeft, gainRight);
+    return;
+  }
+
+  channelGainLeft_ = gainLeft;
+  channelGainRight_ = gainRight;
+  gainRampBlocks_ =
+      juce::jmax(1, static_cast<int>(std::ceil(gainRampSeconds * getSampleRate() / getControlBlockSize())));
+  gainStepLeft_ = (noteGainLeft_ * channelGainLeft_ - table_.gainLeft(slot_)) / gainRampBlocks_;
+  gainStepRight_ = (noteGainRight_ * channelGainRight_ - table_.gainRight(slot_)) / gainRampBlocks_;
+}
+
+void sfzero::Voice::stepGainRamp(float &gainLeft, float &gainRight)
+{
+  // The last step lands exactly on the target.
+  if (--gainRampBlocks_ > 0)
+  {
+    gainLeft += gainStepLeft_;
+    gainRight += gainStepRight_;
+  }
+  else
+  {
+    gainLeft = noteGainLeft_ * channelGainLeft_;
+    gainRight = noteGainRight_ * channelGainRight_;
+  }
+}
+
+void sfzero::Voice::stepPitchRamp(double &pitchRatio)
+{
+  if (--pitchRampBlocks_ > 0)
+  {
+    pitchRatio += pitchStep_;
+  }
+  else
+  {
+    pitchRatio = pitchTarget_;
+  }
+}
+
+void sfzero::Voice::setChannelAndPreset(int midiChannel, int preset)
+{
+  table_.channel(slot_) = midiChannel;
+  preset_ = preset;
+}
 
 juce::String sfzero::Voice::infoString()
 {
@@ -289,41 +1206,186 @@ juce::String sfzero::Voice::infoString()
   return info;
 }
 
-void sfzero::Voice::calcPitchRatio()
+void sfzero::Voice::setModWheelDepth(float cents)
 {
-  double note = curMidiNote_;
+  if (cents == modWheelCents_)
+  {
+    return;
+  }
+  modWheelCents_ = cents;
+  if (region_ != nullptr)
+  {
+    // Vibrato takes the note out of the hit cache, like a bend.  The note
+    // stays modulated, so the wheel going back to zero glides there too.
+    leaveHit();
+    modulating_ = true;
+  }
+}
 
-  note += region_->transpose;
-  note += region_->tune / 100.0;
+int sfzero::Voice::getControlBlockSize() const { return modulating_ ? modulationBlockSize : envelopeBlockSize; }
 
-  double adjustedPitch = region_->pitch_keycenter + (note - region_->pitch_keycenter) * (region_->pitch_keytrack / 100.0);
-  if (curPitchWheel_ != 8192)
+void sfzero::Voice::startModulation(float floatVelocity)
+{
+  noteFrames_ = 0;
+  modPitchFactor_ = 1.0;
+  modGain_ = 1.0f;
+  modulating_ = region_->modulated || (modWheelCents_ != 0.0f);
+  if (region_->modeg_to_pitch != 0.0f || region_->modeg_to_cutoff != 0.0f)
   {
-    double wheel = ((2.0 * curPitchWheel_ / 16383.0) - 1.0);
-    if (wheel > 0)
+    modeg_.startNote(&region_->modeg, floatVelocity, getSampleRate() / modulationBlockSize);
+    modegFrames_ = 0;
+  }
+}
+
+void sfzero::Voice::stepModulation(float *envelope, int numFrames, double pitchRatio, double &frameRatio,
+                                   double &ratioStep)
+{
+  // The values at the end of the block, which the block ramps to.
+  const sfzero::Region &region = *region_;
+  float modEnv = 0.0f;
+  if (region.modeg_to_pitch != 0.0f || region.modeg_to_cutoff != 0.0f)
+  {
+    for (modegFrames_ += numFrames; modegFrames_ >= modulationBlockSize; modegFrames_ -= modulationBlockSize)
     {
-      adjustedPitch += wheel * region_->bend_up / 100.0;
+      float level;
+      modeg_.render(&level, 1);
     }
-    else
+    modEnv = modeg_.getLevel();
+  }
+  double sampleRate = getSampleRate();
+  float modLfo = triangleLfo(noteFrames_, sampleRate, region.modlfo_delay, region.modlfo_freq);
+  float vibLfo = (region.viblfo_to_pitch != 0.0f || modWheelCents_ != 0.0f)
+                     ? triangleLfo(noteFrames_, sampleRate, region.viblfo_delay, region.viblfo_freq)
+                     : 0.0f;
+
+  double cents = modEnv * region.modeg_to_pitch + modLfo * region.modlfo_to_pitch +
+                 vibLfo * (region.viblfo_to_pitch + modWheelCents_);
+  double pitchFactor = cents != 0.0 ? centsToRatio(cents) : 1.0;
+  frameRatio = pitchRatio * modPitchFactor_;
+  ratioStep = numFrames > 0 ? pitchRatio * (pitchFactor - modPitchFactor_) / numFrames : 0.0;
+  modPitchFactor_ = pitchFactor;
+
+  if (region.modlfo_to_volume != 0.0f)
+  {
+    // Decibels to a gain through the cents table: 20 * log10(2) dB an octave.
+    float gain = static_cast<float>(centsToRatio(modLfo * region.modlfo_to_volume * (1200.0 / 6.0206)));
+    float step = numFrames > 0 ? (gain - modGain_) / numFrames : 0.0f;
+    for (int i = 0; i < numFrames; ++i)
     {
-      adjustedPitch += wheel * region_->bend_down / -100.0;
+      envelope[i] *= modGain_ + step * i;
     }
+    modGain_ = gain;
+  }
+
+  if (filtering_)
+  {
+    table_.filterCents(slot_) = region.filter_cents + modEnv * region.modeg_to_cutoff + modLfo * region.modlfo_to_cutoff;
   }
-  double targetFreq = fractionalMidiNoteInHz(adjustedPitch);
-  double naturalFreq = juce::MidiMessage::getMidiNoteInHertz(region_->pitch_keycenter);
-  pitchRatio_ = (targetFreq * region_->sample->getSampleRate()) / (naturalFreq * getSampleRate());
 }
 
-void sfzero::Voice::killNote()
+void sfzero::Voice::startFilter()
 {
-  region_ = nullptr;
-  clearCurrentNote();
+  filtering_ = region_->filter_cents > 0.0f;
+  if (!filtering_)
+  {
+    return;
+  }
+  if (getSampleRate() != filterRate_)
+  {
+    filterRate_ = getSampleRate();
+    filterRateCents_ = static_cast<float>(1200.0 * log2(filterRate_ / 8.176));
+  }
+  table_.filterCents(slot_) = region_->filter_cents;
+  juce::FloatVectorOperations::clear(table_.filterState(slot_), 4);
+  filterBuiltCents_ = -1.0f;
+  updateFilter();
 }
 
-double sfzero::Voice::fractionalMidiNoteInHz(double note, double freqOfA)
+void sfzero::Voice::updateFilter()
 {
-  // Like MidiMessage::getMidiNoteInHertz(), but with a float note.
-  note -= 69;
-  // Now 0 = A
-  return freqOfA * pow(2.0, note / 12.0);
+  float cents = table_.filterCents(slot_);
+  if (cents == filterBuiltCents_)
+  {
+    return;
+  }
+  filterBuiltCents_ = cents;
+  float g = filterWarp(cents - filterRateCents_);
+  float *coefficients = table_.filterCoefficients(slot_);
+  coefficients[0] = 1.0f / (1.0f + g * (g + region_->filter_k));
+  coefficients[1] = g * coefficients[0];
+  coefficients[2] = g * coefficients[1];
+}
+
+void sfzero::Voice::filterInto(float *outL, float *outR, const float *inL, const float *inR, int numFrames)
+{
+  const float *coefficients = table_.filterCoefficients(slot_);
+  float *state = table_.filterState(slot_);
+  float stateL[2] = {state[0], state[1]}, stateR[2] = {state[2], state[3]};
+  if (outR)
+  {
+    for (int i = 0; i < numFrames; ++i)
+    {
+      outL[i] += filterFrame(inL[i], stateL, coefficients);
+      outR[i] += filterFrame(inR[i], stateR, coefficients);
+    }
+  }
+  else
+  {
+    for (int i = 0; i < numFrames; ++i)
+    {
+      outL[i] += filterFrame(inL[i], stateL, coefficients);
+    }
+  }
+  state[0] = stateL[0];
+  state[1] = stateL[1];
+  state[2] = stateR[0];
+  state[3] = stateR[1];
+}
+
+void sfzero::Voice::calcPitchRatio()
+{
+  double cents = (curMidiNote_ - region_->pitch_keycenter) * region_->pitch_cents_per_key + region_->pitch_offset_cents;
+  basePitchRatio_ = centsToRatio(cents) * sourceSampleRate_ / getSampleRate();
+  pitchRampBlocks_ = 0;
+  table_.pitchRatio(slot_) = calcBentPitchRatio();
+}
+
+double sfzero::Voice::calcBentPitchRatio() const
+{
+  if (curPitchWheel_ == 8192)
+  {
+    return basePitchRatio_;
+  }
+  double wheel = ((2.0 * curPitchWheel_ / 16383.0) - 1.0);
+  double cents = (wheel > 0) ? wheel * region_->bend_up : wheel * -region_->bend_down;
+  return basePitchRatio_ * centsToRatio(cents);
+}
+
+void sfzero::Voice::traceSegment()
+{
+#if SFZERO_TRACE
+  int segment = ampeg_.segmentIndex();
+  if (segment != tracedSegment_)
+  {
+    tracedSegment_ = segment;
+    SFZERO_TRACE_EVENT(trace_, Trace::envelopeSegment, slot_, 0, curMidiNote_, segment, region_);
+  }
+#endif
+}
+
+void sfzero::Voice::killNote()
+{
+  if (stream_)
+  {
+    stream_->stop();
+  }
+  leaveHit();
+  if (region_)
+  {
+    SFZERO_TRACE_EVENT(trace_, Trace::voiceEnd, slot_, 0, curMidiNote_, 0, region_);
+  }
+  region_ = nullptr;
+  conversion_ = nullptr;
+  table_.setPlaying(slot_, false);
+  clearCurrentNote();
 }
@@ -8,15 +8,30 @@
 #define SFZVOICE_H_INCLUDED
 
 #include "SFZEG.h"
+#include "SFZHitCache.h"
+#include "SFZSample.h"
+#include "SFZTrace.h"
+#include "SFZVoiceTable.h"
 
 namespace sfzero
 {
 struct Region;
+class StreamBuffer;
 
-class Voice : public juce::SynthesiserVoice
+// Final, so the synth's calls through Voice pointers need no virtual dispatch.
+class Voice final : public juce::SynthesiserVoice
 {
 public:
-  Voice();
+  enum Interpolation
+  {
+    linear,
+    hermite, // 4-point, 3rd-order Hermite
+    sinc8,   // 8-tap Blackman-windowed sinc
+    sinc16   // 16-tap Blackman-windowed sinc
+  };
+
+  // The voice keeps its render state in slot of table, which must outlive it.
+  Voice(VoiceTable &table, int slot);
   virtual ~Voice() override;
 
   bool canPlaySound(juce::SynthesiserSound *sound) override;
@@ -29,33 +44,171 @@ public:
   void renderNextBlock(juce::AudioSampleBuffer &outputBuffer, int startSample, int numSamples) override;
   bool isPlayingNoteDown();
   bool isPlayingOneShot();
+  bool isReleasing();
+  float getCurrentLevel() const;
+  // Where in memory the voice reads its next frame from, or 0 if it's idle.
+  // The synth renders voices in this order, so ones on the same sample, or
+  // on neighbouring samples of the shared buffer, follow each other.
+  juce::pointer_sized_uint getSourceAddress();
 
   int getGroup();
   juce::uint64 getOffBy();
 
   // Set the region to be used by the next startNote().
   void setRegion(Region *nextRegion);
+  // The region playing, or nullptr.
+  Region *getRegion() const { return region_; }
+
+  void setInterpolation(Interpolation newInterpolation) { interpolation_ = newInterpolation; }
+  Interpolation getInterpolation() const { return interpolation_; }
+
+  // Builds the shared windowed-sinc tables, so the first note using a sinc
+  // mode doesn't have to do it on the audio thread.
+  static void prepareInterpolationTables();
+
+  // The channel and subsound the voice was last started for.
+  void setChannelAndPreset(int midiChannel, int preset);
+  int getMidiChannel() const { return table_.getChannel(slot_); }
+  int getPreset() const { return preset_; }
+
+  // The channel's gain, multiplied into the note's own; applies immediately
+  // if the voice is playing and to the notes it starts after.
+  void setChannelGain(float gainLeft, float gainRight);
+  // The same, but a playing note moves to the new gain over about
+  // gainRampSeconds, a step per envelope block, so controller changes don't
+  // click.
+  void rampChannelGain(float gainLeft, float gainRight);
+  static constexpr double gainRampSeconds = 0.01;
+  // How long a playing note takes to glide to a new pitch-wheel position.
+  static constexpr double pitchRampSeconds = 0.005;
+
+  // The vibrato the channel's modulation wheel adds, in cents at the LFO's
+  // peak.  Like the channel gain it's set by the synth, for every voice on
+  // the channel.
+  void setModWheelDepth(float cents);
+
+  // Frames between evaluations of a modulated note's mod envelope and LFOs.
+  // Pitch and volume are interpolated across each, the cutoff steps.
+  static constexpr int modulationBlockSize = 32;
+
+  // Whether the voice renders to its MIDI channel's own pair of output
+  // channels (channel n to 2n-2 and 2n-1) rather than the first pair.  A
+  // buffer with fewer pairs than that wraps round.
+  void setStemOutput(bool enabled) { stemOutput_ = enabled; }
+
+  // Ring buffer for streamed samples, owned by the synth.  Without one a
+  // streamed sample plays only its resident pages.
+  void setStreamBuffer(StreamBuffer *buffer) { stream_ = buffer; }
+  StreamBuffer *getStreamBuffer() const { return stream_; }
+
+  // Cache of unlooped notes' interpolated frames, owned by the synth.  A
+  // voice that finds its note there only applies the envelope and gains.
+  void setHitCache(HitCache *cache) { hitCache_ = cache; }
+  // Plays on without the cache, keeping what it recorded so far; the synth
+  // calls it on every voice before clearing the cache or changing how
+  // voices interpolate.
+  void detachHitCache();
+
+  // Segment changes and the note's end go to the synth's trace, if it has
+  // one (see SFZERO_TRACE).
+#if SFZERO_TRACE
+  void setTrace(Trace *trace) { trace_ = trace; }
+#else
+  void setTrace(Trace *) {}
+#endif
 
   juce::String infoString();
 
 private:
   Region *region_;
+  // Kept apart from region_ so a stolen voice's stopNote() doesn't drop it.
+  Region *nextRegion_;
+  VoiceTable &table_;
+  int slot_;
+  int preset_;
+  Interpolation interpolation_;
+  bool stemOutput_;
+  StreamBuffer *stream_;
+  // The region's sample resampled to the voice's rate, if it was when the
+  // note started (see Sample::convertTo()), and the rate pitching assumes.
+  const Sample::Conversion *conversion_;
+  double sourceSampleRate_;
+  // The blocks of compressed samples the voice decoded last.
+  CompressedPCM::Cache decodeCache_;
+  // The note's cached hit, which it's either recording or playing from
+  // hitFrame_ on, and where in the sample it started.
+  HitCache *hitCache_;
+  HitCache::Hit *hit_;
+  bool recordingHit_;
+  int hitFrame_;
+  double hitStartPosition_;
   int trigger_;
   int curMidiNote_, curPitchWheel_;
-  double pitchRatio_;
+  // The note's gains before the channel's; the table holds the product.
   float noteGainLeft_, noteGainRight_;
-  double sourceSamplePosition_;
+  float channelGainLeft_, channelGainRight_;
+  // Envelope blocks left in a channel gain ramp, and the step per block.
+  int gainRampBlocks_;
+  float gainStepLeft_, gainStepRight_;
+  // The note's pitch ratio with the wheel centred, and a ramp like the gain's
+  // towards the bent ratio.
+  double basePitchRatio_;
+  int pitchRampBlocks_;
+  double pitchStep_, pitchTarget_;
   EG ampeg_;
-  juce::int64 sampleEnd_;
-  juce::int64 loopStart_, loopEnd_;
+  // Whether the note is low-pass filtered, the cutoff its coefficients in the
+  // table were last worked out for, and the sample rate in the same cents.
+  bool filtering_;
+  float filterBuiltCents_;
+  double filterRate_;
+  float filterRateCents_;
+  // Modulation: whether the note has any, how long it's played, the mod
+  // envelope (run at the control rate, a step per modulationBlockSize
+  // frames) with the frames towards its next step, and the pitch factor and
+  // gain the last control block ended on, which the next ramps from.
+  bool modulating_;
+  juce::int64 noteFrames_;
+  EG modeg_;
+  int modegFrames_;
+  double modPitchFactor_;
+  float modGain_;
+  float modWheelCents_;
+#if SFZERO_TRACE
+  Trace *trace_ = nullptr;
+  int tracedSegment_ = -1;
+#endif
 
   // Info only.
   int numLoops_;
   int curVelocity_;
 
+  template <typename SampleType>
+  void renderSamples(const SampleType *inL, const SampleType *inR, int bufferNumSamples,
+                     juce::AudioSampleBuffer &outputBuffer, int startSample, int numSamples);
+  // renderSamples() for one source width, output width and loop mode, fixed
+  // at compile time so the frame loops don't test them.
+  template <typename SampleType, bool stereoSource, bool stereoOutput, bool looping>
+  void renderVariant(const SampleType *inL, const SampleType *inR, int bufferNumSamples, float *outL, float *outR,
+                     int numSamples);
+  void renderStreamed(juce::AudioSampleBuffer &outputBuffer, int startSample, int numSamples);
+  void renderCompressed(const CompressedPCM *data, juce::AudioSampleBuffer &outputBuffer, int startSample,
+                        int numSamples);
+  bool renderHit(juce::AudioSampleBuffer &outputBuffer, int startSample, int numSamples);
+  void startHit();
+  void leaveHit();
+  int getFirstOutputChannel(const juce::AudioSampleBuffer &outputBuffer) const;
+  void stepGainRamp(float &gainLeft, float &gainRight);
+  void stepPitchRamp(double &pitchRatio);
+  int getControlBlockSize() const;
+  void startModulation(float floatVelocity);
+  void stepModulation(float *envelope, int numFrames, double pitchRatio, double &frameRatio, double &ratioStep);
+  void startFilter();
+  void updateFilter();
+  void filterInto(float *outL, float *outR, const float *inL, const float *inR, int numFrames);
   void calcPitchRatio();
+  double calcBentPitchRatio() const;
   void killNote();
-  double fractionalMidiNoteInHz(double note, double freqOfA = 440.0);
+  void traceSegment();
 
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Voice)
 };
@@ -0,0 +1,68 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#include "SFZVoiceTable.h"
+
+sfzero::VoiceTable::VoiceTable() : size_(0), numActive_(0) {}
+
+void sfzero::VoiceTable::setSize(int numVoices)
+{
+  size_ = juce::jmax(0, numVoices);
+  numActive_ = 0;
+  position_.calloc(static_cast<size_t>(size_));
+  pitchRatio_.calloc(static_cast<size_t>(size_));
+  gainLeft_.calloc(static_cast<size_t>(size_));
+  gainRight_.calloc(static_cast<size_t>(size_));
+  filterCents_.calloc(static_cast<size_t>(size_));
+  filterCoefficients_.calloc(3 * static_cast<size_t>(size_));
+  filterState_.calloc(4 * static_cast<size_t>(size_));
+  sampleEnd_.calloc(static_cast<size_t>(size_));
+  loopStart_.calloc(static_cast<size_t>(size_));
+  loopEnd_.calloc(static_cast<size_t>(size_));
+  channel_.calloc(static_cast<size_t>(size_));
+  playing_.calloc(static_cast<size_t>(size_));
+  listed_.calloc(static_cast<size_t>(size_));
+  activeSlots_.calloc(static_cast<size_t>(size_));
+}
+
+int sfzero::VoiceTable::findIdleSlot() const
+{
+  for (int slot = 0; slot < size_; ++slot)
+  {
+    if (playing_[slot] == 0)
+    {
+      return slot;
+    }
+  }
+  return -1;
+}
+
+void sfzero::VoiceTable::addActive(int slot)
+{
+  if (listed_[slot] == 0)
+  {
+    listed_[slot] = 1;
+    activeSlots_[numActive_++] = slot;
+  }
+}
+
+void sfzero::VoiceTable::removeFinished()
+{
+  int kept = 0;
+  for (int i = 0; i < numActive_; ++i)
+  {
+    int slot = activeSlots_[i];
+    if (playing_[slot] != 0)
+    {
+      activeSlots_[kept++] = slot;
+    }
+    else
+    {
+      listed_[slot] = 0;
+    }
+  }
+  numActive_ = kept;
+}
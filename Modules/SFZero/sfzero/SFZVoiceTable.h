@@ -0,0 +1,77 @@
+/*************************************************************************************
+ * Original code copyright (C) 2012 Steve Folta
+ * Converted to Juce module (C) 2016 Leo Olivers
+ * Forked from https://github.com/stevefolta/SFZero
+ * For license info please see the LICENSE file distributed with this source code
+ *************************************************************************************/
+#ifndef SFZVOICETABLE_H_INCLUDED
+#define SFZVOICETABLE_H_INCLUDED
+
+#include "SFZCommon.h"
+
+namespace sfzero
+{
+
+// The per-voice state the render loop and the synth's voice searches touch,
+// kept one array per field and indexed by the voice's slot in the pool, so
+// walking the voices reads contiguous memory rather than one heap object each.
+//
+// Each voice writes only its own slot, so voices rendering on different
+// threads don't interfere.  The active list belongs to the synth and is only
+// changed on the audio thread between renders.
+class VoiceTable
+{
+public:
+  VoiceTable();
+
+  // Not on the audio thread.  Every slot starts idle.
+  void setSize(int numVoices);
+  int size() const { return size_; }
+
+  double &position(int slot) { return position_[slot]; }
+  double &pitchRatio(int slot) { return pitchRatio_[slot]; }
+  float &gainLeft(int slot) { return gainLeft_[slot]; }
+  float &gainRight(int slot) { return gainRight_[slot]; }
+  float getGainLeft(int slot) const { return gainLeft_[slot]; }
+  float getGainRight(int slot) const { return gainRight_[slot]; }
+  juce::int64 &sampleEnd(int slot) { return sampleEnd_[slot]; }
+  juce::int64 &loopStart(int slot) { return loopStart_[slot]; }
+  juce::int64 &loopEnd(int slot) { return loopEnd_[slot]; }
+  int &channel(int slot) { return channel_[slot]; }
+  int getChannel(int slot) const { return channel_[slot]; }
+
+  // The voice's low-pass filter: the cutoff it's moving to, in cents above
+  // MIDI note 0, the state-variable filter coefficients last worked out for
+  // it, and two integrator states each for the left and right channel.
+  float &filterCents(int slot) { return filterCents_[slot]; }
+  float *filterCoefficients(int slot) { return filterCoefficients_ + 3 * slot; }
+  float *filterState(int slot) { return filterState_ + 4 * slot; }
+
+  // Set by the voice from a successful start until its note ends.
+  void setPlaying(int slot, bool playing) { playing_[slot] = playing ? 1 : 0; }
+  bool isPlaying(int slot) const { return playing_[slot] != 0; }
+  // The first slot with nothing playing, or -1.
+  int findIdleSlot() const;
+
+  // Slots that may be playing, in the order they were added.  Slots whose
+  // note has ended stay listed until removeFinished().
+  void addActive(int slot);
+  void removeFinished();
+  int getNumActive() const { return numActive_; }
+  int getActiveSlot(int index) const { return activeSlots_[index]; }
+
+private:
+  int size_, numActive_;
+  juce::HeapBlock<double> position_, pitchRatio_;
+  juce::HeapBlock<float> gainLeft_, gainRight_;
+  juce::HeapBlock<float> filterCents_, filterCoefficients_, filterState_;
+  juce::HeapBlock<juce::int64> sampleEnd_, loopStart_, loopEnd_;
+  juce::HeapBlock<int> channel_;
+  juce::HeapBlock<juce::uint8> playing_, listed_;
+  juce::HeapBlock<int> activeSlots_;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(VoiceTable)
+};
+}
+
+#endif // SFZVOICETABLE_H_INCLUDED
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+
+// A fixed-size single-producer, single-consumer FIFO of plain commands. The
+// message thread pushes; the audio thread drains the lot at the start of each
+// block and applies them there, so state the audio thread reads is only ever
+// written by the audio thread. Neither side locks or allocates.
+template <typename Command, int capacity> class CommandQueue {
+public:
+  CommandQueue() = default;
+
+  // Producer only. Fails, dropping the command, when the audio thread has
+  // fallen capacity commands behind (e.g. the device has stopped).
+  bool push(const Command &command) {
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 + size2 == 0)
+      return false;
+    commands[static_cast<size_t>(size1 > 0 ? start1 : start2)] = command;
+    fifo.finishedWrite(1);
+    return true;
+  }
+
+  // Producer only: how many more pushes are sure to succeed.
+  int getFreeSpace() const { return fifo.getFreeSpace(); }
+
+  // Consumer only. Calls apply(command) for each waiting command, oldest
+  // first.
+  template <typename Function> void drain(Function &&apply) {
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+    for (int i = 0; i < size1; ++i)
+      apply(commands[static_cast<size_t>(start1 + i)]);
+    for (int i = 0; i < size2; ++i)
+      apply(commands[static_cast<size_t>(start2 + i)]);
+    fifo.finishedRead(size1 + size2);
+  }
+
+private:
+  // AbstractFifo keeps one slot empty to tell full from empty.
+  juce::AbstractFifo fifo{capacity + 1};
+  std::array<Command, capacity + 1> commands{};
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CommandQueue)
+};
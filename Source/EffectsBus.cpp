@@ -0,0 +1,238 @@
+#include "EffectsBus.h"
+
+EffectsBus::EffectsBus() {
+  for (int channel = 0; channel < 16; ++channel) {
+    reverbSends[channel] = lastReverbSends[channel] = 40.0f / 127.0f;
+    chorusSends[channel] = lastChorusSends[channel] = 0.0f;
+  }
+
+  // The sends set the level, so the reverb itself is all wet
+  juce::Reverb::Parameters parameters;
+  parameters.roomSize = 0.6f;
+  parameters.damping = 0.4f;
+  parameters.wetLevel = 0.33f;
+  parameters.dryLevel = 0.0f;
+  parameters.width = 1.0f;
+  reverb.setParameters(parameters);
+}
+
+EffectsBus::~EffectsBus() { stopWorker(); }
+
+void EffectsBus::stopWorker() {
+  if (worker == nullptr)
+    return;
+  worker->signalThreadShouldExit();
+  worker->notify();
+  worker->stopThread(1000);
+  worker.reset();
+  busy.store(false);
+}
+
+void EffectsBus::prepare(double sampleRate, int maximumBlockSize, bool pipelined) {
+  stopWorker();
+
+  reverb.setSampleRate(sampleRate);
+  reverb.reset();
+  chorus.prepare(sampleRate);
+  tailSamples = static_cast<int>(tailSeconds * sampleRate);
+  reverbIdleSamples = chorusIdleSamples = tailSamples + 1;
+
+  const int blockSize = juce::jmax(1, maximumBlockSize);
+  for (auto &sends : sendBuffers)
+    sends.setSize(4, blockSize);
+  wetBuffer.setSize(2, blockSize);
+  currentSends = 0;
+
+  if (pipelined) {
+    // Room for a block in flight and one waiting to be read
+    wetFifo.setTotalSize(2 * blockSize + 1);
+    wetRing.setSize(2, 2 * blockSize + 1);
+    wetRing.clear();
+    worker = std::make_unique<Worker>(*this);
+    worker->startThread(juce::Thread::Priority::highest);
+  }
+}
+
+void EffectsBus::setReverbSend(int midiChannel, int level) {
+  if (midiChannel >= 1 && midiChannel <= 16)
+    reverbSends[midiChannel - 1] = juce::jlimit(0, 127, level) / 127.0f;
+}
+
+void EffectsBus::setChorusSend(int midiChannel, int level) {
+  if (midiChannel >= 1 && midiChannel <= 16)
+    chorusSends[midiChannel - 1] = juce::jlimit(0, 127, level) / 127.0f;
+}
+
+void EffectsBus::process(const juce::AudioBuffer<float> &stems,
+                         juce::AudioBuffer<float> &output, int startSample,
+                         int numSamples) {
+  // Blocks longer than prepare() allowed for go through in pieces
+  const int maximumBlockSize = sendBuffers[0].getNumSamples();
+  jassert(maximumBlockSize > 0); // prepare() first
+  for (int done = 0; done < numSamples;) {
+    const int chunk = juce::jmin(numSamples - done, maximumBlockSize);
+    const int chunkStart = startSample + done;
+    mixSends(stems, output, chunkStart, chunk);
+    const bool runReverb = reverbIdleSamples <= tailSamples;
+    const bool runChorus = chorusIdleSamples <= tailSamples;
+
+    if (worker != nullptr) {
+      // The worker has had a whole block for the last one, so it's rare to
+      // find it still busy
+      while (busy.load(std::memory_order_acquire))
+        juce::Thread::yield();
+
+      // Add the returns it rendered from the last block
+      int start1, size1, start2, size2;
+      wetFifo.prepareToRead(juce::jmin(chunk, wetFifo.getNumReady()), start1, size1, start2, size2);
+      for (int channel = 0; channel < 2; ++channel) {
+        if (size1 > 0)
+          output.addFrom(channel, chunkStart, wetRing, channel, start1, size1);
+        if (size2 > 0)
+          output.addFrom(channel, chunkStart + size1, wetRing, channel, start2, size2);
+      }
+      wetFifo.finishedRead(size1 + size2);
+
+      // And hand it this one
+      jobSends = currentSends;
+      jobSamples = chunk;
+      jobReverb = runReverb;
+      jobChorus = runChorus;
+      currentSends ^= 1;
+      busy.store(true, std::memory_order_release);
+      worker->notify();
+    } else if (runReverb || runChorus) {
+      renderEffects(sendBuffers[currentSends], wetBuffer, chunk, runReverb, runChorus);
+      for (int channel = 0; channel < 2; ++channel)
+        output.addFrom(channel, chunkStart, wetBuffer, channel, 0, chunk);
+    }
+    done += chunk;
+  }
+}
+
+void EffectsBus::mixSends(const juce::AudioBuffer<float> &stems,
+                          juce::AudioBuffer<float> &output, int startSample,
+                          int numSamples) {
+  auto &sends = sendBuffers[currentSends];
+  sends.clear(0, numSamples);
+
+  // Send changes ramp over the block rather than stepping
+  bool reverbInput = false, chorusInput = false;
+  const int numPairs = juce::jmin(16, stems.getNumChannels() / 2);
+  for (int channel = 0; channel < numPairs; ++channel) {
+    const float *left = stems.getReadPointer(2 * channel, startSample);
+    const float *right = stems.getReadPointer(2 * channel + 1, startSample);
+    output.addFrom(0, startSample, left, numSamples);
+    output.addFrom(1, startSample, right, numSamples);
+
+    if (reverbSends[channel] > 0.0f || lastReverbSends[channel] > 0.0f) {
+      sends.addFromWithRamp(0, 0, left, numSamples, lastReverbSends[channel], reverbSends[channel]);
+      sends.addFromWithRamp(1, 0, right, numSamples, lastReverbSends[channel], reverbSends[channel]);
+      reverbInput = true;
+    }
+    if (chorusSends[channel] > 0.0f || lastChorusSends[channel] > 0.0f) {
+      sends.addFromWithRamp(2, 0, left, numSamples, lastChorusSends[channel], chorusSends[channel]);
+      sends.addFromWithRamp(3, 0, right, numSamples, lastChorusSends[channel], chorusSends[channel]);
+      chorusInput = true;
+    }
+    lastReverbSends[channel] = reverbSends[channel];
+    lastChorusSends[channel] = chorusSends[channel];
+  }
+
+  // Capped so the counts can't overflow over a long silence
+  reverbIdleSamples = reverbInput ? 0 : juce::jmin(reverbIdleSamples + numSamples, tailSamples + 1);
+  chorusIdleSamples = chorusInput ? 0 : juce::jmin(chorusIdleSamples + numSamples, tailSamples + 1);
+}
+
+void EffectsBus::renderEffects(const juce::AudioBuffer<float> &sends,
+                               juce::AudioBuffer<float> &wet, int numSamples,
+                               bool runReverb, bool runChorus) {
+  float *left = wet.getWritePointer(0);
+  float *right = wet.getWritePointer(1);
+  if (runReverb) {
+    wet.copyFrom(0, 0, sends, 0, 0, numSamples);
+    wet.copyFrom(1, 0, sends, 1, 0, numSamples);
+    reverb.processStereo(left, right, numSamples);
+  } else {
+    wet.clear(0, numSamples);
+  }
+  if (runChorus)
+    chorus.process(sends.getReadPointer(2), sends.getReadPointer(3), left, right, numSamples);
+}
+
+void EffectsBus::Worker::run() {
+  // The reverb's tails decay into subnormals without this
+  const juce::ScopedNoDenormals noDenormals;
+  while (!threadShouldExit()) {
+    if (owner.busy.load(std::memory_order_acquire)) {
+      const int numSamples = owner.jobSamples;
+      owner.renderEffects(owner.sendBuffers[owner.jobSends], owner.wetBuffer, numSamples,
+                          owner.jobReverb, owner.jobChorus);
+
+      int start1, size1, start2, size2;
+      owner.wetFifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+      for (int channel = 0; channel < 2; ++channel) {
+        if (size1 > 0)
+          owner.wetRing.copyFrom(channel, start1, owner.wetBuffer, channel, 0, size1);
+        if (size2 > 0)
+          owner.wetRing.copyFrom(channel, start2, owner.wetBuffer, channel, size1, size2);
+      }
+      owner.wetFifo.finishedWrite(size1 + size2);
+      owner.busy.store(false, std::memory_order_release);
+    }
+    wait(-1);
+  }
+}
+
+void EffectsBus::Chorus::prepare(double sampleRate) {
+  baseDelay = static_cast<float>(0.012 * sampleRate);
+  depth = static_cast<float>(0.003 * sampleRate);
+  phaseStep = juce::MathConstants<double>::twoPi * 0.4 / sampleRate;
+  delaySize = static_cast<int>(std::ceil(baseDelay + depth)) + 2;
+  delay.setSize(2, delaySize);
+  reset();
+}
+
+void EffectsBus::Chorus::reset() {
+  delay.clear();
+  writePosition = 0;
+  phase = 0.0;
+}
+
+void EffectsBus::Chorus::process(const float *inL, const float *inR, float *outL,
+                                 float *outR, int numSamples) {
+  float *delayL = delay.getWritePointer(0);
+  float *delayR = delay.getWritePointer(1);
+
+  // Reads the delay line the given number of frames behind the write position
+  auto tap = [this](const float *line, float delayFrames) {
+    float readPosition = static_cast<float>(writePosition) - delayFrames;
+    if (readPosition < 0.0f)
+      readPosition += static_cast<float>(delaySize);
+    const int index = static_cast<int>(readPosition);
+    const float alpha = readPosition - static_cast<float>(index);
+    const int next = index + 1 < delaySize ? index + 1 : 0;
+    return line[index] + (line[next] - line[index]) * alpha;
+  };
+
+  for (int start = 0; start < numSamples; start += chunkSize) {
+    const int count = juce::jmin(chunkSize, numSamples - start);
+    const double endPhase = phase + phaseStep * count;
+    const float fromL = baseDelay + depth * static_cast<float>(std::sin(phase));
+    const float toL = baseDelay + depth * static_cast<float>(std::sin(endPhase));
+    const float fromR = baseDelay + depth * static_cast<float>(std::cos(phase));
+    const float toR = baseDelay + depth * static_cast<float>(std::cos(endPhase));
+    const float stepL = (toL - fromL) / static_cast<float>(count);
+    const float stepR = (toR - fromR) / static_cast<float>(count);
+
+    for (int i = 0; i < count; ++i) {
+      delayL[writePosition] = inL[start + i];
+      delayR[writePosition] = inR[start + i];
+      outL[start + i] += tap(delayL, fromL + stepL * static_cast<float>(i));
+      outR[start + i] += tap(delayR, fromR + stepR * static_cast<float>(i));
+      if (++writePosition == delaySize)
+        writePosition = 0;
+    }
+    phase = std::fmod(endPhase, juce::MathConstants<double>::twoPi);
+  }
+}
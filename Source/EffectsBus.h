@@ -0,0 +1,100 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+
+// One reverb and one chorus shared by all 16 MIDI channels, fed through each
+// channel's send level (CC91 and CC93) the way a GM module's are. It takes
+// the synth's stem output, so the sends are per channel without the voices
+// knowing about them: each channel's pair is added to the dry mix and, scaled
+// by its sends, to the two effects' inputs. The effects can run on a worker
+// thread one block behind the dry signal, so their cost overlaps the next
+// block's voices.
+class EffectsBus {
+public:
+  EffectsBus();
+  ~EffectsBus();
+
+  // Not on the audio thread; clears the tails. Pipelined runs the effects
+  // on a worker thread, so the wet signal lags the dry by a block.
+  void prepare(double sampleRate, int maximumBlockSize, bool pipelined);
+  bool isPipelined() const { return worker != nullptr; }
+
+  // Audio thread. Channels are 1-16 and levels 0-127; channels start at the
+  // GS defaults of 40 reverb and no chorus.
+  void setReverbSend(int midiChannel, int level);
+  void setChorusSend(int midiChannel, int level);
+
+  // Audio thread. Mixes the stems' pairs (a sfzero::Synth::stemChannels-wide
+  // buffer) into output's first two channels, dry plus the effects' returns.
+  void process(const juce::AudioBuffer<float> &stems, juce::AudioBuffer<float> &output,
+               int startSample, int numSamples);
+
+private:
+  // A stereo chorus: one modulated delay per side, their LFOs a quarter of a
+  // cycle apart. The delay is worked out every chunkSize frames and
+  // interpolated in between.
+  class Chorus {
+  public:
+    void prepare(double sampleRate);
+    void reset();
+    void process(const float *inL, const float *inR, float *outL, float *outR, int numSamples);
+
+  private:
+    static constexpr int chunkSize = 32;
+    juce::AudioBuffer<float> delay;
+    int writePosition = 0, delaySize = 0;
+    double phase = 0.0, phaseStep = 0.0;
+    float baseDelay = 0.0f, depth = 0.0f; // in frames
+  };
+
+  class Worker : public juce::Thread {
+  public:
+    explicit Worker(EffectsBus &ownerIn)
+        : juce::Thread("Effects Bus"), owner(ownerIn) {}
+    void run() override;
+
+  private:
+    EffectsBus &owner;
+  };
+
+  // Renders numSamples of the effects that are running from sends into
+  // wet, replacing what was there
+  void renderEffects(const juce::AudioBuffer<float> &sends, juce::AudioBuffer<float> &wet,
+                     int numSamples, bool runReverb, bool runChorus);
+  // Adds the stems to output and their sends to sendBuffers[currentSends]
+  void mixSends(const juce::AudioBuffer<float> &stems, juce::AudioBuffer<float> &output,
+                int startSample, int numSamples);
+  void stopWorker();
+
+  juce::Reverb reverb;
+  Chorus chorus;
+
+  // Send levels as gains: the current block's target and the last block's,
+  // which the next ramps from
+  float reverbSends[16], chorusSends[16];
+  float lastReverbSends[16], lastChorusSends[16];
+  // Frames since anything was sent to each effect; past tailSamples it's
+  // silent and isn't run at all
+  int reverbIdleSamples = 0, chorusIdleSamples = 0, tailSamples = 0;
+  static constexpr double tailSeconds = 6.0;
+
+  // Reverb in the first pair, chorus in the second. In pipelined mode the
+  // audio thread fills one while the worker renders from the other.
+  juce::AudioBuffer<float> sendBuffers[2];
+  int currentSends = 0;
+  juce::AudioBuffer<float> wetBuffer;
+
+  // Pipelined mode: the worker renders jobSamples from sendBuffers[jobSends]
+  // into the wet FIFO while busy is set, and the audio thread waits for it to
+  // clear before touching either
+  std::unique_ptr<Worker> worker;
+  std::atomic<bool> busy{false};
+  int jobSends = 0, jobSamples = 0;
+  bool jobReverb = false, jobChorus = false;
+  juce::AbstractFifo wetFifo{1};
+  juce::AudioBuffer<float> wetRing;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(EffectsBus)
+};
@@ -0,0 +1,58 @@
+#include "LiveMidiInput.h"
+
+void LiveMidiInput::handleIncomingMidiMessage(juce::MidiInput *,
+                                              const juce::MidiMessage &message) {
+  // Channel messages only: clock and active sensing would only fill the
+  // queue, and the synth has no use for SysEx
+  const int size = message.getRawDataSize();
+  if (size < 1 || size > 3 || message.getRawData()[0] >= 0xf0)
+    return;
+
+  Event event;
+  std::copy(message.getRawData(), message.getRawData() + size, event.data);
+  event.size = size;
+  // MidiInput stamps messages in seconds on the hi-res millisecond counter
+  event.timeMs = message.getTimeStamp() * 1000.0;
+  events.push(event);
+}
+
+bool LiveMidiInput::drainInto(juce::MidiBuffer &buffer, int startSample,
+                              int numSamples, double sampleRate,
+                              double callbackTimeMs) {
+  if (resetRequested.exchange(false)) {
+    numEvents.store(0);
+    lastLatencyMs.store(0.0);
+    totalLatencyMs.store(0.0);
+    worstLatencyMs.store(0.0);
+  }
+
+  // This block stands for the time since the previous callback, a block's
+  // length ago, and an event goes as far into it as it came into that time.
+  // Ones stamped outside it (a late callback, a clock step) are clamped.
+  const double blockMs = numSamples * 1000.0 / sampleRate;
+  const double windowStartMs = callbackTimeMs - blockMs;
+  bool any = false;
+  events.drain([&](const Event &event) {
+    const int offset = juce::jlimit(
+        0, numSamples - 1,
+        static_cast<int>((event.timeMs - windowStartMs) * sampleRate / 1000.0));
+    buffer.addEvent(event.data, event.size, startSample + offset);
+
+    const double latencyMs = callbackTimeMs + offset * 1000.0 / sampleRate - event.timeMs;
+    lastLatencyMs.store(latencyMs);
+    totalLatencyMs.store(totalLatencyMs.load() + latencyMs);
+    worstLatencyMs.store(juce::jmax(worstLatencyMs.load(), latencyMs));
+    numEvents.store(numEvents.load() + 1);
+    any = true;
+  });
+  return any;
+}
+
+LiveMidiInput::Latency LiveMidiInput::getLatency() const {
+  Latency latency;
+  latency.numEvents = numEvents.load();
+  latency.lastMs = lastLatencyMs.load();
+  latency.worstMs = worstLatencyMs.load();
+  latency.averageMs = latency.numEvents > 0 ? totalLatencyMs.load() / latency.numEvents : 0.0;
+  return latency;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "CommandQueue.h"
+#include <JuceHeader.h>
+
+#include <atomic>
+
+// MIDI from hardware controllers, handed from the MIDI callback to the audio
+// thread through a lock-free queue. Each event keeps its input timestamp,
+// and the audio thread places it that far into the block after the one it
+// arrived during, so events sound exactly one callback after they came in
+// rather than bunched at block starts. Register it with
+// AudioDeviceManager::addMidiInputDeviceCallback(), which calls it from one
+// thread at a time, and give it to the scheduler to play.
+class LiveMidiInput : public juce::MidiInputCallback {
+public:
+  // How long events took from input to the start of their sample in the
+  // audio buffer; the device's output latency comes on top
+  struct Latency {
+    int numEvents = 0;
+    double lastMs = 0.0, averageMs = 0.0, worstMs = 0.0;
+  };
+
+  void handleIncomingMidiMessage(juce::MidiInput *source,
+                                 const juce::MidiMessage &message) override;
+
+  // Audio thread. Moves the waiting events into buffer, between startSample
+  // and startSample + numSamples, for a callback made at callbackTimeMs on
+  // the Time::getMillisecondCounterHiRes() clock. Returns whether there were
+  // any.
+  bool drainInto(juce::MidiBuffer &buffer, int startSample, int numSamples,
+                 double sampleRate, double callbackTimeMs);
+
+  Latency getLatency() const;
+  void resetLatency() { resetRequested.store(true); }
+
+private:
+  struct Event {
+    juce::uint8 data[3] = {};
+    int size = 0;
+    double timeMs = 0.0;
+  };
+  CommandQueue<Event, 1024> events;
+
+  // Written by the audio thread only
+  std::atomic<int> numEvents{0};
+  std::atomic<double> lastLatencyMs{0.0}, totalLatencyMs{0.0}, worstLatencyMs{0.0};
+  std::atomic<bool> resetRequested{false};
+};
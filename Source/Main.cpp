@@ -29,6 +29,10 @@ public:
     {
     }
 
+    // In the background only the audio needs to keep going
+    void suspended() override    { setInBackground (true); }
+    void resumed() override      { setInBackground (false); }
+
     class MainWindow    : public juce::DocumentWindow
     {
     public:
@@ -61,6 +65,13 @@ public:
     };
 
 private:
+    void setInBackground (bool inBackground)
+    {
+        if (mainWindow != nullptr)
+            if (auto* content = dynamic_cast<MainComponent*> (mainWindow->getContentComponent()))
+                content->setInBackground (inBackground);
+    }
+
     std::unique_ptr<MainWindow> mainWindow;
 };
 
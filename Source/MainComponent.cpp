@@ -1,11 +1,14 @@
 #include "MainComponent.h"
+#include "OfflineRenderer.h"
 #include "SynthAudioSource.h" // Make sure this header is available in your project
 
 MainComponent::MainComponent()
-    : loadButton("Load MIDI File"), 
+    : loadButton("Load MIDI File"), playlistButton("Playlist"),
       playPauseButton(juce::CharPointer_UTF8(PLAY_SYMBOL)),
       returnToStartButton(juce::CharPointer_UTF8(RETURN_TO_START_SYMBOL)),
       setLoopButton("Set Loop"), clearLoopButton("Clear Loop"),
+      bounceButton("Bounce"), statsButton("Stats"),
+      stemsButton("Stems"), gpuButton("GPU"),
       transpositionLabel("TranspositionLabel", "Transpose"), pianoRoll(),
       tempoSlider(juce::Slider::LinearHorizontal, juce::Slider::TextBoxRight),
       tempoLabel("TempoLabel", "Tempo") {
@@ -13,46 +16,19 @@ MainComponent::MainComponent()
   setWantsKeyboardFocus(true);
   addKeyListener(this);
 
-  // Initialize the audio device manager (0 inputs, 2 outputs)
-  auto error = audioDeviceManager.initialiseWithDefaultDevices(0, 2);
-  if (error.isNotEmpty()) {
-    DBG("Audio device initialization error: " + error);
-  }
-
-  // Add our AudioSourcePlayer as a callback to the device manager.
-  audioDeviceManager.addAudioCallback(&audioSourcePlayer);
+  // The audio device is opened once the window is up (see paint())
+  startupProfile.phase("members");
 
   // Create a MixerAudioSource.
   audioMixerSource = std::make_unique<juce::MixerAudioSource>();
 
   // Create our multi-channel SynthAudioSource
   synthAudioSource = std::make_unique<SynthAudioSource>();
+  startupProfile.phase("synth");
 
-  if (synthAudioSource != nullptr) {
-    if (auto *sound = synthAudioSource->getSF2Sound()) {
-      presetBox.setTextWhenNothingSelected("Select Preset");
-      presetBox.clear();
-      for (int i = 0; i < sound->numSubsounds(); ++i) {
-        presetBox.addItem(sound->subsoundName(i),
-                          i + 1); // ComboBox items are 1-indexed
-      }
-
-      // Set initial preset if available
-      if (presetBox.getNumItems() > 0) {
-        presetBox.setSelectedId(1, juce::dontSendNotification);
-        sound->useSubsound(0);
-      }
-
-      // Add an onChange callback for when the user selects a new preset.
-      presetBox.onChange = [this]() {
-        if (presetBox.getSelectedId() > 0) {
-          // Set up channel 0 (piano) with the selected preset
-          synthAudioSource->setupChannel(0, presetBox.getSelectedId() - 1);
-          DBG("Changed to preset: " + presetBox.getText());
-        }
-      };
-    }
-  }
+  // The preset list is filled in by timerCallback() once the SoundFont has
+  // parsed its presets in the background.
+  presetBox.setTextWhenNothingSelected("Loading SoundFont...");
 
   // Set up transposition combo box
   addAndMakeVisible(transpositionBox);
@@ -74,6 +50,44 @@ MainComponent::MainComponent()
     pianoRoll.setTransposition(transposition);
   };
 
+  // Share dense passages' voices out over some of the spare cores
+  const int renderThreads =
+      juce::jmax(0, juce::SystemStats::getNumPhysicalCpus() / 2 - 1);
+  synthAudioSource->setRenderThreads(renderThreads);
+
+  // GM reverb and chorus, on their own core too when there are cores to spare
+  synthAudioSource->setEffectsPipelined(renderThreads > 0);
+  synthAudioSource->setEffectsEnabled(true);
+  // and a limiter after them, so a dense passage can't clip the output
+  synthAudioSource->setLimiterEnabled(true);
+
+  // A dense passage loses its quietest voices before it glitches
+  synthAudioSource->setLoadBudget(0.8f);
+
+  // Resample the SoundFont to the device rate once it's loaded, so voices
+  // at their root key don't interpolate at all
+  synthAudioSource->setSampleRateConversion(true);
+
+  // SoundFonts in the Layers folder play over the GM bank: drums*.sf2 on
+  // channel 10, any others on the rest, in name order, later ones on top
+  const auto layersDirectory =
+      juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+          .getChildFile("MidiPlayer")
+          .getChildFile("Layers");
+  auto layerFiles = layersDirectory.findChildFiles(juce::File::findFiles, false, "*.sf2");
+  layerFiles.sort();
+  synthAudioSource->setSamplePaging(true);
+  for (const auto &file : layerFiles) {
+    const bool drums = file.getFileName().startsWithIgnoreCase("drums");
+    synthAudioSource->addSoundFontLayer(file, drums ? 0x0200 : 0xfdff);
+  }
+  startupProfile.phase("synth settings and layers");
+
+  // Audio callback load and voice counts, shown over the piano roll on demand
+  performanceOverlay = std::make_unique<PerformanceOverlay>(
+      synthAudioSource->getPerformanceCounters());
+  performanceOverlay->showLiveInput(liveMidiInput, audioDeviceManager);
+
   // Create the MidiSchedulerAudioSource, passing the synth.
   midiSchedulerAudioSource =
       std::make_unique<MidiSchedulerAudioSource>(synthAudioSource.get());
@@ -93,9 +107,10 @@ MainComponent::MainComponent()
   tempoSlider.setValue(120.0, juce::dontSendNotification);
   tempoSlider.setTextBoxStyle(juce::Slider::TextBoxRight, false, 60, 20);
   tempoSlider.onValueChange = [this]() {
+    // The slider shows the song's starting tempo at the current speed, so
+    // moving it scales the whole tempo map by the same factor
     double newTempo = tempoSlider.getValue();
-    tempo = newTempo; // Update our member variable
-    midiSchedulerAudioSource->setTempo(newTempo);
+    midiSchedulerAudioSource->setPlaybackRate(newTempo / tempo);
     DBG("Manual tempo change to: " + juce::String(newTempo) + " BPM");
   };
 
@@ -104,7 +119,10 @@ MainComponent::MainComponent()
     DBG("Received tempo change callback: " + juce::String(newTempo) + " BPM");
     juce::MessageManager::callAsync([this, newTempo]() {
       DBG("Setting tempo slider to: " + juce::String(newTempo) + " BPM");
-      tempoSlider.setValue(newTempo, juce::sendNotification);
+      // The speed carries over from the last song
+      tempo = newTempo;
+      tempoSlider.setValue(newTempo * midiSchedulerAudioSource->getPlaybackRate(),
+                           juce::dontSendNotification);
     });
   };
 
@@ -113,14 +131,33 @@ MainComponent::MainComponent()
     updatePlaybackState(false);
   };
 
+  midiSchedulerAudioSource->onSequenceAdvanced = [this]() {
+    // The next playlist entry has taken over; show it and line up the one
+    // after.
+    ++playlistIndex;
+    if (queuedEntry != nullptr)
+      showLoadedFile(*queuedEntry);
+    queuedEntry = nullptr;
+    prepareNextPlaylistEntry();
+  };
+
   //--- GUI Setup ---
   addAndMakeVisible(loadButton);
+  addAndMakeVisible(playlistButton);
   addAndMakeVisible(playPauseButton);
   addAndMakeVisible(returnToStartButton);
   addAndMakeVisible(setLoopButton);
   addAndMakeVisible(clearLoopButton);
+  addAndMakeVisible(bounceButton);
   addAndMakeVisible(presetBox);
   addAndMakeVisible(pianoRoll);
+  addAndMakeVisible(statsButton);
+  addAndMakeVisible(stemsButton);
+#if JUCE_MODULE_AVAILABLE_juce_opengl
+  addAndMakeVisible(gpuButton);
+#endif
+  addChildComponent(*performanceOverlay);
+  addChildComponent(loadProgressBar);
 
   // Set button text.
   loadButton.setButtonText("Load MIDI File");
@@ -130,9 +167,10 @@ MainComponent::MainComponent()
 
   // Button callbacks.
   loadButton.onClick = [this]() { loadMidiFile(); };
+  playlistButton.onClick = [this]() { choosePlaylist(); };
   
   playPauseButton.onClick = [this]() {
-    if (midiSequence.getNumEvents() > 0) {
+    if (hasMidiData()) {
       if (isPlaying) {
         updatePlaybackState(false);
       } else {
@@ -154,12 +192,30 @@ MainComponent::MainComponent()
 
   setLoopButton.onClick = [this]() { setupLoopRegion(); };
   clearLoopButton.onClick = [this]() { clearLoopRegion(); };
+  bounceButton.onClick = [this]() { bounceToFile(); };
+  statsButton.setClickingTogglesState(true);
+  statsButton.onClick = [this]() {
+    performanceOverlay->setVisible(statsButton.getToggleState());
+  };
+  // Each MIDI channel to its own output pair, for interfaces with enough
+  // outputs to take all sixteen
+  stemsButton.setClickingTogglesState(true);
+  stemsButton.setEnabled(false); // until the device is open
+  stemsButton.onClick = [this]() { setStemOutput(stemsButton.getToggleState()); };
+  // Draws the piano roll with OpenGL, for huge files on high-DPI screens
+  gpuButton.setClickingTogglesState(true);
+  gpuButton.onClick = [this]() { pianoRoll.setUseOpenGL(gpuButton.getToggleState()); };
 
   // Set the size of the MainComponent.
   setSize(800, 600);
 
-  // Start our timer (for example, to update the piano roll playhead).
-  startTimer(5);
+  // Polls the loader and the SoundFont; the playhead follows the display's
+  // refresh instead (see updatePlayhead()).
+  startTimerHz(timerHz);
+
+#if JUCE_IOS || JUCE_ANDROID
+  setLowPowerMode(true);
+#endif
 
   // Initialize other playback and loop-related variables.
   isPlaying = false;
@@ -171,6 +227,32 @@ MainComponent::MainComponent()
   loopEndBeat = 0.0;
   loopCount = 0;
   isLooping = false;
+  startupProfile.phase("controls");
+}
+
+void MainComponent::openAudioDevice() {
+  // Initialize the audio device manager (0 inputs, 2 outputs)
+  auto error = audioDeviceManager.initialiseWithDefaultDevices(0, 2);
+  if (error.isNotEmpty()) {
+    DBG("Audio device initialization error: " + error);
+  }
+
+  // Add our AudioSourcePlayer as a callback to the device manager.
+  audioDeviceManager.addAudioCallback(&audioSourcePlayer);
+
+  // Play whatever controllers are connected at launch. With none, nobody
+  // plays along, so playback is free to render ahead (see setLowPowerMode())
+  const auto inputs = juce::MidiInput::getAvailableDevices();
+  for (const auto &input : inputs)
+    audioDeviceManager.setMidiInputDeviceEnabled(input.identifier, true);
+  audioDeviceManager.addMidiInputDeviceCallback({}, &liveMidiInput);
+  midiSchedulerAudioSource->setLiveInput(inputs.isEmpty() ? nullptr : &liveMidiInput);
+
+  auto *device = audioDeviceManager.getCurrentAudioDevice();
+  stemsButton.setEnabled(device != nullptr &&
+                         device->getOutputChannelNames().size() >=
+                             sfzero::Synth::stemChannels);
+  startupProfile.phase("audio device");
 }
 
 MainComponent::~MainComponent() {
@@ -183,6 +265,7 @@ MainComponent::~MainComponent() {
 
   // Remove our audio callback from the audio device manager.
   audioDeviceManager.removeAudioCallback(&audioSourcePlayer);
+  audioDeviceManager.removeMidiInputDeviceCallback({}, &liveMidiInput);
 
   // Remove ourselves as a key listener.
   removeKeyListener(this);
@@ -193,6 +276,18 @@ MainComponent::~MainComponent() {
 void MainComponent::paint(juce::Graphics& g)
 {
     g.fillAll(getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId));
+
+    // The rest of startup waits for the window to show
+    if (! startupProfile.hasFramed())
+    {
+        startupProfile.firstFrame();
+        juce::Component::SafePointer<MainComponent> safeThis (this);
+        juce::MessageManager::callAsync ([safeThis]
+        {
+            if (safeThis != nullptr)
+                safeThis->openAudioDevice();
+        });
+    }
 }
 
 void MainComponent::resized()
@@ -222,6 +317,7 @@ void MainComponent::resized()
     returnToStartButton.setBounds(transportControls.reduced(paddingX, paddingY));
     
     presetBox.setBounds(topControls.removeFromLeft(200).reduced(paddingX, paddingY));
+    playlistButton.setBounds(topControls.removeFromLeft(100).reduced(paddingX, paddingY));
     
     // Second row: Loop controls and Tempo
     auto loopControls = area.removeFromTop(buttonHeight);
@@ -229,21 +325,152 @@ void MainComponent::resized()
     clearLoopButton.setBounds(loopControls.removeFromLeft(100).reduced(paddingX, paddingY));
     tempoLabel.setBounds(loopControls.removeFromLeft(60).reduced(paddingX, paddingY));
     tempoSlider.setBounds(loopControls.removeFromLeft(200).reduced(paddingX, paddingY));
+    bounceButton.setBounds(loopControls.removeFromLeft(100).reduced(paddingX, paddingY));
     
     // Third row: Transposition controls
     auto transpositionControls = area.removeFromTop(buttonHeight);
     transpositionLabel.setBounds(transpositionControls.removeFromLeft(100).reduced(paddingX, paddingY));
     transpositionBox.setBounds(transpositionControls.removeFromLeft(200).reduced(paddingX, paddingY));
+    statsButton.setBounds(transpositionControls.removeFromLeft(100).reduced(paddingX, paddingY));
+    stemsButton.setBounds(transpositionControls.removeFromLeft(100).reduced(paddingX, paddingY));
+    gpuButton.setBounds(transpositionControls.removeFromLeft(100).reduced(paddingX, paddingY));
     
     // Remaining space for piano roll
     pianoRoll.setBounds(area.reduced(paddingX, paddingY));
+
+    // Loading progress along the piano roll's bottom edge
+    loadProgressBar.setBounds(
+        pianoRoll.getBounds().reduced(10).removeFromBottom(24));
+
+    // Stats overlay in the piano roll's top right corner
+    performanceOverlay->setBounds(
+        pianoRoll.getBounds()
+            .reduced(10)
+            .removeFromTop(PerformanceOverlay::preferredHeight)
+            .removeFromRight(PerformanceOverlay::preferredWidth));
+}
+
+void MainComponent::setStemOutput(bool enabled) {
+  auto setup = audioDeviceManager.getAudioDeviceSetup();
+  setup.useDefaultOutputChannels = false;
+  setup.outputChannels.clear();
+  setup.outputChannels.setRange(0, enabled ? sfzero::Synth::stemChannels : 2, true);
+  auto error = audioDeviceManager.setAudioDeviceSetup(setup, true);
+  if (error.isNotEmpty()) {
+    DBG("Audio device setup error: " + error);
+    stemsButton.setToggleState(false, juce::dontSendNotification);
+    enabled = false;
+  }
+  synthAudioSource->setStemOutput(enabled);
+}
+
+void MainComponent::setLowPowerMode(bool enabled) {
+  if (enabled == lowPowerMode)
+    return;
+  if (enabled) {
+    fullPowerInterpolation = synthAudioSource->getInterpolation();
+    fullPowerRenderThreads = synthAudioSource->getRenderThreads();
+    synthAudioSource->setInterpolation(sfzero::Voice::linear);
+    // Keep the other cores asleep rather than waking them every block
+    synthAudioSource->setRenderThreads(0);
+    // and ride out the blocks a slow core still can't finish in time
+    midiSchedulerAudioSource->setRenderAhead(renderAheadSeconds);
+  } else {
+    setInBackground(false);
+    synthAudioSource->setInterpolation(fullPowerInterpolation);
+    synthAudioSource->setRenderThreads(fullPowerRenderThreads);
+    midiSchedulerAudioSource->setRenderAhead(0.0);
+  }
+  lowPowerMode = enabled;
+}
+
+void MainComponent::setInBackground(bool shouldBeInBackground) {
+  if (!lowPowerMode || shouldBeInBackground == inBackground)
+    return;
+  inBackground = shouldBeInBackground;
+
+  auto *device = audioDeviceManager.getCurrentAudioDevice();
+  if (inBackground) {
+    stopTimer();
+    if (device != nullptr && device->getCurrentSampleRate() > 0.0) {
+      // The largest size the device offers up to backgroundBufferMs
+      const int wanted = static_cast<int>(backgroundBufferMs / 1000.0 *
+                                          device->getCurrentSampleRate());
+      int bufferSize = device->getCurrentBufferSizeSamples();
+      for (int size : device->getAvailableBufferSizes())
+        if (size > bufferSize && size <= wanted)
+          bufferSize = size;
+      foregroundBufferSize = device->getCurrentBufferSizeSamples();
+      setDeviceBufferSize(bufferSize);
+    }
+  } else {
+    if (foregroundBufferSize > 0)
+      setDeviceBufferSize(foregroundBufferSize);
+    foregroundBufferSize = 0;
+    startTimerHz(timerHz);
+    updatePlayhead();
+  }
+}
+
+void MainComponent::setDeviceBufferSize(int bufferSize) {
+  auto setup = audioDeviceManager.getAudioDeviceSetup();
+  if (setup.bufferSize == bufferSize)
+    return;
+  setup.bufferSize = bufferSize;
+  auto error = audioDeviceManager.setAudioDeviceSetup(setup, true);
+  if (error.isNotEmpty())
+    DBG("Audio device setup error: " + error);
+}
+
+void MainComponent::populatePresetBox() {
+  auto *sound = synthAudioSource->getSF2Sound();
+  if (sound == nullptr)
+    return;
+
+  presetBox.setTextWhenNothingSelected("Select Preset");
+  presetBox.clear();
+  for (int i = 0; i < sound->numSubsounds(); ++i) {
+    presetBox.addItem(sound->subsoundName(i),
+                      i + 1); // ComboBox items are 1-indexed
+  }
+
+  // Set initial preset if available
+  if (presetBox.getNumItems() > 0) {
+    presetBox.setSelectedId(1, juce::dontSendNotification);
+  }
+
+  // Add an onChange callback for when the user selects a new preset.
+  presetBox.onChange = [this]() {
+    if (presetBox.getSelectedId() > 0) {
+      // Set up channel 0 (piano) with the selected preset
+      synthAudioSource->setupChannel(0, presetBox.getSelectedId() - 1);
+      DBG("Changed to preset: " + presetBox.getText());
+    }
+  };
+  presetsPopulated = true;
 }
 
 void MainComponent::timerCallback() {
-  // Instead of using a local playbackPosition member,
-  // get the position from the scheduler.
-  double pos = midiSchedulerAudioSource->getPlaybackPosition();
-  pianoRoll.setPlaybackPosition(pos);
+  if (!presetsPopulated && synthAudioSource != nullptr &&
+      synthAudioSource->isSoundFontReady()) {
+    populatePresetBox();
+    startupProfile.phase("SoundFont presets");
+  }
+
+  if (fileLoader != nullptr) {
+    loadProgress = fileLoader->getProgress();
+    loadProgressBar.setTextToDisplay(
+        MidiFileLoader::getStageName(fileLoader->getStage()));
+    if (fileLoader->isFinished())
+      finishLoadingMidiFile();
+  }
+}
+
+void MainComponent::updatePlayhead() {
+  if (midiSchedulerAudioSource == nullptr || inBackground)
+    return;
+  pianoRoll.setPlaybackPosition(midiSchedulerAudioSource->getPlaybackPosition(
+      juce::Time::getMillisecondCounterHiRes()));
 }
 
 void MainComponent::loadMidiFile()
@@ -301,104 +528,14 @@ void MainComponent::loadMidiFile()
             if (stream != nullptr)
             {
                 DBG("Stream opened successfully");
-                
-                // Store the current number of tracks before reading
-                const int prevNumTracks = safeThis->midiFile.getNumTracks();
-                DBG("Previous number of tracks: " + juce::String(prevNumTracks));
-                
-                if (safeThis->midiFile.readFrom(*stream))
-                {
-                    // Check component validity after potentially long file read
-                    if (safeThis == nullptr)
-                    {
-                        DBG("Component became invalid during MIDI file read - aborting");
-                        return;
-                    }
-                    
-                    DBG("MIDI file read successfully");
-                    const int newNumTracks = safeThis->midiFile.getNumTracks();
-                    DBG("New number of tracks: " + juce::String(newNumTracks));
-                    
-                    if (newNumTracks > 0)
-                    {
-                        try {
-                            // Get the time division (PPQ) from the MIDI file
-                            auto timeDivision = safeThis->midiFile.getTimeFormat();
-                            if (timeDivision > 0) {
-                                // Positive values indicate PPQ (ticks per quarter note)
-                                DBG("MIDI file uses PPQ timing: " + juce::String(timeDivision) + " ticks per quarter note");
-                                safeThis->midiSchedulerAudioSource->setPPQ(timeDivision);
-                                safeThis->pianoRoll.setPPQ(timeDivision);
-                            } else {
-                                // Negative values indicate SMPTE timing (not supported yet)
-                                DBG("Warning: SMPTE timing not supported, defaulting to 480 PPQ");
-                                safeThis->midiSchedulerAudioSource->setPPQ(480);
-                                safeThis->pianoRoll.setPPQ(480);
-                            }
-
-                            DBG("Getting first track...");
-                            safeThis->midiSequence = *safeThis->midiFile.getTrack(0);
-                            DBG("First track copied, events: " + juce::String(safeThis->midiSequence.getNumEvents()));
-                            
-                            for (int i = 1; i < newNumTracks; ++i)
-                            {
-                                // Check validity in the loop as it might take time
-                                if (safeThis == nullptr)
-                                {
-                                    DBG("Component became invalid during track processing - aborting");
-                                    return;
-                                }
-                                
-                                DBG("Adding track " + juce::String(i));
-                                safeThis->midiSequence.addSequence(*safeThis->midiFile.getTrack(i),
-                                                       0.0, 0.0,
-                                                       safeThis->midiFile.getLastTimestamp());
-                                DBG("Track " + juce::String(i) + " added, total events now: " + 
-                                    juce::String(safeThis->midiSequence.getNumEvents()));
-                            }
-                            
-                            // Final validity check before UI updates
-                            if (safeThis == nullptr)
-                            {
-                                DBG("Component became invalid before UI updates - aborting");
-                                return;
-                            }
-                            
-                            DBG("Updating matched pairs...");
-                            safeThis->midiSequence.updateMatchedPairs();
-                            
-                            DBG("Setting sequence in piano roll...");
-                            safeThis->pianoRoll.setMidiSequence(safeThis->midiSequence);
-                            
-                            // Set the MIDI sequence in the scheduler first, which will extract tempo
-                            safeThis->midiSchedulerAudioSource->setMidiSequence(safeThis->midiSequence);
-                            
-                            // Update piano roll with time signature from scheduler
-                            safeThis->pianoRoll.setTimeSignature(
-                                safeThis->midiSchedulerAudioSource->getNumerator(),
-                                safeThis->midiSchedulerAudioSource->getDenominator());
-                            
-                            DBG("Updating UI state...");
-                            safeThis->updatePlaybackState(false);
-                            safeThis->currentEvent = 0;
-                            safeThis->playbackPosition = 0.0;
-                            safeThis->lastTime = juce::Time::getMillisecondCounterHiRes();
-                            DBG("MIDI file loading completed successfully");
-                        }
-                        catch (const std::exception& e) {
-                            DBG("Exception during MIDI processing: " + juce::String(e.what()));
-                        }
-                        catch (...) {
-                            DBG("Unknown exception during MIDI processing");
-                        }
-                    }
-                    else {
-                        DBG("No tracks found in MIDI file");
-                    }
-                }
-                else {
-                    DBG("Failed to read MIDI file");
-                }
+
+                // Parsing, merging, compiling and laying out the notes all
+                // happen on the loader's thread; timerCallback() picks up the
+                // result. A load already running is abandoned.
+                safeThis->fileLoader = std::make_unique<MidiFileLoader>(
+                    std::move(stream), safeThis->midiSchedulerAudioSource->getSampleRate());
+                safeThis->loadProgress = 0.0;
+                safeThis->loadProgressBar.setVisible(true);
             }
             else {
                 DBG("Stream is null");
@@ -421,6 +558,127 @@ void MainComponent::loadMidiFile()
     DBG("loadMidiFile() setup completed");
 }
 
+void MainComponent::choosePlaylist() {
+  fileChooser = std::make_unique<juce::FileChooser>(
+      "Select MIDI files to play in order",
+      juce::File::getSpecialLocation(juce::File::userDocumentsDirectory),
+      "*.mid;*.midi");
+
+  juce::Component::SafePointer<MainComponent> safeThis(this);
+  fileChooser->launchAsync(
+      juce::FileBrowserComponent::openMode |
+          juce::FileBrowserComponent::canSelectFiles |
+          juce::FileBrowserComponent::canSelectMultipleItems,
+      [safeThis](const juce::FileChooser &fc) {
+        if (safeThis == nullptr)
+          return;
+        auto files = fc.getResults();
+        safeThis->fileChooser = nullptr;
+        if (!files.isEmpty())
+          safeThis->startPlaylist(files);
+      });
+}
+
+void MainComponent::startPlaylist(const juce::Array<juce::File> &files) {
+  updatePlaybackState(false);
+  synthAudioSource->stopAllNotes();
+  clearPlaylist();
+  playlist = files;
+  playlistIndex = 0;
+
+  // Parse and compile the first file in the background, then play it and
+  // start on the next.
+  juce::Component::SafePointer<MainComponent> safeThis(this);
+  auto *scheduler = midiSchedulerAudioSource.get();
+  const int generation = playlistGeneration;
+  sequenceCompiler.addJob([safeThis, scheduler, generation, file = files.getFirst()]() {
+    std::shared_ptr<MidiFileLoader::Result> loaded =
+        MidiFileLoader::loadFile(file, scheduler->getSampleRate());
+    if (!loaded->succeeded) {
+      DBG(loaded->errorMessage);
+      return;
+    }
+    scheduler->setSequence(std::move(loaded->compiled));
+
+    juce::MessageManager::callAsync([safeThis, generation, loaded]() {
+      if (safeThis == nullptr || safeThis->playlistGeneration != generation)
+        return;
+      safeThis->showLoadedFile(*loaded);
+      safeThis->synthAudioSource->prioritizePresetsFor(*loaded->file);
+      safeThis->updatePlaybackState(true);
+      safeThis->prepareNextPlaylistEntry();
+    });
+  });
+}
+
+void MainComponent::prepareNextPlaylistEntry() {
+  if (playlistIndex < 0 || playlistIndex + 1 >= playlist.size())
+    return;
+
+  juce::Component::SafePointer<MainComponent> safeThis(this);
+  auto *scheduler = midiSchedulerAudioSource.get();
+  const int generation = playlistGeneration;
+  sequenceCompiler.addJob([safeThis, scheduler, generation,
+                           file = playlist[playlistIndex + 1]]() {
+    std::shared_ptr<MidiFileLoader::Result> loaded =
+        MidiFileLoader::loadFile(file, scheduler->getSampleRate());
+    if (!loaded->succeeded) {
+      DBG(loaded->errorMessage);
+      return;
+    }
+
+    // Queue it from the message thread, so it can't race a new playlist
+    // being started. Its presets start loading now, well before it plays.
+    juce::MessageManager::callAsync([safeThis, scheduler, generation, loaded]() {
+      if (safeThis == nullptr || safeThis->playlistGeneration != generation)
+        return;
+      safeThis->synthAudioSource->prioritizePresetsFor(*loaded->file);
+      scheduler->queueNextSequence(std::move(loaded->compiled));
+      safeThis->queuedEntry = loaded;
+    });
+  });
+}
+
+void MainComponent::clearPlaylist() {
+  ++playlistGeneration;
+  playlist.clear();
+  playlistIndex = -1;
+  queuedEntry = nullptr;
+  midiSchedulerAudioSource->clearQueuedSequence();
+}
+
+void MainComponent::showLoadedFile(MidiFileLoader::Result &loaded) {
+  midiData = loaded.file;
+  pianoRoll.setPPQ(midiData->ppq);
+  pianoRoll.setTimeSignature(midiData->timeSignatureNumerator,
+                             midiData->timeSignatureDenominator);
+  pianoRoll.setGeometry(std::move(loaded.geometry));
+}
+
+void MainComponent::finishLoadingMidiFile() {
+  auto result = fileLoader->takeResult();
+  fileLoader = nullptr;
+  loadProgressBar.setVisible(false);
+  if (!result->succeeded) {
+    DBG(result->errorMessage);
+    return;
+  }
+
+  // A file loaded by hand ends any playlist
+  clearPlaylist();
+  updatePlaybackState(false);
+
+  midiSchedulerAudioSource->setPPQ(result->file->ppq);
+  midiSchedulerAudioSource->setSequence(std::move(result->compiled));
+  synthAudioSource->prioritizePresetsFor(*result->file);
+  showLoadedFile(*result);
+
+  currentEvent = 0;
+  playbackPosition = 0.0;
+  lastTime = juce::Time::getMillisecondCounterHiRes();
+  DBG("MIDI file loading completed successfully");
+}
+
 void MainComponent::updatePlaybackState(bool playing) {
     isPlaying = playing;
     playPauseButton.setButtonText(juce::CharPointer_UTF8(playing ? PAUSE_SYMBOL : PLAY_SYMBOL));
@@ -435,10 +693,11 @@ void MainComponent::updatePlaybackState(bool playing) {
 }
 
 void MainComponent::playMidiFile() {
-    if (midiSequence.getNumEvents() > 0) {
+    if (hasMidiData()) {
         // Only set the MIDI sequence if we're starting from the beginning
         if (midiSchedulerAudioSource->getPlaybackPosition() == 0.0) {
-            midiSchedulerAudioSource->setMidiSequence(midiSequence);
+            midiSchedulerAudioSource->setSequence(MidiSchedulerAudioSource::compile(
+                *midiData, midiSchedulerAudioSource->getSampleRate()));
         }
         updatePlaybackState(true);
     }
@@ -502,11 +761,72 @@ bool MainComponent::keyPressed(const juce::KeyPress& key, Component* originating
     if (key == juce::KeyPress::spaceKey)
     {
         // Simulate clicking the play/pause button
-        if (midiSequence.getNumEvents() > 0) {
+        if (hasMidiData()) {
             playPauseButton.onClick();
             return true; // Key was handled
         }
     }
-    
+
+    // T starts a voice trace, and again writes it out (trace builds only)
+    if (auto* trace = synthAudioSource->getTrace())
+    {
+        if (key.getTextCharacter() == 't' || key.getTextCharacter() == 'T')
+        {
+            if (! trace->isRecording())
+            {
+                trace->setRecording (true);
+                return true;
+            }
+            trace->setRecording (false);
+            auto file = juce::File::getSpecialLocation (juce::File::userDocumentsDirectory)
+                            .getNonexistentChildFile ("midiplayer-trace", ".json");
+            if (trace->writeChromeTrace (file))
+                DBG ("Wrote voice trace to " + file.getFullPathName());
+            else
+                DBG ("Couldn't write voice trace to " + file.getFullPathName());
+            return true;
+        }
+    }
+
     return false; // Key wasn't handled
 }
+
+void MainComponent::bounceToFile() {
+  if (!hasMidiData())
+    return;
+
+  bounceChooser = std::make_unique<juce::FileChooser>(
+      "Bounce to audio file",
+      juce::File::getSpecialLocation(juce::File::userMusicDirectory)
+          .getChildFile("bounce.wav"),
+      "*.wav;*.flac");
+
+  juce::Component::SafePointer<MainComponent> safeThis(this);
+  bounceChooser->launchAsync(
+      juce::FileBrowserComponent::saveMode |
+          juce::FileBrowserComponent::warnAboutOverwriting,
+      [safeThis](const juce::FileChooser &fc) {
+        auto outputFile = fc.getResult();
+        if (safeThis == nullptr || outputFile == juce::File())
+          return;
+
+        // Render on a worker thread so the UI and live playback carry on.
+        safeThis->bounceButton.setEnabled(false);
+        auto file = safeThis->midiData;
+        juce::Thread::launch([safeThis, file, outputFile]() {
+          auto result = OfflineRenderer::renderMidiFile(
+              *file, outputFile, OfflineRenderer::Options());
+          juce::MessageManager::callAsync([safeThis, result]() {
+            if (safeThis == nullptr)
+              return;
+            safeThis->bounceButton.setEnabled(true);
+            if (result.succeeded)
+              DBG("Bounced " + juce::String(result.renderedSeconds, 1) +
+                  "s in " + juce::String(result.elapsedSeconds, 2) + "s (" +
+                  juce::String(result.realtimeFactor, 1) + "x realtime)");
+            else
+              DBG("Bounce failed: " + result.errorMessage);
+          });
+        });
+      });
+}
@@ -1,8 +1,12 @@
 #pragma once
 #include "../JuceLibraryCode/BinaryData.h"
 #include "../Modules/SFZero/SFZero.h"
+#include "LiveMidiInput.h"
+#include "MidiFileLoader.h"
+#include "PerformanceOverlay.h"
 #include "PianoRollComponent.h"
 #include "MidiSchedulerAudioSource.h"
+#include "StartupProfile.h"
 #include <JuceHeader.h>
 
 class MainComponent : public juce::Component,
@@ -39,32 +43,90 @@ public:
   // (Other member functions for MIDI handling, file loading, etc. remain as
   // before)
   void loadMidiFile();
+  // Plays files back to back, each one parsed, compiled and queued in the
+  // background while the one before it plays
+  void choosePlaylist();
+  void startPlaylist(const juce::Array<juce::File> &files);
   void playMidiFile();
   void stopMidiFile();
   void setupLoopRegion();
   void clearLoopRegion();
+  void bounceToFile();
+
+  // Trades quality and latency for battery, as the mobile builds do by
+  // default: linear interpolation, no render threads and playback rendered
+  // renderAheadSeconds ahead, and while the app is in the background, no UI
+  // timers or playhead repaints and a buffer of about backgroundBufferMs so
+  // the audio thread wakes less often
+  void setLowPowerMode(bool enabled);
+  bool isLowPowerMode() const { return lowPowerMode; }
+  // From the app's suspended() and resumed()
+  void setInBackground(bool inBackground);
 
 private:
+  // First, so it times everything from the members' construction on
+  StartupProfile startupProfile;
+
+  // Opens the default audio device and every MIDI input. Left until after
+  // the first frame, since it can take longer than everything else at launch
+  void openAudioDevice();
+
   // Updates playback state and related UI elements
   void updatePlaybackState(bool playing);
 
+  // Fills the preset list once the SoundFont has loaded
+  void populatePresetBox();
+  bool presetsPopulated = false;
+
+  // Opens 32 device outputs and gives each MIDI channel its own pair, or
+  // goes back to a stereo mix
+  void setStemOutput(bool enabled);
+
+  // Low-power state: the settings it replaced, to go back to, and the
+  // buffer size the device had before going into the background (0 while
+  // in the foreground)
+  bool lowPowerMode = false, inBackground = false;
+  sfzero::Voice::Interpolation fullPowerInterpolation = sfzero::Voice::linear;
+  int fullPowerRenderThreads = 0;
+  int foregroundBufferSize = 0;
+  static constexpr double backgroundBufferMs = 100.0;
+  static constexpr double renderAheadSeconds = 0.3;
+  void setDeviceBufferSize(int bufferSize);
+
   // File chooser
   std::unique_ptr<juce::FileChooser> fileChooser;
 
+  // The file being loaded, if any, and its progress for loadProgressBar
+  std::unique_ptr<MidiFileLoader> fileLoader;
+  double loadProgress = 0.0;
+  void finishLoadingMidiFile();
+
+  // Playlist state: the files, which one is playing, and the next one once
+  // it's queued, kept for the piano roll
+  juce::Array<juce::File> playlist;
+  int playlistIndex = -1;
+  std::shared_ptr<MidiFileLoader::Result> queuedEntry;
+  int playlistGeneration = 0; // bumped whenever the playlist is replaced
+  void prepareNextPlaylistEntry();
+  void clearPlaylist();
+  void showLoadedFile(MidiFileLoader::Result &loaded);
+  std::unique_ptr<juce::FileChooser> bounceChooser;
+
   // MIDI handling and playback state
-  juce::MidiFile midiFile;
-  juce::MidiMessageSequence midiSequence;
+  std::shared_ptr<const PackedMidiFile> midiData;
+  bool hasMidiData() const { return midiData != nullptr && !midiData->events.empty(); }
   bool isPlaying = false;
   int currentEvent = 0;
   std::atomic<double> playbackPosition{0.0};
   double lastTime = 0.0;
   int currentLoopIteration = 0;
-  double tempo = 120.0; // BPM
+  double tempo = 120.0; // the song's starting tempo in BPM, before the speed
   double loopStartBeat = 0.0, loopEndBeat = 0.0;
   int loopCount = 0;
   bool isLooping = false;
 
   // Audio setup
+  LiveMidiInput liveMidiInput; // every MIDI input, played on top of the file
   juce::AudioDeviceManager audioDeviceManager;
   juce::AudioSourcePlayer audioSourcePlayer;
   std::unique_ptr<juce::MixerAudioSource> audioMixerSource;
@@ -74,16 +136,34 @@ private:
 
   // GUI components
   juce::TextButton loadButton;
+  juce::TextButton playlistButton;
   juce::TextButton playPauseButton;  // Renamed from playButton
   juce::TextButton returnToStartButton;  // New button
   juce::TextButton setLoopButton;
   juce::TextButton clearLoopButton;
+  juce::TextButton bounceButton;
+  juce::TextButton statsButton;
+  juce::TextButton stemsButton;
+  juce::TextButton gpuButton;
   juce::ComboBox presetBox; // For preset selection
   juce::ComboBox transpositionBox; // For note transposition
   juce::Label transpositionLabel;
   PianoRollComponent pianoRoll;
   juce::Slider tempoSlider;
   juce::Label tempoLabel;
+  std::unique_ptr<PerformanceOverlay> performanceOverlay;
+  juce::ProgressBar loadProgressBar{loadProgress};
+
+  // Compiles loaded files for the scheduler off the message thread. Declared
+  // after the scheduler so it finishes its jobs before the scheduler goes.
+  juce::ThreadPool sequenceCompiler{1};
+
+  static constexpr int timerHz = 20;
+
+  // Moves the playhead once per display refresh, run on from the audio
+  // thread's last position snapshot so it doesn't step a block at a time
+  void updatePlayhead();
+  juce::VBlankAttachment playheadVBlank{this, [this] { updatePlayhead(); }};
 
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MainComponent)
 };
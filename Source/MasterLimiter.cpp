@@ -0,0 +1,90 @@
+#include "MasterLimiter.h"
+
+#include <cstring>
+
+void MasterLimiter::prepare(double sampleRate, int maximumBlockSize) {
+  lookahead = juce::jmax(1, juce::roundToInt(lookaheadSeconds * sampleRate));
+  chunkSize = juce::jmax(1, maximumBlockSize);
+  releaseCoefficient = static_cast<float>(1.0 - std::exp(-1.0 / (releaseSeconds * sampleRate)));
+
+  lines.setSize(2, lookahead + chunkSize);
+  lines.clear();
+  peaks.calloc(static_cast<size_t>(chunkSize));
+  gains.calloc(static_cast<size_t>(chunkSize));
+
+  holdSize = lookahead + 2;
+  holdGains.calloc(static_cast<size_t>(holdSize));
+  holdFrames.calloc(static_cast<size_t>(holdSize));
+  holdFirst = holdCount = 0;
+  frame = 0;
+  released = 1.0f;
+
+  box.calloc(static_cast<size_t>(lookahead));
+  juce::FloatVectorOperations::fill(box.get(), 1.0f, lookahead);
+  boxPosition = 0;
+  boxSum = lookahead;
+}
+
+void MasterLimiter::process(juce::AudioBuffer<float> &buffer, int startSample, int numSamples) {
+  jassert(lookahead > 0); // prepare() first
+  if (buffer.getNumChannels() < 2)
+    return;
+  float *left = buffer.getWritePointer(0, startSample);
+  float *right = buffer.getWritePointer(1, startSample);
+
+  for (int done = 0; done < numSamples;) {
+    const int count = juce::jmin(chunkSize, numSamples - done);
+    float *lineL = lines.getWritePointer(0);
+    float *lineR = lines.getWritePointer(1);
+
+    // The gain each frame needs, from its louder side
+    juce::FloatVectorOperations::abs(peaks.get(), left + done, count);
+    juce::FloatVectorOperations::abs(gains.get(), right + done, count);
+    juce::FloatVectorOperations::max(peaks.get(), peaks.get(), gains.get(), count);
+    computeGains(count);
+
+    // Out come the frames lookahead behind, at the gain worked out for them
+    // ahead of time
+    juce::FloatVectorOperations::copy(lineL + lookahead, left + done, count);
+    juce::FloatVectorOperations::copy(lineR + lookahead, right + done, count);
+    juce::FloatVectorOperations::multiply(left + done, lineL, gains.get(), count);
+    juce::FloatVectorOperations::multiply(right + done, lineR, gains.get(), count);
+    std::memmove(lineL, lineL + count, sizeof(float) * static_cast<size_t>(lookahead));
+    std::memmove(lineR, lineR + count, sizeof(float) * static_cast<size_t>(lookahead));
+    done += count;
+  }
+}
+
+void MasterLimiter::computeGains(int numSamples) {
+  // Under the ceiling a frame needs no reduction
+  const float limit = ceiling.load();
+  float *needed = gains.get();
+  juce::FloatVectorOperations::max(peaks.get(), peaks.get(), limit, numSamples);
+  for (int i = 0; i < numSamples; ++i)
+    needed[i] = limit / peaks[i];
+
+  // Every frame whose gain goes into a frame's average is at most the gain
+  // that frame needs, so the average is too
+  for (int i = 0; i < numSamples; ++i, ++frame) {
+    const float gain = needed[i];
+    while (holdCount > 0 && holdGains[(holdFirst + holdCount - 1) % holdSize] >= gain)
+      --holdCount;
+    const int last = (holdFirst + holdCount) % holdSize;
+    holdGains[last] = gain;
+    holdFrames[last] = frame;
+    ++holdCount;
+    if (holdFrames[holdFirst] <= frame - lookahead - 1) {
+      holdFirst = (holdFirst + 1) % holdSize;
+      --holdCount;
+    }
+    const float held = holdGains[holdFirst];
+
+    released = held < released ? held : released + (held - released) * releaseCoefficient;
+
+    boxSum += released - box[boxPosition];
+    box[boxPosition] = released;
+    if (++boxPosition == lookahead)
+      boxPosition = 0;
+    needed[i] = static_cast<float>(boxSum / lookahead);
+  }
+}
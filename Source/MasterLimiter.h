@@ -0,0 +1,58 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+
+// A stereo-linked look-ahead peak limiter for the end of the mix bus. The
+// output is delayed by getLatencySamples() and the gain starts coming down
+// that far ahead of each peak, along a straight ramp, so nothing passes the
+// ceiling and nothing is clipped. After a peak the gain recovers over about
+// releaseSeconds.
+//
+// The peaks, the gains they need and applying the gain run over whole
+// blocks with FloatVectorOperations; only the gain's hold and release go
+// frame by frame.
+class MasterLimiter {
+public:
+  static constexpr double lookaheadSeconds = 0.0015;
+  static constexpr double releaseSeconds = 0.08;
+
+  // Not on the audio thread; clears the delay and any reduction
+  void prepare(double sampleRate, int maximumBlockSize);
+
+  // The peak level let through, in dBFS. Any thread.
+  void setCeiling(float decibels) { ceiling.store(juce::Decibels::decibelsToGain(decibels)); }
+  float getCeiling() const { return juce::Decibels::gainToDecibels(ceiling.load()); }
+
+  int getLatencySamples() const { return lookahead; }
+
+  // Audio thread. Limits the first two channels of buffer in place.
+  void process(juce::AudioBuffer<float> &buffer, int startSample, int numSamples);
+
+private:
+  void computeGains(int numSamples);
+
+  std::atomic<float> ceiling{juce::Decibels::decibelsToGain(-1.0f)};
+  int lookahead = 0, chunkSize = 0;
+  float releaseCoefficient = 0.0f;
+
+  // Each channel's last lookahead frames, followed by room for a chunk
+  juce::AudioBuffer<float> lines;
+  // Per chunk: the peaks, then the gains they need, then the gains applied
+  juce::HeapBlock<float> peaks, gains;
+
+  // The least gain needed over the last lookahead + 1 frames, as a ring of
+  // candidates, oldest first, increasing in gain
+  juce::HeapBlock<float> holdGains;
+  juce::HeapBlock<juce::int64> holdFrames;
+  int holdFirst = 0, holdCount = 0, holdSize = 0;
+  juce::int64 frame = 0;
+  float released = 1.0f;
+
+  // The released gain averaged over the last lookahead frames, which turns
+  // the hold's steps into the ramps down
+  juce::HeapBlock<float> box;
+  int boxPosition = 0;
+  double boxSum = 0.0;
+};
@@ -0,0 +1,211 @@
+#include "MidiFileAnalysis.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+MidiFileAnalysis::Calibration
+MidiFileAnalysis::Calibration::fromBenchmarkReport(const juce::var &report, int blockSize) {
+  Calibration calibration;
+  const auto *results = report["results"].getArray();
+  if (results == nullptr)
+    return calibration;
+
+  int nearest = -1;
+  for (const auto &result : *results) {
+    const int size = result["blockSize"];
+    if (result["level"].toString() == "synth" &&
+        (nearest < 0 || std::abs(size - blockSize) < std::abs(nearest - blockSize)))
+      nearest = size;
+  }
+  double total = 0.0;
+  int count = 0;
+  for (const auto &result : *results) {
+    if (result["level"].toString() == "synth" && static_cast<int>(result["blockSize"]) == nearest &&
+        static_cast<double>(result["nsPerVoiceSample"]) > 0.0) {
+      total += static_cast<double>(result["nsPerVoiceSample"]);
+      ++count;
+    }
+  }
+  if (count > 0)
+    calibration.nsPerVoiceSample = total / count;
+  return calibration;
+}
+
+MidiFileAnalysis::Calibration
+MidiFileAnalysis::Calibration::fromBenchmarkFile(const juce::File &file, int blockSize) {
+  return fromBenchmarkReport(juce::JSON::parse(file), blockSize);
+}
+
+MidiFileAnalysis MidiFileAnalysis::analyse(const MidiSchedulerAudioSource::Sequence &sequence,
+                                           const Calibration &calibration) {
+  MidiFileAnalysis analysis;
+  const auto &timeline = sequence.timeline;
+  analysis.lengthSeconds = static_cast<double>(sequence.endSample) / sequence.sampleRate;
+
+  // Notes sounding per channel and key, split into those still held and
+  // those only the pedal keeps, with the voices they started, and when
+  // voices start and stop. A voice stops releaseSeconds after its note does;
+  // ties stop first.
+  struct Change {
+    double seconds;
+    int delta;
+    int channel;
+    bool operator<(const Change &other) const {
+      return seconds < other.seconds || (seconds == other.seconds && delta < other.delta);
+    }
+  };
+  std::vector<Change> changes;
+  std::array<std::array<int, 128>, 16> held{}, sustained{}, heldVoices{}, sustainedVoices{};
+  std::array<int, 16> sounding{}, programs{};
+  std::array<bool, 16> pedal{};
+  int totalSounding = 0;
+  const auto numSeconds = static_cast<size_t>(std::ceil(analysis.lengthSeconds)) + 1;
+  std::array<std::vector<int>, 16> perSecond;
+  for (auto &counts : perSecond)
+    counts.assign(numSeconds, 0);
+
+  auto release = [&](int channel, int count, int noteVoices, double seconds) {
+    sounding[static_cast<size_t>(channel)] -= count;
+    totalSounding -= count;
+    if (noteVoices > 0)
+      changes.push_back({seconds + calibration.releaseSeconds, -noteVoices, channel});
+  };
+
+  for (size_t i = 0; i < timeline.size(); ++i) {
+    const auto &data = timeline.data[i];
+    const int channel = data[0] & 0x0f;
+    const auto c = static_cast<size_t>(channel);
+    const double seconds = static_cast<double>(timeline.samples[i]) / sequence.sampleRate;
+    auto &info = analysis.channels[c];
+    ++info.events;
+    ++perSecond[c][juce::jmin(numSeconds - 1, static_cast<size_t>(juce::jmax(0.0, seconds)))];
+
+    const int type = data[0] & 0xf0;
+    const auto key = static_cast<size_t>(data[1] & 0x7f);
+    if (type == 0x90 && data[2] > 0) {
+      const int noteVoices =
+          calibration.regionsPerNote
+              ? calibration.regionsPerNote(channel, programs[c], data[1] & 0x7f, data[2] & 0x7f)
+              : 1;
+      ++info.notes;
+      info.programs.set(static_cast<size_t>(programs[c]));
+      ++held[c][key];
+      heldVoices[c][key] += noteVoices;
+      ++sounding[c];
+      ++totalSounding;
+      info.peakPolyphony = juce::jmax(info.peakPolyphony, sounding[c]);
+      analysis.peakPolyphony = juce::jmax(analysis.peakPolyphony, totalSounding);
+      if (noteVoices > 0)
+        changes.push_back({seconds, noteVoices, channel});
+    } else if (type == 0x80 || type == 0x90) {
+      if (held[c][key] > 0) {
+        // A repeated key's notes share out the voices they started
+        const int noteVoices = heldVoices[c][key] / held[c][key];
+        --held[c][key];
+        heldVoices[c][key] -= noteVoices;
+        if (pedal[c]) {
+          ++sustained[c][key];
+          sustainedVoices[c][key] += noteVoices;
+        } else {
+          release(channel, 1, noteVoices, seconds);
+        }
+      }
+    } else if (type == 0xb0 && data[1] == 64) {
+      pedal[c] = data[2] >= 64;
+      if (!pedal[c]) {
+        int count = 0, noteVoices = 0;
+        for (size_t k = 0; k < 128; ++k) {
+          count += sustained[c][k];
+          noteVoices += sustainedVoices[c][k];
+          sustained[c][k] = 0;
+          sustainedVoices[c][k] = 0;
+        }
+        release(channel, count, noteVoices, seconds);
+      }
+    } else if (type == 0xc0) {
+      programs[c] = data[1] & 0x7f;
+    }
+  }
+
+  // Voices, from the starts and stops in time order
+  std::sort(changes.begin(), changes.end());
+  std::array<int, 16> voices{};
+  std::array<int, 16> peakVoices{};
+  int totalVoices = 0, peakTotal = 0;
+  double voiceSeconds = 0.0, lastSeconds = 0.0;
+  for (const auto &change : changes) {
+    const double seconds = juce::jmin(change.seconds, analysis.lengthSeconds);
+    voiceSeconds += totalVoices * juce::jmax(0.0, seconds - lastSeconds);
+    lastSeconds = juce::jmax(lastSeconds, seconds);
+    const auto c = static_cast<size_t>(change.channel);
+    voices[c] += change.delta;
+    totalVoices += change.delta;
+    peakVoices[c] = juce::jmax(peakVoices[c], voices[c]);
+    peakTotal = juce::jmax(peakTotal, totalVoices);
+  }
+  voiceSeconds += totalVoices * juce::jmax(0.0, analysis.lengthSeconds - lastSeconds);
+
+  const double length = juce::jmax(analysis.lengthSeconds, 1.0e-9);
+  const double perNote = calibration.regionsPerNote ? 1.0 : calibration.voicesPerNote;
+  std::vector<int> allPerSecond(numSeconds, 0);
+  for (size_t c = 0; c < 16; ++c) {
+    auto &info = analysis.channels[c];
+    info.peakVoices = static_cast<int>(std::ceil(peakVoices[c] * perNote));
+    info.eventsPerSecond = info.events / length;
+    for (size_t second = 0; second < numSeconds; ++second) {
+      info.peakEventsPerSecond = juce::jmax(info.peakEventsPerSecond,
+                                            static_cast<double>(perSecond[c][second]));
+      allPerSecond[second] += perSecond[c][second];
+    }
+    analysis.events += info.events;
+    analysis.notes += info.notes;
+  }
+  for (int count : allPerSecond)
+    analysis.peakEventsPerSecond = juce::jmax(analysis.peakEventsPerSecond, static_cast<double>(count));
+  analysis.eventsPerSecond = analysis.events / length;
+  analysis.peakVoices = static_cast<int>(std::ceil(peakTotal * perNote));
+  analysis.averageVoices = voiceSeconds / length * perNote;
+
+  // Cores: voices times samples per second times the cost of each
+  const double coresPerVoice = calibration.nsPerVoiceSample * sequence.sampleRate * 1.0e-9;
+  analysis.peakLoad = analysis.peakVoices * coresPerVoice;
+  analysis.averageLoad = analysis.averageVoices * coresPerVoice;
+  return analysis;
+}
+
+int MidiFileAnalysis::getVoiceBudget() const {
+  const int wanted = (peakVoices * 5 + 3) / 4;
+  return juce::jlimit(32, maxVoiceBudget, (wanted + 31) / 32 * 32);
+}
+
+juce::String MidiFileAnalysis::toString() const {
+  juce::String text;
+  text << juce::String(lengthSeconds, 1) << "s, " << notes << " notes, " << events
+       << " events (" << juce::roundToInt(eventsPerSecond) << "/s, peak "
+       << juce::roundToInt(peakEventsPerSecond) << "/s)\n";
+  text << "polyphony " << peakPolyphony << ", voices peak " << peakVoices << " average "
+       << juce::String(averageVoices, 1) << ", budget " << getVoiceBudget();
+  if (peakLoad > 0.0)
+    text << ", load peak " << juce::String(peakLoad, 2) << " average "
+         << juce::String(averageLoad, 2) << " cores";
+  text << "\n";
+
+  for (int channel = 1; channel <= 16; ++channel) {
+    const auto &info = channels[static_cast<size_t>(channel - 1)];
+    if (info.events == 0)
+      continue;
+    juce::StringArray programList;
+    for (int program = 0; program < 128; ++program)
+      if (info.programs[static_cast<size_t>(program)])
+        programList.add(juce::String(program));
+    text << "  ch" << juce::String(channel).paddedLeft('0', 2) << ": " << info.notes
+         << " notes, polyphony " << info.peakPolyphony << ", voices " << info.peakVoices << ", "
+         << juce::String(info.eventsPerSecond, 1) << " events/s (peak "
+         << juce::roundToInt(info.peakEventsPerSecond) << "), "
+         << (channel == 10 ? "kits " : "programs ")
+         << (programList.isEmpty() ? juce::String("none") : programList.joinIntoString(" "))
+         << "\n";
+  }
+  return text;
+}
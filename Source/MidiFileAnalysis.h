@@ -0,0 +1,64 @@
+#pragma once
+
+#include "MidiSchedulerAudioSource.h"
+#include <JuceHeader.h>
+
+#include <array>
+#include <bitset>
+#include <functional>
+
+// A quick pass over a compiled sequence before anything renders it: per
+// channel, the programs its notes play, how many of them sound at once and
+// how dense its events are, and across the file the voices it needs and the
+// CPU they're predicted to take. Note-offs are matched to note-ons key by
+// key, and the sustain pedal keeps a released note sounding until it lifts.
+// A file of millions of events takes milliseconds.
+struct MidiFileAnalysis {
+  // What the prediction is made from. nsPerVoiceSample is the cost of one
+  // voice for one sample as MidiPlayerBenchmarks measures it; at 0 no load
+  // is predicted, only voices. Each note counts the voices regionsPerNote
+  // says it starts in the SoundFont that will play it; without one, it counts
+  // voicesPerNote, which allows for layered and stereo presets.
+  struct Calibration {
+    double nsPerVoiceSample = 0.0;
+    double voicesPerNote = 2.0;  // regions a note starts, on average
+    double releaseSeconds = 0.5; // a released note's voice rings on this long
+    std::function<int(int channel, int program, int note, int velocity)> regionsPerNote;
+
+    // The "synth" level results of a MidiPlayerBenchmarks --json report,
+    // averaged over the workloads at the block size nearest blockSize. Keeps
+    // the defaults if the report has none.
+    static Calibration fromBenchmarkReport(const juce::var &report, int blockSize);
+    static Calibration fromBenchmarkFile(const juce::File &file, int blockSize);
+  };
+
+  struct Channel {
+    int events = 0, notes = 0;
+    std::bitset<128> programs; // under which its notes played; drums are on 10
+    int peakPolyphony = 0;     // held and sustained notes at once
+    int peakVoices = 0;        // the same with release tails, in regions
+    double eventsPerSecond = 0.0;
+    double peakEventsPerSecond = 0.0; // the busiest whole second
+  };
+
+  std::array<Channel, 16> channels;
+  double lengthSeconds = 0.0;
+  int events = 0, notes = 0;
+  int peakPolyphony = 0, peakVoices = 0;
+  double averageVoices = 0.0;
+  double eventsPerSecond = 0.0, peakEventsPerSecond = 0.0;
+  // Cores needed to render in real time at the busiest moment and on
+  // average; 0 without a calibrated nsPerVoiceSample.
+  double peakLoad = 0.0, averageLoad = 0.0;
+
+  static MidiFileAnalysis analyse(const MidiSchedulerAudioSource::Sequence &sequence,
+                                  const Calibration &calibration = {});
+
+  // A voice pool for the file: its peak voices with a quarter again for
+  // stolen and overlapping notes, in steps of 32, from 32 to maxVoiceBudget
+  static constexpr int maxVoiceBudget = 4096;
+  int getVoiceBudget() const;
+
+  // A few lines for a terminal: the totals, then a line per channel used
+  juce::String toString() const;
+};
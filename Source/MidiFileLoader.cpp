@@ -0,0 +1,76 @@
+#include "MidiFileLoader.h"
+
+MidiFileLoader::MidiFileLoader(std::unique_ptr<juce::InputStream> streamIn,
+                               double sampleRateIn)
+    : juce::Thread("MIDI File Loader"), stream(std::move(streamIn)),
+      sampleRate(sampleRateIn), result(std::make_unique<Result>()) {
+  startThread();
+}
+
+MidiFileLoader::~MidiFileLoader() { stopThread(10000); }
+
+juce::String MidiFileLoader::getStageName(Stage stage) {
+  switch (stage) {
+  case Stage::reading:
+    return "Reading file";
+  case Stage::compiling:
+    return "Preparing playback";
+  case Stage::drawing:
+    return "Drawing notes";
+  case Stage::finished:
+    break;
+  }
+  return "Done";
+}
+
+std::unique_ptr<MidiFileLoader::Result> MidiFileLoader::takeResult() {
+  jassert(isFinished());
+  return std::move(result);
+}
+
+void MidiFileLoader::setStage(Stage newStage, double progressAtStart) {
+  progress.store(progressAtStart);
+  stage.store(newStage);
+}
+
+std::unique_ptr<MidiFileLoader::Result>
+MidiFileLoader::loadFile(const juce::File &file, double sampleRate) {
+  auto loaded = std::make_unique<Result>();
+  loaded->file = SmfReader::readFile(file, loaded->errorMessage);
+  if (loaded->file != nullptr)
+    prepare(*loaded, sampleRate, nullptr);
+  return loaded;
+}
+
+void MidiFileLoader::prepare(Result &loaded, double sampleRate,
+                             MidiFileLoader *loader) {
+  loaded.compiled = MidiSchedulerAudioSource::compile(*loaded.file, sampleRate);
+  if (loader != nullptr)
+    loader->setStage(Stage::drawing, 0.0);
+
+  const auto &compiled = *loaded.compiled;
+  const double beatsPerBar = compiled.timeSignatureNumerator *
+                             (4.0 / compiled.timeSignatureDenominator);
+  loaded.geometry = PianoRollComponent::buildGeometry(*loaded.file, beatsPerBar);
+  loaded.succeeded = true;
+}
+
+void MidiFileLoader::run() {
+  std::shared_ptr<PackedMidiFile> file;
+  if (stream != nullptr)
+    file = SmfReader::readStream(*stream, result->errorMessage, &progress, this);
+  stream.reset();
+  if (threadShouldExit())
+    return;
+  if (file == nullptr) {
+    if (result->errorMessage.isEmpty())
+      result->errorMessage = "Failed to read MIDI file";
+    setStage(Stage::finished, 1.0);
+    return;
+  }
+  result->file = file;
+
+  setStage(Stage::compiling, 0.0);
+  prepare(*result, sampleRate, this);
+  setStage(Stage::finished, 1.0);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "MidiSchedulerAudioSource.h"
+#include "PianoRollComponent.h"
+#include "SmfReader.h"
+#include <JuceHeader.h>
+
+// Loads a MIDI file on its own thread, in stages: decode and merge the
+// tracks into a PackedMidiFile, compile the scheduler's timeline, then match
+// note pairs into the piano roll's geometry. Huge files take seconds, none of
+// it on the message thread. The owner polls getProgress() and isFinished(),
+// then takes the result; deleting the loader abandons a load part-way.
+class MidiFileLoader : private juce::Thread {
+public:
+  enum class Stage { reading, compiling, drawing, finished };
+
+  struct Result {
+    bool succeeded = false;
+    juce::String errorMessage;
+    std::shared_ptr<const PackedMidiFile> file;
+    std::unique_ptr<MidiSchedulerAudioSource::Sequence> compiled;
+    PianoRollComponent::Geometry geometry;
+  };
+
+  // Starts straight away. The stream is read on the loader's thread; the
+  // timeline is compiled at sampleRate.
+  MidiFileLoader(std::unique_ptr<juce::InputStream> stream, double sampleRate);
+  ~MidiFileLoader() override;
+
+  // Every stage at once on the calling thread, for a file on disk (which is
+  // memory-mapped rather than read)
+  static std::unique_ptr<Result> loadFile(const juce::File &file, double sampleRate);
+
+  Stage getStage() const { return stage.load(); }
+  static juce::String getStageName(Stage stage);
+  // Progress through the current stage, 0-1. Only reading, by far the
+  // longest stage, reports anything in between.
+  double getProgress() const { return progress.load(); }
+
+  bool isFinished() const { return stage.load() == Stage::finished; }
+  // Once isFinished(), hands over what was loaded. Only call it once.
+  std::unique_ptr<Result> takeResult();
+
+private:
+  void run() override;
+  void setStage(Stage newStage, double progressAtStart);
+  // The stages after reading, reported to the loader if there is one
+  static void prepare(Result &result, double sampleRate, MidiFileLoader *loader);
+
+  std::unique_ptr<juce::InputStream> stream;
+  const double sampleRate;
+  std::unique_ptr<Result> result;
+  std::atomic<Stage> stage{Stage::reading};
+  std::atomic<double> progress{0.0};
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MidiFileLoader)
+};
@@ -2,122 +2,407 @@
 
 MidiSchedulerAudioSource::MidiSchedulerAudioSource(
     SynthAudioSource *synthSource)
-    : synth(synthSource) {}
+    : synth(synthSource),
+      sequence(compile(juce::MidiMessageSequence(), 480, 44100.0).release()) {}
 
-MidiSchedulerAudioSource::~MidiSchedulerAudioSource() {}
+MidiSchedulerAudioSource::~MidiSchedulerAudioSource() {
+  stopRenderAhead();
+  delete pendingSequence.exchange(nullptr);
+  delete queuedSequence.exchange(nullptr);
+  {
+    const juce::ScopedLock lock(publishLock);
+    freeRetiredSequences();
+  }
+  delete sequence;
+}
 
 void MidiSchedulerAudioSource::prepareToPlay(int samplesPerBlockExpected,
                                              double sampleRate) {
+  // The audio thread isn't running, so the sequence can be swapped and
+  // re-timed here, once the render-ahead worker has stopped too.
+  const juce::ScopedLock lock(renderAheadLock);
+  stopRenderAhead();
   currentSampleRate = sampleRate;
+  preparedBlockSize = samplesPerBlockExpected;
+  preparedSampleRate.store(sampleRate);
+  adoptPendingSequence();
+  sequence->retime(sampleRate);
+  lengthInSamples.store(sequence->endSample);
+  seekToSample(sequence->beatsToSamples(playbackPosition.load()));
+
+  scheduledEvents.clear();
+  scheduledEvents.ensureSize(scheduledEventsBytes);
   if (synth != nullptr)
     synth->prepareToPlay(samplesPerBlockExpected, sampleRate);
+
+  renderAheadPrepared = true;
+  if (renderAheadSeconds.load() > 0.0)
+    startRenderAhead();
 }
 
 void MidiSchedulerAudioSource::getNextAudioBlock(
     const juce::AudioSourceChannelInfo &bufferToFill) {
+  // Envelope and reverb tails would otherwise decay into subnormals, which
+  // some CPUs take a hundred times longer over
+  const juce::ScopedNoDenormals noDenormals;
   bufferToFill.clearActiveBufferRegion();
-  if (!isPlaying || synth == nullptr)
+  if (synth == nullptr)
     return;
 
-  const int numSamples = bufferToFill.numSamples;
-  const double currentTick = playbackPosition.load() * ppq;
-  const double currentTempo = getCurrentTempo(currentTick);
-  tempo.store(currentTempo);  // Update the stored tempo for UI purposes
-  const double secondsPerBeat = 60.0 / currentTempo;
-  const double beatsPerBlock =
-      (numSamples / currentSampleRate) / secondsPerBeat;
-  double currentBeat = playbackPosition.load();
-
-  // --- Looping Check ---
-  if (isLooping && currentBeat > loopEndBeat) {
-    if (currentLoopIteration < loopCount - 1) {
-      ++currentLoopIteration;
-      currentBeat = loopStartBeat;
-      playbackPosition.store(currentBeat);
-    } else {
-      // End looping: exit loop mode (or you could choose to stop playback).
-      isLooping = false;
-      currentLoopIteration = 0;
+  // Before the commands, so a seek pushed after this time is never missed
+  // (see notePositionChanged()).
+  const double hostTimeMs = juce::Time::getMillisecondCounterHiRes();
+
+  // While the worker renders ahead, only copy out what it rendered. Taking
+  // the rendering back waits for the block it's on, then goes back to what
+  // was last heard.
+  LiveMidiInput *live = liveInput.load();
+  const bool renderAhead =
+      renderAheadSamples.load() > 0 && live == nullptr && !synth->isStemOutput();
+  if (aheadOwned.load()) {
+    if (renderAhead) {
+      playRenderedAhead(bufferToFill, hostTimeMs);
+      return;
+    }
+    aheadOwned.store(false);
+    aheadReleasing = true;
+  }
+  if (aheadReleasing) {
+    if (aheadBusy.load()) {
+      playRenderedAhead(bufferToFill, hostTimeMs);
+      return;
     }
+    aheadReleasing = false;
+    rewindToHeard(aheadRead);
+    synth->setLoadBudgetSuspended(false);
   }
 
-  // --- End-of-File Check ---
-  double fileEndBeat = 0.0;
-  if (midiSequence.getNumEvents() > 0)
-    fileEndBeat =
-        ticksToBeats(
-            midiSequence.getEventPointer(midiSequence.getNumEvents() - 1)
-                ->message.getTimeStamp()) +
-        1.0;
-
-  if (!isLooping && (currentBeat + beatsPerBlock) >= fileEndBeat) {
-    double beatsToEnd = fileEndBeat - currentBeat;
-    int samplesToEnd =
-        juce::jmin(numSamples, static_cast<int>(beatsToEnd * currentSampleRate /
-                                                (60.0 / currentTempo)));
-    juce::MidiBuffer midiBuffer;
-    int startEventIndex = findEventIndexForBeat(currentBeat);
-    int endEventIndex = findEventIndexForBeat(fileEndBeat);
-    for (int i = startEventIndex;
-         i < endEventIndex && i < midiSequence.getNumEvents(); ++i) {
-      auto *event = midiSequence.getEventPointer(i);
-      double eventBeat = ticksToBeats(event->message.getTimeStamp());
-      double relativeBeat = eventBeat - currentBeat;
-      double eventTimeSec = relativeBeat * secondsPerBeat;
-      int sampleOffset = static_cast<int>(eventTimeSec * currentSampleRate);
-      if (sampleOffset >= 0 && sampleOffset < samplesToEnd)
-        midiBuffer.addEvent(event->message,
-                            bufferToFill.startSample + sampleOffset);
+  {
+    // Idle callbacks count too: they're part of the device's real load.
+    const sfzero::PerformanceCounters::ScopedCallback timing(
+        synth->getPerformanceCounters(), bufferToFill.numSamples);
+    applyChanges();
+    publishSnapshot(hostTimeMs, bufferToFill.numSamples);
+    const bool reachedEnd = renderBlock(bufferToFill, live, hostTimeMs);
+    if (isPlaying)
+      playbackPosition.store(sequence->secondsToBeats(playheadSample / currentSampleRate));
+
+    if (sequenceAdvanced) {
+      sequenceAdvanced = false;
+      notifySequenceAdvanced(advancedTempo);
     }
-    synth->renderNextBlock(*bufferToFill.buffer, midiBuffer,
-                           bufferToFill.startSample, samplesToEnd);
-    playbackPosition.store(fileEndBeat);
+    if (reachedEnd)
+      notifyPlaybackStopped();
+  }
+
+  // The worker carries on from the end of this block
+  if (renderAhead)
+    handOverToRenderAhead();
+}
+
+void MidiSchedulerAudioSource::applyChanges() {
+  adoptPendingSequence();
+  commands.drain([this](const Command &command) { applyCommand(command); });
+}
+
+bool MidiSchedulerAudioSource::renderBlock(
+    const juce::AudioSourceChannelInfo &bufferToFill, LiveMidiInput *live,
+    double hostTimeMs) {
+  const int numSamples = bufferToFill.numSamples;
+  scheduledEvents.clear();
+  if (chasePending && isPlaying) {
+    releaseSoundingNotes(bufferToFill.startSample);
+    chaseToCursor(bufferToFill.startSample);
+    chasePending = false;
+  }
 
-    // Call the onPlaybackStopped callback on the message thread.
-    if (onPlaybackStopped) {
-      juce::MessageManager::callAsync([this] { onPlaybackStopped(); });
+  // Live input goes in first, at its own offsets, and keeps the synth
+  // running while stopped.
+  if (live != nullptr)
+    live->drainInto(scheduledEvents, bufferToFill.startSample, numSamples,
+                    currentSampleRate, hostTimeMs);
+  if (!isPlaying) {
+    if (live != nullptr)
+      synth->renderNextBlock(*bufferToFill.buffer, scheduledEvents,
+                             bufferToFill.startSample, numSamples);
+    return false;
+  }
+
+  // Walk the timeline, splitting the block at tempo changes, the loop end and
+  // the file end. The timeline is in the tempo map's samples, which the
+  // playback rate steps through rate at a time per output sample.
+  int rendered = 0;
+  bool reachedEnd = false;
+  while (rendered < numSamples) {
+    const int remaining = numSamples - rendered;
+    const double position = playheadSample + playheadFraction;
+    // Just past where the rest of the block's last sample falls
+    juce::int64 segmentEnd =
+        static_cast<juce::int64>(std::floor(position + (remaining - 1) * rate)) + 1;
+
+    // Tempo changes take effect on their exact sample (the reported tempo and
+    // position follow the map; event times already include it).
+    const auto &tempoEvents = sequence->tempoEvents;
+    while (tempoCursor < tempoEvents.size() &&
+           tempoEvents[tempoCursor].sample <= playheadSample) {
+      setSequenceTempo(60000000.0 / tempoEvents[tempoCursor].tempo);
+      ++tempoCursor;
+    }
+    if (tempoCursor < tempoEvents.size())
+      segmentEnd = juce::jmin(segmentEnd, tempoEvents[tempoCursor].sample);
+
+    // With another song queued, this one ends on its last event rather than
+    // the beat after, so the next starts without a gap.
+    const juce::int64 endSample = queuedSequence.load() != nullptr
+                                      ? sequence->lastEventSample
+                                      : sequence->endSample;
+    if (isLooping) {
+      const juce::int64 loopEndSample = sequence->beatsToSamples(loopEndBeat);
+      if (playheadSample >= loopEndSample) {
+        const juce::int64 loopStartSample = sequence->beatsToSamples(loopStartBeat);
+        if (currentLoopIteration < loopCount - 1 &&
+            loopStartSample < loopEndSample) {
+          // Wrap on this sample: stop what's still sounding and restore the
+          // loop start's state, ahead of its events at the same offset. Below
+          // normal speed the end may have been overshot by a fraction of a
+          // step, which carries over.
+          const double overshoot = position - static_cast<double>(loopEndSample);
+          ++currentLoopIteration;
+          releaseSoundingNotes(bufferToFill.startSample + rendered);
+          seekToSample(loopStartSample + static_cast<juce::int64>(overshoot));
+          playheadFraction = overshoot - std::floor(overshoot);
+          chaseToCursor(bufferToFill.startSample + rendered);
+        } else {
+          // End looping: exit loop mode (or you could choose to stop playback).
+          isLooping = false;
+          currentLoopIteration = 0;
+        }
+        continue;
+      }
+      segmentEnd = juce::jmin(segmentEnd, loopEndSample);
+    } else if (segmentEnd >= endSample) {
+      segmentEnd = juce::jmax(playheadSample, endSample);
+      reachedEnd = true;
+    }
+
+    // The output samples that fall before segmentEnd
+    const int count = juce::jlimit(
+        0, remaining, static_cast<int>(std::ceil((segmentEnd - position) / rate)));
+    scheduleEvents(position, segmentEnd, count, bufferToFill.startSample + rendered);
+    rendered += count;
+    const double nextPosition = position + count * rate;
+    playheadSample = static_cast<juce::int64>(std::floor(nextPosition));
+    playheadFraction = nextPosition - static_cast<double>(playheadSample);
+    if (reachedEnd) {
+      if (!advanceToQueuedSequence())
+        break;
+      reachedEnd = false; // carry on into the next song from this sample
     }
-    return;
   }
 
-  // --- Normal Playback ---
-  juce::MidiBuffer midiBuffer;
-  int startEventIndex = findEventIndexForBeat(currentBeat);
-  int endEventIndex = findEventIndexForBeat(currentBeat + beatsPerBlock);
-  for (int i = startEventIndex;
-       i < endEventIndex && i < midiSequence.getNumEvents(); ++i) {
-    auto *event = midiSequence.getEventPointer(i);
-    double eventBeat = ticksToBeats(event->message.getTimeStamp());
-    double relativeBeat = eventBeat - currentBeat;
-    double eventTimeSec = relativeBeat * secondsPerBeat;
-    int sampleOffset = static_cast<int>(eventTimeSec * currentSampleRate);
-    if (sampleOffset >= 0 && sampleOffset < numSamples)
-      midiBuffer.addEvent(event->message,
-                          bufferToFill.startSample + sampleOffset);
+  // With live input the whole block renders, past the song's end too.
+  if (live != nullptr)
+    rendered = numSamples;
+  if (rendered > 0)
+    synth->renderNextBlock(*bufferToFill.buffer, scheduledEvents,
+                           bufferToFill.startSample, rendered);
+  return reachedEnd;
+}
+
+void MidiSchedulerAudioSource::notifyPlaybackStopped() {
+  // Call the onPlaybackStopped callback on the message thread.
+  if (onPlaybackStopped)
+    juce::MessageManager::callAsync([this] { onPlaybackStopped(); });
+}
+
+void MidiSchedulerAudioSource::notifySequenceAdvanced(double initialTempo) {
+  juce::MessageManager::callAsync([this, initialTempo] {
+    if (onTempoChanged) onTempoChanged(initialTempo);
+    if (onSequenceAdvanced) onSequenceAdvanced();
+  });
+}
+
+double MidiSchedulerAudioSource::getEndBeat() const {
+  return isLooping ? loopEndBeat
+                   : sequence->secondsToBeats(sequence->endSample / currentSampleRate);
+}
+
+void MidiSchedulerAudioSource::publishSnapshot(double hostTimeMs, int numSamples) {
+  PositionSnapshot snapshot;
+  snapshot.sampleTime = playheadSample;
+  snapshot.beat = sequence->secondsToBeats(playheadSample / currentSampleRate);
+  snapshot.hostTimeMs = hostTimeMs;
+  snapshot.tempo = tempo.load();
+  snapshot.endBeat = getEndBeat();
+  snapshot.blockSeconds = numSamples / currentSampleRate;
+  snapshot.playing = isPlaying;
+  writeSnapshot(snapshot);
+}
+
+void MidiSchedulerAudioSource::writeSnapshot(const PositionSnapshot &snapshot) {
+  const juce::uint32 version = snapshotVersion.load(std::memory_order_relaxed);
+  snapshotVersion.store(version + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  snapshotSampleTime.store(snapshot.sampleTime, std::memory_order_relaxed);
+  snapshotBeat.store(snapshot.beat, std::memory_order_relaxed);
+  snapshotHostTimeMs.store(snapshot.hostTimeMs, std::memory_order_relaxed);
+  snapshotTempo.store(snapshot.tempo, std::memory_order_relaxed);
+  snapshotEndBeat.store(snapshot.endBeat, std::memory_order_relaxed);
+  snapshotBlockSeconds.store(snapshot.blockSeconds, std::memory_order_relaxed);
+  snapshotPlaying.store(snapshot.playing, std::memory_order_relaxed);
+  snapshotVersion.store(version + 2, std::memory_order_release);
+}
+
+MidiSchedulerAudioSource::PositionSnapshot
+MidiSchedulerAudioSource::getPositionSnapshot() const {
+  PositionSnapshot snapshot;
+  for (;;) {
+    const juce::uint32 before = snapshotVersion.load(std::memory_order_acquire);
+    if ((before & 1) != 0)
+      continue; // mid-write
+    snapshot.sampleTime = snapshotSampleTime.load(std::memory_order_relaxed);
+    snapshot.beat = snapshotBeat.load(std::memory_order_relaxed);
+    snapshot.hostTimeMs = snapshotHostTimeMs.load(std::memory_order_relaxed);
+    snapshot.tempo = snapshotTempo.load(std::memory_order_relaxed);
+    snapshot.endBeat = snapshotEndBeat.load(std::memory_order_relaxed);
+    snapshot.blockSeconds = snapshotBlockSeconds.load(std::memory_order_relaxed);
+    snapshot.playing = snapshotPlaying.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (snapshotVersion.load(std::memory_order_relaxed) == before)
+      return snapshot;
   }
-  synth->renderNextBlock(*bufferToFill.buffer, midiBuffer,
-                         bufferToFill.startSample, numSamples);
-  playbackPosition.store(currentBeat + beatsPerBlock);
 }
 
-void MidiSchedulerAudioSource::releaseResources() {
-  if (synth != nullptr)
-    synth->releaseResources();
+double MidiSchedulerAudioSource::getPlaybackPosition(double hostTimeMs) const {
+  const PositionSnapshot snapshot = getPositionSnapshot();
+  if (!snapshot.playing || snapshot.hostTimeMs < positionChangedMs.load())
+    return getPlaybackPosition();
+
+  // Up to two blocks on: if the audio thread stalls, the playhead waits for
+  // it rather than running ahead of the sound.
+  const double elapsed = juce::jlimit(0.0, 2.0 * snapshot.blockSeconds,
+                                      (hostTimeMs - snapshot.hostTimeMs) / 1000.0);
+  return juce::jmin(snapshot.beat + elapsed * snapshot.tempo / 60.0,
+                    juce::jmax(snapshot.beat, snapshot.endBeat));
 }
 
-void MidiSchedulerAudioSource::setMidiSequence (const juce::MidiMessageSequence& sequence)
-{
-    midiSequence = sequence;
-    // Reset only the playback position, not the tempo:
-    playbackPosition.store(0.0);
-    
-    // Extract tempo and time signature information
-    extractTempoEvents();
-    extractTimeSignature();
+void MidiSchedulerAudioSource::notePositionChanged() {
+  // After the command or sequence is published: a callback that started
+  // after this time has already picked it up.
+  positionChangedMs.store(juce::Time::getMillisecondCounterHiRes());
+}
+
+void MidiSchedulerAudioSource::scheduleEvents(double fromPosition,
+                                              juce::int64 toSample,
+                                              int numSamples, int bufferOffset) {
+  // Each event goes on the first output sample at or past it; one the last
+  // segment's rounding left just behind goes on the first
+  const auto &timeline = sequence->timeline;
+  const size_t numEvents = timeline.size();
+  const int lastOffset = juce::jmax(0, numSamples - 1);
+  while (cursor < numEvents && timeline.samples[cursor] < toSample) {
+    const double eventSample = static_cast<double>(timeline.samples[cursor]);
+    const int offset = juce::jlimit(
+        0, lastOffset, static_cast<int>(std::ceil((eventSample - fromPosition) / rate)));
+    const auto &data = timeline.data[cursor];
+    scheduledEvents.addEvent(data.data(), timeline.sizes[cursor], bufferOffset + offset);
+    const int type = data[0] & 0xf0;
+    if (type == 0x90 || type == 0x80)
+      soundingNotes[data[0] & 0x0f][data[1] & 0x7f] = type == 0x90 && data[2] > 0;
+    ++cursor;
+  }
 }
 
-void MidiSchedulerAudioSource::extractTempoEvents()
+void MidiSchedulerAudioSource::releaseSoundingNotes(int bufferOffset) {
+  for (int channel = 0; channel < 16; ++channel) {
+    auto &notes = soundingNotes[static_cast<size_t>(channel)];
+    if (notes.none())
+      continue;
+    for (int note = 0; note < 128; ++note) {
+      if (notes[static_cast<size_t>(note)]) {
+        const juce::uint8 noteOff[3] = {static_cast<juce::uint8>(0x80 | channel),
+                                        static_cast<juce::uint8>(note), 0};
+        scheduledEvents.addEvent(noteOff, 3, bufferOffset);
+      }
+    }
+    notes.reset();
+  }
+}
+
+void MidiSchedulerAudioSource::chaseToCursor(int bufferOffset) {
+  const auto &checkpoints = sequence->checkpoints;
+  const auto checkpoint =
+      std::upper_bound(checkpoints.begin(), checkpoints.end(), cursor,
+                       [](size_t index, const Sequence::Checkpoint &c) { return index < c.eventIndex; }) -
+      1;
+  chase.channels = checkpoint->channels;
+  std::memset(chase.velocities, 0, sizeof(chase.velocities));
+  for (size_t i = 0; i < checkpoint->numHeldNotes; ++i) {
+    const auto &held = sequence->heldNotes[checkpoint->firstHeldNote + i];
+    chase.velocities[held.channel][held.note] = held.velocity;
+  }
+  for (size_t i = checkpoint->eventIndex; i < cursor; ++i)
+    chase.apply(sequence->timeline.data[i]);
+
+  // Only the channels the sequence plays on, so live input keeps the rest
+  auto send = [this, bufferOffset](juce::uint8 status, juce::uint8 data1, juce::uint8 data2, int size) {
+    const juce::uint8 message[3] = {status, data1, data2};
+    scheduledEvents.addEvent(message, size, bufferOffset);
+  };
+  for (int channel = 0; channel < 16; ++channel) {
+    if ((sequence->usedChannels & (1 << channel)) == 0)
+      continue;
+    const auto &state = chase.channels[static_cast<size_t>(channel)];
+    const auto c = static_cast<juce::uint8>(channel);
+    if (state.program >= 0)
+      send(0xc0 | c, static_cast<juce::uint8>(state.program), 0, 2);
+    // Pedal up first, so the notes just released don't hang on it
+    send(0xb0 | c, 64, 0, 3);
+    for (int i = 0; i < Sequence::ChannelState::numControllers; ++i)
+      send(0xb0 | c, Sequence::ChannelState::controllerNumbers[i], state.controllers[i], 3);
+    send(0xe0 | c, static_cast<juce::uint8>(state.pitchBend & 0x7f),
+         static_cast<juce::uint8>(state.pitchBend >> 7), 3);
+
+    // Notes already in progress restart from their attack
+    for (int note = 0; note < 128; ++note) {
+      const juce::uint8 velocity = chase.velocities[channel][note];
+      if (velocity > 0) {
+        send(0x90 | c, static_cast<juce::uint8>(note), velocity, 3);
+        soundingNotes[static_cast<size_t>(channel)][static_cast<size_t>(note)] = true;
+      }
+    }
+  }
+}
+
+void MidiSchedulerAudioSource::seekToSample(juce::int64 sample) {
+  const auto &timeline = sequence->timeline;
+  const auto &tempoEvents = sequence->tempoEvents;
+  playheadSample = sample;
+  playheadFraction = 0.0;
+  cursor = static_cast<size_t>(
+      std::lower_bound(timeline.samples.begin(), timeline.samples.end(), sample) -
+      timeline.samples.begin());
+
+  // Apply the tempo in force here, then wait for the next change.
+  tempoCursor = static_cast<size_t>(
+      std::upper_bound(tempoEvents.begin(), tempoEvents.end(), sample,
+                       [](juce::int64 s, const TempoEvent &event) { return s < event.sample; }) -
+      tempoEvents.begin());
+  setSequenceTempo(tempoCursor > 0 ? 60000000.0 / tempoEvents[tempoCursor - 1].tempo : 120.0);
+}
+
+void MidiSchedulerAudioSource::setSequenceTempo(double bpm) {
+  sequenceTempo = bpm;
+  tempo.store(bpm * rate);
+}
+
+namespace {
+
+// Tempo changes, sorted, with a 120 BPM one at time 0 if the file has none
+void extractTempoEvents(const juce::MidiMessageSequence &midiSequence,
+                        MidiSchedulerAudioSource::Sequence &compiled)
 {
+    auto &tempoEvents = compiled.tempoEvents;
     tempoEvents.clear();
     bool foundTempoEvent = false;
     double initialTempo = 120.0;  // Default tempo
@@ -157,20 +442,12 @@ void MidiSchedulerAudioSource::extractTempoEvents()
         tempoEvents.push_back({0.0, 500000.0});  // 120 BPM
         initialTempo = 120.0;
     }
-    
-    // Always notify about the initial tempo, whether it's from the file or default
-    if (onTempoChanged) {
-        DBG("Setting initial tempo to: " + juce::String(initialTempo) + " BPM");
-        juce::MessageManager::callAsync([this, initialTempo]() {
-            if (onTempoChanged) onTempoChanged(initialTempo);
-        });
-    }
-    
-    // Store the initial tempo
-    tempo.store(initialTempo);
+    compiled.initialTempo = initialTempo;
+    compiled.buildTempoTable();
 }
 
-void MidiSchedulerAudioSource::extractTimeSignature()
+void extractTimeSignature(const juce::MidiMessageSequence &midiSequence,
+                          MidiSchedulerAudioSource::Sequence &compiled)
 {
     for (int i = 0; i < midiSequence.getNumEvents(); ++i)
     {
@@ -182,15 +459,15 @@ void MidiSchedulerAudioSource::extractTimeSignature()
             const uint8_t* data = msg.getRawData();
             if (data[1] == 0x58 && data[2] == 0x04)  // Time signature meta event
             {
-                timeSignatureNumerator = data[3];
-                timeSignatureDenominator = 1 << data[4];  // 2^data[4]
-                clocksPerClick = data[5];
-                thirtySecondPer24Clocks = data[6];
+                compiled.timeSignatureNumerator = data[3];
+                compiled.timeSignatureDenominator = 1 << data[4];  // 2^data[4]
+                compiled.clocksPerClick = data[5];
+                compiled.thirtySecondPer24Clocks = data[6];
                 
-                DBG("Found time signature: " + juce::String(timeSignatureNumerator) + "/" + 
-                    juce::String(timeSignatureDenominator) + 
-                    " (clocks per click: " + juce::String(clocksPerClick) + 
-                    ", 32nd notes per 24 MIDI clocks: " + juce::String(thirtySecondPer24Clocks) + ")");
+                DBG("Found time signature: " + juce::String(compiled.timeSignatureNumerator) + "/" + 
+                    juce::String(compiled.timeSignatureDenominator) + 
+                    " (clocks per click: " + juce::String(compiled.clocksPerClick) + 
+                    ", 32nd notes per 24 MIDI clocks: " + juce::String(compiled.thirtySecondPer24Clocks) + ")");
                 
                 // Usually we only care about the first time signature, unless implementing
                 // time signature changes
@@ -200,39 +477,634 @@ void MidiSchedulerAudioSource::extractTimeSignature()
     }
 }
 
-double MidiSchedulerAudioSource::getCurrentTempo(double timestamp) const
-{
-    // Find the last tempo event before or at this timestamp
-    auto it = std::upper_bound(tempoEvents.begin(), tempoEvents.end(), 
-                              TempoEvent{timestamp, 0.0});
-    
-    if (it == tempoEvents.begin())
-        return 120.0;  // Default tempo if timestamp is before first tempo event
-        
-    --it;  // Move to the last event before timestamp
-    return 60000000.0 / it->tempo;  // Convert microseconds per quarter note to BPM
+void compileTimeline(const juce::MidiMessageSequence &midiSequence,
+                     MidiSchedulerAudioSource::Sequence &compiled) {
+  auto &timeline = compiled.timeline;
+  const int numEvents = midiSequence.getNumEvents();
+  timeline.beats.reserve(static_cast<size_t>(numEvents));
+  timeline.data.reserve(static_cast<size_t>(numEvents));
+  timeline.sizes.reserve(static_cast<size_t>(numEvents));
+
+  for (int i = 0; i < numEvents; ++i) {
+    const auto &msg = midiSequence.getEventPointer(i)->message;
+    const int size = msg.getRawDataSize();
+    if (msg.isMetaEvent() || size > 3)
+      continue; // meta events and sysex never reach the synth
+
+    std::array<juce::uint8, 3> bytes{};
+    std::copy(msg.getRawData(), msg.getRawData() + size, bytes.begin());
+    timeline.beats.push_back(compiled.ticksToBeats(msg.getTimeStamp()));
+    timeline.data.push_back(bytes);
+    timeline.sizes.push_back(static_cast<juce::uint8>(size));
+  }
+
+  compiled.lastEventBeat = numEvents > 0
+                ? compiled.ticksToBeats(midiSequence.getEventPointer(numEvents - 1)
+                                   ->message.getTimeStamp())
+                : 0.0;
+  compiled.sequenceEndBeat = numEvents > 0 ? compiled.lastEventBeat + 1.0 : 0.0;
+}
+
+} // namespace
+
+std::unique_ptr<MidiSchedulerAudioSource::Sequence>
+MidiSchedulerAudioSource::compile(const juce::MidiMessageSequence &midiSequence,
+                                  int ppq, double sampleRate) {
+  auto compiled = std::make_unique<Sequence>();
+  compiled->ppq = ppq;
+  extractTempoEvents(midiSequence, *compiled);
+  extractTimeSignature(midiSequence, *compiled);
+  compileTimeline(midiSequence, *compiled);
+  compiled->buildCheckpoints();
+  compiled->retime(sampleRate);
+  return compiled;
+}
+
+std::unique_ptr<MidiSchedulerAudioSource::Sequence>
+MidiSchedulerAudioSource::compile(const PackedMidiFile &file, double sampleRate) {
+  auto compiled = std::make_unique<Sequence>();
+  compiled->ppq = file.ppq;
+
+  auto &tempoEvents = compiled->tempoEvents;
+  tempoEvents.reserve(juce::jmax<size_t>(1, file.tempos.size()));
+  for (const auto &change : file.tempos)
+    tempoEvents.push_back({static_cast<double>(change.tick),
+                           static_cast<double>(change.microsPerQuarter)});
+  if (tempoEvents.empty())
+    tempoEvents.push_back({0.0, 500000.0}); // 120 BPM
+  compiled->initialTempo = file.tempos.empty() ? 120.0 : 60000000.0 / tempoEvents.front().tempo;
+  compiled->buildTempoTable();
+
+  compiled->timeSignatureNumerator = file.timeSignatureNumerator;
+  compiled->timeSignatureDenominator = file.timeSignatureDenominator;
+  compiled->clocksPerClick = file.clocksPerClick;
+  compiled->thirtySecondPer24Clocks = file.thirtySecondPer24Clocks;
+
+  auto &timeline = compiled->timeline;
+  const size_t numEvents = file.events.size();
+  timeline.beats.resize(numEvents);
+  timeline.data.resize(numEvents);
+  timeline.sizes.resize(numEvents);
+  for (size_t i = 0; i < numEvents; ++i) {
+    const auto &event = file.events[i];
+    timeline.beats[i] = compiled->ticksToBeats(event.tick);
+    timeline.data[i] = {event.status, event.data1, event.data2};
+    timeline.sizes[i] = event.size;
+  }
+
+  compiled->lastEventBeat = compiled->ticksToBeats(file.lastTick);
+  compiled->sequenceEndBeat = file.lastTick > 0 || numEvents > 0 ? compiled->lastEventBeat + 1.0 : 0.0;
+  compiled->buildCheckpoints();
+  compiled->retime(sampleRate);
+  return compiled;
+}
+
+void MidiSchedulerAudioSource::Sequence::retime(double newSampleRate) {
+  sampleRate = newSampleRate;
+  timeline.samples.resize(timeline.size());
+  for (size_t i = 0; i < timeline.size(); ++i)
+    timeline.samples[i] = beatsToSamples(timeline.beats[i]);
+  for (auto &event : tempoEvents)
+    event.sample = static_cast<juce::int64>(std::llround(event.seconds * sampleRate));
+  endSample = beatsToSamples(sequenceEndBeat);
+  lastEventSample = beatsToSamples(lastEventBeat);
+}
+
+void MidiSchedulerAudioSource::Sequence::buildTempoTable() {
+  // Cumulative time at each tempo change, so converting between ticks and
+  // seconds is one binary search plus one segment, with nothing accumulated.
+  double segmentTick = 0.0, seconds = 0.0;
+  double microsPerQuarter = 500000.0; // 120 BPM until the first tempo event
+  for (auto &event : tempoEvents) {
+    seconds += (event.timestamp - segmentTick) / ppq * microsPerQuarter / 1000000.0;
+    event.seconds = seconds;
+    segmentTick = event.timestamp;
+    microsPerQuarter = event.tempo;
+  }
+}
+
+double MidiSchedulerAudioSource::Sequence::beatsToSeconds(double beat) const {
+  const double tick = beat * ppq;
+  auto it = std::upper_bound(tempoEvents.begin(), tempoEvents.end(), tick,
+                             [](double t, const TempoEvent &event) { return t < event.timestamp; });
+  if (it == tempoEvents.begin())
+    return tick / ppq * 0.5; // 120 BPM before the first tempo event
+  --it;
+  return it->seconds + (tick - it->timestamp) / ppq * it->tempo / 1000000.0;
+}
+
+double MidiSchedulerAudioSource::Sequence::secondsToBeats(double seconds) const {
+  auto it = std::upper_bound(tempoEvents.begin(), tempoEvents.end(), seconds,
+                             [](double s, const TempoEvent &event) { return s < event.seconds; });
+  if (it == tempoEvents.begin())
+    return seconds * 2.0; // 120 BPM before the first tempo event
+  --it;
+  return ticksToBeats(it->timestamp + (seconds - it->seconds) * 1000000.0 / it->tempo * ppq);
+}
+
+void MidiSchedulerAudioSource::Sequence::ChaseState::apply(
+    const std::array<juce::uint8, 3> &data) {
+  const int channel = data[0] & 0x0f;
+  auto &state = channels[static_cast<size_t>(channel)];
+  switch (data[0] & 0xf0) {
+  case 0x80:
+    velocities[channel][data[1] & 0x7f] = 0;
+    break;
+  case 0x90:
+    velocities[channel][data[1] & 0x7f] = data[2];
+    break;
+  case 0xb0:
+    if (data[1] == 120 || data[1] == 123) {
+      std::memset(velocities[channel], 0, sizeof(velocities[channel]));
+    } else if (data[1] == 121) {
+      // As the synth resets them: expression, the pedal, modulation and bend
+      const ChannelState defaults;
+      for (int i = 0; i < ChannelState::numControllers; ++i) {
+        const int number = ChannelState::controllerNumbers[i];
+        if (number == 1 || number == 11 || number == 64)
+          state.controllers[i] = defaults.controllers[i];
+      }
+      state.pitchBend = defaults.pitchBend;
+    } else {
+      for (int i = 0; i < ChannelState::numControllers; ++i)
+        if (ChannelState::controllerNumbers[i] == data[1])
+          state.controllers[i] = data[2];
+    }
+    break;
+  case 0xc0:
+    state.program = data[1];
+    break;
+  case 0xe0:
+    state.pitchBend = data[1] | (data[2] << 7);
+    break;
+  default:
+    break;
+  }
+}
+
+void MidiSchedulerAudioSource::Sequence::buildCheckpoints() {
+  checkpoints.clear();
+  heldNotes.clear();
+  usedChannels = 0;
+
+  // A seek then replays at most checkpointBeats of events
+  auto chase = std::make_unique<ChaseState>();
+  auto addCheckpoint = [&](size_t eventIndex) {
+    Checkpoint checkpoint;
+    checkpoint.eventIndex = eventIndex;
+    checkpoint.channels = chase->channels;
+    checkpoint.firstHeldNote = heldNotes.size();
+    for (int channel = 0; channel < 16; ++channel)
+      for (int note = 0; note < 128; ++note)
+        if (chase->velocities[channel][note] > 0)
+          heldNotes.push_back({static_cast<juce::uint8>(channel),
+                               static_cast<juce::uint8>(note),
+                               chase->velocities[channel][note]});
+    checkpoint.numHeldNotes = heldNotes.size() - checkpoint.firstHeldNote;
+    checkpoints.push_back(checkpoint);
+  };
+
+  addCheckpoint(0);
+  double nextBeat = checkpointBeats;
+  for (size_t i = 0; i < timeline.size(); ++i) {
+    if (timeline.beats[i] >= nextBeat) {
+      addCheckpoint(i);
+      nextBeat = (std::floor(timeline.beats[i] / checkpointBeats) + 1.0) * checkpointBeats;
+    }
+    chase->apply(timeline.data[i]);
+    usedChannels |= static_cast<juce::uint16>(1 << (timeline.data[i][0] & 0x0f));
+  }
+}
+
+void MidiSchedulerAudioSource::releaseResources() {
+  {
+    const juce::ScopedLock lock(renderAheadLock);
+    stopRenderAhead();
+    renderAheadPrepared = false;
+  }
+  if (synth != nullptr)
+    synth->releaseResources();
+}
+
+void MidiSchedulerAudioSource::setMidiSequence(
+    const juce::MidiMessageSequence &midiSequence) {
+  setSequence(compile(midiSequence, ppq, preparedSampleRate.load()));
+}
+
+void MidiSchedulerAudioSource::setSequence(std::unique_ptr<Sequence> compiled) {
+  if (compiled->sampleRate != preparedSampleRate.load())
+    compiled->retime(preparedSampleRate.load());
+
+  // Reset only the playback position, not the tempo:
+  playbackPosition.store(0.0);
+  lengthInSamples.store(compiled->endSample);
+  timeSignatureNumerator.store(compiled->timeSignatureNumerator);
+  timeSignatureDenominator.store(compiled->timeSignatureDenominator);
+
+  // Always notify about the initial tempo, whether it's from the file or default
+  if (onTempoChanged) {
+    const double initialTempo = compiled->initialTempo;
+    DBG("Setting initial tempo to: " + juce::String(initialTempo) + " BPM");
+    juce::MessageManager::callAsync([this, initialTempo]() {
+      if (onTempoChanged) onTempoChanged(initialTempo);
+    });
+  }
+
+  const juce::ScopedLock lock(publishLock);
+  freeRetiredSequences();
+  // One the audio thread never picked up is still ours to free.
+  delete pendingSequence.exchange(compiled.release());
+  ++changesPublished;
+  aheadWorker.notify();
+  notePositionChanged();
+}
+
+void MidiSchedulerAudioSource::queueNextSequence(std::unique_ptr<Sequence> compiled) {
+  if (compiled != nullptr && compiled->sampleRate != preparedSampleRate.load())
+    compiled->retime(preparedSampleRate.load());
+
+  const juce::ScopedLock lock(publishLock);
+  freeRetiredSequences();
+  delete queuedSequence.exchange(compiled.release());
+}
+
+void MidiSchedulerAudioSource::adoptPendingSequence() {
+  // Wait a block if there's nowhere to send the old one back to.
+  if (retiredSequences.getFreeSpace() == 0)
+    return;
+  Sequence *next = pendingSequence.exchange(nullptr);
+  if (next != nullptr)
+    switchToSequence(next);
+}
+
+bool MidiSchedulerAudioSource::advanceToQueuedSequence() {
+  if (retiredSequences.getFreeSpace() == 0)
+    return false;
+  Sequence *next = queuedSequence.exchange(nullptr);
+  if (next == nullptr)
+    return false;
+
+  switchToSequence(next);
+  isLooping = false; // the loop region was the last song's
+  currentLoopIteration = 0;
+  lengthInSamples.store(sequence->endSample);
+  timeSignatureNumerator.store(sequence->timeSignatureNumerator);
+  timeSignatureDenominator.store(sequence->timeSignatureDenominator);
+  // Posted by whoever plays the block it took over in
+  sequenceAdvanced = true;
+  advancedTempo = sequence->initialTempo;
+  return true;
+}
+
+void MidiSchedulerAudioSource::switchToSequence(Sequence *next) {
+  // Only if the device changed rate since it was queued. The sample
+  // positions are already sized, so re-timing doesn't allocate.
+  if (next->sampleRate != currentSampleRate)
+    next->retime(currentSampleRate);
+
+  retiredSequences.push(sequence);
+  sequence = next;
+  ++sequenceNumber;
+  playbackPosition.store(0.0);
+  seekToSample(0);
+}
+
+void MidiSchedulerAudioSource::freeRetiredSequences() {
+  retiredSequences.drain([](Sequence *retired) { delete retired; });
+}
+
+void MidiSchedulerAudioSource::pushCommand(const Command &command) {
+  commands.push(command);
+  ++changesPublished;
+  aheadWorker.notify();
 }
 
 void MidiSchedulerAudioSource::startPlayback() {
-  isPlaying = true;
-  isLooping = true;
+  pushCommand({Command::Type::start});
 }
 
-void MidiSchedulerAudioSource::stopPlayback() { isPlaying = false; }
+void MidiSchedulerAudioSource::stopPlayback() {
+  pushCommand({Command::Type::stop});
+}
 
-void MidiSchedulerAudioSource::setTempo(double newTempo) {
-  tempo.store(newTempo);
-  // Clear any MIDI tempo events and set a single tempo event at time 0
-  tempoEvents.clear();
-  tempoEvents.push_back({0.0, 60000000.0 / newTempo});  // Convert BPM to microseconds per quarter note
+void MidiSchedulerAudioSource::setPlaybackRate(double newRate) {
+  newRate = juce::jlimit(minimumRate, maximumRate, newRate);
+  playbackRate.store(newRate);
+  pushCommand({Command::Type::setRate, newRate});
 }
 
 void MidiSchedulerAudioSource::setLoopRegion(double startBeat, double endBeat,
                                              int loops) {
-  loopStartBeat = startBeat;
-  loopEndBeat = endBeat;
-  loopCount = loops;
-  currentLoopIteration = 0;
-  isLooping = (loops > 0 && endBeat > startBeat);
-  playbackPosition.store(loopStartBeat);
+  playbackPosition.store(startBeat);
+  pushCommand({Command::Type::setLoopRegion, startBeat, endBeat, loops});
+  notePositionChanged();
+}
+
+void MidiSchedulerAudioSource::setPlaybackPosition(double newPosition) {
+  // Report the new position straight away; the audio thread catches up.
+  playbackPosition.store(newPosition);
+  pushCommand({Command::Type::seek, newPosition});
+  notePositionChanged();
+}
+
+void MidiSchedulerAudioSource::applyCommand(const Command &command) {
+  switch (command.type) {
+  case Command::Type::start:
+    isPlaying = true;
+    chasePending = true;
+    isLooping = true;
+    break;
+  case Command::Type::stop:
+    isPlaying = false;
+    for (auto &notes : soundingNotes)
+      notes.reset(); // the synth stops them all
+    break;
+  case Command::Type::seek:
+    chasePending = true;
+    seekToSample(sequence->beatsToSamples(command.beat));
+    playbackPosition.store(command.beat);
+    break;
+  case Command::Type::setRate:
+    // Nothing to re-time: the rate only changes how fast the playhead moves
+    // through the tempo map's samples
+    rate = command.beat;
+    setSequenceTempo(sequenceTempo);
+    break;
+  case Command::Type::setLoopRegion:
+    loopStartBeat = command.beat;
+    loopEndBeat = command.endBeat;
+    loopCount = command.loops;
+    currentLoopIteration = 0;
+    isLooping = (command.loops > 0 && command.endBeat > command.beat);
+    chasePending = true;
+    seekToSample(sequence->beatsToSamples(loopStartBeat));
+    playbackPosition.store(loopStartBeat);
+    break;
+  }
+}
+
+void MidiSchedulerAudioSource::setRenderAhead(double seconds) {
+  const juce::ScopedLock lock(renderAheadLock);
+  renderAheadSeconds.store(juce::jlimit(0.0, maximumRenderAhead, seconds));
+  if (renderAheadSeconds.load() == 0.0) {
+    renderAheadSamples.store(0); // the callback takes the rendering back
+    aheadWorker.notify();
+  }
+  else if (renderAheadPrepared)
+    startRenderAhead();
+}
+
+void MidiSchedulerAudioSource::startRenderAhead() {
+  // Sized once per prepareToPlay() for the most that can be asked for, so
+  // the callback never reads from a ring being reallocated: twice over, for
+  // what a change leaves stale as well as what replaces it
+  if (aheadRing.getNumSamples() == 0) {
+    const int capacity =
+        2 * (static_cast<int>(std::ceil(maximumRenderAhead * currentSampleRate)) +
+             preparedBlockSize + aheadBlockSize);
+    aheadRing.setSize(2, capacity + 1);
+    aheadRing.clear();
+    aheadFifo.setTotalSize(capacity + 1);
+    aheadScratch.setSize(2, aheadBlockSize);
+    // An entry for every block the ring holds and the one being heard
+    aheadLog.assign(static_cast<size_t>(capacity / aheadBlockSize + 2), {});
+    heardBlocks.assign(aheadLog.size(), {});
+  }
+  if (!aheadWorker.isThreadRunning())
+    aheadWorker.startThread(juce::Thread::Priority::highest);
+
+  // Ahead of the callback's block, not counting it
+  renderAheadSamples.store(
+      juce::roundToInt(renderAheadSeconds.load() * currentSampleRate) + preparedBlockSize);
+  aheadWorker.notify();
+}
+
+void MidiSchedulerAudioSource::stopRenderAhead() {
+  aheadWorker.signalThreadShouldExit();
+  aheadWorker.notify();
+  aheadWorker.stopThread(1000);
+  renderAheadSamples.store(0);
+  aheadOwned.store(false);
+  aheadBusy.store(false);
+  aheadReleasing = false;
+  aheadRing.setSize(0, 0);
+  if (synth != nullptr)
+    synth->setLoadBudgetSuspended(false);
+}
+
+void MidiSchedulerAudioSource::RenderAheadWorker::run() {
+  const juce::ScopedNoDenormals noDenormals;
+  while (!threadShouldExit()) {
+    owner.aheadBusy.store(true);
+    const bool rendered = owner.aheadOwned.load() && owner.renderAheadBlock();
+    owner.aheadBusy.store(false);
+    // Sleeps until the callback makes room, is handed rendering or takes
+    // it back, or something changes, so it costs nothing while turned off
+    if (!rendered)
+      wait(-1);
+  }
+}
+
+bool MidiSchedulerAudioSource::renderAheadBlock() {
+  const juce::int64 heard = aheadWritten - aheadFifo.getNumReady();
+  const juce::int64 fresh = aheadWritten - juce::jmax(heard, aheadFlushStart);
+  if (fresh >= renderAheadSamples.load() || aheadFifo.getFreeSpace() < aheadBlockSize ||
+      renderedBlocks.getFreeSpace() == 0)
+    return false;
+
+  // Anything published since the last block makes what's buffered stale:
+  // go back to what's being heard and render on from there with it
+  RenderedBlock block;
+  block.changes = changesPublished.load();
+  if (block.changes != aheadChanges) {
+    rewindToHeard(heard);
+    aheadChanges = block.changes;
+    aheadFlushStart = aheadWritten;
+    block.flush = true;
+  }
+  applyChanges();
+
+  // The ring rides out slow blocks while it's at least half full, so the
+  // synth's load budget only sheds voices once it has drained below that.
+  // Catch-up blocks after a change are heavy, but the stale audio still
+  // buffered covers them.
+  synth->setLoadBudgetSuspended(2 * aheadFifo.getNumReady() >= renderAheadSamples.load());
+
+  block.start = aheadWritten;
+  block.numSamples = aheadBlockSize;
+  block.position = playheadSample + playheadFraction;
+  block.rate = rate;
+  block.beat = sequence->secondsToBeats(playheadSample / currentSampleRate);
+  block.tempo = tempo.load();
+  block.endBeat = getEndBeat();
+  block.sequenceNumber = sequenceNumber;
+  block.loopIteration = currentLoopIteration;
+  block.playing = isPlaying;
+  {
+    const sfzero::PerformanceCounters::ScopedCallback timing(
+        synth->getPerformanceCounters(), aheadBlockSize);
+    const juce::AudioSourceChannelInfo info(&aheadScratch, 0, aheadBlockSize);
+    info.clearActiveBufferRegion();
+    block.reachedEnd = renderBlock(info, nullptr, 0.0);
+  }
+  block.jumped = sequenceNumber != block.sequenceNumber ||
+                 currentLoopIteration != block.loopIteration;
+  block.beatAfter = sequence->secondsToBeats(playheadSample / currentSampleRate);
+  block.advanced = sequenceAdvanced;
+  block.advancedTempo = advancedTempo;
+  sequenceAdvanced = false;
+
+  // The audio before the block that describes it, so the callback never
+  // finds a block it can't play
+  int start1, size1, start2, size2;
+  aheadFifo.prepareToWrite(aheadBlockSize, start1, size1, start2, size2);
+  for (int channel = 0; channel < aheadRing.getNumChannels(); ++channel) {
+    aheadRing.copyFrom(channel, start1, aheadScratch, channel, 0, size1);
+    if (size2 > 0)
+      aheadRing.copyFrom(channel, start2, aheadScratch, channel, size1, size2);
+  }
+  aheadFifo.finishedWrite(size1 + size2);
+  aheadWritten += aheadBlockSize;
+  aheadLog[static_cast<size_t>(aheadBlockCount++ % static_cast<juce::int64>(aheadLog.size()))] = block;
+  renderedBlocks.push(block);
+  return true;
+}
+
+void MidiSchedulerAudioSource::rewindToHeard(juce::int64 heard) {
+  // What was rendered after the last flush is the newest wanted, heard yet
+  // or not
+  heard = juce::jmax(heard, aheadFlushStart);
+  if (heard >= aheadWritten || aheadLog.empty())
+    return; // nothing rendered past it
+
+  const auto logSize = static_cast<juce::int64>(aheadLog.size());
+  for (juce::int64 i = aheadBlockCount - 1; i >= juce::jmax<juce::int64>(0, aheadBlockCount - logSize); --i) {
+    const auto &block = aheadLog[static_cast<size_t>(i % logSize)];
+    if (block.start > heard)
+      continue;
+    // Not back into the last sequence, and from the start of a block that
+    // looped back
+    if (!block.playing || block.sequenceNumber != sequenceNumber)
+      return;
+    const double position =
+        block.position + (block.jumped ? 0.0 : static_cast<double>(heard - block.start) * block.rate);
+    seekToSample(static_cast<juce::int64>(std::floor(position)));
+    playheadFraction = position - std::floor(position);
+    currentLoopIteration = block.loopIteration;
+    chasePending = true;
+    return;
+  }
+}
+
+void MidiSchedulerAudioSource::handOverToRenderAhead() {
+  // The worker doesn't touch any of this until aheadOwned is set
+  renderedBlocks.drain([](const RenderedBlock &) {});
+  aheadFifo.reset();
+  aheadWritten = aheadFlushStart = aheadBlockCount = aheadRead = 0;
+  aheadChanges = changesPublished.load();
+  firstHeard = numHeard = 0;
+  aheadOwned.store(true);
+  aheadWorker.notify();
+}
+
+void MidiSchedulerAudioSource::playRenderedAhead(
+    const juce::AudioSourceChannelInfo &bufferToFill, double hostTimeMs) {
+  renderedBlocks.drain([this](const RenderedBlock &block) {
+    jassert(numHeard < heardBlocks.size()); // the ring holds fewer
+    if (numHeard < heardBlocks.size())
+      heardBlock(numHeard++) = block;
+  });
+
+  // Blocks heard, or at least started, post what happened in them
+  auto notifyHeard = [this](RenderedBlock &block) {
+    if (block.advanced)
+      notifySequenceAdvanced(block.advancedTempo);
+    if (block.reachedEnd)
+      notifyPlaybackStopped();
+    block.advanced = block.reachedEnd = false;
+  };
+
+  // Drop what the last flush made stale, once what replaces it covers this
+  // callback; until then the stale audio plays on. A sequence the dropped
+  // blocks moved on to is still the one playing.
+  const int numSamples = bufferToFill.numSamples;
+  for (size_t i = numHeard; i-- > 0;) {
+    auto &flushed = heardBlock(i);
+    if (!flushed.flush)
+      continue;
+    const juce::int64 stale = flushed.start - aheadRead;
+    const juce::int64 heard = aheadRead;
+    if (stale > 0 && aheadFifo.getNumReady() - stale >= numSamples) {
+      aheadFifo.finishedRead(static_cast<int>(stale));
+      aheadRead = flushed.start;
+    }
+    if (aheadRead >= flushed.start) {
+      for (size_t j = 0; j < i; ++j) {
+        auto &dropped = heardBlock(j);
+        if (dropped.start < heard)
+          notifyHeard(dropped);
+        else if (dropped.advanced)
+          notifySequenceAdvanced(dropped.advancedTempo);
+      }
+      flushed.flush = false;
+      firstHeard = (firstHeard + i) % heardBlocks.size();
+      numHeard -= i;
+    }
+    break;
+  }
+
+  PositionSnapshot snapshot;
+  if (findHeardPosition(aheadRead, snapshot)) {
+    snapshot.hostTimeMs = hostTimeMs;
+    snapshot.blockSeconds = numSamples / currentSampleRate;
+    writeSnapshot(snapshot);
+  }
+
+  // Short of a block, the rest stays silent
+  int start1, size1, start2, size2;
+  aheadFifo.prepareToRead(numSamples, start1, size1, start2, size2);
+  auto &buffer = *bufferToFill.buffer;
+  for (int channel = 0; channel < juce::jmin(buffer.getNumChannels(), aheadRing.getNumChannels());
+       ++channel) {
+    if (size1 > 0)
+      buffer.copyFrom(channel, bufferToFill.startSample, aheadRing, channel, start1, size1);
+    if (size2 > 0)
+      buffer.copyFrom(channel, bufferToFill.startSample + size1, aheadRing, channel, start2, size2);
+  }
+  aheadFifo.finishedRead(size1 + size2);
+  aheadRead += size1 + size2;
+  aheadWorker.notify();
+
+  for (size_t i = 0; i < numHeard && heardBlock(i).start < aheadRead; ++i)
+    notifyHeard(heardBlock(i));
+  while (numHeard > 1 && heardBlock(0).start + heardBlock(0).numSamples <= aheadRead) {
+    firstHeard = (firstHeard + 1) % heardBlocks.size();
+    --numHeard;
+  }
+  if (findHeardPosition(aheadRead, snapshot) && snapshot.playing)
+    playbackPosition.store(snapshot.beat);
+}
+
+bool MidiSchedulerAudioSource::findHeardPosition(juce::int64 sample,
+                                                 PositionSnapshot &snapshot) {
+  for (size_t i = 0; i < numHeard; ++i) {
+    const auto &block = heardBlock(i);
+    if (block.start + block.numSamples <= sample && i + 1 < numHeard)
+      continue;
+    if (block.start > sample)
+      return false; // its block hasn't been logged yet
+
+    // Along the block, unless it jumped somewhere in it
+    const double fraction =
+        block.jumped ? 0.0
+                     : juce::jmin(1.0, static_cast<double>(sample - block.start) / block.numSamples);
+    snapshot.sampleTime = static_cast<juce::int64>(
+        std::floor(block.position + fraction * block.numSamples * block.rate));
+    snapshot.beat = block.beat + fraction * (block.beatAfter - block.beat);
+    snapshot.tempo = block.tempo;
+    snapshot.endBeat = block.endBeat;
+    snapshot.playing = block.playing;
+    return block.changes == changesPublished.load();
+  }
+  return false;
 }
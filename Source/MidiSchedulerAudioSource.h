@@ -1,8 +1,12 @@
 #pragma once
 
+#include "CommandQueue.h"
+#include "LiveMidiInput.h"
+#include "SmfReader.h"
 #include "SynthAudioSource.h"
 #include <JuceHeader.h>
 
+#include <bitset>
 
 // This class centralizes MIDI scheduling, global playback position, and
 // looping. It does no audio rendering on its own but uses its contained
@@ -20,18 +24,146 @@ public:
   getNextAudioBlock(const juce::AudioSourceChannelInfo &bufferToFill) override;
   void releaseResources() override;
 
-  // Sets the MIDI sequence to play.
+  // A sequence compiled for playback: its channel events in time order and
+  // its tempo map, both timed in samples at sampleRate.
+  struct Sequence {
+    struct TempoEvent {
+      double timestamp;  // in ticks
+      double tempo;      // in microseconds per quarter note
+      double seconds = 0.0;          // time at timestamp, from buildTempoTable()
+      juce::int64 sample = 0;        // the same, in samples, from retime()
+
+      bool operator<(const TempoEvent& other) const {
+        return timestamp < other.timestamp;
+      }
+    };
+
+    // The channel events as parallel arrays, so playback is a single forward
+    // cursor.
+    struct Timeline {
+      std::vector<double> beats;                    // event time in beats
+      std::vector<juce::int64> samples;             // event time along the tempo map
+      std::vector<std::array<juce::uint8, 3>> data; // packed message bytes
+      std::vector<juce::uint8> sizes;               // bytes used in data (1-3)
+      size_t size() const { return beats.size(); }
+    };
+
+    // What the timeline has left a channel set to at some point, so a seek
+    // can put it back: its program, the controllers worth chasing (at their
+    // GM defaults until set) and its pitch bend.
+    struct ChannelState {
+      static constexpr int numControllers = 7;
+      static constexpr juce::uint8 controllerNumbers[numControllers] = {1, 7, 10, 11, 64, 91, 93};
+      int program = -1; // until the timeline sets one
+      juce::uint8 controllers[numControllers] = {0, 100, 64, 127, 0, 40, 0};
+      int pitchBend = 8192;
+    };
+
+    // Channel states run forward through the timeline, with the notes held
+    struct ChaseState {
+      std::array<ChannelState, 16> channels;
+      juce::uint8 velocities[16][128] = {}; // 0 where a note isn't held
+      void apply(const std::array<juce::uint8, 3> &data);
+    };
+
+    // The chase state just before timeline event eventIndex: the channels,
+    // and its held notes as a run of heldNotes.
+    struct HeldNote {
+      juce::uint8 channel, note, velocity;
+    };
+    struct Checkpoint {
+      size_t eventIndex = 0;
+      std::array<ChannelState, 16> channels;
+      size_t firstHeldNote = 0, numHeldNotes = 0;
+    };
+
+    Timeline timeline;
+    std::vector<TempoEvent> tempoEvents; // never empty
+    std::vector<Checkpoint> checkpoints; // from buildCheckpoints(); never empty
+    std::vector<HeldNote> heldNotes;
+    juce::uint16 usedChannels = 0;       // bit n for channel n + 1
+    static constexpr double checkpointBeats = 8.0;
+    int ppq = 480;
+    double sampleRate = 44100.0;
+    double sequenceEndBeat = 0.0;    // one beat past the last event
+    double lastEventBeat = 0.0;      // the last event, end of track included
+    juce::int64 endSample = 0;
+    juce::int64 lastEventSample = 0; // where a queued sequence takes over
+    double initialTempo = 120.0;     // BPM
+
+    // Time signature
+    int timeSignatureNumerator = 4;
+    int timeSignatureDenominator = 4;
+    int clocksPerClick = 24;
+    int thirtySecondPer24Clocks = 8;
+
+    double ticksToBeats(double ticks) const { return ticks / ppq; }
+    double beatsToSeconds(double beat) const;
+    double secondsToBeats(double seconds) const;
+    juce::int64 beatsToSamples(double beat) const {
+      return static_cast<juce::int64>(std::llround(beatsToSeconds(beat) * sampleRate));
+    }
+    void buildTempoTable();
+    void buildCheckpoints(); // one every checkpointBeats, from the timeline
+    void retime(double newSampleRate); // recomputes every sample position
+  };
+
+  // Compiles a sequence for playback. Safe on any thread, and the slow part
+  // of loading a file, so large files are best compiled off the message
+  // thread.
+  static std::unique_ptr<Sequence> compile(const juce::MidiMessageSequence &sequence,
+                                           int ppq, double sampleRate);
+  // The same from a packed file, which is already in the timeline's order
+  static std::unique_ptr<Sequence> compile(const PackedMidiFile &file, double sampleRate);
+
+  // Hands a compiled sequence to the audio thread, which switches to it at the
+  // start of its next block and plays from the top. Any thread may call this
+  // (also freeing the sequences the audio thread has finished with) without
+  // ever blocking the audio thread.
+  void setSequence(std::unique_ptr<Sequence> sequence);
+
+  // Queues a compiled sequence to follow the current one. It takes over on
+  // the sample the current one's last event (normally its end of track) falls
+  // on, within the same block and without stopping the notes still ringing.
+  // A second call replaces the first. Any thread, like setSequence().
+  void queueNextSequence(std::unique_ptr<Sequence> sequence);
+  void clearQueuedSequence() { queueNextSequence(nullptr); }
+  bool hasQueuedSequence() const { return queuedSequence.load() != nullptr; }
+
+  // Called on the message thread after a queued sequence has taken over,
+  // just after onTempoChanged reports its tempo.
+  std::function<void()> onSequenceAdvanced;
+
+  // Compiles a sequence, at the PPQ from setPPQ(), and sets it.
   void setMidiSequence(const juce::MidiMessageSequence &sequence);
 
-  // Playback controls.
+  // The sample rate sequences should be compiled at; setSequence() re-times
+  // any that aren't.
+  double getSampleRate() const { return preparedSampleRate.load(); }
+
+  // Playback controls. These, setLoopRegion() and setPlaybackPosition() are
+  // queued and take effect at the start of the next audio block. Starting,
+  // seeking and looping back chase the programs, controllers and held notes
+  // the timeline had set by the new position.
   void startPlayback();
   void stopPlayback();
-  void setTempo(double newTempo);
+
+  // Playback speed as a multiple of the sequence's own tempo map, which it
+  // scales rather than replaces; notes keep their pitch. Any thread, and
+  // queued like the controls above. Stays across sequences.
+  void setPlaybackRate(double newRate);
+  double getPlaybackRate() const { return playbackRate.load(); }
+  static constexpr double minimumRate = 0.1, maximumRate = 4.0;
   void setPPQ(int ppqValue) { ppq = ppqValue; }
+  int getPPQ() const { return ppq; }
+
+  // Length of the last sequence set (to one beat past its last event) along
+  // the tempo map, at the sample rate given to prepareToPlay.
+  juce::int64 getLengthInSamples() const { return lengthInSamples.load(); }
 
-  // Time signature getters
-  int getNumerator() const { return timeSignatureNumerator; }
-  int getDenominator() const { return timeSignatureDenominator; }
+  // The last sequence's time signature
+  int getNumerator() const { return timeSignatureNumerator.load(); }
+  int getDenominator() const { return timeSignatureDenominator.load(); }
   
   // Callback for tempo changes
   std::function<void(double)> onTempoChanged;
@@ -40,43 +172,131 @@ public:
   // startBeat. loops: the number of times to loop.
   void setLoopRegion(double startBeat, double endBeat, int loops);
   double getPlaybackPosition() const { return playbackPosition.load(); }
-  void setPlaybackPosition(double newPosition) { playbackPosition.store(newPosition); }
+  void setPlaybackPosition(double newPosition);
+
+  // Where the audio clock was at the start of the last block, published by
+  // the audio thread every callback. Any thread.
+  struct PositionSnapshot {
+    juce::int64 sampleTime = 0; // the playback clock
+    double beat = 0.0;
+    double hostTimeMs = 0.0;    // Time::getMillisecondCounterHiRes() at the callback
+    double tempo = 120.0;       // BPM
+    double endBeat = 0.0;       // the loop or song end, which playback won't pass
+    double blockSeconds = 0.0;
+    bool playing = false;
+  };
+  PositionSnapshot getPositionSnapshot() const;
+  // The position at hostTimeMs, run on from the last snapshot at its tempo,
+  // so a display can move every frame rather than every audio block. Falls
+  // back to getPlaybackPosition() while stopped or until the audio thread
+  // has caught up with a seek.
+  double getPlaybackPosition(double hostTimeMs) const;
+
+  // Plays live MIDI on top of the sequence, and while stopped. Not owned;
+  // null disconnects it. Any thread, but the input must outlive the
+  // scheduler or be disconnected first.
+  void setLiveInput(LiveMidiInput *input) { liveInput.store(input); }
+
+  // Render-ahead, for playback nobody plays along to: a worker thread at
+  // high priority renders up to seconds ahead into a ring that the audio
+  // callback only copies out of, so a block that takes longer to render than
+  // to play is absorbed rather than heard; the synth's load budget only
+  // sheds voices once the ring is less than half full. It stands aside,
+  // with blocks rendered in the callback as at 0, while a live input is
+  // connected or the synth's stems are out (the ring is stereo). Starting, stopping, seeking,
+  // looping, speed changes and new sequences throw the buffered audio away
+  // and render again from what was being heard, to within a block; settings
+  // changed on the synth itself are heard once the buffer has played out.
+  // Message thread.
+  void setRenderAhead(double seconds);
+  double getRenderAhead() const { return renderAheadSeconds.load(); }
+  static constexpr double maximumRenderAhead = 1.0;
 
   std::function<void()> onPlaybackStopped;
 
 private:
+  using TempoEvent = Sequence::TempoEvent;
+
   // The synth that actually renders audio.
   SynthAudioSource *synth = nullptr; // not owned
 
-  // The MIDI sequence for playback.
-  juce::MidiMessageSequence midiSequence;
+  // The sequence playing, owned by the audio thread. A new one is published
+  // through pendingSequence; the one it replaces goes back through
+  // retiredSequences to be freed by the next publisher, since the audio
+  // thread mustn't free memory.
+  Sequence *sequence = nullptr;
+  std::atomic<Sequence *> pendingSequence{nullptr};
+  std::atomic<Sequence *> queuedSequence{nullptr};
+  CommandQueue<Sequence *, 8> retiredSequences;
+  juce::CriticalSection publishLock; // publishers only; never the audio thread
+  void adoptPendingSequence();        // audio thread
+  bool advanceToQueuedSequence();     // audio thread; false if nothing to play
+  void switchToSequence(Sequence *next); // audio thread; retires the current one
+  void freeRetiredSequences();        // caller holds publishLock
+  juce::uint32 sequenceNumber = 0;    // bumped by each switch
 
-  struct TempoEvent {
-    double timestamp;  // in ticks
-    double tempo;      // in microseconds per quarter note
-    
-    bool operator<(const TempoEvent& other) const {
-      return timestamp < other.timestamp;
-    }
+  // Set when a queued sequence takes over, until the callback that plays
+  // it posts onTempoChanged and onSequenceAdvanced
+  bool sequenceAdvanced = false;
+  double advancedTempo = 120.0;
+  void notifySequenceAdvanced(double initialTempo);
+  void notifyPlaybackStopped();
+
+  // Events scheduled for the current block. Reserved in prepareToPlay and
+  // reused so the audio callback doesn't allocate.
+  juce::MidiBuffer scheduledEvents;
+  static constexpr size_t scheduledEventsBytes = 16384;
+  std::atomic<LiveMidiInput *> liveInput{nullptr};
+
+  // Transport changes from the message thread, applied by the audio thread
+  // before it renders.
+  struct Command {
+    enum class Type { start, stop, seek, setRate, setLoopRegion };
+    Type type = Type::stop;
+    double beat = 0.0;    // seek target, loop start, or playback rate
+    double endBeat = 0.0; // loop end
+    int loops = 0;
   };
-  
-  std::vector<TempoEvent> tempoEvents;
-  double getCurrentTempo(double timestamp) const;
-  void extractTempoEvents();
-  void extractTimeSignature();
+  CommandQueue<Command, 256> commands;
+  void pushCommand(const Command &command);
+  void applyCommand(const Command &command);
+  // Commands and sequences published so far, for the render-ahead worker to
+  // tell when what it has buffered has gone stale
+  std::atomic<juce::uint32> changesPublished{0};
+
+  // Whatever renders blocks, in the callback or ahead of it: applies the
+  // new sequence and the commands waiting, then renders a block of the
+  // sequence and live input. Returns whether the sequence ended in it with
+  // nothing queued to follow.
+  void applyChanges();
+  bool renderBlock(const juce::AudioSourceChannelInfo &bufferToFill,
+                   LiveMidiInput *live, double hostTimeMs);
 
-  // Global playback state.
+  // Global playback state. Only the audio thread writes these once playback
+  // has been prepared; the atomics are read back by the UI.
   std::atomic<double> playbackPosition{0.0}; // in beats
-  std::atomic<double> tempo{120.0};          // BPM
+  std::atomic<double> tempo{120.0};          // BPM, at the playback rate
+  std::atomic<double> playbackRate{1.0};     // the last one set
+  double rate = 1.0;                         // the audio thread's
+  double sequenceTempo = 120.0;              // the tempo map's, at the playhead
+  void setSequenceTempo(double bpm);
   double currentSampleRate = 44100.0;
+
+  // The latest PositionSnapshot, as a seqlock: the audio thread makes
+  // snapshotVersion odd while it writes, so readers retry rather than wait.
+  std::atomic<juce::uint32> snapshotVersion{0};
+  std::atomic<juce::int64> snapshotSampleTime{0};
+  std::atomic<double> snapshotBeat{0.0}, snapshotHostTimeMs{0.0},
+      snapshotTempo{120.0}, snapshotEndBeat{0.0}, snapshotBlockSeconds{0.0};
+  std::atomic<bool> snapshotPlaying{false};
+  // When the message thread last moved the position. Snapshots taken before
+  // then may predate the move.
+  std::atomic<double> positionChangedMs{0.0};
+  void publishSnapshot(double hostTimeMs, int numSamples); // audio thread
+  void writeSnapshot(const PositionSnapshot &snapshot);    // audio thread
+  double getEndBeat() const; // the loop or song end
+  void notePositionChanged();
   bool isPlaying = false;
-  int ppq = 480;  // Pulses Per Quarter note, default 480
-  
-  // Time signature state
-  int timeSignatureNumerator = 4;
-  int timeSignatureDenominator = 4;
-  int clocksPerClick = 24;
-  int thirtySecondPer24Clocks = 8;
 
   // Looping variables.
   bool isLooping = false;
@@ -85,24 +305,110 @@ private:
   int loopCount = 0;
   int currentLoopIteration = 0;
 
-  // Helper: convert ticks (assuming 480 PPQ) to beats.
-  inline double ticksToBeats(double ticks) const { return ticks / ppq; }
-
-  // Helper: find the first MIDI event at or after a given beat.
-  int findEventIndexForBeat(double beat) {
-    int low = 0;
-    int high = midiSequence.getNumEvents();
-    while (low < high) {
-      int mid = (low + high) / 2;
-      double eventBeat = ticksToBeats(
-          midiSequence.getEventPointer(mid)->message.getTimeStamp());
-      if (eventBeat < beat)
-        low = mid + 1;
-      else
-        high = mid;
-    }
-    return low;
+  // Notes the timeline has started and not yet stopped, per channel. A loop
+  // wrap or seek jumps past their note-offs, so it sends them itself.
+  std::array<std::bitset<128>, 16> soundingNotes;
+  void releaseSoundingNotes(int bufferOffset);
+
+  // Restores the state at the cursor after a jump: from the checkpoint
+  // before it, run on through the events since, then sent at bufferOffset.
+  // Waits in chasePending while stopped.
+  Sequence::ChaseState chase;
+  bool chasePending = false;
+  void chaseToCursor(int bufferOffset);
+
+  size_t cursor = 0;               // next timeline event to schedule
+  size_t tempoCursor = 0;          // next tempo change to apply
+  juce::int64 playheadSample = 0;  // the playback clock, along the tempo map
+  double playheadFraction = 0.0;   // and the way to the next sample, off normal speed
+
+  // Publisher-side state: the PPQ for setMidiSequence(), and what the UI
+  // reads back about the last sequence set (or advanced to).
+  int ppq = 480;  // Pulses Per Quarter note, default 480
+  std::atomic<double> preparedSampleRate{44100.0};
+  std::atomic<juce::int64> lengthInSamples{0};
+  std::atomic<int> timeSignatureNumerator{4};
+  std::atomic<int> timeSignatureDenominator{4};
+
+  void seekToSample(juce::int64 sample);
+  // Schedules the events before toSample over numSamples output samples
+  // from bufferOffset, the first at fromPosition
+  void scheduleEvents(double fromPosition, juce::int64 toSample, int numSamples,
+                      int bufferOffset);
+
+  // Render-ahead (see setRenderAhead()). The worker renders aheadBlockSize
+  // samples at a time through applyChanges() and renderBlock() into
+  // aheadRing, and logs each block twice: in aheadLog, for a change to
+  // rewind to what's being heard, and through renderedBlocks to the
+  // callback, which reports the position from it.
+  struct RenderedBlock {
+    juce::int64 start = 0;   // among the samples the worker has written
+    int numSamples = 0;
+    double position = 0.0;   // the playhead at its start, with the fraction
+    double rate = 1.0;
+    double beat = 0.0, beatAfter = 0.0; // at its start and just past it
+    double tempo = 120.0, endBeat = 0.0; // as in PositionSnapshot
+    juce::uint32 sequenceNumber = 0;     // at its start
+    juce::uint32 changes = 0;            // changesPublished it rendered with
+    int loopIteration = 0;
+    bool playing = false;
+    bool jumped = false;     // looped back or moved on to the next sequence
+    bool flush = false;      // everything written before it is stale
+    bool reachedEnd = false, advanced = false;
+    double advancedTempo = 120.0;
+  };
+
+  class RenderAheadWorker : public juce::Thread {
+  public:
+    explicit RenderAheadWorker(MidiSchedulerAudioSource &ownerIn)
+        : juce::Thread("Render Ahead"), owner(ownerIn) {}
+    void run() override;
+
+  private:
+    MidiSchedulerAudioSource &owner;
+  };
+
+  static constexpr int aheadBlockSize = 512;
+  RenderAheadWorker aheadWorker{*this};
+  juce::CriticalSection renderAheadLock; // setRenderAhead() and prepareToPlay()
+  std::atomic<double> renderAheadSeconds{0.0};
+  std::atomic<int> renderAheadSamples{0}; // what the worker keeps buffered; 0 when off
+  bool renderAheadPrepared = false;       // under renderAheadLock
+  int preparedBlockSize = 0;              // from prepareToPlay()
+  void startRenderAhead();                // caller holds renderAheadLock
+  void stopRenderAhead();                 // not while the callback runs
+
+  // The worker renders while aheadOwned is set. It sets aheadBusy before
+  // looking, and the callback clears aheadOwned before looking at
+  // aheadBusy, so the callback only renders again once the worker has
+  // finished its block. aheadReleasing: the callback is waiting for that.
+  std::atomic<bool> aheadOwned{false}, aheadBusy{false};
+  bool aheadReleasing = false;
+  juce::AbstractFifo aheadFifo{1};
+  juce::AudioBuffer<float> aheadRing, aheadScratch;
+  CommandQueue<RenderedBlock, 1024> renderedBlocks;
+
+  // The worker's, and the callback's while it renders
+  std::vector<RenderedBlock> aheadLog; // by block number, wrapping
+  juce::int64 aheadWritten = 0, aheadFlushStart = 0, aheadBlockCount = 0;
+  juce::uint32 aheadChanges = 0;
+  bool renderAheadBlock();             // false when there's nothing to do
+  void rewindToHeard(juce::int64 heard);
+
+  // The callback's: the samples it has taken from the ring, and the blocks
+  // logged that it hasn't played all of yet, oldest first
+  juce::int64 aheadRead = 0;
+  std::vector<RenderedBlock> heardBlocks;
+  size_t firstHeard = 0, numHeard = 0;
+  RenderedBlock &heardBlock(size_t i) {
+    return heardBlocks[(firstHeard + i) % heardBlocks.size()];
   }
+  void handOverToRenderAhead();
+  void playRenderedAhead(const juce::AudioSourceChannelInfo &bufferToFill,
+                         double hostTimeMs);
+  // The position sample samples into what the worker wrote; false if the
+  // blocks don't say, or the position has been moved since
+  bool findHeardPosition(juce::int64 sample, PositionSnapshot &snapshot);
 
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MidiSchedulerAudioSource)
 };
@@ -0,0 +1,98 @@
+#include "NoteBurstFilter.h"
+
+#include <algorithm>
+
+namespace {
+
+bool isNoteOn(const juce::MidiMessageMetadata &metadata) {
+  return metadata.numBytes >= 3 && (metadata.data[0] & 0xf0) == 0x90 &&
+         metadata.data[2] > 0;
+}
+
+bool isNoteOff(const juce::MidiMessageMetadata &metadata) {
+  return metadata.numBytes >= 3 && ((metadata.data[0] & 0xf0) == 0x80 ||
+                                    (metadata.data[0] & 0xf0) == 0x90);
+}
+
+int keyOf(const juce::MidiMessageMetadata &metadata) {
+  return (metadata.data[0] & 0x0f) * 128 + (metadata.data[1] & 0x7f);
+}
+
+} // namespace
+
+NoteBurstFilter::NoteBurstFilter() {
+  notes.reserve(maxNotesPerBlock);
+  byKey.reserve(maxNotesPerBlock);
+}
+
+int NoteBurstFilter::process(juce::MidiBuffer &events) {
+  const int maxNoteOns = limit.load();
+  if (maxNoteOns <= 0)
+    return 0;
+
+  // Most blocks are nowhere near the limit, and stop at the count
+  notes.clear();
+  int numNoteOns = 0;
+  for (const auto metadata : events) {
+    if (!isNoteOn(metadata))
+      continue;
+    ++numNoteOns;
+    if (numNoteOns <= maxNotesPerBlock)
+      notes.push_back({keyOf(metadata), metadata.data[2], true});
+  }
+  if (numNoteOns <= maxNoteOns)
+    return 0;
+
+  // Only each key's last note-on
+  byKey.resize(notes.size());
+  for (int i = 0; i < static_cast<int>(notes.size()); ++i)
+    byKey[i] = i;
+  std::sort(byKey.begin(), byKey.end(), [this](int a, int b) {
+    return notes[a].key != notes[b].key ? notes[a].key < notes[b].key : a < b;
+  });
+  int numKept = 0;
+  for (int i = 0; i < static_cast<int>(byKey.size()); ++i) {
+    const bool last = i + 1 == static_cast<int>(byKey.size()) ||
+                      notes[byKey[i + 1]].key != notes[byKey[i]].key;
+    notes[byKey[i]].kept = last;
+    numKept += last ? 1 : 0;
+  }
+
+  // Then the loudest, the earlier of equals first
+  if (numKept > maxNoteOns) {
+    byKey.erase(std::remove_if(byKey.begin(), byKey.end(),
+                               [this](int i) { return !notes[i].kept; }),
+                byKey.end());
+    std::nth_element(byKey.begin(), byKey.begin() + maxNoteOns, byKey.end(),
+                     [this](int a, int b) {
+                       return notes[a].velocity != notes[b].velocity
+                                  ? notes[a].velocity > notes[b].velocity
+                                  : a < b;
+                     });
+    for (auto i = byKey.begin() + maxNoteOns; i != byKey.end(); ++i)
+      notes[*i].kept = false;
+  }
+
+  thinned.clear();
+  pending.reset();
+  int index = 0, dropped = 0;
+  for (const auto metadata : events) {
+    if (isNoteOn(metadata)) {
+      const int key = keyOf(metadata);
+      const bool kept = index < static_cast<int>(notes.size()) && notes[index].kept;
+      ++index;
+      if (!kept) {
+        pending.set(static_cast<size_t>(key));
+        ++dropped;
+        continue;
+      }
+      pending.reset(static_cast<size_t>(key));
+    } else if (isNoteOff(metadata) && pending.test(static_cast<size_t>(keyOf(metadata)))) {
+      pending.reset(static_cast<size_t>(keyOf(metadata)));
+      continue;
+    }
+    thinned.addEvent(metadata.data, metadata.numBytes, metadata.samplePosition);
+  }
+  events.swapWith(thinned);
+  return dropped;
+}
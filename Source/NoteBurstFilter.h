@@ -0,0 +1,45 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+#include <bitset>
+#include <vector>
+
+// Thins out blocks with more note-ons than the synth could start, as
+// black-MIDI files with thousands of notes on one tick have. Of a key's
+// note-ons in the block only the last is kept, since each one the synth
+// starts stops the one before; then, if there are still more than the limit,
+// only the loudest limit of them. A dropped note's note-off later in the
+// block goes too, so it can't start a release region. Blocks under the limit
+// pass through untouched.
+class NoteBurstFilter {
+public:
+  // Note-ons past this many in one block are dropped whatever the limit
+  static constexpr int maxNotesPerBlock = 8192;
+
+  NoteBurstFilter();
+
+  // Message thread. Reserves the thinned buffer like the one it replaces.
+  void prepare(size_t bufferBytes) { thinned.ensureSize(bufferBytes); }
+
+  // Note-ons per block; 0 turns the filter off. Any thread.
+  void setLimit(int maxNoteOns) { limit.store(maxNoteOns); }
+  int getLimit() const { return limit.load(); }
+
+  // Audio thread. Thins events in place and returns the number of note-ons
+  // dropped.
+  int process(juce::MidiBuffer &events);
+
+private:
+  struct Note {
+    int key = 0; // channel * 128 + note
+    int velocity = 0;
+    bool kept = true;
+  };
+  std::vector<Note> notes;   // the block's note-ons, in order
+  std::vector<int> byKey;    // indexes into notes
+  juce::MidiBuffer thinned;
+  std::bitset<16 * 128> pending; // keys whose last note-on was dropped
+  std::atomic<int> limit{0};
+};
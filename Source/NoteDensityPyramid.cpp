@@ -0,0 +1,78 @@
+#include "NoteDensityPyramid.h"
+
+void NoteDensityPyramid::reset(double lengthInBeats) {
+  levels.clear();
+  const int columns = juce::jmax(1, static_cast<int>(std::ceil(lengthInBeats / baseBeatsPerColumn)));
+  levels.emplace_back(static_cast<size_t>(columns) * numRows);
+}
+
+int NoteDensityPyramid::getNumColumns(int level) const {
+  return static_cast<int>(levels[static_cast<size_t>(level)].size() / numRows);
+}
+
+void NoteDensityPyramid::addNote(double startBeat, double endBeat, int noteNumber,
+                                 int channel) {
+  if (levels.empty() || endBeat <= startBeat || noteNumber < 0 || noteNumber >= numRows)
+    return;
+
+  auto &cells = levels.front();
+  const int numColumns = getNumColumns(0);
+  const int first = juce::jlimit(0, numColumns - 1, static_cast<int>(startBeat / baseBeatsPerColumn));
+  const int last = juce::jlimit(0, numColumns - 1, static_cast<int>(endBeat / baseBeatsPerColumn));
+  for (int column = first; column <= last; ++column) {
+    // The share of this column the note covers
+    const double columnStart = column * baseBeatsPerColumn;
+    const double overlap = juce::jmin(endBeat, columnStart + baseBeatsPerColumn) -
+                           juce::jmax(startBeat, columnStart);
+    if (overlap <= 0.0)
+      continue;
+    const double share = overlap / baseBeatsPerColumn;
+
+    auto &cell = cells[static_cast<size_t>(column) * numRows + static_cast<size_t>(noteNumber)];
+    cell.density = static_cast<juce::uint16>(
+        juce::jmin(65535, cell.density + juce::roundToInt(share * 256.0)));
+    const auto shareByte = static_cast<juce::uint8>(juce::roundToInt(share * 255.0));
+    if (shareByte >= cell.largestShare) {
+      cell.largestShare = shareByte;
+      cell.channel = static_cast<juce::uint8>(channel & 0x0f);
+    }
+  }
+}
+
+void NoteDensityPyramid::buildLevels() {
+  if (levels.empty())
+    return;
+  levels.resize(1);
+
+  // Each level averages pairs of columns from the one below, until one
+  // column covers the song
+  while (getNumColumns(getNumLevels() - 1) > 1) {
+    const auto &below = levels.back();
+    const int belowColumns = static_cast<int>(below.size() / numRows);
+    const int numColumns = (belowColumns + 1) / 2;
+    std::vector<Cell> level(static_cast<size_t>(numColumns) * numRows);
+    const Cell empty;
+    for (int column = 0; column < numColumns; ++column) {
+      for (int row = 0; row < numRows; ++row) {
+        const auto &left = below[static_cast<size_t>(column * 2) * numRows + static_cast<size_t>(row)];
+        const auto &right = column * 2 + 1 < belowColumns
+                                ? below[static_cast<size_t>(column * 2 + 1) * numRows + static_cast<size_t>(row)]
+                                : empty;
+        auto &cell = level[static_cast<size_t>(column) * numRows + static_cast<size_t>(row)];
+        cell.density = static_cast<juce::uint16>((left.density + right.density) / 2);
+        cell.channel = left.density >= right.density ? left.channel : right.channel;
+      }
+    }
+    levels.push_back(std::move(level));
+  }
+}
+
+int NoteDensityPyramid::chooseLevel(double beatsPerPixel) const {
+  int chosen = -1;
+  for (int level = 0; level < getNumLevels(); ++level) {
+    if (getBeatsPerColumn(level) > beatsPerPixel)
+      break;
+    chosen = level;
+  }
+  return chosen;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <vector>
+
+// How busy each key is over time, at a series of resolutions, like the peak
+// files audio editors keep for waveforms. Level 0 has a column for every
+// baseBeatsPerColumn; each level above halves the columns. A zoomed-out
+// piano roll draws one level's cells instead of the notes, so its cost
+// follows the pixels on screen, not the notes in the song.
+class NoteDensityPyramid {
+public:
+  struct Cell {
+    // Average notes sounding on this key across the column, 8.8 fixed point
+    juce::uint16 density = 0;
+    // The channel of the note covering most of the column, 0-15, which
+    // picks the colour
+    juce::uint8 channel = 0;
+    juce::uint8 largestShare = 0; // level 0 only: that note's share, 0-255
+  };
+
+  static constexpr int numRows = 128;
+  static constexpr double baseBeatsPerColumn = 0.5;
+
+  // Clears, then sizes level 0 for a song this long
+  void reset(double lengthInBeats);
+  // Level 0 only; call buildLevels() once every note is in
+  void addNote(double startBeat, double endBeat, int noteNumber, int channel);
+  void buildLevels();
+
+  bool isEmpty() const { return levels.empty(); }
+  int getNumLevels() const { return static_cast<int>(levels.size()); }
+  double getBeatsPerColumn(int level) const { return baseBeatsPerColumn * (1 << level); }
+  int getNumColumns(int level) const;
+
+  // The coarsest level whose columns are no wider than beatsPerPixel, or -1
+  // when even level 0 is too coarse and the notes should be drawn instead
+  int chooseLevel(double beatsPerPixel) const;
+
+  const Cell &getCell(int level, int column, int row) const {
+    return levels[static_cast<size_t>(level)][static_cast<size_t>(column) * numRows +
+                                              static_cast<size_t>(row)];
+  }
+
+private:
+  std::vector<std::vector<Cell>> levels;
+};
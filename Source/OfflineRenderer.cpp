@@ -0,0 +1,289 @@
+#include "OfflineRenderer.h"
+#include "MidiSchedulerAudioSource.h"
+#include "SynthAudioSource.h"
+
+#include <atomic>
+
+namespace {
+
+// Passes writes on to a file, noting any that fail. The threaded writers
+// encode on their own thread and don't report failures, so the render checks
+// this once they've drained.
+class CheckedOutputStream : public juce::OutputStream {
+public:
+  CheckedOutputStream(std::unique_ptr<juce::FileOutputStream> streamIn,
+                      std::atomic<bool> &failedIn)
+      : stream(std::move(streamIn)), failed(failedIn) {}
+
+  bool write(const void *data, size_t numBytes) override {
+    if (stream->write(data, numBytes))
+      return true;
+    failed = true;
+    return false;
+  }
+  bool setPosition(juce::int64 position) override { return stream->setPosition(position); }
+  juce::int64 getPosition() override { return stream->getPosition(); }
+  void flush() override { stream->flush(); }
+
+private:
+  std::unique_ptr<juce::FileOutputStream> stream;
+  std::atomic<bool> &failed;
+};
+
+} // namespace
+
+OfflineRenderer::Result OfflineRenderer::renderToFile(
+    const juce::File &midiFile, const juce::File &outputFile,
+    const Options &options) {
+  juce::String errorMessage;
+  auto file = SmfReader::readFile(midiFile, errorMessage);
+  if (file == nullptr) {
+    Result result;
+    result.errorMessage = errorMessage + " (" + midiFile.getFullPathName() + ")";
+    return result;
+  }
+  return renderMidiFile(*file, outputFile, options);
+}
+
+OfflineRenderer::Result OfflineRenderer::renderMidiFile(
+    const PackedMidiFile &file, const juce::File &outputFile,
+    const Options &options) {
+  return renderCompiled(MidiSchedulerAudioSource::compile(file, options.sampleRate),
+                        outputFile, options);
+}
+
+OfflineRenderer::Result OfflineRenderer::renderSequence(
+    const juce::MidiMessageSequence &sequence, int ppq,
+    const juce::File &outputFile, const Options &options) {
+  return renderCompiled(
+      MidiSchedulerAudioSource::compile(sequence, ppq, options.sampleRate),
+      outputFile, options);
+}
+
+juce::File OfflineRenderer::getStemFile(const juce::File &outputFile,
+                                        int midiChannel) {
+  return outputFile.getSiblingFile(
+      outputFile.getFileNameWithoutExtension() + "_ch" +
+      juce::String(midiChannel).paddedLeft('0', 2) +
+      outputFile.getFileExtension());
+}
+
+OfflineRenderer::Result OfflineRenderer::renderCompiled(
+    std::unique_ptr<MidiSchedulerAudioSource::Sequence> compiled,
+    const juce::File &outputFile, const Options &options) {
+  Result result;
+
+  juce::AudioFormatManager formatManager;
+  formatManager.registerBasicFormats();
+  auto *format = formatManager.findFormatForFileExtension(
+      outputFile.getFileExtension());
+  if (format == nullptr) {
+    result.errorMessage = "Unsupported output format " + outputFile.getFileExtension();
+    return result;
+  }
+
+  // One writer for the mix, or one for each channel that has events. A stem
+  // writer's channel pair sits at 2 * (channel - 1) in the render buffer.
+  juce::Array<int> channels;
+  if (options.stems) {
+    bool used[16] = {};
+    for (const auto &bytes : compiled->timeline.data)
+      used[bytes[0] & 0x0f] = true;
+    for (int channel = 1; channel <= 16; ++channel)
+      if (used[channel - 1])
+        channels.add(channel);
+  } else {
+    channels.add(0);
+  }
+
+  // Each writer hands its blocks to the writer thread, which encodes them.
+  // The thread outlives the writers, which drain into it as they go.
+  juce::TimeSliceThread writerThread("Offline render writer");
+  writerThread.startThread();
+  std::atomic<bool> writeFailed{false};
+  // The writers' FIFOs hold a sample less than their size, so one block more
+  // than asked for, or a block the size of the queue would never fit
+  const int queueSamples = (juce::jmax(1, options.writeAheadBlocks) + 1) * options.blockSize;
+  std::vector<std::unique_ptr<juce::AudioFormatWriter::ThreadedWriter>> writers;
+  for (int channel : channels) {
+    const juce::File file =
+        channel > 0 ? getStemFile(outputFile, channel) : outputFile;
+    file.deleteFile();
+    auto outputStream = file.createOutputStream();
+    if (outputStream == nullptr) {
+      result.errorMessage = "Couldn't write " + file.getFullPathName();
+      return result;
+    }
+    auto checkedStream =
+        std::make_unique<CheckedOutputStream>(std::move(outputStream), writeFailed);
+    std::unique_ptr<juce::AudioFormatWriter> writer(format->createWriterFor(
+        checkedStream.get(), options.sampleRate, 2, options.bitsPerSample, {}, 0));
+    if (writer == nullptr) {
+      result.errorMessage = "Couldn't create a " + format->getFormatName() + " writer";
+      return result;
+    }
+    checkedStream.release(); // now owned by the writer
+    writers.push_back(std::make_unique<juce::AudioFormatWriter::ThreadedWriter>(
+        writer.release(), writerThread, queueSamples));
+    result.outputFiles.add(file);
+  }
+
+  // Each writer copies its pair straight out of the render buffer into its
+  // queue. A full queue means the disk is behind, so the render waits for it.
+  auto writeBlock = [&](const juce::AudioBuffer<float> &buffer, int startSample,
+                        int numSamples) {
+    for (size_t i = 0; i < writers.size(); ++i) {
+      const int firstChannel = channels[static_cast<int>(i)] > 0
+                                   ? 2 * (channels[static_cast<int>(i)] - 1)
+                                   : 0;
+      const float *pair[] = {buffer.getReadPointer(firstChannel, startSample),
+                             buffer.getReadPointer(firstChannel + 1, startSample), nullptr};
+      while (!writers[i]->write(pair, numSamples)) {
+        // A stopped writer thread will never make room
+        if (!writerThread.isThreadRunning())
+          writeFailed = true;
+        if (writeFailed)
+          break;
+        juce::Thread::sleep(1);
+      }
+    }
+    return !writeFailed;
+  };
+  const bool rendered = renderBlocks(std::move(compiled), options, writeBlock, result);
+  writers.clear(); // waits for the queued blocks to be written
+  writerThread.stopThread(1000);
+  if (!rendered || writeFailed) {
+    result.errorMessage = (options.stems ? "Write failed for a stem of " : "Write failed for ") +
+                          outputFile.getFullPathName();
+    return result;
+  }
+  result.succeeded = true;
+  return result;
+}
+
+OfflineRenderer::Result OfflineRenderer::renderToStream(
+    const PackedMidiFile &file, juce::OutputStream &out, const Options &options) {
+  Result result;
+  if (options.stems) {
+    result.errorMessage = "Streamed renders can't be split into stems";
+    return result;
+  }
+  const int bytesPerSample = options.bitsPerSample == 16 ? 2 : options.bitsPerSample == 32 ? 4 : 3;
+  const int numChannels = 2;
+  const auto sampleRate = static_cast<int>(options.sampleRate);
+
+  // A 44-byte canonical header with both chunk sizes left unknown
+  const juce::uint32 unknownSize = 0xffffffff;
+  out.write("RIFF", 4);
+  out.writeInt(static_cast<int>(unknownSize));
+  out.write("WAVEfmt ", 8);
+  out.writeInt(16);
+  out.writeShort(1); // PCM
+  out.writeShort(static_cast<short>(numChannels));
+  out.writeInt(sampleRate);
+  out.writeInt(sampleRate * numChannels * bytesPerSample);
+  out.writeShort(static_cast<short>(numChannels * bytesPerSample));
+  out.writeShort(static_cast<short>(8 * bytesPerSample));
+  out.write("data", 4);
+  out.writeInt(static_cast<int>(unknownSize));
+
+  // Interleaved little-endian integers, converted a block at a time
+  juce::MemoryBlock block(static_cast<size_t>(options.blockSize) * numChannels * bytesPerSample);
+  const double scale = static_cast<double>((juce::int64(1) << (8 * bytesPerSample - 1)) - 1);
+  auto writeBlock = [&](const juce::AudioBuffer<float> &buffer, int startSample,
+                        int numSamples) {
+    auto *bytes = static_cast<juce::uint8 *>(block.getData());
+    for (int i = 0; i < numSamples; ++i) {
+      for (int channel = 0; channel < numChannels; ++channel) {
+        const float sample = juce::jlimit(-1.0f, 1.0f, buffer.getSample(channel, startSample + i));
+        auto value = static_cast<juce::int64>(std::round(sample * scale));
+        for (int byte = 0; byte < bytesPerSample; ++byte, value >>= 8)
+          *bytes++ = static_cast<juce::uint8>(value & 0xff);
+      }
+    }
+    const size_t size = static_cast<size_t>(numSamples) * numChannels * bytesPerSample;
+    if (!out.write(block.getData(), size)) {
+      result.errorMessage = "Write failed";
+      return false;
+    }
+    return true;
+  };
+  if (!renderBlocks(MidiSchedulerAudioSource::compile(file, options.sampleRate), options,
+                    writeBlock, result))
+    return result;
+  out.flush();
+  result.succeeded = true;
+  return result;
+}
+
+bool OfflineRenderer::renderBlocks(
+    std::unique_ptr<MidiSchedulerAudioSource::Sequence> compiled,
+    const Options &options, const BlockWriter &write, Result &result) {
+  const double startTime = juce::Time::getMillisecondCounterHiRes();
+
+  std::unique_ptr<SynthAudioSource> synthSource(
+      options.soundFont != nullptr ? new SynthAudioSource(options.soundFont)
+                                   : new SynthAudioSource());
+  auto &synth = *synthSource;
+  synth.waitUntilFullyLoaded();
+
+  // Voices counted by the regions each note starts in this SoundFont, so
+  // layered presets get the pool they need
+  auto calibration = options.calibration;
+  calibration.regionsPerNote = [&synth](int channel, int program, int note, int velocity) {
+    return synth.countNoteRegions(channel, program, note, velocity);
+  };
+  result.analysis = MidiFileAnalysis::analyse(*compiled, calibration);
+  synth.setStemOutput(options.stems);
+  synth.setEffectsEnabled(options.effects);
+  synth.setLimiterEnabled(options.limiter);
+  synth.setLimiterCeiling(options.limiterCeilingDb);
+  synth.setRenderThreads(options.renderThreads);
+  if (options.fitPolyphony)
+    synth.setPolyphony(result.analysis.getVoiceBudget());
+  MidiSchedulerAudioSource scheduler(&synth);
+  scheduler.prepareToPlay(options.blockSize, options.sampleRate);
+  scheduler.setSequence(std::move(compiled));
+  scheduler.startPlayback();
+
+  juce::AudioBuffer<float> buffer(options.stems ? sfzero::Synth::stemChannels : 2,
+                                  options.blockSize);
+  const juce::int64 lengthInSamples = scheduler.getLengthInSamples();
+  const juce::int64 tailSamples =
+      static_cast<juce::int64>(options.tailSeconds * options.sampleRate);
+
+  // The limiter's delay is rendered on past the tail and cut from the start
+  const juce::int64 endSamples = lengthInSamples + tailSamples + synth.getLatencySamples();
+  juce::int64 delaySamples = synth.getLatencySamples();
+
+  // Render the sequence through the scheduler, ending the last block exactly
+  // at its end, then let the voices ring out with no further events. The
+  // tail renders with flush-to-zero too, like the scheduler's blocks.
+  const juce::ScopedNoDenormals noDenormals;
+  const juce::MidiBuffer noEvents;
+  for (juce::int64 position = 0; position < endSamples;) {
+    const int numSamples = static_cast<int>(juce::jmin<juce::int64>(
+        options.blockSize, position < lengthInSamples ? lengthInSamples - position
+                                                      : endSamples - position));
+    if (position < lengthInSamples) {
+      juce::AudioSourceChannelInfo info(&buffer, 0, numSamples);
+      scheduler.getNextAudioBlock(info);
+    } else {
+      synth.renderNextBlock(buffer, noEvents, 0, numSamples);
+    }
+    const int skipped = static_cast<int>(juce::jmin<juce::int64>(delaySamples, numSamples));
+    delaySamples -= skipped;
+    if (skipped < numSamples && !write(buffer, skipped, numSamples - skipped))
+      return false;
+    position += numSamples;
+  }
+
+  result.renderedSeconds =
+      static_cast<double>(lengthInSamples + tailSamples) / options.sampleRate;
+  result.elapsedSeconds =
+      (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+  result.realtimeFactor = result.elapsedSeconds > 0.0
+                              ? result.renderedSeconds / result.elapsedSeconds
+                              : 0.0;
+  return true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "../Modules/SFZero/SFZero.h"
+#include "MidiFileAnalysis.h"
+#include "MidiSchedulerAudioSource.h"
+#include "SmfReader.h"
+#include <JuceHeader.h>
+
+#include <functional>
+
+// Renders a MIDI file straight to an audio file, with no audio device and as
+// fast as the CPU allows. It drives its own SynthAudioSource and
+// MidiSchedulerAudioSource, so it can run alongside live playback.
+class OfflineRenderer {
+public:
+  struct Options {
+    double sampleRate = 44100.0;
+    int blockSize = 8192;       // much larger than a device block
+    int bitsPerSample = 24;
+    double tailSeconds = 2.0;   // let releases ring out after the last event
+    // A fully loaded SoundFont to render with instead of loading the built-in
+    // one. It is only read, so any number of renders can share it at once.
+    sfzero::SF2Sound *soundFont = nullptr;
+    // Extra threads to render each block's voices on. Batch jobs that already
+    // keep every core busy are better off leaving this at zero.
+    int renderThreads = 0;
+    // Write one stereo file per MIDI channel the sequence uses, named after
+    // the output file with a _chNN suffix, instead of a single mix.
+    bool stems = false;
+    // Mix in the shared reverb and chorus the channels' CC91 and CC93 send
+    // to. Stems stay dry.
+    bool effects = false;
+    // Blocks a file render may get ahead of its writer thread by. Encoding
+    // and disk writes happen there, overlapping the next blocks' synthesis;
+    // this bounds the queue between them, so memory stays the same however
+    // long the file.
+    int writeAheadBlocks = 4;
+    // End the mix in the look-ahead limiter, with its peaks held to
+    // limiterCeilingDb. The files are compensated for its delay, so they
+    // line up with a render without it. Stems aren't limited.
+    bool limiter = false;
+    float limiterCeilingDb = -1.0f;
+    // Size the voice pool to the file's voice budget (see MidiFileAnalysis)
+    // instead of the default, so sparse files don't carry hundreds of idle
+    // voices and dense ones don't steal.
+    bool fitPolyphony = false;
+    // What the analysis each render reports predicts the load from
+    MidiFileAnalysis::Calibration calibration;
+  };
+
+  struct Result {
+    bool succeeded = false;
+    juce::String errorMessage;
+    double renderedSeconds = 0.0;
+    double elapsedSeconds = 0.0;
+    double realtimeFactor = 0.0; // seconds of audio rendered per second taken
+    juce::Array<juce::File> outputFiles;
+    MidiFileAnalysis analysis; // of the sequence, made before rendering it
+  };
+
+  // The output format follows the file extension (.wav or .flac). Encoding
+  // and writing run on a thread of their own, a few blocks behind the render.
+  static Result renderToFile(const juce::File &midiFile,
+                             const juce::File &outputFile,
+                             const Options &options);
+  static Result renderMidiFile(const PackedMidiFile &file,
+                               const juce::File &outputFile,
+                               const Options &options);
+  static Result renderSequence(const juce::MidiMessageSequence &sequence,
+                               int ppq, const juce::File &outputFile,
+                               const Options &options);
+
+  // Writes the render to out as PCM WAV, a block at a time as it renders,
+  // so only one block is ever held. The header gives the lengths as unknown,
+  // since out needn't be able to seek back to fill them in; readers that
+  // stream WAV read on to the end. Stems aren't supported.
+  static Result renderToStream(const PackedMidiFile &file, juce::OutputStream &out,
+                               const Options &options);
+
+  // Where a stem render puts a channel's file: song.wav -> song_ch01.wav.
+  static juce::File getStemFile(const juce::File &outputFile, int midiChannel);
+
+private:
+  // Takes each block as it's rendered, from startSample on; returning false
+  // stops the render
+  using BlockWriter = std::function<bool(const juce::AudioBuffer<float> &buffer,
+                                         int startSample, int numSamples)>;
+
+  // Plays compiled through a fresh synth into write, then rings out the
+  // tail, and fills in result's timings. Returns false if write failed.
+  static bool renderBlocks(std::unique_ptr<MidiSchedulerAudioSource::Sequence> compiled,
+                           const Options &options, const BlockWriter &write,
+                           Result &result);
+
+  static Result renderCompiled(
+      std::unique_ptr<MidiSchedulerAudioSource::Sequence> compiled,
+      const juce::File &outputFile, const Options &options);
+};
@@ -0,0 +1,100 @@
+#include "PerformanceOverlay.h"
+
+PerformanceOverlay::PerformanceOverlay(
+    sfzero::PerformanceCounters &countersToShow)
+    : counters(countersToShow) {
+  setInterceptsMouseClicks(false, false);
+}
+
+void PerformanceOverlay::showLiveInput(LiveMidiInput &input,
+                                       juce::AudioDeviceManager &deviceManager) {
+  liveInput = &input;
+  audioDeviceManager = &deviceManager;
+}
+
+void PerformanceOverlay::visibilityChanged() {
+  if (isVisible()) {
+    // Start from a clean slate, so the figures cover what's on screen now
+    counters.reset();
+    if (liveInput != nullptr)
+      liveInput->resetLatency();
+    startTimerHz(4);
+  } else {
+    stopTimer();
+  }
+}
+
+void PerformanceOverlay::timerCallback() {
+  snapshot = counters.getSnapshot();
+  if (liveInput != nullptr) {
+    liveLatency = liveInput->getLatency();
+    auto *device = audioDeviceManager->getCurrentAudioDevice();
+    outputLatencyMs = device != nullptr && device->getCurrentSampleRate() > 0.0
+                          ? device->getOutputLatencyInSamples() * 1000.0 /
+                                device->getCurrentSampleRate()
+                          : 0.0;
+  }
+  repaint();
+}
+
+void PerformanceOverlay::paint(juce::Graphics &g) {
+  g.setColour(juce::Colours::black.withAlpha(0.7f));
+  g.fillRoundedRectangle(getLocalBounds().toFloat(), 6.0f);
+
+  auto percent = [](double load) { return juce::String(load * 100.0, 1) + "%"; };
+
+  // Red once the worst callback gets near the buffer's deadline
+  const bool nearDropout = snapshot.worstLoad >= 0.8;
+
+  juce::StringArray lines;
+  lines.add("CPU " + percent(snapshot.averageLoad) + " avg, " +
+            percent(snapshot.getLoadAtPercentile(0.5)) + " p50, " +
+            percent(snapshot.getLoadAtPercentile(0.99)) + " p99");
+  lines.add("Worst " + percent(snapshot.worstLoad) + " (" +
+            juce::String(snapshot.worstCallbackMs, 2) + " ms), last " +
+            juce::String(snapshot.lastCallbackMs, 2) + " of " +
+            juce::String(snapshot.lastBufferMs, 2) + " ms");
+  lines.add("Voices " + juce::String(snapshot.activeVoices) + " (peak " +
+            juce::String(snapshot.peakVoices) + "), stolen " +
+            juce::String(snapshot.voicesStolen) +
+            (snapshot.voiceLimit > 0 ? ", limit " + juce::String(snapshot.voiceLimit) +
+                                           " (shed " + juce::String(snapshot.voicesShed) + ")"
+                                     : juce::String()));
+  lines.add("Energy " + juce::String(snapshot.getRenderSecondsPerMinute(), 2) +
+            " s CPU, " + juce::String(juce::roundToInt(snapshot.getCallbacksPerMinute())) +
+            " wakeups per minute played");
+  lines.add("MIDI events " + juce::String(snapshot.eventsLastBlock) +
+            " last block, " + juce::String(snapshot.maxEventsPerBlock) +
+            " max, " + juce::String(snapshot.totalEvents) + " total" +
+            (snapshot.notesDropped > 0
+                 ? ", " + juce::String(snapshot.notesDropped) + " notes dropped"
+                 : juce::String()));
+
+  juce::String perChannel, perChannelRest;
+  for (int channel = 0; channel < 16; ++channel) {
+    auto &row = channel < 8 ? perChannel : perChannelRest;
+    row += juce::String(channel + 1).paddedLeft(' ', 2) + ":" +
+           juce::String(snapshot.voicesPerChannel[channel]).paddedRight(' ', 4);
+  }
+  lines.add(perChannel.trimEnd());
+  lines.add(perChannelRest.trimEnd());
+
+  if (liveInput != nullptr) {
+    lines.add(liveLatency.numEvents == 0
+                  ? juce::String("MIDI in: nothing received")
+                  : "MIDI in " + juce::String(liveLatency.averageMs, 1) + " ms avg, " +
+                        juce::String(liveLatency.worstMs, 1) + " worst + " +
+                        juce::String(outputLatencyMs, 1) + " ms output");
+  }
+
+  g.setFont(juce::Font(juce::Font::getDefaultMonospacedFontName(), 12.0f,
+                       juce::Font::plain));
+  auto area = getLocalBounds().reduced(8, 6);
+  const int lineHeight = area.getHeight() / lines.size();
+  for (int i = 0; i < lines.size(); ++i) {
+    g.setColour(i < 2 && nearDropout ? juce::Colours::orangered
+                                     : juce::Colours::white);
+    g.drawText(lines[i], area.removeFromTop(lineHeight),
+               juce::Justification::centredLeft, false);
+  }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "../Modules/SFZero/SFZero.h"
+#include "LiveMidiInput.h"
+#include <JuceHeader.h>
+
+// A translucent readout of the synth's PerformanceCounters, laid over the
+// piano roll. It polls a few times a second while it's visible and ignores
+// the mouse, so the piano roll underneath still scrolls and zooms.
+class PerformanceOverlay : public juce::Component, private juce::Timer {
+public:
+  explicit PerformanceOverlay(sfzero::PerformanceCounters &countersToShow);
+
+  // Adds a line for live MIDI latency, with the device's output latency
+  // that comes on top of it
+  void showLiveInput(LiveMidiInput &input, juce::AudioDeviceManager &deviceManager);
+
+  void paint(juce::Graphics &g) override;
+  void visibilityChanged() override;
+
+  // The size that fits the readout
+  static constexpr int preferredWidth = 330;
+  static constexpr int preferredHeight = 190;
+
+private:
+  void timerCallback() override;
+
+  sfzero::PerformanceCounters &counters;
+  sfzero::PerformanceCounters::Snapshot snapshot;
+  LiveMidiInput *liveInput = nullptr;
+  juce::AudioDeviceManager *audioDeviceManager = nullptr;
+  LiveMidiInput::Latency liveLatency;
+  double outputLatencyMs = 0.0;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PerformanceOverlay)
+};
@@ -1,6 +1,14 @@
 #pragma once
+#include "NoteDensityPyramid.h"
+#include "PianoRollGLRenderer.h"
+#include "SmfReader.h"
 #include <JuceHeader.h>
 
+#include <map>
+
+// A piano roll that draws straight from a beat-to-pixel transform: the
+// canvas is only ever the size of the view, and zooming or scrolling just
+// changes pixelsPerBeat or the scroll position, whatever the song's length.
 class PianoRollComponent : public juce::Component,
                           public juce::Timer,
                           public juce::ScrollBar::Listener
@@ -10,13 +18,15 @@ public:
     {
         setOpaque(true);
         
-        addAndMakeVisible(viewport);
-        viewport.setViewedComponent(&contentComponent, false);
-        viewport.setScrollBarsShown(true, true);
+        addAndMakeVisible(contentComponent);
+        addAndMakeVisible(horizontalScrollBar);
+        addAndMakeVisible(verticalScrollBar);
+        horizontalScrollBar.setAutoHide(false);
+        verticalScrollBar.setAutoHide(false);
         
         // Add listeners for both horizontal and vertical scrollbars
-        viewport.getHorizontalScrollBar().addListener(this);
-        viewport.getVerticalScrollBar().addListener(this);
+        horizontalScrollBar.addListener(this);
+        verticalScrollBar.addListener(this);
         
         pixelsPerBeat = 50;
         pixelsPerNote = 10;
@@ -31,49 +41,109 @@ public:
         beatsPerBar = 4.0;  // Default 4/4 time
         transposition = 0;  // No transposition by default
         isPlaying = false;
-        isAutoScrolling = false;
         isManuallyScrolling = false;
     }
 
     ~PianoRollComponent() override
     {
-        viewport.getHorizontalScrollBar().removeListener(this);
-        viewport.getVerticalScrollBar().removeListener(this);
+        setUseOpenGL(false);
+        horizontalScrollBar.removeListener(this);
+        verticalScrollBar.removeListener(this);
     }
 
     void paint(juce::Graphics& g) override
     {
-        g.fillAll(juce::Colours::darkgrey);
+        // With OpenGL the renderer has drawn everything under the scrollbars
+        if (!isUsingOpenGL())
+            g.fillAll(juce::Colours::darkgrey);
     }
 
     void resized() override
     {
         auto bounds = getLocalBounds();
-        viewport.setBounds(bounds);
+        const int thickness = getLookAndFeel().getDefaultScrollbarWidth();
+        auto bottom = bounds.removeFromBottom(thickness);
+        verticalScrollBar.setBounds(bounds.removeFromRight(thickness));
+        horizontalScrollBar.setBounds(bottom.withTrimmedRight(thickness));
+        contentComponent.setBounds(bounds);
         updateContentSize();
     }
 
-    void setMidiSequence(const juce::MidiMessageSequence& sequence)
+    struct Note
     {
-        notes.clear();
-        DBG("PianoRoll: Setting new MIDI sequence with " + juce::String(sequence.getNumEvents()) + " events");
+        int noteNumber;
+        double startBeat;
+        double endBeat;
+        int velocity;
+        int channel;  // Add MIDI channel information
+
+        int getTransposedNoteNumber(int transposition) const
+        {
+            // Don't transpose if it would go out of MIDI note range (0-127)
+            int transposed = noteNumber + transposition;
+            return juce::jlimit(0, 127, transposed);
+        }
+    };
+
+    // What the roll draws for a sequence. Building it only reads the
+    // sequence (whose note pairs must already be matched), so it can be done
+    // on any thread and handed over with setGeometry().
+    struct Geometry
+    {
+        juce::Array<Note> notes;  // sorted by startBeat once indexed
+        // latestEndBeat[i] is the latest endBeat of notes[0..i]. It never
+        // decreases, so a binary search finds the first note that can still
+        // be sounding at a given beat.
+        std::vector<double> latestEndBeat;
+        int numBeats = 16;
+        // What's drawn instead of the notes when they're under a pixel wide
+        NoteDensityPyramid density;
+
+        void index()
+        {
+            std::stable_sort(notes.begin(), notes.end(), [](const Note& a, const Note& b)
+            {
+                return a.startBeat < b.startBeat;
+            });
+            latestEndBeat.resize(static_cast<size_t>(notes.size()));
+            double latest = 0.0;
+            for (int i = 0; i < notes.size(); ++i)
+            {
+                latest = std::max(latest, notes.getReference(i).endBeat);
+                latestEndBeat[static_cast<size_t>(i)] = latest;
+            }
+
+            density.reset(numBeats);
+            for (const auto& note : notes)
+                density.addNote(note.startBeat, note.endBeat, note.noteNumber, note.channel);
+            density.buildLevels();
+        }
+    };
+
+    static Geometry buildGeometry(const juce::MidiMessageSequence& sequence, int ppq,
+                                  double beatsPerBar)
+    {
+        Geometry geometry;
         
         // First find the absolute last timestamp in the sequence
         double lastTimestamp = 0.0;
+        int numNotes = 0;
         for (int i = 0; i < sequence.getNumEvents(); ++i)
         {
-            auto timestamp = sequence.getEventPointer(i)->message.getTimeStamp();
-            lastTimestamp = std::max(lastTimestamp, timestamp);
+            const auto& message = sequence.getEventPointer(i)->message;
+            lastTimestamp = std::max(lastTimestamp, message.getTimeStamp());
+            numNotes += message.isNoteOn() ? 1 : 0;
         }
         
         // Convert to beats and round up to the nearest bar
         double sequenceLength = lastTimestamp / ppq; // Convert to beats using current PPQ
-        numBeats = static_cast<int>(std::ceil(sequenceLength / beatsPerBar) * beatsPerBar) + 4;
+        geometry.numBeats = static_cast<int>(std::ceil(sequenceLength / beatsPerBar) * beatsPerBar) + 4;
         
         DBG("PianoRoll: Last timestamp is " + juce::String(lastTimestamp) + " ticks, " + 
-            juce::String(sequenceLength) + " beats, setting numBeats to " + juce::String(numBeats));
+            juce::String(sequenceLength) + " beats, setting numBeats to " + juce::String(geometry.numBeats));
         
         // Now process all notes
+        geometry.notes.ensureStorageAllocated(numNotes);
         for (int i = 0; i < sequence.getNumEvents(); ++i)
         {
             auto* event = sequence.getEventPointer(i);
@@ -94,20 +164,140 @@ public:
                 {
                     // If there's no note-off event, extend to the end of the sequence plus one beat
                     note.endBeat = sequenceLength + 1.0;
-                    DBG("PianoRoll: Note " + juce::String(note.noteNumber) + 
-                        " has no note-off event, extending to " + juce::String(note.endBeat));
                 }
                 
-                notes.add(note);
-                DBG("PianoRoll: Added note - Number: " + juce::String(note.noteNumber) + 
-                    " Channel: " + juce::String(note.channel) +
-                    " Start: " + juce::String(note.startBeat) + 
-                    " End: " + juce::String(note.endBeat));
+                geometry.notes.add(note);
             }
         }
-        
+        DBG("PianoRoll: Built " + juce::String(geometry.notes.size()) + " notes");
+        geometry.index();
+        return geometry;
+    }
+
+    // The same from a packed file. Each note-off ends the earliest
+    // unfinished note of its key and channel, as updateMatchedPairs() would.
+    static Geometry buildGeometry(const PackedMidiFile& file, double beatsPerBar)
+    {
+        Geometry geometry;
+        const double ppq = file.ppq;
+        double sequenceLength = file.lastTick / ppq;
+        geometry.numBeats = static_cast<int>(std::ceil(sequenceLength / beatsPerBar) * beatsPerBar) + 4;
+
+        int numNotes = 0;
+        for (const auto& event : file.events)
+            numNotes += event.isNoteOn() ? 1 : 0;
+        geometry.notes.ensureStorageAllocated(numNotes);
+
+        // Unfinished notes per channel and key, oldest first, as indices into
+        // geometry.notes; the position of each queue's oldest is kept apart
+        // so finishing a note is O(1).
+        std::vector<std::vector<int>> open(16 * 128);
+        std::vector<size_t> oldest(16 * 128, 0);
+        for (const auto& event : file.events)
+        {
+            const int key = (event.status & 0x0f) * 128 + event.data1;
+            if (event.isNoteOn())
+            {
+                Note note;
+                note.noteNumber = event.data1;
+                note.startBeat = event.tick / ppq;
+                note.endBeat = sequenceLength + 1.0; // until its note-off turns up
+                note.velocity = event.data2;
+                note.channel = event.status & 0x0f;
+                open[static_cast<size_t>(key)].push_back(geometry.notes.size());
+                geometry.notes.add(note);
+            }
+            else if (event.isNoteOff())
+            {
+                auto& queue = open[static_cast<size_t>(key)];
+                auto& first = oldest[static_cast<size_t>(key)];
+                if (first < queue.size())
+                {
+                    geometry.notes.getReference(queue[first++]).endBeat = event.tick / ppq;
+                    if (first == queue.size())
+                    {
+                        queue.clear();
+                        first = 0;
+                    }
+                }
+            }
+        }
+        DBG("PianoRoll: Built " + juce::String(geometry.notes.size()) + " notes");
+        geometry.index();
+        return geometry;
+    }
+
+    void setGeometry(Geometry&& geometry)
+    {
+        notes.swapWith(geometry.notes);
+        latestEndBeat.swap(geometry.latestEndBeat);
+        density = std::move(geometry.density);
+        numBeats = geometry.numBeats;
+        uploadGLNotes();
         updateContentSize();
+        contentComponent.invalidateCache();
+    }
+
+    // Draws with OpenGL instead of juce::Graphics, where the OpenGL module
+    // is built in. Notes are uploaded whenever the geometry changes.
+    void setUseOpenGL(bool shouldUseOpenGL)
+    {
+       #if JUCE_MODULE_AVAILABLE_juce_opengl
+        if (shouldUseOpenGL == isUsingOpenGL())
+            return;
+
+        if (shouldUseOpenGL)
+        {
+            glRenderer = std::make_unique<PianoRollGLRenderer>();
+            uploadGLNotes();
+            updateGLView();
+            glRenderer->attachTo(*this);
+        }
+        else
+        {
+            glRenderer->detach();
+            glRenderer = nullptr;
+        }
+
+        // Transparent, so the GL frame shows through the component painting
+        setOpaque(!shouldUseOpenGL);
+        contentComponent.setOpaque(!shouldUseOpenGL);
+        contentComponent.invalidateCache();
         repaint();
+       #else
+        juce::ignoreUnused(shouldUseOpenGL);
+       #endif
+    }
+
+    bool isUsingOpenGL() const
+    {
+       #if JUCE_MODULE_AVAILABLE_juce_opengl
+        return glRenderer != nullptr;
+       #else
+        return false;
+       #endif
+    }
+
+    // Calls fn(note) for each note sounding at some point in [startBeat, endBeat),
+    // in start order.
+    template <typename Function>
+    void forEachNoteBetween(double startBeat, double endBeat, Function&& fn) const
+    {
+        auto first = std::upper_bound(latestEndBeat.begin(), latestEndBeat.end(), startBeat);
+        for (int i = static_cast<int>(first - latestEndBeat.begin()); i < notes.size(); ++i)
+        {
+            const auto& note = notes.getReference(i);
+            if (note.startBeat >= endBeat)
+                break;
+            if (note.endBeat > startBeat)
+                fn(note);
+        }
+    }
+
+    void setMidiSequence(const juce::MidiMessageSequence& sequence)
+    {
+        DBG("PianoRoll: Setting new MIDI sequence with " + juce::String(sequence.getNumEvents()) + " events");
+        setGeometry(buildGeometry(sequence, ppq, beatsPerBar));
     }
 
     void setLoopRegion(double startBeat, double endBeat, int numberOfLoops)
@@ -116,7 +306,7 @@ public:
         loopEndBeat = endBeat;
         loopCount = numberOfLoops;
         isLooping = (loopCount > 0);
-        repaint();
+        contentComponent.invalidateCache();
     }
 
     int getLoopCount() const { return loopCount; }
@@ -131,77 +321,64 @@ public:
         if (isPlaying && !isManuallyScrolling)
         {
             // Calculate the x position of the playback line
-            const float keyWidth = 40.0f;
-            float playbackX = keyWidth + static_cast<float>(currentBeatPosition * pixelsPerBeat);
+            float playbackX = static_cast<float>(currentBeatPosition * pixelsPerBeat);
             
-            // Get the current viewport position and size
-            auto viewportBounds = viewport.getViewArea();
-            float viewportLeft = static_cast<float>(viewportBounds.getX());
-            float viewportRight = static_cast<float>(viewportBounds.getRight());
+            // The visible part of the notes, past the keys
+            const float visibleWidth = static_cast<float>(getVisibleNoteWidth());
+            float viewLeft = static_cast<float>(scrollX);
+            float viewRight = viewLeft + visibleWidth;
             
             // Check if the playback line is outside the visible area
-            if (playbackX < viewportLeft || playbackX > viewportRight)
+            if (playbackX < viewLeft || playbackX > viewRight)
             {
-                // Calculate new viewport position to center the playback line
-                targetScrollX = playbackX - (viewportBounds.getWidth() / 2.0f);
+                // Calculate new scroll position to center the playback line
+                targetScrollX = playbackX - (visibleWidth / 2.0f);
                 
                 // Ensure we don't scroll past the content bounds
                 targetScrollX = juce::jlimit(0.0f, 
-                                          static_cast<float>(contentComponent.getWidth() - viewportBounds.getWidth()),
+                                          static_cast<float>(std::max(0, getMaxScrollX())),
                                           targetScrollX);
                 
                 // Initialize current scroll position if needed
                 if (currentScrollX < 0)
-                    currentScrollX = static_cast<float>(viewport.getViewPositionX());
+                    currentScrollX = static_cast<float>(scrollX);
+            }
+
+            // Ease towards the target; this is called every frame
+            if (currentScrollX >= 0)
+            {
+                float diff = targetScrollX - currentScrollX;
+                if (std::abs(diff) > 0.5f)
+                {
+                    currentScrollX += diff * scrollAnimationSpeed;
+                    setScrollPosition(static_cast<int>(currentScrollX), scrollY);
+                }
             }
         }
         
-        contentComponent.repaint();
+        contentComponent.updatePlayhead();
     }
 
     void startPlayback()
     {
         isPlaying = true;
-        currentScrollX = static_cast<float>(viewport.getViewPositionX());
+        currentScrollX = static_cast<float>(scrollX);
         targetScrollX = currentScrollX;
-        startTimerHz(60); // Increased refresh rate for smoother animation
     }
 
     void stopPlayback()
     {
         isPlaying = false;
         currentScrollX = -1; // Reset scroll animation state
-        stopTimer();
         currentBeatPosition = 0.0;
-        contentComponent.repaint();
+        contentComponent.updatePlayhead();
     }
 
+    // The manual scrolling timeout; auto-scrolling follows setPlaybackPosition()
     void timerCallback() override
     {
-        if (isManuallyScrolling)
-        {
-            isManuallyScrolling = false;
-            stopTimer();
-            startTimerHz(60); // Restart the normal animation timer
-        }
-        else
-        {
-            // Normal animation timer callback
-            if (isPlaying && currentScrollX >= 0)
-            {
-                float diff = targetScrollX - currentScrollX;
-                if (std::abs(diff) > 0.5f)
-                {
-                    currentScrollX += diff * scrollAnimationSpeed;
-                    isAutoScrolling = true;  // Set flag before viewport change
-                    viewport.setViewPosition(static_cast<int>(currentScrollX), viewport.getViewPositionY());
-                    isAutoScrolling = false;  // Reset flag after viewport change
-                }
-            }
-            
-            // Update playback line
-            contentComponent.repaint();
-        }
+        isManuallyScrolling = false;
+        stopTimer();
     }
 
     void setPPQ(int ppqValue) { ppq = ppqValue; }
@@ -210,45 +387,67 @@ public:
         timeSignatureNumerator = numerator;
         timeSignatureDenominator = denominator;
         beatsPerBar = static_cast<double>(timeSignatureNumerator) * (4.0 / static_cast<double>(timeSignatureDenominator));
-        repaint();
+        contentComponent.invalidateCache();
     }
 
     void setTransposition(int semitones)
     {
         transposition = semitones;
-        contentComponent.repaint();
+        contentComponent.invalidateCache();
     }
 
     int getTransposition() const { return transposition; }
 
-    // Modify ScrollBar::Listener callback
-    void scrollBarMoved(juce::ScrollBar* scrollBarThatHasMoved, double newRangeStart) override
+    // Horizontal zoom. zoomAround() keeps the beat under viewX, a position
+    // on the canvas, where it is. Only what's visible is redrawn.
+    void setPixelsPerBeat(double newPixelsPerBeat)
     {
-        if (!isAutoScrolling)
-        {            
-            isManuallyScrolling = true;
-            stopTimer(); // Stop any existing timer
-            startTimer(1000); // Start 1 second timeout
-        }
+        zoomAround(newPixelsPerBeat / pixelsPerBeat, static_cast<int>(keyWidth) + getVisibleNoteWidth() / 2);
     }
 
-private:
-    struct Note
+    void zoomAround(double factor, int viewX)
     {
-        int noteNumber;
-        double startBeat;
-        double endBeat;
-        int velocity;
-        int channel;  // Add MIDI channel information
+        const double beat = (scrollX + viewX - keyWidth) / pixelsPerBeat;
+        pixelsPerBeat = juce::jlimit(minPixelsPerBeat, maxPixelsPerBeat, pixelsPerBeat * factor);
+        currentScrollX = -1; // the old target no longer means anything
+        updateContentSize();
+        setScrollPosition(juce::roundToInt(beat * pixelsPerBeat - (viewX - keyWidth)), scrollY);
+        contentComponent.invalidateCache();
+    }
 
-        int getTransposedNoteNumber(int transposition) const
-        {
-            // Don't transpose if it would go out of MIDI note range (0-127)
-            int transposed = noteNumber + transposition;
-            return juce::jlimit(0, 127, transposed);
-        }
-    };
+    double getPixelsPerBeat() const { return pixelsPerBeat; }
 
+    // Scrolls so that content pixel (x, y) is at the top left of the notes,
+    // clamped to the content
+    void setScrollPosition(int x, int y)
+    {
+        x = juce::jlimit(0, std::max(0, getMaxScrollX()), x);
+        y = juce::jlimit(0, std::max(0, getContentHeight() - contentComponent.getHeight()), y);
+        if (x == scrollX && y == scrollY)
+            return;
+        scrollX = x;
+        scrollY = y;
+        horizontalScrollBar.setCurrentRangeStart(scrollX, juce::dontSendNotification);
+        verticalScrollBar.setCurrentRangeStart(scrollY, juce::dontSendNotification);
+        contentComponent.scrolled();
+    }
+
+    // Modify ScrollBar::Listener callback
+    void scrollBarMoved(juce::ScrollBar* scrollBarThatHasMoved, double newRangeStart) override
+    {
+        userScrolled();
+        if (scrollBarThatHasMoved == &horizontalScrollBar)
+            setScrollPosition(juce::roundToInt(newRangeStart), scrollY);
+        else
+            setScrollPosition(scrollX, juce::roundToInt(newRangeStart));
+    }
+
+private:
+    // The canvas, always the size of the visible area. It paints from cached
+    // layers: the grid, loop region and notes are drawn once into fixed-size
+    // tiles of content space, and the keys into one strip, so a repaint or a
+    // scroll only blits images and draws the playhead. Only the notes in a
+    // tile's time range are visited when it is drawn.
     class ContentComponent : public juce::Component
     {
     public:
@@ -257,22 +456,176 @@ private:
             setOpaque(true);
         }
 
+        // Call when anything the tiles show has changed
+        void invalidateCache()
+        {
+            tiles.clear();
+            keysImage = juce::Image();
+            repaint();
+            owner.updateGLView();
+        }
+
+        // Repaints the strips under the old and new playhead, and nothing else
+        void updatePlayhead()
+        {
+            if (owner.isUsingOpenGL())
+            {
+                owner.updateGLView();
+                return;
+            }
+
+            const int x = getPlayheadX();
+            if (x == playheadX)
+                return;
+            repaint(playheadX - 1, 0, 3, getHeight());
+            repaint(x - 1, 0, 3, getHeight());
+            playheadX = x;
+        }
+
+        // The tiles stay valid; they're just blitted somewhere else
+        void scrolled()
+        {
+            repaint();
+            owner.updateGLView();
+        }
+
+        // Cmd/Ctrl + wheel zooms; anything else scrolls, shift + wheel
+        // sideways
+        void mouseWheelMove(const juce::MouseEvent& e, const juce::MouseWheelDetails& wheel) override
+        {
+            if (e.mods.isCommandDown())
+            {
+                owner.zoomAround(std::pow(2.0, wheel.deltaY * 2.0), e.x);
+                return;
+            }
+
+            const float dx = e.mods.isShiftDown() ? wheel.deltaY : wheel.deltaX;
+            const float dy = e.mods.isShiftDown() ? 0.0f : wheel.deltaY;
+            const float step = wheel.isReversed ? -wheelPixels : wheelPixels;
+            owner.userScrolled();
+            owner.setScrollPosition(owner.scrollX - juce::roundToInt(dx * step),
+                                    owner.scrollY - juce::roundToInt(dy * step));
+        }
+
         void paint(juce::Graphics& g) override
         {
-            auto height = getHeight();
-            
-            // Constants
-            const float keyWidth = 40.0f;
-            
+            if (owner.isUsingOpenGL())
+                return;
+
+            const float scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+            if (scale != cacheScale)
+            {
+                tiles.clear();
+                keysImage = juce::Image();
+                cacheScale = scale;
+            }
+
+            // The clip region right of the keys, in content space
+            const int left = static_cast<int>(keyWidth);
+            const auto clip = g.getClipBounds();
+            const auto content = clip.withLeft(std::max(clip.getX(), left))
+                                     .translated(owner.scrollX - left, owner.scrollY);
+            const auto toLogical = juce::AffineTransform::scale(1.0f / scale);
+            if (!content.isEmpty())
+            {
+                for (int row = content.getY() / tileSize; row * tileSize < content.getBottom(); ++row)
+                    for (int column = content.getX() / tileSize; column * tileSize < content.getRight(); ++column)
+                        g.drawImageTransformed(getTile(column, row),
+                                               toLogical.translated(static_cast<float>(column * tileSize - owner.scrollX + left),
+                                                                    static_cast<float>(row * tileSize - owner.scrollY)));
+            }
+
+            // The keys stay put on the left and scroll vertically
+            if (clip.getX() < left)
+            {
+                if (keysImage.isNull())
+                    keysImage = renderKeys();
+                g.setColour(juce::Colours::darkgrey);
+                g.fillRect(0, 0, left, getHeight());
+                g.drawImageTransformed(keysImage, toLogical.translated(0.0f, static_cast<float>(-owner.scrollY)));
+            }
+
+            // Draw playback position line, unless it's scrolled under the keys
+            playheadX = getPlayheadX();
+            if (playheadX >= left)
+            {
+                g.setColour(juce::Colours::white);
+                g.drawVerticalLine(playheadX, 0.0f, static_cast<float>(getHeight()));
+            }
+        }
+
+    private:
+        static constexpr int tileSize = 512;
+        // About 40 MB at 1x; more than a full-screen canvas needs, so
+        // scrolling back and forth redraws little.
+        static constexpr size_t maxTiles = 40;
+        static constexpr float wheelPixels = 224.0f;
+
+        struct Tile
+        {
+            juce::Image image;
+            juce::uint32 lastUsed = 0;
+        };
+
+        int getPlayheadX() const
+        {
+            return static_cast<int>(keyWidth + owner.currentBeatPosition * owner.pixelsPerBeat) - owner.scrollX;
+        }
+
+        const juce::Image& getTile(int column, int row)
+        {
+            const auto key = (static_cast<juce::int64>(column) << 32) | static_cast<juce::uint32>(row);
+            auto& tile = tiles[key];
+            tile.lastUsed = ++useCounter;
+            if (tile.image.isNull())
+            {
+                tile.image = renderTile(column, row);
+
+                // Drop the least recently drawn tile once there are too many
+                if (tiles.size() > maxTiles)
+                {
+                    auto oldest = tiles.begin();
+                    for (auto it = tiles.begin(); it != tiles.end(); ++it)
+                        if (it->second.lastUsed < oldest->second.lastUsed)
+                            oldest = it;
+                    tiles.erase(oldest);
+                }
+            }
+            return tile.image;
+        }
+
+        juce::Image renderTile(int column, int row) const
+        {
+            const int pixels = juce::roundToInt(tileSize * cacheScale);
+            juce::Image image(juce::Image::RGB, pixels, pixels, false);
+            juce::Graphics g(image);
+            g.addTransform(juce::AffineTransform::scale(cacheScale));
+            g.setOrigin(-column * tileSize, -row * tileSize);
+            paintStaticLayers(g, {column * tileSize, row * tileSize, tileSize, tileSize});
+            return image;
+        }
+
+        // The grid, loop region and notes within area, in content space:
+        // beat 0 at x = 0, and the top key at y = 0
+        void paintStaticLayers(juce::Graphics& g, juce::Rectangle<int> area) const
+        {
+            auto height = owner.getContentHeight();
+            const double ppb = owner.pixelsPerBeat;
+            const double firstBeat = area.getX() / ppb;
+            const double lastBeat = area.getRight() / ppb;
+
             g.fillAll(juce::Colours::black);
 
-            // Draw grid first
-            for (int beat = 0; beat <= owner.numBeats; ++beat)
+            // Draw grid first, thinned out when zoomed out
+            const int barLength = std::max(1, static_cast<int>(owner.beatsPerBar));
+            const int step = getGridStep(ppb, barLength);
+            for (int beat = std::max(0, static_cast<int>(std::floor(firstBeat / step))) * step;
+                 beat <= std::min(owner.numBeats, static_cast<int>(std::ceil(lastBeat))); beat += step)
             {
-                float x = keyWidth + static_cast<float>(beat * owner.pixelsPerBeat);
-                
+                float x = static_cast<float>(beat * owner.pixelsPerBeat);
+
                 // Draw bar lines darker and thicker
-                if (beat % static_cast<int>(owner.beatsPerBar) == 0) {
+                if (beat % barLength == 0) {
                     g.setColour(juce::Colours::grey);
                     g.drawVerticalLine(static_cast<int>(x), 0.0f, static_cast<float>(height));
                 } else {
@@ -285,40 +638,98 @@ private:
             if (owner.isLooping)
             {
                 g.setColour(juce::Colours::yellow.withAlpha(0.3f));
-                float x1 = keyWidth + static_cast<float>(owner.loopStartBeat * owner.pixelsPerBeat);
-                float x2 = keyWidth + static_cast<float>(owner.loopEndBeat * owner.pixelsPerBeat);
+                float x1 = static_cast<float>(owner.loopStartBeat * owner.pixelsPerBeat);
+                float x2 = static_cast<float>(owner.loopEndBeat * owner.pixelsPerBeat);
                 g.fillRect(x1, 0.0f, x2 - x1, static_cast<float>(height));
             }
 
-            // Draw notes before piano keys to ensure they don't overlay
-            for (auto& note : owner.notes)
+            // Once notes are narrower than a pixel, the density level with
+            // about a column per pixel stands in for them
+            const int level = owner.density.chooseLevel(1.0 / ppb);
+            if (level >= 0)
+            {
+                paintDensity(g, area, level);
+                return;
+            }
+
+            // Only notes overlapping the area in time, and then in pitch
+            owner.forEachNoteBetween(firstBeat, lastBeat, [&](const Note& note)
             {
-                float x = keyWidth + static_cast<float>(note.startBeat * owner.pixelsPerBeat);
-                float w = static_cast<float>((note.endBeat - note.startBeat) * owner.pixelsPerBeat);
-                
                 // Use transposed note number for y-position
                 int transposedNote = note.getTransposedNoteNumber(owner.transposition);
                 float y = height - (transposedNote + 1) * owner.pixelsPerNote;
-                
+                if (y >= area.getBottom() || y + owner.pixelsPerNote <= area.getY())
+                    return;
+
+                float x = static_cast<float>(note.startBeat * owner.pixelsPerBeat);
+                float w = static_cast<float>((note.endBeat - note.startBeat) * owner.pixelsPerBeat);
+
                 // Calculate hue based on both note number and channel
                 float baseHue = static_cast<float>(note.channel) / 16.0f;  // Base hue from channel (0-1)
                 float noteHue = static_cast<float>(transposedNote) / 128.0f;  // Note variation (0-1)
                 float finalHue = std::fmod(baseHue + (noteHue * 0.2f), 1.0f);  // Combine with smaller note influence
-                
+
                 g.setColour(juce::Colour::fromHSV(finalHue, 0.7f, 0.9f, 1.0f));
-                
+
                 g.fillRect(x, y, w, static_cast<float>(owner.pixelsPerNote));
+            });
+        }
+
+        // One level of the density pyramid within area, each cell shaded by
+        // how many notes it holds
+        void paintDensity(juce::Graphics& g, juce::Rectangle<int> area, int level) const
+        {
+            const auto& density = owner.density;
+            const int height = owner.getContentHeight();
+            const double ppb = owner.pixelsPerBeat;
+            const double columnBeats = density.getBeatsPerColumn(level);
+            const float columnWidth = static_cast<float>(std::max(1.0, columnBeats * ppb));
+            const double firstBeat = area.getX() / ppb;
+            const double lastBeat = area.getRight() / ppb;
+            const int firstColumn = std::max(0, static_cast<int>(firstBeat / columnBeats));
+            const int lastColumn = std::min(density.getNumColumns(level) - 1, static_cast<int>(lastBeat / columnBeats));
+
+            // The keys whose rows cross area
+            const int lowestKey = std::max(0, (height - area.getBottom()) / owner.pixelsPerNote - 1);
+            const int highestKey = std::min(127, (height - area.getY()) / owner.pixelsPerNote);
+            for (int key = lowestKey; key <= highestKey; ++key)
+            {
+                const int row = key - owner.transposition;
+                if (row < 0 || row >= NoteDensityPyramid::numRows)
+                    continue;
+                const float y = static_cast<float>(height - (key + 1) * owner.pixelsPerNote);
+                const float noteHue = static_cast<float>(key) / 128.0f;
+
+                for (int column = firstColumn; column <= lastColumn; ++column)
+                {
+                    const auto& cell = density.getCell(level, column, row);
+                    if (cell.density == 0)
+                        continue;
+
+                    // The same hue as the notes, fainter where they're sparse
+                    const float hue = std::fmod(static_cast<float>(cell.channel) / 16.0f + noteHue * 0.2f, 1.0f);
+                    const float alpha = juce::jlimit(0.35f, 1.0f, cell.density / 256.0f);
+                    g.setColour(juce::Colour::fromHSV(hue, 0.7f, 0.9f, alpha));
+                    g.fillRect(static_cast<float>(column * columnBeats * ppb), y,
+                               columnWidth, static_cast<float>(owner.pixelsPerNote));
+                }
             }
+        }
+
+        // The piano keys, drawn as an overlay on the left
+        juce::Image renderKeys() const
+        {
+            auto height = owner.getContentHeight();
+            juce::Image image(juce::Image::ARGB, juce::roundToInt(keyWidth * cacheScale),
+                              std::max(1, juce::roundToInt(height * cacheScale)), true);
+            juce::Graphics g(image);
+            g.addTransform(juce::AffineTransform::scale(cacheScale));
 
-            // Draw piano keys as an overlay on the left
-            g.saveState();  // Save the current state to create a clipping region
-            g.reduceClipRegion(0, 0, static_cast<int>(keyWidth), height);  // Only draw keys in this region
-            
             for (int note = 0; note < 128; ++note)
             {
                 float y = height - (note + 1) * owner.pixelsPerNote;
                 bool isBlackKey = juce::MidiMessage::isMidiNoteBlack(note);
-                
+
                 // Draw white keys first
                 if (!isBlackKey)
                 {
@@ -328,45 +739,136 @@ private:
                     g.drawRect(0.0f, y, keyWidth, static_cast<float>(owner.pixelsPerNote));
                 }
             }
-            
+
             // Draw black keys on top
             for (int note = 0; note < 128; ++note)
             {
                 float y = height - (note + 1) * owner.pixelsPerNote;
                 bool isBlackKey = juce::MidiMessage::isMidiNoteBlack(note);
-                
+
                 if (isBlackKey)
                 {
                     g.setColour(juce::Colours::black);
                     g.fillRect(0.0f, y, keyWidth * 0.6f, static_cast<float>(owner.pixelsPerNote));
                 }
             }
-            g.restoreState();  // Restore the previous clipping region
-
-            // Draw playback position line
-            float playbackX = keyWidth + static_cast<float>(owner.currentBeatPosition * owner.pixelsPerBeat);
-            g.setColour(juce::Colours::white);
-            g.drawVerticalLine(static_cast<int>(playbackX), 0.0f, static_cast<float>(height));
+            return image;
         }
 
-    private:
         PianoRollComponent& owner;
+        std::map<juce::int64, Tile> tiles;  // keyed by column << 32 | row
+        juce::uint32 useCounter = 0;
+        juce::Image keysImage;
+        float cacheScale = 1.0f;
+        int playheadX = 0;
     };
 
+    static constexpr float keyWidth = 40.0f;
+    static constexpr double minPixelsPerBeat = 0.02;
+    static constexpr double maxPixelsPerBeat = 400.0;
+
+    // Beats between gridlines: every beat while they're at least 4 pixels
+    // apart, then every bar, 2 bars, 4 bars...
+    static int getGridStep(double pixelsPerBeat, int barLength)
+    {
+        if (pixelsPerBeat >= 4.0)
+            return 1;
+        int step = barLength;
+        while (step * pixelsPerBeat < 4.0)
+            step *= 2;
+        return step;
+    }
+
+    void uploadGLNotes()
+    {
+       #if JUCE_MODULE_AVAILABLE_juce_opengl
+        if (glRenderer == nullptr)
+            return;
+        std::vector<PianoRollGLRenderer::NoteInstance> instances;
+        instances.reserve(static_cast<size_t>(notes.size()));
+        for (const auto& note : notes)
+            instances.push_back({ static_cast<float>(note.startBeat), static_cast<float>(note.endBeat),
+                                  static_cast<float>(note.noteNumber), static_cast<float>(note.channel) });
+        glRenderer->setNotes(std::move(instances));
+       #endif
+    }
+
+    // Hands the renderer what the next frame should show
+    void updateGLView()
+    {
+       #if JUCE_MODULE_AVAILABLE_juce_opengl
+        if (glRenderer == nullptr)
+            return;
+        PianoRollGLRenderer::View view;
+        view.scrollX = static_cast<float>(scrollX);
+        view.scrollY = static_cast<float>(scrollY);
+        view.width = static_cast<float>(contentComponent.getWidth());
+        view.height = static_cast<float>(contentComponent.getHeight());
+        view.componentHeight = static_cast<float>(getHeight());
+        view.pixelsPerBeat = static_cast<float>(pixelsPerBeat);
+        view.pixelsPerNote = static_cast<float>(pixelsPerNote);
+        view.contentHeight = static_cast<float>(getContentHeight());
+        view.keyWidth = keyWidth;
+        view.transposition = transposition;
+        view.playheadBeat = currentBeatPosition;
+        view.numBeats = numBeats;
+        view.beatsPerBar = static_cast<int>(beatsPerBar);
+        view.gridStep = getGridStep(pixelsPerBeat, std::max(1, view.beatsPerBar));
+        view.looping = isLooping;
+        view.loopStartBeat = loopStartBeat;
+        view.loopEndBeat = loopEndBeat;
+
+        // The same culling as the tiles: notes are sorted by start
+        const double firstBeat = scrollX / pixelsPerBeat;
+        const double lastBeat = (scrollX + getVisibleNoteWidth()) / pixelsPerBeat;
+        const auto first = std::upper_bound(latestEndBeat.begin(), latestEndBeat.end(), firstBeat);
+        view.firstNote = static_cast<int>(first - latestEndBeat.begin());
+        view.endNote = static_cast<int>(std::partition_point(notes.begin() + view.firstNote, notes.end(),
+                                                             [lastBeat](const Note& note)
+                                                             {
+                                                                 return note.startBeat < lastBeat;
+                                                             }) - notes.begin());
+        glRenderer->setView(view);
+       #endif
+    }
+
+    // The size of the whole roll at the current zoom, past the keys
+    int getContentWidth() const { return static_cast<int>(std::ceil(numBeats * pixelsPerBeat)); }
+    int getContentHeight() const { return 128 * pixelsPerNote; }  // 128 MIDI notes
+    int getVisibleNoteWidth() const { return std::max(0, contentComponent.getWidth() - static_cast<int>(keyWidth)); }
+    int getMaxScrollX() const { return getContentWidth() - getVisibleNoteWidth(); }
+
+    // Fits the scrollbars and scroll position to the content and canvas
+    // sizes; no component is resized with the content.
     void updateContentSize()
     {
-        int width = numBeats * pixelsPerBeat;
-        int height = 128 * pixelsPerNote;  // 128 MIDI notes
-        contentComponent.setSize(width, height);
+        horizontalScrollBar.setRangeLimits(0.0, std::max(getContentWidth(), getVisibleNoteWidth()), juce::dontSendNotification);
+        verticalScrollBar.setRangeLimits(0.0, std::max(getContentHeight(), contentComponent.getHeight()), juce::dontSendNotification);
+        horizontalScrollBar.setCurrentRange(scrollX, getVisibleNoteWidth(), juce::dontSendNotification);
+        verticalScrollBar.setCurrentRange(scrollY, contentComponent.getHeight(), juce::dontSendNotification);
+        setScrollPosition(scrollX, scrollY);
+        contentComponent.scrolled();
+    }
+
+    // Wheel or scrollbar movement holds off auto-scrolling for a second
+    void userScrolled()
+    {
+        isManuallyScrolling = true;
+        stopTimer(); // Stop any existing timer
+        startTimer(1000); // Start 1 second timeout
     }
 
-    juce::Viewport viewport;
     ContentComponent contentComponent { *this };
+    juce::ScrollBar horizontalScrollBar { false };
+    juce::ScrollBar verticalScrollBar { true };
+    int scrollX = 0, scrollY = 0;  // content pixels at the canvas's top left, past the keys
     juce::Array<Note> notes;
+    std::vector<double> latestEndBeat;  // see Geometry
     
-    int pixelsPerBeat;
+    double pixelsPerBeat;
     int pixelsPerNote;
     int numBeats;
+    NoteDensityPyramid density;  // see Geometry
     
     double loopStartBeat;
     double loopEndBeat;
@@ -384,8 +886,11 @@ private:
     float currentScrollX = 0.0f;
     static constexpr float scrollAnimationSpeed = 0.3f; // Lower = smoother but slower
 
-    bool isAutoScrolling = false;
     bool isManuallyScrolling = false;
 
+   #if JUCE_MODULE_AVAILABLE_juce_opengl
+    std::unique_ptr<PianoRollGLRenderer> glRenderer;
+   #endif
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PianoRollComponent)
 };
\ No newline at end of file
@@ -0,0 +1,287 @@
+#include "PianoRollGLRenderer.h"
+
+#if JUCE_MODULE_AVAILABLE_juce_opengl
+
+#include <cstddef>
+
+using namespace juce::gl;
+
+namespace {
+
+// Both shaders work in the visible area's logical pixels, y down, and place
+// a unit quad's corners; positionFor() maps that to clip space.
+const char *const positionFor =
+    "uniform vec2 viewSize;\n"
+    "vec4 positionFor(vec2 p)\n"
+    "{\n"
+    "    return vec4(p.x / viewSize.x * 2.0 - 1.0, 1.0 - p.y / viewSize.y * 2.0, 0.0, 1.0);\n"
+    "}\n";
+
+// Matches PianoRollComponent's software painting: the hue comes from the
+// channel, nudged by the (transposed) key.
+const char *const noteVertexShader =
+    "attribute vec2 corner;\n"
+    "attribute vec4 note;\n" // startBeat, endBeat, noteNumber, channel
+    "uniform vec2 scroll;\n"
+    "uniform vec2 noteScale;\n" // pixels per beat, pixels per note
+    "uniform float contentHeight;\n"
+    "uniform float keyWidth;\n"
+    "uniform float transposition;\n"
+    "varying vec4 colour;\n"
+    "vec3 hsv(float h, float s, float v)\n"
+    "{\n"
+    "    vec3 k = clamp(abs(mod(h * 6.0 + vec3(0.0, 4.0, 2.0), 6.0) - 3.0) - 1.0, 0.0, 1.0);\n"
+    "    return v * mix(vec3(1.0), k, s);\n"
+    "}\n"
+    "void main()\n"
+    "{\n"
+    "    float key = clamp(note.z + transposition, 0.0, 127.0);\n"
+    "    vec2 origin = vec2(keyWidth + note.x * noteScale.x,\n"
+    "                       contentHeight - (key + 1.0) * noteScale.y) - scroll;\n"
+    "    vec2 size = vec2((note.y - note.x) * noteScale.x, noteScale.y);\n"
+    "    gl_Position = positionFor(origin + corner * size);\n"
+    "    colour = vec4(hsv(fract(note.w / 16.0 + key / 128.0 * 0.2), 0.7, 0.9), 1.0);\n"
+    "}\n";
+
+const char *const rectVertexShader =
+    "attribute vec2 corner;\n"
+    "attribute vec4 rect;\n"
+    "attribute vec4 rectColour;\n"
+    "varying vec4 colour;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_Position = positionFor(rect.xy + corner * rect.zw);\n"
+    "    colour = rectColour;\n"
+    "}\n";
+
+const char *const fragmentShader =
+    "varying " JUCE_MEDIUMP " vec4 colour;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_FragColor = colour;\n"
+    "}\n";
+
+std::unique_ptr<juce::OpenGLShaderProgram>
+compileShader(juce::OpenGLContext &context, const char *vertexShader) {
+  auto program = std::make_unique<juce::OpenGLShaderProgram>(context);
+  if (!program->addVertexShader(juce::OpenGLHelpers::translateVertexShaderToV3(
+          juce::String(positionFor) + vertexShader)) ||
+      !program->addFragmentShader(juce::OpenGLHelpers::translateFragmentShaderToV3(fragmentShader)) ||
+      !program->link()) {
+    DBG("Piano roll shader: " + program->getLastError());
+    return nullptr;
+  }
+  return program;
+}
+
+// Points the named attribute at one member of an instance buffer, advancing
+// once per instance
+void setInstanceAttribute(juce::OpenGLShaderProgram &program, const char *name,
+                          GLsizei stride, size_t offset) {
+  const GLint location = glGetAttribLocation(program.getProgramID(), name);
+  if (location < 0)
+    return;
+  glEnableVertexAttribArray(static_cast<GLuint>(location));
+  glVertexAttribPointer(static_cast<GLuint>(location), 4, GL_FLOAT, GL_FALSE, stride,
+                        reinterpret_cast<const void *>(offset));
+  glVertexAttribDivisor(static_cast<GLuint>(location), 1);
+}
+
+} // namespace
+
+PianoRollGLRenderer::PianoRollGLRenderer() {
+  context.setRenderer(this);
+  context.setOpenGLVersionRequired(juce::OpenGLContext::openGL3_2);
+  context.setComponentPaintingEnabled(true);
+  context.setContinuousRepainting(false);
+}
+
+PianoRollGLRenderer::~PianoRollGLRenderer() { detach(); }
+
+void PianoRollGLRenderer::attachTo(juce::Component &component) {
+  context.attachTo(component);
+}
+
+void PianoRollGLRenderer::detach() { context.detach(); }
+
+void PianoRollGLRenderer::setNotes(std::vector<NoteInstance> &&notes) {
+  {
+    const juce::SpinLock::ScopedLockType sl(lock);
+    pendingNotes = std::move(notes);
+    notesChanged = true;
+  }
+  context.triggerRepaint();
+}
+
+void PianoRollGLRenderer::setView(const View &view) {
+  {
+    const juce::SpinLock::ScopedLockType sl(lock);
+    pendingView = view;
+  }
+  context.triggerRepaint();
+}
+
+void PianoRollGLRenderer::newOpenGLContextCreated() {
+  noteShader = compileShader(context, noteVertexShader);
+  rectShader = compileShader(context, rectVertexShader);
+
+  glGenVertexArrays(1, &vertexArray);
+  glGenBuffers(1, &quadBuffer);
+  glGenBuffers(1, &noteBuffer);
+  glGenBuffers(1, &rectBuffer);
+
+  const GLfloat corners[] = {0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f};
+  glBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+
+  // A new context has none of the old one's buffers
+  const juce::SpinLock::ScopedLockType sl(lock);
+  notesChanged = true;
+  numNotes = 0;
+}
+
+void PianoRollGLRenderer::openGLContextClosing() {
+  glDeleteBuffers(1, &quadBuffer);
+  glDeleteBuffers(1, &noteBuffer);
+  glDeleteBuffers(1, &rectBuffer);
+  glDeleteVertexArrays(1, &vertexArray);
+  quadBuffer = noteBuffer = rectBuffer = vertexArray = 0;
+  noteShader = nullptr;
+  rectShader = nullptr;
+}
+
+void PianoRollGLRenderer::renderOpenGL() {
+  View view;
+  {
+    const juce::SpinLock::ScopedLockType sl(lock);
+    view = pendingView;
+    if (notesChanged) {
+      // Only when a file is loaded; the message thread waits at most once
+      glBindBuffer(GL_ARRAY_BUFFER, noteBuffer);
+      glBufferData(GL_ARRAY_BUFFER,
+                   static_cast<GLsizeiptr>(pendingNotes.size() * sizeof(NoteInstance)),
+                   pendingNotes.data(), GL_STATIC_DRAW);
+      numNotes = static_cast<GLsizei>(pendingNotes.size());
+      notesChanged = false;
+    }
+  }
+
+  juce::OpenGLHelpers::clear(juce::Colours::darkgrey);
+  if (noteShader == nullptr || rectShader == nullptr || view.width <= 0.0f || view.height <= 0.0f)
+    return;
+
+  // Only the viewport's visible area; GL counts up from the bottom
+  const auto scale = static_cast<float>(context.getRenderingScale());
+  glViewport(0, juce::roundToInt((view.componentHeight - view.height) * scale),
+             juce::roundToInt(view.width * scale), juce::roundToInt(view.height * scale));
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glBindVertexArray(vertexArray);
+
+  buildRects(view, background, foreground);
+  drawRects(background, view);
+
+  // Only the run of notes the piano roll found overlapping the view
+  const GLsizei first = juce::jlimit(0, static_cast<GLsizei>(numNotes), view.firstNote);
+  const GLsizei count = juce::jlimit(0, static_cast<GLsizei>(numNotes) - first, view.endNote - first);
+  if (count > 0) {
+    noteShader->use();
+    noteShader->setUniform("viewSize", view.width, view.height);
+    noteShader->setUniform("scroll", view.scrollX, view.scrollY);
+    noteShader->setUniform("noteScale", view.pixelsPerBeat, view.pixelsPerNote);
+    noteShader->setUniform("contentHeight", view.contentHeight);
+    noteShader->setUniform("keyWidth", view.keyWidth);
+    noteShader->setUniform("transposition", static_cast<GLfloat>(view.transposition));
+
+    glBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+    const GLint corner = glGetAttribLocation(noteShader->getProgramID(), "corner");
+    glEnableVertexAttribArray(static_cast<GLuint>(corner));
+    glVertexAttribPointer(static_cast<GLuint>(corner), 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glVertexAttribDivisor(static_cast<GLuint>(corner), 0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, noteBuffer);
+    setInstanceAttribute(*noteShader, "note", sizeof(NoteInstance),
+                         static_cast<size_t>(first) * sizeof(NoteInstance));
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+  }
+
+  drawRects(foreground, view);
+  glBindVertexArray(0);
+}
+
+void PianoRollGLRenderer::buildRects(const View &view,
+                                     std::vector<RectInstance> &behind,
+                                     std::vector<RectInstance> &inFront) const {
+  behind.clear();
+  inFront.clear();
+  auto add = [](std::vector<RectInstance> &rects, float x, float y, float w, float h,
+                juce::Colour colour) {
+    rects.push_back({x, y, w, h, colour.getFloatRed(), colour.getFloatGreen(),
+                     colour.getFloatBlue(), colour.getFloatAlpha()});
+  };
+  const float top = -view.scrollY;
+  auto beatToX = [&](double beat) {
+    return view.keyWidth + static_cast<float>(beat * view.pixelsPerBeat) - view.scrollX;
+  };
+
+  add(behind, 0.0f, 0.0f, view.width, view.height, juce::Colours::black);
+
+  // Beat and bar lines across the visible beats
+  const int step = juce::jmax(1, view.gridStep);
+  const int firstBeat = juce::jmax(0, static_cast<int>(std::floor((view.scrollX - view.keyWidth) / view.pixelsPerBeat / step))) * step;
+  const int lastBeat = juce::jmin(view.numBeats, static_cast<int>(std::ceil((view.scrollX + view.width - view.keyWidth) / view.pixelsPerBeat)));
+  const int barLength = juce::jmax(1, view.beatsPerBar);
+  for (int beat = firstBeat; beat <= lastBeat; beat += step)
+    add(behind, std::floor(beatToX(beat)), top, 1.0f, view.contentHeight,
+        beat % barLength == 0 ? juce::Colours::grey : juce::Colours::darkgrey.darker());
+
+  if (view.looping) {
+    const float x1 = beatToX(view.loopStartBeat);
+    add(behind, x1, top, beatToX(view.loopEndBeat) - x1, view.contentHeight,
+        juce::Colours::yellow.withAlpha(0.3f));
+  }
+
+  add(inFront, std::floor(beatToX(view.playheadBeat)), top, 1.0f, view.contentHeight,
+      juce::Colours::white);
+
+  // The keys stay on the left, as they do when painted
+  add(inFront, 0.0f, 0.0f, view.keyWidth, view.height, juce::Colours::darkgrey);
+  for (int note = 0; note < 128; ++note) {
+    const float y = top + view.contentHeight - (note + 1) * view.pixelsPerNote;
+    if (!juce::MidiMessage::isMidiNoteBlack(note)) {
+      // White with a one-pixel outline
+      add(inFront, 0.0f, y, view.keyWidth, view.pixelsPerNote, juce::Colours::black);
+      add(inFront, 1.0f, y + 1.0f, view.keyWidth - 2.0f, view.pixelsPerNote - 2.0f,
+          juce::Colours::white);
+    }
+  }
+  for (int note = 0; note < 128; ++note) {
+    const float y = top + view.contentHeight - (note + 1) * view.pixelsPerNote;
+    if (juce::MidiMessage::isMidiNoteBlack(note))
+      add(inFront, 0.0f, y, view.keyWidth * 0.6f, view.pixelsPerNote, juce::Colours::black);
+  }
+}
+
+void PianoRollGLRenderer::drawRects(const std::vector<RectInstance> &rects,
+                                    const View &view) {
+  if (rects.empty())
+    return;
+
+  rectShader->use();
+  rectShader->setUniform("viewSize", view.width, view.height);
+
+  glBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+  const GLint corner = glGetAttribLocation(rectShader->getProgramID(), "corner");
+  glEnableVertexAttribArray(static_cast<GLuint>(corner));
+  glVertexAttribPointer(static_cast<GLuint>(corner), 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+  glVertexAttribDivisor(static_cast<GLuint>(corner), 0);
+
+  glBindBuffer(GL_ARRAY_BUFFER, rectBuffer);
+  glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(rects.size() * sizeof(RectInstance)),
+               rects.data(), GL_STREAM_DRAW);
+  setInstanceAttribute(*rectShader, "rect", sizeof(RectInstance), offsetof(RectInstance, x));
+  setInstanceAttribute(*rectShader, "rectColour", sizeof(RectInstance), offsetof(RectInstance, r));
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(rects.size()));
+}
+
+#endif
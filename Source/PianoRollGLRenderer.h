@@ -0,0 +1,84 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#if JUCE_MODULE_AVAILABLE_juce_opengl
+
+#include <vector>
+
+// Draws the piano roll with OpenGL. Every note is uploaded once to a vertex
+// buffer and drawn in a single instanced call, placed by the vertex shader
+// from its beat and key, so scrolling, zooming and the playhead only change
+// uniforms. The grid, loop region, keys and playhead are a few hundred
+// rectangles rebuilt each frame. Attach it to the component whose area it
+// should fill; that component's own painting is drawn over the top.
+class PianoRollGLRenderer : private juce::OpenGLRenderer {
+public:
+  // One note as the GPU sees it
+  struct NoteInstance {
+    float startBeat, endBeat;
+    float noteNumber;
+    float channel; // 0-15
+  };
+
+  // Everything a frame needs from the piano roll, in logical pixels
+  struct View {
+    float scrollX = 0.0f, scrollY = 0.0f;  // content pixels at the top left
+    float width = 0.0f, height = 0.0f;     // the canvas, keys included
+    float componentHeight = 0.0f;          // of the attached component
+    float pixelsPerBeat = 50.0f, pixelsPerNote = 10.0f;
+    float contentHeight = 1280.0f;
+    float keyWidth = 40.0f;
+    int transposition = 0;
+    double playheadBeat = 0.0;
+    int numBeats = 16;
+    int beatsPerBar = 4;
+    int gridStep = 1; // beats between gridlines
+    bool looping = false;
+    double loopStartBeat = 0.0, loopEndBeat = 0.0;
+    // The notes, in setNotes() order, that overlap the visible beats
+    int firstNote = 0, endNote = 0;
+  };
+
+  PianoRollGLRenderer();
+  ~PianoRollGLRenderer() override;
+
+  void attachTo(juce::Component &component);
+  void detach();
+
+  // Message thread. The notes are uploaded on the next frame.
+  void setNotes(std::vector<NoteInstance> &&notes);
+  void setView(const View &view);
+
+private:
+  struct RectInstance {
+    float x, y, w, h;
+    float r, g, b, a;
+  };
+
+  void newOpenGLContextCreated() override;
+  void renderOpenGL() override;
+  void openGLContextClosing() override;
+
+  void buildRects(const View &view, std::vector<RectInstance> &background,
+                  std::vector<RectInstance> &foreground) const;
+  void drawRects(const std::vector<RectInstance> &rects, const View &view);
+
+  juce::OpenGLContext context;
+
+  // Handed over from the message thread under lock
+  juce::SpinLock lock;
+  View pendingView;
+  std::vector<NoteInstance> pendingNotes;
+  bool notesChanged = false;
+
+  // GL thread only
+  std::unique_ptr<juce::OpenGLShaderProgram> noteShader, rectShader;
+  GLuint vertexArray = 0, quadBuffer = 0, noteBuffer = 0, rectBuffer = 0;
+  GLsizei numNotes = 0;
+  std::vector<RectInstance> background, foreground;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PianoRollGLRenderer)
+};
+
+#endif
@@ -0,0 +1,238 @@
+#include "SmfReader.h"
+
+#include <queue>
+
+namespace {
+
+juce::uint32 readBigEndian(const juce::uint8 *p, int numBytes) {
+  juce::uint32 value = 0;
+  for (int i = 0; i < numBytes; ++i)
+    value = (value << 8) | p[i];
+  return value;
+}
+
+// A variable-length quantity; false if it runs off the end
+bool readVariableLength(const juce::uint8 *&p, const juce::uint8 *end,
+                        juce::uint32 &value) {
+  value = 0;
+  for (int i = 0; i < 4; ++i) {
+    if (p >= end)
+      return false;
+    const juce::uint8 byte = *p++;
+    value = (value << 7) | (byte & 0x7f);
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+struct DecodedTrack {
+  std::vector<PackedMidiFile::Event> events;
+  std::vector<PackedMidiFile::TempoChange> tempos;
+  juce::uint32 lastTick = 0;
+  bool hasTimeSignature = false;
+  juce::uint32 timeSignatureTick = 0;
+  juce::uint8 timeSignature[4] = {};
+};
+
+void decodeTrack(const juce::uint8 *p, const juce::uint8 *end,
+                 DecodedTrack &track) {
+  // Roughly three bytes an event in dense tracks
+  track.events.reserve(static_cast<size_t>(end - p) / 3);
+
+  juce::uint64 tick = 0;
+  juce::uint8 runningStatus = 0;
+  while (p < end) {
+    juce::uint32 delta;
+    if (!readVariableLength(p, end, delta) || p >= end)
+      break;
+    tick += delta;
+    const auto eventTick = static_cast<juce::uint32>(
+        juce::jmin<juce::uint64>(tick, std::numeric_limits<juce::uint32>::max()));
+    track.lastTick = eventTick;
+
+    juce::uint8 status = *p;
+    if (status >= 0x80) {
+      ++p;
+    } else if (runningStatus != 0) {
+      status = runningStatus; // running status: this byte is data
+    } else {
+      ++p; // stray data byte; skip it
+      continue;
+    }
+
+    if (status == 0xff) {
+      // Meta event
+      if (p >= end)
+        break;
+      const juce::uint8 type = *p++;
+      juce::uint32 length;
+      if (!readVariableLength(p, end, length) ||
+          length > static_cast<juce::uint32>(end - p))
+        break;
+      if (type == 0x51 && length == 3) {
+        track.tempos.push_back({eventTick, readBigEndian(p, 3)});
+      } else if (type == 0x58 && length == 4 && !track.hasTimeSignature) {
+        track.hasTimeSignature = true;
+        track.timeSignatureTick = eventTick;
+        std::copy(p, p + 4, track.timeSignature);
+      } else if (type == 0x2f) {
+        break; // end of track
+      }
+      p += length;
+      runningStatus = 0;
+    } else if (status == 0xf0 || status == 0xf7) {
+      // Sysex, which never reaches the synth
+      juce::uint32 length;
+      if (!readVariableLength(p, end, length) ||
+          length > static_cast<juce::uint32>(end - p))
+        break;
+      p += length;
+      runningStatus = 0;
+    } else if (status >= 0xf0) {
+      // System common messages have no place in a file; skip the byte
+      runningStatus = 0;
+    } else {
+      const int numDataBytes = ((status & 0xf0) == 0xc0 || (status & 0xf0) == 0xd0) ? 1 : 2;
+      if (end - p < numDataBytes)
+        break;
+      PackedMidiFile::Event event;
+      event.tick = eventTick;
+      event.status = status;
+      event.data1 = p[0] & 0x7f;
+      event.data2 = numDataBytes > 1 ? (p[1] & 0x7f) : 0;
+      event.size = static_cast<juce::uint8>(numDataBytes + 1);
+      track.events.push_back(event);
+      p += numDataBytes;
+      runningStatus = status;
+    }
+  }
+}
+
+} // namespace
+
+std::shared_ptr<PackedMidiFile> SmfReader::read(const void *data, size_t size,
+                                                juce::String &errorMessage,
+                                                std::atomic<double> *progress,
+                                                juce::Thread *thread) {
+  const auto *bytes = static_cast<const juce::uint8 *>(data);
+  const auto *end = bytes + size;
+  if (size < 14 || std::memcmp(bytes, "MThd", 4) != 0 || readBigEndian(bytes + 4, 4) < 6) {
+    errorMessage = "Not a MIDI file";
+    return nullptr;
+  }
+
+  auto file = std::make_shared<PackedMidiFile>();
+  const int numTracksDeclared = static_cast<int>(readBigEndian(bytes + 10, 2));
+  const int division = static_cast<int>(readBigEndian(bytes + 12, 2));
+  // The top bit set means SMPTE timing, which we don't support.
+  file->ppq = (division & 0x8000) == 0 && division > 0 ? division : 480;
+
+  // Decode each track chunk on its own
+  std::vector<DecodedTrack> tracks;
+  tracks.reserve(static_cast<size_t>(numTracksDeclared));
+  const auto *p = bytes + 8 + readBigEndian(bytes + 4, 4);
+  while (end - p >= 8) {
+    const juce::uint32 length = readBigEndian(p + 4, 4);
+    const auto *chunk = p + 8;
+    const auto *chunkEnd = length <= static_cast<juce::uint32>(end - chunk) ? chunk + length : end;
+    if (std::memcmp(p, "MTrk", 4) == 0) {
+      tracks.emplace_back();
+      decodeTrack(chunk, chunkEnd, tracks.back());
+      if (progress != nullptr)
+        progress->store(0.8 * static_cast<double>(chunkEnd - bytes) / static_cast<double>(size));
+      if (thread != nullptr && thread->threadShouldExit())
+        return nullptr;
+    }
+    p = chunkEnd;
+  }
+  if (tracks.empty()) {
+    errorMessage = "No tracks found in MIDI file";
+    return nullptr;
+  }
+
+  // K-way merge by tick; on a tie the earlier track goes first, and each
+  // track keeps its own order, as when JUCE merges tracks into a sequence.
+  size_t totalEvents = 0;
+  for (const auto &track : tracks)
+    totalEvents += track.events.size();
+  file->events.reserve(totalEvents);
+
+  using Head = std::pair<juce::uint32, size_t>; // next tick, track index
+  std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+  std::vector<size_t> cursors(tracks.size(), 0);
+  for (size_t i = 0; i < tracks.size(); ++i)
+    if (!tracks[i].events.empty())
+      heads.push({tracks[i].events.front().tick, i});
+  while (!heads.empty()) {
+    const size_t i = heads.top().second;
+    heads.pop();
+    const auto &events = tracks[i].events;
+    // Take the run of this track's events that still come first
+    size_t &cursor = cursors[i];
+    if (heads.empty()) {
+      file->events.insert(file->events.end(), events.begin() + static_cast<std::ptrdiff_t>(cursor),
+                          events.end());
+      break;
+    }
+    const Head next = heads.top();
+    do {
+      file->events.push_back(events[cursor++]);
+    } while (cursor < events.size() && Head(events[cursor].tick, i) < next);
+    if (cursor < events.size())
+      heads.push({events[cursor].tick, i});
+  }
+  if (progress != nullptr)
+    progress->store(0.9);
+
+  // Tempo changes from every track, and the earliest time signature
+  const DecodedTrack *timeSignatureTrack = nullptr;
+  for (auto &track : tracks) {
+    file->tempos.insert(file->tempos.end(), track.tempos.begin(), track.tempos.end());
+    file->lastTick = juce::jmax(file->lastTick, track.lastTick);
+    if (track.hasTimeSignature &&
+        (timeSignatureTrack == nullptr || track.timeSignatureTick < timeSignatureTrack->timeSignatureTick))
+      timeSignatureTrack = &track;
+  }
+  std::stable_sort(file->tempos.begin(), file->tempos.end(),
+                   [](const PackedMidiFile::TempoChange &a, const PackedMidiFile::TempoChange &b) {
+                     return a.tick < b.tick;
+                   });
+  file->tempos.erase(std::remove_if(file->tempos.begin(), file->tempos.end(),
+                                    [](const PackedMidiFile::TempoChange &change) {
+                                      return change.microsPerQuarter == 0;
+                                    }),
+                     file->tempos.end());
+  if (timeSignatureTrack != nullptr) {
+    file->timeSignatureNumerator = timeSignatureTrack->timeSignature[0];
+    file->timeSignatureDenominator = 1 << juce::jmin(7, static_cast<int>(timeSignatureTrack->timeSignature[1]));
+    file->clocksPerClick = timeSignatureTrack->timeSignature[2];
+    file->thirtySecondPer24Clocks = timeSignatureTrack->timeSignature[3];
+  }
+
+  if (progress != nullptr)
+    progress->store(1.0);
+  return file;
+}
+
+std::shared_ptr<PackedMidiFile> SmfReader::readFile(const juce::File &midiFile,
+                                                    juce::String &errorMessage,
+                                                    std::atomic<double> *progress,
+                                                    juce::Thread *thread) {
+  juce::MemoryMappedFile mapped(midiFile, juce::MemoryMappedFile::readOnly);
+  if (mapped.getData() == nullptr) {
+    errorMessage = "Couldn't read " + midiFile.getFullPathName();
+    return nullptr;
+  }
+  return read(mapped.getData(), mapped.getSize(), errorMessage, progress, thread);
+}
+
+std::shared_ptr<PackedMidiFile> SmfReader::readStream(juce::InputStream &stream,
+                                                      juce::String &errorMessage,
+                                                      std::atomic<double> *progress,
+                                                      juce::Thread *thread) {
+  // Streams from URLs and content providers can't be mapped; read them whole.
+  juce::MemoryBlock block;
+  stream.readIntoMemoryBlock(block);
+  return read(block.getData(), block.getSize(), errorMessage, progress, thread);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <vector>
+
+// A Standard MIDI File decoded straight into flat arrays: every track's
+// channel events merged into one time-ordered list of 8-byte records, plus
+// the tempo map. Black MIDI files with millions of notes stay a few bytes per
+// event, where juce::MidiMessageSequence spends a heap object on each.
+struct PackedMidiFile {
+  struct Event {
+    juce::uint32 tick;
+    juce::uint8 status; // channel voice status, channel in the low nibble
+    juce::uint8 data1, data2;
+    juce::uint8 size; // bytes used (2 for program change and channel pressure)
+
+    int getChannel() const { return (status & 0x0f) + 1; }
+    bool isNoteOn() const { return (status & 0xf0) == 0x90 && data2 > 0; }
+    // Note-ons with zero velocity count as note-offs, as in JUCE
+    bool isNoteOff() const {
+      return (status & 0xf0) == 0x80 || ((status & 0xf0) == 0x90 && data2 == 0);
+    }
+    bool isProgramChange() const { return (status & 0xf0) == 0xc0; }
+  };
+
+  struct TempoChange {
+    juce::uint32 tick;
+    juce::uint32 microsPerQuarter;
+  };
+
+  std::vector<Event> events;        // merged; ties keep track order
+  std::vector<TempoChange> tempos;  // sorted by tick; may be empty
+  int ppq = 480;
+  juce::uint32 lastTick = 0;        // the last event of any kind, end of track included
+
+  // The first time signature, if any
+  int timeSignatureNumerator = 4;
+  int timeSignatureDenominator = 4;
+  int clocksPerClick = 24;
+  int thirtySecondPer24Clocks = 8;
+};
+
+// Decodes SMF data into a PackedMidiFile: running status, meta and sysex
+// events are handled, and the tracks are k-way merged by tick. Files are
+// memory-mapped rather than read.
+class SmfReader {
+public:
+  // Each read fills in errorMessage and returns nullptr on failure. Progress
+  // (0-1) is stored as tracks are decoded; a reader running on a thread
+  // returns nullptr early once threadShouldExit() is set.
+  static std::shared_ptr<PackedMidiFile> read(const void *data, size_t size,
+                                              juce::String &errorMessage,
+                                              std::atomic<double> *progress = nullptr,
+                                              juce::Thread *thread = nullptr);
+  static std::shared_ptr<PackedMidiFile> readFile(const juce::File &file,
+                                                  juce::String &errorMessage,
+                                                  std::atomic<double> *progress = nullptr,
+                                                  juce::Thread *thread = nullptr);
+  static std::shared_ptr<PackedMidiFile> readStream(juce::InputStream &stream,
+                                                    juce::String &errorMessage,
+                                                    std::atomic<double> *progress = nullptr,
+                                                    juce::Thread *thread = nullptr);
+};
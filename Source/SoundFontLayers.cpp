@@ -0,0 +1,131 @@
+#include "SoundFontLayers.h"
+
+SoundFontLayers::SoundFontLayers(sfzero::Synth &synthIn,
+                                 const juce::File &regionCacheDirectoryIn)
+    : juce::Thread("SoundFont Layers"), synth(synthIn),
+      regionCacheDirectory(regionCacheDirectoryIn) {}
+
+SoundFontLayers::~SoundFontLayers() { stopThread(10000); }
+
+bool SoundFontLayers::addLayer(const juce::File &file, juce::uint16 channels, int bank) {
+  const int index = numLayers.load();
+  if (index >= maxLayers || !file.existsAsFile())
+    return false;
+
+  Layer &layer = layers[static_cast<size_t>(index)];
+  layer.file = file;
+  layer.channels = channels;
+  layer.bank = juce::jlimit(-1, 128, bank);
+  layer.wanted.store(true);
+  numLayers.store(index + 1);
+
+  if (!isThreadRunning())
+    startThread(juce::Thread::Priority::low);
+  notify();
+  return true;
+}
+
+bool SoundFontLayers::resolve(int midiChannel, int bank, int program,
+                              int &synthLayer, int &subsound) {
+  if (midiChannel < 1 || midiChannel > 16 || program < 0 || program > 127)
+    return false;
+
+  for (int i = numLayers.load(); --i >= 0;) {
+    Layer &layer = layers[static_cast<size_t>(i)];
+    if ((layer.channels & (1 << (midiChannel - 1))) == 0 ||
+        (layer.bank >= 0 && layer.bank != bank))
+      continue;
+    if (!layer.loaded.load()) {
+      if (!layer.wanted.exchange(true))
+        notify();
+      continue;
+    }
+    const int index = layer.presets[static_cast<size_t>(juce::jlimit(0, 128, bank))]
+                                   [static_cast<size_t>(program)];
+    if (index >= 0) {
+      synthLayer = i + 1;
+      subsound = index;
+      return true;
+    }
+  }
+  return false;
+}
+
+void SoundFontLayers::run() {
+  while (!threadShouldExit()) {
+    const int count = numLayers.load();
+    for (int i = 0; i < count && !threadShouldExit(); ++i) {
+      const Layer &layer = layers[static_cast<size_t>(i)];
+      if (layer.wanted.load() && !layer.loaded.load())
+        load(i);
+      else if (layer.sound != nullptr)
+        layer.sound->loadRequestedSamples(this);
+    }
+    evictIdleLayers();
+    wait(idleCheckMs);
+  }
+}
+
+void SoundFontLayers::load(int index) {
+  Layer &layer = layers[static_cast<size_t>(index)];
+  juce::ReferenceCountedObjectPtr<sfzero::SF2Sound> sound = new sfzero::SF2Sound(layer.file);
+  sound->setRegionCacheDirectory(regionCacheDirectory);
+  sound->setPagedSamples(pagedSamples.load());
+  sound->setSampleFormat(sampleFormat.load());
+  sound->loadRegions();
+  if (sound->numSubsounds() == 0) {
+    DBG("No presets in " + layer.file.getFullPathName());
+    layer.wanted.store(false);
+    return;
+  }
+
+  for (auto &bank : layer.presets)
+    bank.fill(-1);
+  const auto &presets = sound->getPresets();
+  for (int i = presets.size(); --i >= 0;) {
+    const auto *preset = presets.getUnchecked(i);
+    if (juce::isPositiveAndNotGreaterThan(preset->bank, 128) &&
+        juce::isPositiveAndBelow(preset->preset, 128))
+      layer.presets[static_cast<size_t>(preset->bank)][static_cast<size_t>(preset->preset)] =
+          static_cast<juce::int16>(i);
+  }
+
+  // All of it before any channel can select it, unless it's paged, when
+  // only what the channels ask for is read from here on; a font dropped and
+  // loaded again takes its samples from the pool if they're still there
+  sound->loadSamples(nullptr, nullptr, this);
+  if (threadShouldExit())
+    return;
+
+  layer.sound = sound;
+  layer.idleSinceMs = juce::Time::getMillisecondCounterHiRes();
+  synth.setLayerSound(index + 1, sound.get());
+  layer.loaded.store(true);
+  loadedSinceChecked.store(true);
+  DBG("Layered " + layer.file.getFileName());
+}
+
+void SoundFontLayers::evictIdleLayers() {
+  const double now = juce::Time::getMillisecondCounterHiRes();
+  bool released = false;
+  for (int i = 0; i < numLayers.load(); ++i) {
+    Layer &layer = layers[static_cast<size_t>(i)];
+    if (layer.loaded.load()) {
+      if (synth.isLayerInUse(i + 1)) {
+        layer.idleSinceMs = now;
+      } else if (now - layer.idleSinceMs > evictAfterSeconds * 1000.0 &&
+                 synth.clearLayerIfUnused(i + 1)) {
+        layer.loaded.store(false);
+        layer.wanted.store(false);
+        layer.retiring = std::move(layer.sound);
+        DBG("Dropped idle layer " + layer.file.getFileName());
+      }
+    }
+    if (layer.retiring != nullptr && layer.retiring->getReferenceCount() == 1) {
+      layer.retiring = nullptr;
+      released = true;
+    }
+  }
+  if (released)
+    sfzero::SamplePool::purgeUnused();
+}
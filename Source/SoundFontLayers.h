@@ -0,0 +1,85 @@
+#pragma once
+
+#include "../Modules/SFZero/SFZero.h"
+#include <JuceHeader.h>
+
+#include <array>
+#include <atomic>
+
+// SoundFonts layered over the built-in GM bank on the synth's layers 1 and
+// up: a dedicated piano for some channels, say, and a drum font for channel
+// 10. Each serves the channels it's given and, optionally, one bank, and a
+// channel's program comes from the last layer that serves it and has that
+// bank and program; anything else still comes from the GM bank. Fonts load
+// on a background thread as they're added, and again when a channel asks
+// for one that was dropped. One that no channel has selected for
+// evictAfterSeconds is dropped, its samples with it unless another sound
+// shares them through sfzero::SamplePool.
+class SoundFontLayers : private juce::Thread {
+public:
+  SoundFontLayers(sfzero::Synth &synth, const juce::File &regionCacheDirectory);
+  ~SoundFontLayers() override;
+
+  static constexpr int maxLayers = sfzero::Synth::maxLayers - 1;
+  static constexpr double evictAfterSeconds = 60.0;
+
+  // Message thread. Channels is a mask with bit n for MIDI channel n + 1;
+  // bank is an SF2 bank (drum kits are in 128) or -1 for any. Returns false
+  // once every layer is taken.
+  bool addLayer(const juce::File &file, juce::uint16 channels, int bank = -1);
+  int getNumLayers() const { return numLayers.load(); }
+
+  // Before adding layers: read only the samples of the notes channels ask
+  // for (see sfzero::SF2Sound::setPagedSamples()), on this thread as they
+  // ask, rather than the whole font before it plays
+  void setPagedSamples(bool enabled) { pagedSamples.store(enabled); }
+
+  // Before adding layers: how fonts hold their samples in memory (see
+  // sfzero::SF2Sound::setSampleFormat()). 16-bit and compressed copies are
+  // read whole, so they take precedence over paging
+  void setSampleFormat(sfzero::Sample::Format format) { sampleFormat.store(format); }
+
+  // Audio thread. The synth layer and subsound that play program, selected
+  // under bank on a MIDI channel (1-16), or false if the GM bank plays it.
+  // A layer that would but isn't loaded is asked to load, meanwhile falling
+  // through to the ones below it.
+  bool resolve(int midiChannel, int bank, int program, int &synthLayer, int &subsound);
+
+  // Audio thread: whether a layer has loaded since the last call, and so
+  // channels should resolve their programs again.
+  bool takeLoadedFlag() { return loadedSinceChecked.exchange(false); }
+
+private:
+  static constexpr int idleCheckMs = 5000;
+
+  struct Layer {
+    // Set by addLayer() before the layer is counted, then only read
+    juce::File file;
+    juce::uint16 channels = 0;
+    int bank = -1;
+
+    // Subsound by bank and program, -1 where the font has none. Rebuilt
+    // while unloaded and only read while loaded.
+    std::array<std::array<juce::int16, 128>, 129> presets;
+    std::atomic<bool> loaded{false}, wanted{false};
+
+    // Loader thread only. A dropped sound is kept until the voices fading
+    // it out let it go, so it's freed here rather than on the audio thread.
+    juce::ReferenceCountedObjectPtr<sfzero::SF2Sound> sound, retiring;
+    double idleSinceMs = 0.0;
+  };
+
+  void run() override;
+  void load(int index);
+  void evictIdleLayers();
+
+  sfzero::Synth &synth;
+  const juce::File regionCacheDirectory;
+  std::array<Layer, maxLayers> layers;
+  std::atomic<int> numLayers{0};
+  std::atomic<bool> loadedSinceChecked{false};
+  std::atomic<bool> pagedSamples{false};
+  std::atomic<sfzero::Sample::Format> sampleFormat{sfzero::Sample::float32};
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SoundFontLayers)
+};
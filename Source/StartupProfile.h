@@ -0,0 +1,46 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Times a cold launch as named phases, each measured from the end of the one
+// before, and logs them with the total once the first frame has been painted.
+// Phases ended after that, for the work deferred until then, are logged as
+// they end with the time since launch. Message thread only.
+class StartupProfile {
+public:
+  // What launch to first frame should take on a typical desktop machine
+  static constexpr double targetMs = 150.0;
+
+  // Ends the current phase
+  void phase(const juce::String &name) {
+    const double nowMs = juce::Time::getMillisecondCounterHiRes();
+    if (framed)
+      juce::Logger::writeToLog("Startup: " + name + " at " +
+                               juce::String(nowMs - startMs, 1) + " ms");
+    else
+      lines.add("  " + name + ": " + juce::String(nowMs - lastMs, 1) + " ms");
+    lastMs = nowMs;
+  }
+
+  // Call from paint(); only the first call does anything
+  void firstFrame() {
+    if (framed)
+      return;
+    phase("first paint");
+    framed = true;
+    const double totalMs = lastMs - startMs;
+    juce::Logger::writeToLog("Startup: first frame after " + juce::String(totalMs, 1) +
+                             " ms (target " + juce::String(targetMs, 0) + " ms)");
+    for (const auto &line : lines)
+      juce::Logger::writeToLog(line);
+    lines.clear();
+  }
+
+  bool hasFramed() const { return framed; }
+
+private:
+  double startMs = juce::Time::getMillisecondCounterHiRes();
+  double lastMs = startMs;
+  bool framed = false;
+  juce::StringArray lines;
+};
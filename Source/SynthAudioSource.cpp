@@ -2,114 +2,341 @@
 #include "../JuceLibraryCode/BinaryData.h" // For BinaryData::Korg_Triton_Piano_sf2 and its size
 
 SynthAudioSource::SynthAudioSource() {
-  // Load the SF2 sound from binary data.
-  auto tempFile = juce::File::createTempFile(".sf2");
-  tempFile.replaceWithData(BinaryData::gm_sf2,
-                           BinaryData::gm_sf2Size);
-  sf2Sound = new sfzero::SF2Sound(tempFile);
-  sf2Sound->loadRegions();
-  sf2Sound->loadSamples(nullptr);
-  tempFile.deleteFile();
-
-  // Print out all available subsounds
-  DBG("Available Subsounds:");
-  for (int i = 0; i < sf2Sound->numSubsounds(); ++i) {
-    DBG(juce::String(i) + ": " + sf2Sound->subsoundName(i));
-  }
+  // The SF2 is parsed straight out of the binary data (its samples are read in
+  // place rather than copied), on a worker thread so the UI isn't held up.
+  sf2Sound = new sfzero::SF2Sound(BinaryData::gm_sf2,
+                                  static_cast<size_t>(BinaryData::gm_sf2Size));
+  sf2Sound->setRegionCacheDirectory(getSoundFontCacheDirectory());
 
-  // Initialize synths for all channels
-  for (int channel = 0; channel < 16; ++channel) {
-    channelInfos[channel].synth = std::make_unique<sfzero::Synth>();
-    
-    // Add voices to each synth
-    for (int i = 0; i < 8; ++i) {
-      channelInfos[channel].synth->addVoice(new sfzero::Voice());
-    }
-    
-    // Add the shared sound to each synth
-    channelInfos[channel].synth->clearSounds();
-    channelInfos[channel].synth->addSound(sf2Sound.get());
-  }
+  // The voices are allocated on the loader thread too; nothing can play
+  // before the SoundFont is in anyway
+  initialiseChannels();
+  soundFontLoader.startThread();
+}
+
+SynthAudioSource::SynthAudioSource(sfzero::SF2Sound *loadedSound)
+    : sf2Sound(loadedSound) {
+  soundFontReady.store(true);
+  loadProgress = 1.0;
+  allocateVoices();
+  initialiseChannels();
+  synth.setSound(loadedSound);
+}
+
+juce::File SynthAudioSource::getSoundFontCacheDirectory() {
+  return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+      .getChildFile("MidiPlayer")
+      .getChildFile("SoundFontCache");
+}
+
+void SynthAudioSource::allocateVoices() {
+  // A single voice pool serves every channel
+  setPolyphony(defaultPolyphony);
+  synth.setHitCacheSize(hitCacheFrames);
+}
+
+void SynthAudioSource::initialiseChannels() {
+  // The synth splits the block at every event it's given; renderNextBlock()
+  // has already moved the ones that needn't be sample-accurate together
+  synth.setMinimumRenderingSubdivisionSize(1, true);
 
   // Set up our specific channel mappings
   // Initialize all melodic channels to Piano (program 0)
   for (int channel = 0; channel < 16; ++channel) {
+    channelNoteRanges[channel].store(allNotes);
     if (channel == 9) {
       // Channel 10 (index 9) is always drums
-      setupChannel(channel, 228);    // Use drum kit sound
+      applyChannelPreset(channel, 228);    // Use drum kit sound
     } else {
       // All other channels default to Acoustic Grand Piano
-      setupChannel(channel, 0);      // Program 0 = Acoustic Grand Piano
+      applyChannelPreset(channel, 0);      // Program 0 = Acoustic Grand Piano
+    }
+  }
+}
+
+void SynthAudioSource::SoundFontLoader::run() {
+  owner.allocateVoices();
+  auto &sound = *owner.sf2Sound;
+  sound.loadRegions();
+  if (threadShouldExit())
+    return;
+  DBG(juce::String(sound.numSubsounds()) + " subsounds");
+
+  // Whatever the channels are already set to loads first
+  for (int channel = 1; channel <= 16; ++channel)
+    sound.prioritizeSubsound(owner.synth.getChannelPreset(channel));
+
+  owner.synth.setSound(&sound);
+  owner.soundFontReady.store(true);
+
+  sound.loadSamples(nullptr, &owner.loadProgress, this);
+}
+
+void SynthAudioSource::SampleConverter::run() {
+  // Only once every sample is in memory
+  while (!owner.waitUntilFullyLoaded(100))
+    if (threadShouldExit())
+      return;
+
+  double convertedRate = 0.0;
+  while (!threadShouldExit()) {
+    const double rate = owner.conversionRate.load();
+    if (rate != convertedRate) {
+      if (owner.sf2Sound->convertSamples(rate, this)) {
+        convertedRate = rate;
+        DBG("Samples converted to " + juce::String(rate) + " Hz");
+      }
+      continue; // the rate may have changed again meanwhile
     }
+    wait(-1);
   }
 }
 
+void SynthAudioSource::setSampleRateConversion(bool enabled) {
+  sampleRateConversion.store(enabled);
+  updateConversionRate();
+}
+
+void SynthAudioSource::updateConversionRate() {
+  conversionRate.store(sampleRateConversion.load() ? currentSampleRate.load() : 0.0);
+  if (!sampleConverter.isThreadRunning())
+    sampleConverter.startThread(juce::Thread::Priority::low);
+  sampleConverter.notify();
+}
+
+SynthAudioSource::PresetUsage::PresetUsage() {
+  std::fill(std::begin(lowest), std::end(lowest), 128);
+  std::fill(std::begin(highest), std::end(highest), -1);
+}
+
+void SynthAudioSource::PresetUsage::addNoteOn(int channel, int note) {
+  lowest[channel] = juce::jmin(lowest[channel], note);
+  highest[channel] = juce::jmax(highest[channel], note);
+  programs[channel][currentPrograms[channel]] = true;
+}
+
+void SynthAudioSource::prioritizePresetsFor(
+    const juce::MidiMessageSequence &sequence) {
+  PresetUsage usage;
+  for (int i = 0; i < sequence.getNumEvents(); ++i) {
+    const auto &msg = sequence.getEventPointer(i)->message;
+    const int channel = msg.getChannel() - 1;
+    if (channel < 0)
+      continue;
+    if (msg.isProgramChange())
+      usage.addProgramChange(channel, msg.getProgramChangeNumber());
+    else if (msg.isNoteOn())
+      usage.addNoteOn(channel, msg.getNoteNumber());
+  }
+  requestPresets(usage);
+}
+
+void SynthAudioSource::prioritizePresetsFor(const PackedMidiFile &file) {
+  // As above, from the packed events
+  PresetUsage usage;
+  for (const auto &event : file.events) {
+    const int channel = event.getChannel() - 1;
+    if (channel < 0)
+      continue;
+    if (event.isProgramChange())
+      usage.addProgramChange(channel, event.data1);
+    else if (event.isNoteOn())
+      usage.addNoteOn(channel, event.data1);
+  }
+  requestPresets(usage);
+}
+
+void SynthAudioSource::requestPresets(const PresetUsage &usage) {
+  for (int channel = 0; channel < 16; ++channel) {
+    const bool playsNotes = usage.lowest[channel] <= usage.highest[channel];
+    channelNoteRanges[channel].store(
+        playsNotes ? usage.lowest[channel] << 8 | usage.highest[channel] : noNotes);
+  }
+  // The layers are asked on the audio thread, for what each channel has
+  // selected from them
+  commands.push({Command::Type::requestNotes});
+  if (!soundFontReady.load())
+    return;
+
+  // Program numbers map straight to GM subsound indices, as in
+  // setupChannel(), and channel 10 always plays the drum kit
+  for (int channel = 0; channel < 16; ++channel) {
+    for (int program = 0; program < 128; ++program) {
+      if (usage.programs[channel][program])
+        sf2Sound->requestNotes(channel == 9 ? 228 : program, usage.lowest[channel],
+                               usage.highest[channel]);
+    }
+  }
+}
+
+int SynthAudioSource::countNoteRegions(int channel, int program, int note, int velocity) {
+  // Channel 10 (index 9) plays the drum kit, as selectProgram() has it
+  const auto matches = sf2Sound->getMatchingRegions(note, velocity, sfzero::Region::attack,
+                                                    channel == 9 ? 228 : program);
+  return static_cast<int>(matches.end() - matches.begin());
+}
+
 void SynthAudioSource::setupChannel(int channel, int subsoundIndex) {
   if (channel >= 0 && channel < 16) {
-    // Stop any playing notes on this channel
-    if (auto* synth = channelInfos[channel].synth.get()) {
-      synth->allNotesOff(0, true);
-    }
-    
-    // Store the subsound index for this channel
-    channelInfos[channel].subsoundIndex = subsoundIndex;
+    commands.push({Command::Type::setupChannel, channel, subsoundIndex});
+
+    // If it's still loading, move it to the front of the queue
+    if (soundFontReady.load())
+      sf2Sound->prioritizeSubsound(subsoundIndex);
   }
 }
 
-void SynthAudioSource::prepareToPlay(int samplesPerBlockExpected, double sampleRate) {
-  currentSampleRate = sampleRate;
-  
-  // Initialize the temporary buffer
-  tempBuffer = std::make_unique<juce::AudioBuffer<float>>(2, samplesPerBlockExpected);
-  
-  // Prepare all synths
-  for (auto& info : channelInfos) {
-    if (info.synth) {
-      info.synth->setCurrentPlaybackSampleRate(sampleRate);
+void SynthAudioSource::applyChannelPreset(int channel, int subsoundIndex) {
+  // Stop any playing notes on this channel
+  synth.allNotesOff(channel + 1, true);
+
+  // Store the subsound index for this channel
+  synth.setChannelPreset(channel + 1, subsoundIndex);
+}
+
+void SynthAudioSource::selectProgram(int channel, int program, bool force) {
+  channelPrograms[channel] = program;
+  const int bank = channel == 9 ? 128 : channelBanks[channel];
+  int layer = 0, subsound = 0;
+  if (soundFontLayers.resolve(channel + 1, bank, program, layer, subsound)) {
+    if (!force && synth.getChannelLayer(channel + 1) == layer &&
+        synth.getChannelPreset(channel + 1) == subsound)
+      return;
+    synth.allNotesOff(channel + 1, true);
+    // Fails if the layer was dropped just now; the GM bank plays it then
+    if (synth.setChannelPreset(channel + 1, subsound, layer)) {
+      requestChannelNotes(channel);
+      return;
     }
   }
+
+  // Channel 10 (index 9) keeps the GM drum kit whatever its program
+  subsound = channel == 9 ? 228 : program;
+  if ((channel == 9 || !force) && synth.getChannelLayer(channel + 1) == 0 &&
+      synth.getChannelPreset(channel + 1) == subsound)
+    return;
+  applyChannelPreset(channel, subsound);
+  if (soundFontReady.load())
+    requestChannelNotes(channel);
+}
+
+void SynthAudioSource::requestChannelNotes(int channel) {
+  sfzero::Sound *sound = synth.getLayerSound(synth.getChannelLayer(channel + 1));
+  if (sound == nullptr)
+    return;
+  const int range = channelNoteRanges[channel].load();
+  sound->requestNotes(synth.getChannelPreset(channel + 1), range >> 8, range & 0xff);
+}
+
+void SynthAudioSource::setPolyphony(int numVoices) {
+  synth.setPolyphony(numVoices);
+  burstFilter.setLimit(numVoices);
+}
+
+void SynthAudioSource::setStemOutput(bool enabled) {
+  stemOutput.store(enabled);
+  synth.setStemOutput(enabled || effectsEnabled.load());
+}
+
+void SynthAudioSource::setEffectsEnabled(bool enabled) {
+  effectsEnabled.store(enabled);
+  synth.setStemOutput(enabled || stemOutput.load());
+}
+
+void SynthAudioSource::setChannelTrim(int midiChannel, float decibels) {
+  const float gain = juce::Decibels::decibelsToGain(decibels, -100.0f);
+  synth.setChannelGain(midiChannel, gain, gain);
 }
 
-void SynthAudioSource::releaseResources() {
-  tempBuffer = nullptr;
+void SynthAudioSource::setRenderThreads(int numWorkers) {
+  renderThreads = juce::jmax(0, numWorkers);
+  if (currentBlockSize > 0)
+    synth.setRenderThreads(renderThreads, currentBlockSize);
+}
+
+void SynthAudioSource::prepareToPlay(int samplesPerBlockExpected, double sampleRate) {
+  currentSampleRate.store(sampleRate);
+  if (sampleRateConversion.load())
+    updateConversionRate();
+  currentBlockSize = samplesPerBlockExpected;
+  synth.setRenderThreads(renderThreads, samplesPerBlockExpected);
+
+  // Reserve the event storage up front
+  midiEvents.clear();
+  midiEvents.ensureSize(midiEventsBytes);
+  burstFilter.prepare(midiEventsBytes);
+
+  stemBuffer.setSize(sfzero::Synth::stemChannels, samplesPerBlockExpected);
+  effects.prepare(sampleRate, samplesPerBlockExpected, effectsPipelined);
+  limiterActive = limiterEnabled;
+  if (limiterActive)
+    limiter.prepare(sampleRate, samplesPerBlockExpected);
+
+  synth.setCurrentPlaybackSampleRate(sampleRate);
 }
 
+void SynthAudioSource::releaseResources() {}
+
 void SynthAudioSource::renderNextBlock(juce::AudioBuffer<float>& outputBuffer,
                                      const juce::MidiBuffer& midiBuffer,
                                      int startSample, int numSamples) {
+  commands.drain([this](const Command &command) {
+    if (command.type == Command::Type::setupChannel) {
+      applyChannelPreset(command.channel, command.subsoundIndex);
+    } else if (command.type == Command::Type::requestNotes) {
+      for (int channel = 0; channel < 16; ++channel)
+        requestChannelNotes(channel);
+    } else {
+      synth.allNotesOff(0, true);
+    }
+  });
+
+  // Channels whose programs a newly loaded layer has move over to it
+  if (soundFontLayers.takeLoadedFlag())
+    for (int channel = 0; channel < 16; ++channel)
+      selectProgram(channel, channelPrograms[channel], false);
+
   // Clear the output buffer
   outputBuffer.clear(startSample, numSamples);
   
-  // Create separate MIDI buffers for each channel
-  std::array<juce::MidiBuffer, 16> channelBuffers;
+  // Reuse the preallocated event buffer
+  midiEvents.clear();
   
-  // Sort MIDI events by channel
+  // Only this slice's events, for callers that render a buffer in pieces
+  const int granularity = controllerGranularity.load();
+  int lastNoteSample = startSample;
   for (const auto metadata : midiBuffer) {
+    if (metadata.samplePosition < startSample ||
+        metadata.samplePosition >= startSample + numSamples)
+      continue;
     auto msg = metadata.getMessage();
     int channel = msg.getChannel() - 1; // MIDI channels are 1-based
     if (channel >= 0 && channel < 16) {
-      // Add debug logging for all MIDI messages
-      DBG("MIDI Message - Channel: " + juce::String(channel) + 
-          " Type: " + (msg.isNoteOn() ? "Note On" : 
-                      msg.isNoteOff() ? "Note Off" : 
-                      msg.isController() ? "Controller" : 
-                      msg.isProgramChange() ? "Program Change" : "Other") +
-          " Data1: " + juce::String(msg.getRawData()[1]) +
-          " Data2: " + juce::String(msg.getRawData()[2]) +
-          " Subsound: " + juce::String(channelInfos[channel].subsoundIndex));
-
-      // Handle Program Change messages
+      // Handle Program Change messages. Channel 9 (MIDI channel 10) is
+      // reserved for drums: only a drum font layered over it can change its
+      // kit. Applied here rather than queued, so notes later in the block (a
+      // seek's chase, say) already get the new preset.
       if (msg.isProgramChange()) {
-        int programNumber = msg.getProgramChangeNumber();
-        // Don't change program on channel 9 (MIDI channel 10) as it's reserved for drums
-        if (channel != 9) {
-          setupChannel(channel, programNumber);
-          DBG("Program Change on channel " + juce::String(channel) + 
-              " to program " + juce::String(programNumber));
-        }
+        selectProgram(channel, msg.getProgramChangeNumber(), true);
+        continue;
       }
+
+      // Bank select picks among the layers' banks at the next program change
+      if (msg.isController() && msg.getControllerNumber() == 0)
+        channelBanks[channel] = msg.getControllerValue();
+
+      // The effect sends are the bus's; the synth never sees them
+      if (msg.isController() && (msg.getControllerNumber() == 91 ||
+                                 msg.getControllerNumber() == 93)) {
+        if (msg.getControllerNumber() == 91)
+          effects.setReverbSend(msg.getChannel(), msg.getControllerValue());
+        else
+          effects.setChorusSend(msg.getChannel(), msg.getControllerValue());
+        continue;
+      }
+
       // Handle note messages - apply transposition except for channel 10 (drums)
-      else if ((msg.isNoteOn() || msg.isNoteOff()) && channel != 9) {
+      if ((msg.isNoteOn() || msg.isNoteOff()) && channel != 9) {
         int transposedNote = juce::jlimit(0, 127, msg.getNoteNumber() + transpositionAmount.load());
         if (msg.isNoteOn()) {
           msg = juce::MidiMessage::noteOn(msg.getChannel(), transposedNote, msg.getVelocity());
@@ -117,39 +344,45 @@ void SynthAudioSource::renderNextBlock(juce::AudioBuffer<float>& outputBuffer,
           msg = juce::MidiMessage::noteOff(msg.getChannel(), transposedNote, msg.getVelocity());
         }
       }
-      
-      channelBuffers[channel].addEvent(msg, metadata.samplePosition);
-      activeChannels.set(channel);
+
+      // Anything but notes moves back to the start of its slice. Never past
+      // a note event, so the pedals and notes still come in the same order.
+      int samplePosition = metadata.samplePosition;
+      if (msg.isNoteOnOrOff())
+        lastNoteSample = samplePosition;
+      else
+        samplePosition = juce::jmax(lastNoteSample,
+                                    startSample + (samplePosition - startSample) / granularity * granularity);
+      midiEvents.addEvent(msg, samplePosition);
     }
   }
+
+  // Bursts too big for the voice pool lose the notes it would drop anyway
+  if (const int dropped = burstFilter.process(midiEvents))
+    synth.getPerformanceCounters().addDroppedNotes(dropped);
   
-  // Process each active channel
-  for (int channel = 0; channel < 16; ++channel) {
-    if (activeChannels[channel]) {
-      // Clear the temp buffer
-      tempBuffer->clear();
-      
-      // Set the correct subsound for this channel before rendering
-      if (sf2Sound) {
-        sf2Sound->useSubsound(channelInfos[channel].subsoundIndex);
-      }
-      
-      // Render this channel's synth
-      if (auto* synth = channelInfos[channel].synth.get()) {
-        synth->renderNextBlock(*tempBuffer, channelBuffers[channel], 0, numSamples);
-      }
-      
-      // Mix into the main output buffer
-      for (int i = 0; i < outputBuffer.getNumChannels(); ++i) {
-        outputBuffer.addFrom(i, startSample, *tempBuffer, i, 0, numSamples);
-      }
-    }
+  // Every channel renders through the shared voice pool, straight into the
+  // output or, for the effects, into stems they mix down
+  if (effectsEnabled.load() && !stemOutput.load() && currentBlockSize > 0) {
+    // Only a block longer than prepareToPlay() promised allocates here
+    if (stemBuffer.getNumSamples() < startSample + numSamples)
+      stemBuffer.setSize(sfzero::Synth::stemChannels, startSample + numSamples, false, false, true);
+    stemBuffer.clear(startSample, numSamples);
+    synth.renderNextBlock(stemBuffer, midiEvents, startSample, numSamples);
+    effects.process(stemBuffer, outputBuffer, startSample, numSamples);
+  } else {
+    synth.renderNextBlock(outputBuffer, midiEvents, startSample, numSamples);
   }
+  if (limiterActive && !stemOutput.load())
+    limiter.process(outputBuffer, startSample, numSamples);
 }
 
 void SynthAudioSource::getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill) {
+  const juce::ScopedNoDenormals noDenormals; // as the scheduler's callback
   // Always clear the output.
   bufferToFill.clearActiveBufferRegion();
+  const sfzero::PerformanceCounters::ScopedCallback timing(
+      synth.getPerformanceCounters(), bufferToFill.numSamples);
 
   if (!isPlaying)
     return;
@@ -157,7 +390,7 @@ void SynthAudioSource::getNextAudioBlock(const juce::AudioSourceChannelInfo& buf
   const int numSamples = bufferToFill.numSamples;
   const double secondsPerBeat = 60.0 / tempo;
   const double beatsPerBlock =
-      (numSamples / currentSampleRate) / secondsPerBeat;
+      (numSamples / currentSampleRate.load()) / secondsPerBeat;
   const double currentBeat = playbackPosition.load();
 
   juce::MidiBuffer midiBuffer;
@@ -173,7 +406,7 @@ void SynthAudioSource::getNextAudioBlock(const juce::AudioSourceChannelInfo& buf
         event->message.getTimeStamp() / 480.0; // convert ticks to beats
     double relativeBeat = eventBeat - currentBeat;
     double eventTimeSec = relativeBeat * secondsPerBeat;
-    int sampleOffset = static_cast<int>(eventTimeSec * currentSampleRate);
+    int sampleOffset = static_cast<int>(eventTimeSec * currentSampleRate.load());
     if (sampleOffset >= 0 && sampleOffset < numSamples)
       midiBuffer.addEvent(event->message,
                           bufferToFill.startSample + sampleOffset);
@@ -201,14 +434,7 @@ void SynthAudioSource::startPlayback() {
 void SynthAudioSource::stopPlayback() { isPlaying = false; }
 
 void SynthAudioSource::stopAllNotes() {
-  // Stop all notes on all channels
-  for (auto& info : channelInfos) {
-    if (info.synth) {
-      info.synth->allNotesOff(0, true);
-    }
-  }
-  // Clear any active channel flags
-  activeChannels.reset();
+  commands.push({Command::Type::stopAllNotes});
 }
 
 void SynthAudioSource::setTempo(double newTempo) { tempo = newTempo; }
@@ -230,16 +456,9 @@ int SynthAudioSource::findEventIndexForBeat(double beat) {
 }
 
 SynthAudioSource::~SynthAudioSource() {
-  // Clean up any resources
-  tempBuffer = nullptr;
-  
-  // Clear all synths first
-  for (auto& info : channelInfos) {
-    if (info.synth) {
-      info.synth->clearSounds();
-    }
-  }
-  
-  // Then clear the shared sound
-  // sf2Sound = nullptr;
-}
\ No newline at end of file
+  sampleConverter.stopThread(10000);
+  soundFontLoader.stopThread(10000);
+
+  // Release the synth's reference before the shared sound goes away
+  synth.setSound(nullptr);
+}
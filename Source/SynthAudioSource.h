@@ -1,12 +1,21 @@
 #pragma once
 
 #include "../Modules/SFZero/SFZero.h" // Adjust include path as needed
+#include "CommandQueue.h"
+#include "EffectsBus.h"
+#include "MasterLimiter.h"
+#include "NoteBurstFilter.h"
+#include "SmfReader.h"
+#include "SoundFontLayers.h"
 #include <JuceHeader.h>
 
 
 class SynthAudioSource : public juce::AudioSource {
 public:
   SynthAudioSource();
+  // Plays an SF2Sound that is already fully loaded, e.g. one shared between
+  // several offline renders. Nothing is loaded in the background.
+  explicit SynthAudioSource(sfzero::SF2Sound *loadedSound);
   ~SynthAudioSource() override;
 
   void prepareToPlay(int samplesPerBlockExpected, double sampleRate) override;
@@ -25,48 +34,250 @@ public:
                        const juce::MidiBuffer &midiBuffer, int startSample,
                        int numSamples);
 
+  // Where parsed SoundFont presets are cached between launches
+  static juce::File getSoundFontCacheDirectory();
+
   // Get the shared SF2 sound
   sfzero::SF2Sound* getSF2Sound() const { return sf2Sound.get(); }
 
-  // Helper to set up a channel with a specific subsound
+  // The SoundFont loads on a background thread. Once this is true its preset
+  // list can be read; presets whose samples are still loading stay silent.
+  bool isSoundFontReady() const { return soundFontReady.load(); }
+
+  // Blocks until every preset's samples are loaded, e.g. before an offline
+  // render. Returns false on timeout.
+  bool waitUntilFullyLoaded(int timeoutMs = -1) {
+    return soundFontLoader.waitForThreadToExit(timeoutMs);
+  }
+
+  // The regions, and so voices, a note on a channel (0-15) starts under a
+  // program of the GM bank, e.g. for MidiFileAnalysis::Calibration. Call once
+  // it's fully loaded.
+  int countNoteRegions(int channel, int program, int note, int velocity);
+
+  // Layer another SoundFont over the GM bank for the channels in the mask
+  // (bit n for MIDI channel n + 1), optionally for one bank only; see
+  // SoundFontLayers. Programs it has play from it once it's loaded.
+  bool addSoundFontLayer(const juce::File &file, juce::uint16 channels, int bank = -1) {
+    return soundFontLayers.addLayer(file, channels, bank);
+  }
+
+  // Load the presets a sequence uses ahead of the rest of the SoundFont.
+  // Each channel's programs are asked for the range of notes it plays, which
+  // is all a paged layer reads (see setSamplePaging()).
+  void prioritizePresetsFor(const juce::MidiMessageSequence &sequence);
+  void prioritizePresetsFor(const PackedMidiFile &file);
+
+  // Before adding layers: layered fonts read only the samples of the notes
+  // the loaded songs play, and any others as they're first played, so their
+  // memory goes with the songs rather than the banks. The built-in bank is
+  // read in place and isn't affected.
+  void setSamplePaging(bool enabled) { soundFontLayers.setPagedSamples(enabled); }
+
+  // Before adding layers: layered fonts keep their samples as 16-bit PCM or
+  // compressed blocks rather than float, for libraries too big for memory
+  // otherwise. Either is read whole, overriding paging.
+  void setSampleFormat(sfzero::Sample::Format format) { soundFontLayers.setSampleFormat(format); }
+
+  // Helper to set up a channel with a specific subsound. Like stopAllNotes()
+  // it is queued for the audio thread and applied at the start of the next
+  // renderNextBlock().
   void setupChannel(int channel, int subsoundIndex);
 
   // Stop all notes on all channels
   void stopAllNotes();
 
+  // Resize the voice pool shared by all 16 channels. The burst limit
+  // follows it.
+  void setPolyphony(int numVoices);
+
+  // A block with more note-ons than this plays only the loudest of them, one
+  // per key (see NoteBurstFilter); 0 plays them all. The performance
+  // counters count the ones dropped.
+  void setBurstLimit(int maxNoteOns) { burstFilter.setLimit(maxNoteOns); }
+  int getBurstLimit() const { return burstFilter.getLimit(); }
+
+  // Controllers, pitch bend and aftertouch take effect at the start of the
+  // numSamples-long slice of the block they fall in, or at the note event
+  // before them if that's later; note-ons and note-offs keep their exact
+  // sample. Dense controller data then splits a block at most once per slice.
+  // 1 is sample-accurate, controllersAtBlockRate applies them all at the
+  // block's start.
+  void setControllerGranularity(int numSamples) { controllerGranularity.store(juce::jmax(1, numSamples)); }
+  int getControllerGranularity() const { return controllerGranularity.load(); }
+  static constexpr int controllersAtBlockRate = std::numeric_limits<int>::max();
+
+  // Trade voice count for quality: linear is cheapest, sinc16 the cleanest
+  void setInterpolation(sfzero::Voice::Interpolation interpolation) { synth.setInterpolation(interpolation); }
+  sfzero::Voice::Interpolation getInterpolation() const { return synth.getInterpolation(); }
+
+  // Drop the least audible voices rather than miss the device's deadline
+  // once callbacks take more than maximumLoad of their time; 0 turns it off
+  void setLoadBudget(float maximumLoad) { synth.setLoadBudget(maximumLoad); }
+  void setLoadBudgetSuspended(bool suspended) { synth.setLoadBudgetSuspended(suspended); }
+
+  // Resamples the SoundFont to the device rate in the background once it has
+  // loaded, and again whenever the rate changes, so voices only pitch it.
+  // Until a conversion is ready, notes convert as they play, as they do with
+  // this off.
+  void setSampleRateConversion(bool enabled);
+  bool isSampleRateConversionEnabled() const { return sampleRateConversion.load(); }
+
+  // Render voices on this many extra threads alongside the audio thread;
+  // zero renders everything on the audio thread
+  void setRenderThreads(int numWorkers);
+  int getRenderThreads() const { return renderThreads; }
+
+  // Routes MIDI channel n to output channels 2n-2 and 2n-1 of a
+  // sfzero::Synth::stemChannels-wide buffer instead of mixing to stereo.
+  // Stems are always dry.
+  void setStemOutput(bool enabled);
+  bool isStemOutput() const { return stemOutput.load(); }
+
+  // Adds the shared reverb and chorus, fed by each channel's CC91 and CC93
+  // sends (see EffectsBus). Pipelined effects run on their own thread a
+  // block behind, from the next prepareToPlay().
+  void setEffectsEnabled(bool enabled);
+  bool areEffectsEnabled() const { return effectsEnabled.load(); }
+  void setEffectsPipelined(bool enabled) { effectsPipelined = enabled; }
+
+  // Ends the stereo mix in a MasterLimiter, from the next prepareToPlay(), so
+  // dense passages come down to the ceiling instead of clipping. It delays
+  // the output by getLatencySamples(). Stems aren't limited, so they aren't
+  // delayed either.
+  void setLimiterEnabled(bool enabled) { limiterEnabled = enabled; }
+  void setLimiterCeiling(float decibels) { limiter.setCeiling(decibels); }
+  int getLatencySamples() const {
+    return limiterActive && !stemOutput.load() ? limiter.getLatencySamples() : 0;
+  }
+
+  // Trims a MIDI channel (1-16) before the mix, for files whose channels
+  // were never balanced against each other
+  void setChannelTrim(int midiChannel, float decibels);
+
+  // Callback timing, voice and event counts for the synth's audio thread
+  sfzero::PerformanceCounters &getPerformanceCounters() { return synth.getPerformanceCounters(); }
+  // The synth's voice trace, or nullptr unless SFZero is built with
+  // SFZERO_TRACE
+  sfzero::Trace *getTrace() { return synth.getTrace(); }
+
   // Set the transposition amount in semitones
   void setTransposition(int semitones) { transpositionAmount = semitones; }
 
 private:
-  // Our SF2 synthesizer and sound.
-  struct ChannelInfo {
-    std::unique_ptr<sfzero::Synth> synth;
-    int subsoundIndex = 0;
-  };
-
   // Single shared SF2 sound instance
   juce::ReferenceCountedObjectPtr<sfzero::SF2Sound> sf2Sound;
-  
 
-  // Separate synth instances per channel
-  std::array<ChannelInfo, 16> channelInfos;
+  // One multitimbral synth; each voice carries its own channel and preset
+  sfzero::Synth synth;
+  static constexpr int defaultPolyphony = 256;
+  // 16 MB of drum hits and other unlooped notes (see sfzero::HitCache)
+  static constexpr int hitCacheFrames = 1 << 22;
 
-  // Track which channels are active
-  std::bitset<16> activeChannels;
+  // Transposed copy of the incoming events, reserved in prepareToPlay and
+  // cleared (not freed) every block so the audio thread never allocates.
+  juce::MidiBuffer midiEvents;
+  static constexpr size_t midiEventsBytes = 16384;
+  NoteBurstFilter burstFilter;
+  std::atomic<int> controllerGranularity{32}; // Synthesiser's own default
+
+  // With effects on, the synth renders stems into stemBuffer for the bus to
+  // mix, whether or not the caller asked for stems
+  EffectsBus effects;
+  juce::AudioBuffer<float> stemBuffer;
+  std::atomic<bool> stemOutput{false}, effectsEnabled{false};
+  bool effectsPipelined = false;
+  MasterLimiter limiter;
+  bool limiterEnabled = false, limiterActive = false;
 
   // Our MIDI playback data.
   juce::MidiMessageSequence midiSequence;
   std::atomic<double> playbackPosition{0.0};
   double tempo = 120.0; // BPM
-  double currentSampleRate = 44100.0;
+  std::atomic<double> currentSampleRate{44100.0};
+  int currentBlockSize = 0;
+  int renderThreads = 0;
   bool isPlaying = false;
 
-  // Temporary buffer for mixing
-  std::unique_ptr<juce::AudioBuffer<float>> tempBuffer;
-
   // Transposition amount in semitones
   std::atomic<int> transpositionAmount{0};
 
+  // Fonts over the GM bank, and what each channel last selected from them
+  // (audio thread only), so channels can switch once a layer loads
+  SoundFontLayers soundFontLayers{synth, getSoundFontCacheDirectory()};
+  int channelPrograms[16] = {};
+  int channelBanks[16] = {};
+
+  // The lowest and highest note the current song plays on each channel, as
+  // low << 8 | high, empty (1, 0) where it plays none. Written by
+  // prioritizePresetsFor() and read on the audio thread.
+  std::atomic<int> channelNoteRanges[16];
+  static constexpr int allNotes = 127, noNotes = 1 << 8;
+
+  // What a song plays on each channel (0-15), gathered by
+  // prioritizePresetsFor(). A program counts once a note follows it.
+  struct PresetUsage {
+    int lowest[16], highest[16];
+    int currentPrograms[16] = {};
+    bool programs[16][128] = {};
+    PresetUsage();
+    void addProgramChange(int channel, int program) { currentPrograms[channel] = program; }
+    void addNoteOn(int channel, int note);
+  };
+  void requestPresets(const PresetUsage &usage);
+
+  // Allocates the voices and the hit cache, parses the SoundFont, hands it to
+  // the synth, then loads its samples
+  class SoundFontLoader : public juce::Thread {
+  public:
+    explicit SoundFontLoader(SynthAudioSource &ownerIn)
+        : juce::Thread("SoundFont Loader"), owner(ownerIn) {}
+    void run() override;
+
+  private:
+    SynthAudioSource &owner;
+  };
+  SoundFontLoader soundFontLoader{*this};
+  std::atomic<bool> soundFontReady{false};
+  double loadProgress = 0.0;
+
+  // Keeps the samples converted to conversionRate (0 for none)
+  class SampleConverter : public juce::Thread {
+  public:
+    explicit SampleConverter(SynthAudioSource &ownerIn)
+        : juce::Thread("Sample Rate Converter"), owner(ownerIn) {}
+    void run() override;
+
+  private:
+    SynthAudioSource &owner;
+  };
+  SampleConverter sampleConverter{*this};
+  std::atomic<bool> sampleRateConversion{false};
+  std::atomic<double> conversionRate{0.0};
+  void updateConversionRate();
+
+  // Sets every channel to its default program
+  void initialiseChannels();
+  // The voice pool and the hit cache, a few megabytes between them
+  void allocateVoices();
+
+  // Channel changes from the message thread, so it never waits on the lock
+  // the synth holds while rendering
+  struct Command {
+    enum class Type { setupChannel, stopAllNotes, requestNotes };
+    Type type = Type::stopAllNotes;
+    int channel = 0;
+    int subsoundIndex = 0;
+  };
+  CommandQueue<Command, 256> commands;
+  void applyChannelPreset(int channel, int subsoundIndex);
+  // Audio thread: plays a program on a channel (0-15) from the layer that
+  // has it, or the GM bank. Unless forced, a channel already playing it is
+  // left alone.
+  void selectProgram(int channel, int program, bool force);
+  // Audio thread: asks whatever plays a channel for the notes it plays
+  void requestChannelNotes(int channel);
+
   // Helper: Given a beat value, find the first event in our MIDI sequence that
   // occurs at or after that beat.
   int findEventIndexForBeat(double beat);
@@ -0,0 +1,429 @@
+#include <JuceHeader.h>
+#include "../../../Source/SynthAudioSource.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// Replays fixed workloads through the synth with no audio device, at several
+// block sizes, and reports what each costs. "synth" runs time
+// SynthAudioSource::renderNextBlock (event dispatch, voice allocation and
+// rendering); "voice" runs time only sfzero::Voice::renderNextBlock on the
+// voices those same events start.
+//
+//   MidiPlayerBenchmarks [--soundfont bank.sf2] [--rate 44100] [--seconds 10]
+//                        [--repeats 3] [--only name] [--json results.json]
+//                        [--denormals]
+//
+// Blocks run with flush-to-zero, as the app's audio callback does;
+// --denormals leaves it off, for comparing the two.
+
+namespace {
+
+// Every heap allocation the process makes, so a timed block can be checked for
+// allocating. Nothing else runs while a block is timed.
+std::atomic<juce::int64> allocationCount{0};
+
+} // namespace
+
+void *operator new(std::size_t size) {
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  if (void *memory = std::malloc(size > 0 ? size : 1))
+    return memory;
+  throw std::bad_alloc();
+}
+void *operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void *memory) noexcept { std::free(memory); }
+void operator delete[](void *memory) noexcept { std::free(memory); }
+void operator delete(void *memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void *memory, std::size_t) noexcept { std::free(memory); }
+
+namespace {
+
+const int blockSizes[] = {32, 64, 256, 1024};
+
+struct Settings {
+  juce::File soundFont;
+  double sampleRate = 44100.0;
+  double seconds = 10.0;
+  int repeats = 3;
+  juce::String only;
+  juce::File jsonFile;
+  bool denormals = false;
+};
+
+// A fixed stream of events and the subsound each channel starts on. Event
+// timestamps are in seconds, so the workload is the same at any sample rate.
+struct Workload {
+  juce::String name;
+  int programs[16];
+  juce::MidiMessageSequence events;
+  bool effects = false; // through the reverb and chorus bus, at "synth" level
+};
+
+struct Measurement {
+  juce::String workload, level;
+  int blockSize = 0;
+  juce::int64 blocks = 0, samples = 0, voiceSamples = 0, allocations = 0;
+  double seconds = 0.0;
+};
+
+Workload makeWorkload(const juce::String &name) {
+  Workload workload;
+  workload.name = name;
+  for (int channel = 0; channel < 16; ++channel)
+    workload.programs[channel] = channel == 9 ? 228 : 0;
+  return workload;
+}
+
+void addNote(juce::MidiMessageSequence &events, int channel, int note,
+             int velocity, double start, double end) {
+  events.addEvent(juce::MidiMessage::noteOn(channel, note, static_cast<juce::uint8>(velocity)), start);
+  events.addEvent(juce::MidiMessage::noteOff(channel, note), end);
+}
+
+// 16 notes on each of 8 piano channels, struck together every two seconds.
+Workload pianoChord(double seconds) {
+  auto workload = makeWorkload("piano-chord-128");
+  for (double start = 0.0; start < seconds; start += 2.0)
+    for (int channel = 1; channel <= 8; ++channel)
+      for (int i = 0; i < 16; ++i)
+        addNote(workload.events, channel, 36 + i * 4, 100, start, start + 1.9);
+  return workload;
+}
+
+// A busy GM kit groove at 140 BPM: 16th-note hats, 8th-note ride, kick and
+// snare with ghost notes, a crash every bar and a tom fill every fourth.
+Workload drumPattern(double seconds) {
+  auto workload = makeWorkload("gm-drums-dense");
+  const double sixteenth = 60.0 / 140.0 / 4.0;
+  int step = 0;
+  for (double time = 0.0; time < seconds; time += sixteenth, ++step) {
+    const int inBar = step % 16;
+    const bool fillBar = (step / 16) % 4 == 3;
+    auto hit = [&](int note, int velocity) {
+      addNote(workload.events, 10, note, velocity, time, time + sixteenth * 0.5);
+    };
+
+    hit(42, 70 + (inBar % 4 == 0 ? 30 : (inBar * 7) % 20)); // closed hat
+    if (inBar % 2 == 0)
+      hit(51, 80); // ride
+    if (inBar == 0)
+      hit(49, 120); // crash
+    if (inBar % 4 == 0 || inBar == 10)
+      hit(36, 110); // kick
+    if (inBar == 4 || inBar == 12)
+      hit(38, 115); // snare
+    else if (inBar % 3 == 1)
+      hit(38, 35); // ghost snare
+    if (fillBar && inBar >= 8)
+      hit(inBar < 11 ? 50 : inBar < 14 ? 47 : 45, 100); // toms
+  }
+  return workload;
+}
+
+// Four-note chords held for eight seconds on four string and pad presets, so
+// the voices spend their time in sample loops.
+Workload stringPads(double seconds) {
+  auto workload = makeWorkload("string-pads");
+  const int programs[] = {48, 49, 50, 89};
+  const int chords[][4] = {{48, 55, 60, 64}, {45, 52, 57, 60},
+                           {41, 48, 53, 57}, {43, 50, 55, 59}};
+  for (int channel = 1; channel <= 4; ++channel)
+    workload.programs[channel - 1] = programs[channel - 1];
+
+  int chord = 0;
+  for (double start = 0.0; start < seconds; start += 8.0, ++chord)
+    for (int channel = 1; channel <= 4; ++channel)
+      for (int note : chords[chord % 4])
+        addNote(workload.events, channel, note + (channel - 1) * 12 - 12, 80,
+                start, start + 8.5); // overlaps the next chord's attack
+  return workload;
+}
+
+// Held chords on four channels with the wheel sweeping end to end, one
+// pitch-bend message per channel every millisecond.
+Workload pitchBendSweeps(double seconds) {
+  auto workload = makeWorkload("pitch-bend-sweeps");
+  const int programs[] = {80, 81, 48, 56};
+  for (int channel = 1; channel <= 4; ++channel) {
+    workload.programs[channel - 1] = programs[channel - 1];
+    for (int note : {48, 55, 60, 67})
+      addNote(workload.events, channel, note, 90, 0.0, seconds);
+  }
+  for (double time = 0.0; time < seconds; time += 0.001)
+    for (int channel = 1; channel <= 4; ++channel) {
+      const double phase = time * (0.5 + channel * 0.25) * juce::MathConstants<double>::twoPi;
+      const int wheel = juce::jlimit(0, 16383, static_cast<int>(8192.0 + 8191.0 * std::sin(phase)));
+      workload.events.addEvent(juce::MidiMessage::pitchWheel(channel, wheel), time);
+    }
+  return workload;
+}
+
+// Short chords on four sustaining presets, three a second and then three
+// seconds' rest, through the effects: most of the time goes on release and
+// reverb tails fading out, where subnormals turn up without flush-to-zero.
+Workload releaseTails(double seconds) {
+  auto workload = makeWorkload("release-tails");
+  workload.effects = true;
+  const int programs[] = {0, 48, 52, 89};
+  for (int channel = 1; channel <= 4; ++channel)
+    workload.programs[channel - 1] = programs[channel - 1];
+
+  for (double bar = 0.0; bar < seconds; bar += 4.0)
+    for (double start = bar; start < bar + 1.0 && start < seconds; start += 1.0 / 3.0)
+      for (int channel = 1; channel <= 4; ++channel)
+        for (int note : {48, 52, 55, 60})
+          addNote(workload.events, channel, note + (channel - 1) * 5, 100, start, start + 0.05);
+  return workload;
+}
+
+juce::int64 sampleOf(const juce::MidiMessageSequence &events, int index, double sampleRate) {
+  return static_cast<juce::int64>(events.getEventPointer(index)->message.getTimeStamp() * sampleRate);
+}
+
+int countActiveVoices(SynthAudioSource &source) {
+  return source.getPerformanceCounters().getSnapshot().activeVoices;
+}
+
+Measurement runSynth(sfzero::SF2Sound &sound, const Workload &workload,
+                     int blockSize, const Settings &settings) {
+  Measurement result;
+  result.workload = workload.name;
+  result.level = "synth";
+  result.blockSize = blockSize;
+
+  SynthAudioSource source(&sound);
+  for (int channel = 0; channel < 16; ++channel)
+    source.setupChannel(channel, workload.programs[channel]);
+  source.setEffectsEnabled(workload.effects);
+  source.prepareToPlay(blockSize, settings.sampleRate);
+
+  juce::AudioBuffer<float> buffer(2, blockSize);
+  juce::MidiBuffer midi;
+  midi.ensureSize(65536);
+  const juce::int64 length = static_cast<juce::int64>(settings.seconds * settings.sampleRate);
+  int next = 0;
+
+  for (juce::int64 position = 0; position < length; position += blockSize) {
+    const int numSamples = static_cast<int>(juce::jmin<juce::int64>(blockSize, length - position));
+    midi.clear();
+    for (; next < workload.events.getNumEvents(); ++next) {
+      const juce::int64 eventSample = sampleOf(workload.events, next, settings.sampleRate);
+      if (eventSample >= position + numSamples)
+        break;
+      midi.addEvent(workload.events.getEventPointer(next)->message,
+                    static_cast<int>(juce::jmax<juce::int64>(0, eventSample - position)));
+    }
+
+    const juce::int64 allocationsBefore = allocationCount.load();
+    const juce::int64 startTicks = juce::Time::getHighResolutionTicks();
+    source.renderNextBlock(buffer, midi, 0, numSamples);
+    const juce::int64 elapsedTicks = juce::Time::getHighResolutionTicks() - startTicks;
+    result.allocations += allocationCount.load() - allocationsBefore;
+
+    result.seconds += juce::Time::highResolutionTicksToSeconds(elapsedTicks);
+    result.voiceSamples += static_cast<juce::int64>(countActiveVoices(source)) * numSamples;
+    result.samples += numSamples;
+    ++result.blocks;
+  }
+  return result;
+}
+
+Measurement runVoices(sfzero::SF2Sound &sound, const Workload &workload,
+                      int blockSize, const Settings &settings) {
+  Measurement result;
+  result.workload = workload.name;
+  result.level = "voice";
+  result.blockSize = blockSize;
+
+  // Events are dispatched at the start of the block they fall in, untimed.
+  sfzero::Synth synth;
+  synth.setSound(&sound);
+  synth.setPolyphony(256);
+  synth.setCurrentPlaybackSampleRate(settings.sampleRate);
+  for (int channel = 0; channel < 16; ++channel)
+    synth.setChannelPreset(channel + 1, workload.programs[channel]);
+
+  juce::Array<juce::SynthesiserVoice *> active;
+  active.ensureStorageAllocated(synth.getNumVoices());
+  juce::AudioBuffer<float> buffer(2, blockSize);
+  const juce::int64 length = static_cast<juce::int64>(settings.seconds * settings.sampleRate);
+  int next = 0;
+
+  for (juce::int64 position = 0; position < length; position += blockSize) {
+    const int numSamples = static_cast<int>(juce::jmin<juce::int64>(blockSize, length - position));
+    for (; next < workload.events.getNumEvents() &&
+           sampleOf(workload.events, next, settings.sampleRate) < position + numSamples;
+         ++next)
+      synth.handleMidiEvent(workload.events.getEventPointer(next)->message);
+
+    active.clearQuick();
+    for (int i = 0; i < synth.getNumVoices(); ++i)
+      if (synth.getVoice(i)->isVoiceActive())
+        active.add(synth.getVoice(i));
+    buffer.clear();
+
+    const juce::int64 allocationsBefore = allocationCount.load();
+    const juce::int64 startTicks = juce::Time::getHighResolutionTicks();
+    for (auto *voice : active)
+      voice->renderNextBlock(buffer, 0, numSamples);
+    const juce::int64 elapsedTicks = juce::Time::getHighResolutionTicks() - startTicks;
+    result.allocations += allocationCount.load() - allocationsBefore;
+
+    result.seconds += juce::Time::highResolutionTicksToSeconds(elapsedTicks);
+    result.voiceSamples += static_cast<juce::int64>(active.size()) * numSamples;
+    result.samples += numSamples;
+    ++result.blocks;
+  }
+
+  synth.setSound(nullptr);
+  return result;
+}
+
+double nsPerVoiceSample(const Measurement &m) {
+  return m.voiceSamples > 0 ? m.seconds * 1.0e9 / static_cast<double>(m.voiceSamples) : 0.0;
+}
+
+double averageVoices(const Measurement &m) {
+  return m.samples > 0 ? static_cast<double>(m.voiceSamples) / m.samples : 0.0;
+}
+
+double allocationsPerBlock(const Measurement &m) {
+  return m.blocks > 0 ? static_cast<double>(m.allocations) / m.blocks : 0.0;
+}
+
+double realtimeFactor(const Measurement &m, double sampleRate) {
+  return m.seconds > 0.0 ? (m.samples / sampleRate) / m.seconds : 0.0;
+}
+
+juce::var toJson(const Measurement &m, double sampleRate) {
+  auto *object = new juce::DynamicObject();
+  object->setProperty("workload", m.workload);
+  object->setProperty("level", m.level);
+  object->setProperty("blockSize", m.blockSize);
+  object->setProperty("blocks", m.blocks);
+  object->setProperty("seconds", m.seconds);
+  object->setProperty("realtimeFactor", realtimeFactor(m, sampleRate));
+  object->setProperty("averageVoices", averageVoices(m));
+  object->setProperty("nsPerVoiceSample", nsPerVoiceSample(m));
+  object->setProperty("allocationsPerBlock", allocationsPerBlock(m));
+  return juce::var(object);
+}
+
+bool parseArguments(const juce::StringArray &args, Settings &settings) {
+  for (int i = 0; i < args.size(); ++i) {
+    const auto &arg = args[i];
+    if (arg == "--denormals") {
+      settings.denormals = true;
+      continue;
+    }
+    if (i + 1 >= args.size())
+      return false;
+
+    if (arg == "--soundfont")
+      settings.soundFont = juce::File::getCurrentWorkingDirectory().getChildFile(args[++i]);
+    else if (arg == "--rate")
+      settings.sampleRate = args[++i].getDoubleValue();
+    else if (arg == "--seconds")
+      settings.seconds = args[++i].getDoubleValue();
+    else if (arg == "--repeats")
+      settings.repeats = juce::jmax(1, args[++i].getIntValue());
+    else if (arg == "--only")
+      settings.only = args[++i];
+    else if (arg == "--json")
+      settings.jsonFile = juce::File::getCurrentWorkingDirectory().getChildFile(args[++i]);
+    else
+      return false;
+  }
+  return settings.sampleRate > 0.0 && settings.seconds > 0.0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+  juce::StringArray args;
+  for (int i = 1; i < argc; ++i)
+    args.add(juce::CharPointer_UTF8(argv[i]));
+
+  Settings settings;
+  if (!parseArguments(args, settings)) {
+    std::cout << "Usage: MidiPlayerBenchmarks [--soundfont bank.sf2] [--rate 44100] "
+                 "[--seconds 10] [--repeats 3] [--only name] [--json results.json] "
+                 "[--denormals]"
+              << std::endl;
+    return 1;
+  }
+
+  // Every block is timed on this thread
+  if (!settings.denormals)
+    juce::FloatVectorOperations::disableDenormalisedNumberSupport();
+
+  // Loaded completely up front, as the batch renderer does, so nothing
+  // streams or loads in the background while blocks are timed.
+  juce::ReferenceCountedObjectPtr<sfzero::SF2Sound> sound;
+  if (settings.soundFont != juce::File())
+    sound = new sfzero::SF2Sound(settings.soundFont);
+  else
+    sound = new sfzero::SF2Sound(BinaryData::gm_sf2, static_cast<size_t>(BinaryData::gm_sf2Size));
+  sound->loadRegions();
+  sound->loadSamples(nullptr);
+  if (sound->numSubsounds() == 0) {
+    std::cerr << "Couldn't load the SoundFont" << std::endl;
+    return 1;
+  }
+
+  const Workload workloads[] = {pianoChord(settings.seconds), drumPattern(settings.seconds),
+                                stringPads(settings.seconds), pitchBendSweeps(settings.seconds),
+                                releaseTails(settings.seconds)};
+
+  juce::Array<juce::var> results;
+  std::cout << "workload              level  block    x realtime   ns/voice/sample  voices  allocs/block" << std::endl;
+  for (const auto &workload : workloads) {
+    if (settings.only.isNotEmpty() && workload.name != settings.only)
+      continue;
+
+    for (int blockSize : blockSizes) {
+      for (bool voiceLevel : {false, true}) {
+        // The fastest of the repeats, as the one least disturbed by the rest
+        // of the machine.
+        Measurement best;
+        for (int repeat = 0; repeat < settings.repeats; ++repeat) {
+          auto m = voiceLevel ? runVoices(*sound, workload, blockSize, settings)
+                              : runSynth(*sound, workload, blockSize, settings);
+          if (repeat == 0 || m.seconds < best.seconds)
+            best = m;
+        }
+
+        std::cout << best.workload.paddedRight(' ', 22) << best.level.paddedRight(' ', 7)
+                  << juce::String(best.blockSize).paddedLeft(' ', 5)
+                  << juce::String(realtimeFactor(best, settings.sampleRate), 1).paddedLeft(' ', 13)
+                  << juce::String(nsPerVoiceSample(best), 2).paddedLeft(' ', 18)
+                  << juce::String(averageVoices(best), 1).paddedLeft(' ', 8)
+                  << juce::String(allocationsPerBlock(best), 2).paddedLeft(' ', 14)
+                  << std::endl;
+        results.add(toJson(best, settings.sampleRate));
+      }
+    }
+  }
+
+  if (settings.jsonFile != juce::File()) {
+    auto *report = new juce::DynamicObject();
+    report->setProperty("cpu", juce::SystemStats::getCpuModel());
+    report->setProperty("juce", juce::SystemStats::getJUCEVersion());
+    report->setProperty("sampleRate", settings.sampleRate);
+    report->setProperty("seconds", settings.seconds);
+    report->setProperty("repeats", settings.repeats);
+    report->setProperty("denormals", settings.denormals);
+    report->setProperty("results", results);
+    if (!settings.jsonFile.replaceWithText(juce::JSON::toString(juce::var(report)))) {
+      std::cerr << "Couldn't write " << settings.jsonFile.getFullPathName() << std::endl;
+      return 1;
+    }
+  }
+
+  sound = nullptr;
+  return 0;
+}
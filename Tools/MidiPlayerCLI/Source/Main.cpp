@@ -0,0 +1,444 @@
+#include <JuceHeader.h>
+#include "../../../Source/OfflineRenderer.h"
+#include "../../../Source/SynthAudioSource.h"
+#include "NumaReplicas.h"
+#include "RenderServer.h"
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+// Renders MIDI files to audio without a GUI, one file per core. Every job
+// plays the same loaded SoundFont, so memory doesn't grow with the job count.
+//
+//   MidiPlayerCLI [--soundfont bank.sf2] [--out dir] [--format wav|flac]
+//                 [--rate 44100] [--jobs N] [--stems] [--src] [--effects]
+//                 [--limit [dB]] [--numa] [--compare dir [--tolerance dB]]
+//                 [--fit-voices] [--calibration results.json]
+//                 file.mid|directory ...
+//   MidiPlayerCLI --analyze [--rate 44100] [--calibration results.json]
+//                 file.mid|directory ...
+//   MidiPlayerCLI --serve port [--queue N] [--jobs N] [--soundfont bank.sf2]
+//                 [--rate 44100] [--src] [--effects] [--limit [dB]] [--numa]
+//                 [--fit-voices]
+//
+// --stems writes song_ch01.wav, song_ch02.wav, ... for each channel in use
+// instead of one mixed song.wav.
+//
+// --src resamples the SoundFont to the output rate with a windowed-sinc
+// converter before rendering, instead of letting each voice do it.
+//
+// --effects adds the reverb and chorus the file's CC91 and CC93 send to.
+//
+// --limit ends the mix in a look-ahead limiter that holds its peaks to dB
+// (-1 by default) instead of letting dense passages clip.
+//
+// --numa loads a copy of the samples into each NUMA node's memory and binds
+// each job to a node, so on a multi-socket box no job reads samples from
+// another socket's memory (see NumaReplicas).
+//
+// --compare checks each render against the file of the same name in dir,
+// rendered the same way by a build known to be right, and fails unless the
+// difference nulls to at least --tolerance dB (-90 by default) below the
+// reference. Render a corpus into dir once to make the references, then run
+// with --compare after each engine change for its timings and its errors.
+//
+// --fit-voices sizes each render's voice pool to its file's voice budget
+// (see MidiFileAnalysis) instead of the default 256, counting the regions
+// each note starts in the SoundFont.
+//
+// --analyze prints each file's analysis instead of rendering it: per channel,
+// the programs played, the most notes at once and the event rate, then the
+// voices the file needs. --calibration takes a MidiPlayerBenchmarks --json
+// report, and adds the CPU those voices are predicted to take; renders
+// report it too.
+//
+// --serve renders MIDI files posted over HTTP instead, streaming each back
+// as WAV, --jobs at a time with up to --queue more waiting (see
+// RenderServer).
+
+namespace {
+
+struct Settings {
+  juce::File soundFont;
+  juce::File outputDirectory;
+  juce::String format = "wav";
+  OfflineRenderer::Options options;
+  int numJobs = juce::SystemStats::getNumCpus();
+  bool convertSamples = false;
+  juce::File referenceDirectory;
+  double toleranceDb = -90.0;
+  int servePort = 0;
+  int maxQueued = 64;
+  bool replicateSamples = false;
+  bool analyzeOnly = false;
+  NumaReplicas *replicas = nullptr; // with replicateSamples, once loaded
+  juce::Array<juce::File> midiFiles;
+};
+
+// A render against its reference, sample by sample over every channel
+struct Comparison {
+  bool matched = false;
+  juce::String errorMessage;
+  double peakDifference = 0.0;
+  double rmsDifference = 0.0;
+  // The difference's RMS relative to the reference's; -inf if they're equal
+  double nullDb = -std::numeric_limits<double>::infinity();
+};
+
+Comparison compareRenders(const juce::File &rendered, const juce::File &reference,
+                          double toleranceDb) {
+  Comparison comparison;
+  juce::AudioFormatManager formatManager;
+  formatManager.registerBasicFormats();
+  std::unique_ptr<juce::AudioFormatReader> renderedReader(formatManager.createReaderFor(rendered));
+  std::unique_ptr<juce::AudioFormatReader> referenceReader(formatManager.createReaderFor(reference));
+  if (referenceReader == nullptr) {
+    comparison.errorMessage = "no reference at " + reference.getFullPathName();
+    return comparison;
+  }
+  if (renderedReader == nullptr) {
+    comparison.errorMessage = "couldn't read the render back";
+    return comparison;
+  }
+  if (renderedReader->numChannels != referenceReader->numChannels ||
+      renderedReader->lengthInSamples != referenceReader->lengthInSamples ||
+      renderedReader->sampleRate != referenceReader->sampleRate) {
+    comparison.errorMessage =
+        juce::String(renderedReader->lengthInSamples) + " frames of " +
+        juce::String(renderedReader->numChannels) + " channels at " +
+        juce::String(renderedReader->sampleRate) + " Hz, the reference has " +
+        juce::String(referenceReader->lengthInSamples) + " of " +
+        juce::String(referenceReader->numChannels) + " at " +
+        juce::String(referenceReader->sampleRate) + " Hz";
+    return comparison;
+  }
+
+  const int numChannels = static_cast<int>(referenceReader->numChannels);
+  const int chunkSize = 65536;
+  juce::AudioBuffer<float> renderedChunk(numChannels, chunkSize);
+  juce::AudioBuffer<float> referenceChunk(numChannels, chunkSize);
+  double differenceSquares = 0.0, referenceSquares = 0.0;
+  for (juce::int64 start = 0; start < referenceReader->lengthInSamples; start += chunkSize) {
+    const int count = static_cast<int>(
+        juce::jmin(static_cast<juce::int64>(chunkSize), referenceReader->lengthInSamples - start));
+    renderedReader->read(&renderedChunk, 0, count, start, true, true);
+    referenceReader->read(&referenceChunk, 0, count, start, true, true);
+    for (int channel = 0; channel < numChannels; ++channel) {
+      const float *a = renderedChunk.getReadPointer(channel);
+      const float *b = referenceChunk.getReadPointer(channel);
+      for (int i = 0; i < count; ++i) {
+        const double difference = static_cast<double>(a[i]) - b[i];
+        comparison.peakDifference = juce::jmax(comparison.peakDifference, std::abs(difference));
+        differenceSquares += difference * difference;
+        referenceSquares += static_cast<double>(b[i]) * b[i];
+      }
+    }
+  }
+
+  const double numSamples = juce::jmax(1.0, static_cast<double>(referenceReader->lengthInSamples) * numChannels);
+  comparison.rmsDifference = std::sqrt(differenceSquares / numSamples);
+  if (differenceSquares > 0.0) {
+    // Against a silent reference any difference fails
+    comparison.nullDb = referenceSquares > 0.0
+                            ? 10.0 * std::log10(differenceSquares / referenceSquares)
+                            : std::numeric_limits<double>::infinity();
+  }
+  comparison.matched = comparison.nullDb <= toleranceDb;
+  return comparison;
+}
+
+void printUsage() {
+  std::cout << "Usage: MidiPlayerCLI [--soundfont bank.sf2] [--out dir] "
+               "[--format wav|flac] [--rate 44100] [--jobs N] [--stems] "
+               "[--src] [--effects] [--limit [dB]] [--numa] [--compare dir [--tolerance dB]] "
+               "[--fit-voices] [--calibration results.json] file.mid|directory ...\n"
+               "       MidiPlayerCLI --analyze [--rate 44100] [--calibration results.json] "
+               "file.mid|directory ...\n"
+               "       MidiPlayerCLI --serve port [--queue N] [--jobs N] "
+               "[--soundfont bank.sf2] [--rate 44100] [--src] [--effects] [--limit [dB]] [--numa] "
+               "[--fit-voices]"
+            << std::endl;
+}
+
+bool parseArguments(const juce::StringArray &args, Settings &settings) {
+  for (int i = 0; i < args.size(); ++i) {
+    const auto &arg = args[i];
+    const bool hasValue = i + 1 < args.size();
+
+    if (arg == "--soundfont" && hasValue) {
+      settings.soundFont = juce::File::getCurrentWorkingDirectory().getChildFile(args[++i]);
+    } else if (arg == "--out" && hasValue) {
+      settings.outputDirectory = juce::File::getCurrentWorkingDirectory().getChildFile(args[++i]);
+    } else if (arg == "--format" && hasValue) {
+      settings.format = args[++i].toLowerCase();
+    } else if (arg == "--rate" && hasValue) {
+      settings.options.sampleRate = args[++i].getDoubleValue();
+    } else if (arg == "--jobs" && hasValue) {
+      settings.numJobs = juce::jmax(1, args[++i].getIntValue());
+    } else if (arg == "--stems") {
+      settings.options.stems = true;
+    } else if (arg == "--src") {
+      settings.convertSamples = true;
+    } else if (arg == "--effects") {
+      settings.options.effects = true;
+    } else if (arg == "--limit") {
+      settings.options.limiter = true;
+      // The ceiling is optional, so only a number is taken as one
+      if (hasValue && args[i + 1].containsOnly("+-.0123456789"))
+        settings.options.limiterCeilingDb = args[++i].getFloatValue();
+    } else if (arg == "--numa") {
+      settings.replicateSamples = true;
+    } else if (arg == "--compare" && hasValue) {
+      settings.referenceDirectory = juce::File::getCurrentWorkingDirectory().getChildFile(args[++i]);
+    } else if (arg == "--tolerance" && hasValue) {
+      settings.toleranceDb = args[++i].getDoubleValue();
+    } else if (arg == "--serve" && hasValue) {
+      settings.servePort = args[++i].getIntValue();
+    } else if (arg == "--fit-voices") {
+      settings.options.fitPolyphony = true;
+    } else if (arg == "--analyze") {
+      settings.analyzeOnly = true;
+    } else if (arg == "--calibration" && hasValue) {
+      const auto report = juce::File::getCurrentWorkingDirectory().getChildFile(args[++i]);
+      settings.options.calibration =
+          MidiFileAnalysis::Calibration::fromBenchmarkFile(report, settings.options.blockSize);
+      if (settings.options.calibration.nsPerVoiceSample <= 0.0) {
+        std::cerr << "No synth results in " << report.getFullPathName() << std::endl;
+        return false;
+      }
+    } else if (arg == "--queue" && hasValue) {
+      settings.maxQueued = juce::jmax(0, args[++i].getIntValue());
+    } else if (arg.startsWith("--")) {
+      return false;
+    } else {
+      auto file = juce::File::getCurrentWorkingDirectory().getChildFile(arg);
+      if (file.isDirectory()) {
+        auto found = file.findChildFiles(juce::File::findFiles, true, "*.mid;*.midi");
+        found.sort();
+        settings.midiFiles.addArray(found);
+      } else if (file.existsAsFile()) {
+        settings.midiFiles.add(file);
+      } else {
+        std::cerr << "No such file: " << arg << std::endl;
+        return false;
+      }
+    }
+  }
+
+  // Served renders stream back as one stereo WAV, which can't hold stems
+  if (settings.servePort > 0 && settings.options.stems) {
+    std::cerr << "--stems can't be used with --serve" << std::endl;
+    return false;
+  }
+
+  return (!settings.midiFiles.isEmpty() || settings.servePort > 0) &&
+         settings.options.sampleRate > 0.0 &&
+         (settings.format == "wav" || settings.format == "flac");
+}
+
+class RenderJob : public juce::ThreadPoolJob {
+public:
+  RenderJob(const juce::File &midiFileIn, const juce::File &outputFileIn,
+            const Settings &settingsIn, juce::CriticalSection &outputLockIn,
+            std::atomic<int> &failuresIn, std::atomic<int> &mismatchesIn,
+            std::atomic<double> &renderedSecondsIn)
+      : juce::ThreadPoolJob(midiFileIn.getFileName()), midiFile(midiFileIn),
+        outputFile(outputFileIn), settings(settingsIn), outputLock(outputLockIn),
+        failures(failuresIn), mismatches(mismatchesIn),
+        renderedSeconds(renderedSecondsIn) {}
+
+  JobStatus runJob() override {
+    auto options = settings.options;
+    std::unique_ptr<NumaReplicas::Lease> lease;
+    if (settings.replicas != nullptr) {
+      lease = std::make_unique<NumaReplicas::Lease>(*settings.replicas);
+      options.soundFont = lease->getSoundFont();
+    }
+    auto result = OfflineRenderer::renderToFile(midiFile, outputFile, options);
+
+    // Compared outside the lock, so the jobs read their references in parallel
+    juce::StringArray comparisons;
+    bool matched = true;
+    if (result.succeeded && settings.referenceDirectory != juce::File()) {
+      for (const auto &rendered : result.outputFiles) {
+        const auto comparison = compareRenders(
+            rendered, settings.referenceDirectory.getChildFile(rendered.getFileName()),
+            settings.toleranceDb);
+        const auto figures =
+            comparison.errorMessage.isNotEmpty()
+                ? comparison.errorMessage
+                : (std::isinf(comparison.nullDb) && comparison.nullDb < 0.0
+                       ? juce::String("identical")
+                       : "null " + juce::String(comparison.nullDb, 1) + " dB, peak " +
+                             juce::String(comparison.peakDifference, 7) + ", rms " +
+                             juce::String(comparison.rmsDifference, 7));
+        comparisons.add("  " + rendered.getFileName() + ": " + figures +
+                        (comparison.matched ? "" : " - MISMATCH"));
+        matched = matched && comparison.matched;
+      }
+    }
+
+    const juce::ScopedLock lock(outputLock);
+    if (result.succeeded) {
+      // No fetch_add on atomic<double> before C++20
+      double total = renderedSeconds.load();
+      while (!renderedSeconds.compare_exchange_weak(total, total + result.renderedSeconds)) {
+      }
+      const auto name = result.outputFiles.size() == 1
+                            ? outputFile.getFullPathName()
+                            : outputFile.getFullPathName() + " (" +
+                                  juce::String(result.outputFiles.size()) + " stems)";
+      std::cout << name << ": "
+                << juce::String(result.renderedSeconds, 1) << "s in "
+                << juce::String(result.elapsedSeconds, 1) << "s ("
+                << juce::String(result.realtimeFactor, 1) << "x), "
+                << result.analysis.peakVoices << " voices at most";
+      if (result.analysis.peakLoad > 0.0)
+        std::cout << ", predicted " << juce::String(result.analysis.peakLoad, 2) << " cores";
+      std::cout << std::endl;
+      for (const auto &line : comparisons)
+        std::cout << line << std::endl;
+      if (!matched)
+        ++mismatches;
+    } else {
+      ++failures;
+      std::cerr << midiFile.getFullPathName() << ": " << result.errorMessage << std::endl;
+    }
+    return jobHasFinished;
+  }
+
+private:
+  juce::File midiFile, outputFile;
+  const Settings &settings;
+  juce::CriticalSection &outputLock;
+  std::atomic<int> &failures, &mismatches;
+  std::atomic<double> &renderedSeconds;
+};
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  // Message manager and friends, for the format classes that expect them
+  juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+  juce::StringArray args;
+  for (int i = 1; i < argc; ++i)
+    args.add(juce::CharPointer_UTF8(argv[i]));
+
+  Settings settings;
+  if (!parseArguments(args, settings)) {
+    printUsage();
+    return 1;
+  }
+
+  // Analysis reads only the files, so it needs no SoundFont; voices are
+  // counted at the calibration's voicesPerNote instead
+  if (settings.analyzeOnly) {
+    bool succeeded = true;
+    for (const auto &midiFile : settings.midiFiles) {
+      juce::String errorMessage;
+      auto file = SmfReader::readFile(midiFile, errorMessage);
+      if (file == nullptr) {
+        std::cerr << midiFile.getFullPathName() << ": " << errorMessage << std::endl;
+        succeeded = false;
+        continue;
+      }
+      const auto compiled = MidiSchedulerAudioSource::compile(*file, settings.options.sampleRate);
+      std::cout << midiFile.getFullPathName() << ": "
+                << MidiFileAnalysis::analyse(*compiled, settings.options.calibration).toString();
+    }
+    return succeeded ? 0 : 1;
+  }
+
+  // Load the SoundFont once, completely, before any job starts. Its samples
+  // are mapped from disk (or read in place from the embedded bank) rather
+  // than copied, so the workers share one read-only pool.
+  if (settings.soundFont != juce::File() && !settings.soundFont.existsAsFile()) {
+    std::cerr << "No such SoundFont: " << settings.soundFont.getFullPathName() << std::endl;
+    return 1;
+  }
+  auto loadSoundFont = [&settings](bool privateSamples) {
+    juce::ReferenceCountedObjectPtr<sfzero::SF2Sound> sound =
+        settings.soundFont != juce::File()
+            ? new sfzero::SF2Sound(settings.soundFont)
+            : new sfzero::SF2Sound(BinaryData::gm_sf2,
+                                   static_cast<size_t>(BinaryData::gm_sf2Size));
+    sound->setMemoryMapSamples(true);
+    sound->setPrivateSamples(privateSamples);
+    sound->setRegionCacheDirectory(SynthAudioSource::getSoundFontCacheDirectory());
+    sound->loadRegions();
+    sound->loadSamples(nullptr);
+    if (sound->numSubsounds() == 0)
+      return juce::ReferenceCountedObjectPtr<sfzero::SF2Sound>();
+    if (settings.convertSamples)
+      sound->convertSamples(settings.options.sampleRate);
+    return sound;
+  };
+  auto soundFont = loadSoundFont(false);
+  if (soundFont == nullptr) {
+    std::cerr << "Couldn't load the SoundFont" << std::endl;
+    return 1;
+  }
+  settings.options.soundFont = soundFont.get();
+
+  // Then, if asked, a private copy on each node as well
+  NumaReplicas replicas(soundFont.get());
+  if (settings.replicateSamples) {
+    if (!replicas.load([&loadSoundFont] { return loadSoundFont(true); })) {
+      std::cerr << "Couldn't load a copy of the SoundFont for each NUMA node" << std::endl;
+      return 1;
+    }
+    std::cout << "Samples copied to " << replicas.getNumNodes() << " NUMA node"
+              << (replicas.getNumNodes() == 1 ? "" : "s") << std::endl;
+    settings.replicas = &replicas;
+  }
+
+  if (settings.servePort > 0) {
+    RenderServer::Options serverOptions;
+    serverOptions.port = settings.servePort;
+    serverOptions.numJobs = settings.numJobs;
+    serverOptions.maxQueued = settings.maxQueued;
+    serverOptions.render = settings.options;
+    serverOptions.replicas = settings.replicas;
+    RenderServer server(serverOptions);
+    return server.run() ? 0 : 1;
+  }
+
+  juce::CriticalSection outputLock;
+  std::atomic<int> failures{0}, mismatches{0};
+  std::atomic<double> renderedSeconds{0.0};
+  const double startTime = juce::Time::getMillisecondCounterHiRes();
+
+  {
+    juce::ThreadPool pool(juce::jmin(settings.numJobs, settings.midiFiles.size()));
+    for (const auto &midiFile : settings.midiFiles) {
+      const auto directory = settings.outputDirectory != juce::File()
+                                 ? settings.outputDirectory
+                                 : midiFile.getParentDirectory();
+      directory.createDirectory();
+      const auto outputFile =
+          directory.getChildFile(midiFile.getFileNameWithoutExtension() + "." + settings.format);
+      pool.addJob(new RenderJob(midiFile, outputFile, settings, outputLock,
+                                failures, mismatches, renderedSeconds),
+                  true);
+    }
+    while (pool.getNumJobs() > 0)
+      juce::Thread::sleep(50);
+  }
+
+  const double elapsedSeconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+  std::cout << settings.midiFiles.size() - failures.load() << " of "
+            << settings.midiFiles.size() << " files, "
+            << juce::String(renderedSeconds.load(), 1) << "s of audio in "
+            << juce::String(elapsedSeconds, 1) << "s ("
+            << juce::String(elapsedSeconds > 0.0 ? renderedSeconds.load() / elapsedSeconds : 0.0, 1)
+            << "x) on " << settings.numJobs << " jobs" << std::endl;
+  if (settings.referenceDirectory != juce::File())
+    std::cout << settings.midiFiles.size() - failures.load() - mismatches.load() << " of "
+              << settings.midiFiles.size() - failures.load()
+              << " renders matched the references within "
+              << juce::String(settings.toleranceDb, 1) << " dB" << std::endl;
+
+  return failures.load() == 0 && mismatches.load() == 0 ? 0 : 1;
+}
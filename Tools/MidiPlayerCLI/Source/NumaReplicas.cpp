@@ -0,0 +1,128 @@
+#include "NumaReplicas.h"
+
+#if JUCE_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+// "0-15,32-47" as in the kernel's cpulist files
+juce::Array<int> parseCpuList(const juce::String &list) {
+  juce::Array<int> cpus;
+  for (const auto &range : juce::StringArray::fromTokens(list.trim(), ",", "")) {
+    const int first = range.upToFirstOccurrenceOf("-", false, false).getIntValue();
+    const int last = range.containsChar('-')
+                         ? range.fromFirstOccurrenceOf("-", false, false).getIntValue()
+                         : first;
+    for (int cpu = first; cpu <= last; ++cpu)
+      cpus.add(cpu);
+  }
+  return cpus;
+}
+
+} // namespace
+
+class NumaReplicas::LoaderThread : public juce::Thread {
+public:
+  LoaderThread(const Node &nodeIn, const Loader &loadIn)
+      : juce::Thread("SoundFont copy for node " + juce::String(nodeIn.id)), node(nodeIn),
+        load(loadIn) {}
+
+  void run() override {
+    bindCurrentThread(node);
+    soundFont = load();
+  }
+
+  const Node node;
+  const Loader &load;
+  juce::ReferenceCountedObjectPtr<sfzero::SF2Sound> soundFont;
+};
+
+juce::Array<NumaReplicas::Node> NumaReplicas::findNodes() {
+  juce::Array<Node> nodes;
+#if JUCE_LINUX
+  const juce::File root("/sys/devices/system/node");
+  for (const auto &directory : root.findChildFiles(juce::File::findDirectories, false, "node*")) {
+    const auto id = directory.getFileName().substring(4);
+    if (!id.containsOnly("0123456789"))
+      continue;
+    Node node;
+    node.id = id.getIntValue();
+    node.cpus = parseCpuList(directory.getChildFile("cpulist").loadFileAsString());
+    if (!node.cpus.isEmpty())
+      nodes.add(node);
+  }
+  std::sort(nodes.begin(), nodes.end(), [](const Node &a, const Node &b) { return a.id < b.id; });
+#endif
+  if (nodes.isEmpty())
+    nodes.add(Node());
+  return nodes;
+}
+
+bool NumaReplicas::bindCurrentThread(const Node &node) {
+#if JUCE_LINUX
+  if (node.cpus.isEmpty())
+    return false;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : node.cpus)
+    if (cpu < CPU_SETSIZE)
+      CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  juce::ignoreUnused(node);
+  return false;
+#endif
+}
+
+NumaReplicas::NumaReplicas(sfzero::SF2Sound *sharedSoundFont) : shared(sharedSoundFont) {}
+
+bool NumaReplicas::load(const Loader &load) {
+  const auto nodes = findNodes();
+  if (nodes.size() < 2)
+    return true; // nothing to spread over
+
+  // Each copy's pages are committed by the thread that first writes them,
+  // so each is loaded from its own node
+  juce::OwnedArray<LoaderThread> loaders;
+  for (const auto &node : nodes) {
+    loaders.add(new LoaderThread(node, load));
+    loaders.getLast()->startThread();
+  }
+  bool loaded = true;
+  for (auto *loader : loaders) {
+    loader->waitForThreadToExit(-1);
+    loaded = loaded && loader->soundFont != nullptr;
+  }
+  if (!loaded)
+    return false;
+
+  for (auto *loader : loaders) {
+    auto *replica = replicas.add(new Replica());
+    replica->node = loader->node;
+    replica->soundFont = loader->soundFont;
+  }
+  return true;
+}
+
+NumaReplicas::Lease::Lease(NumaReplicas &ownerIn) : owner(ownerIn), soundFont(ownerIn.shared) {
+  if (owner.replicas.isEmpty())
+    return;
+
+  // The least busy node; two jobs starting at once may both pick it, which
+  // the next jobs even out
+  index = 0;
+  for (int i = 1; i < owner.replicas.size(); ++i)
+    if (owner.replicas[i]->numJobs.load() < owner.replicas[index]->numJobs.load())
+      index = i;
+  auto *replica = owner.replicas[index];
+  ++replica->numJobs;
+  bindCurrentThread(replica->node);
+  soundFont = replica->soundFont.get();
+}
+
+NumaReplicas::Lease::~Lease() {
+  if (index >= 0)
+    --owner.replicas[index]->numJobs;
+}
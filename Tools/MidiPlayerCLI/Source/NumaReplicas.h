@@ -0,0 +1,61 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "../../../Modules/SFZero/SFZero.h"
+
+#include <atomic>
+#include <functional>
+
+// A copy of the SoundFont's samples in each NUMA node's memory, for render
+// boxes with more than one socket. Otherwise every job interpolates from the
+// one copy on whichever node loaded it, and the other sockets' jobs read it
+// across the interconnect. Each job takes a Lease, which binds its thread to
+// the node with the fewest jobs running and hands it that node's copy.
+//
+// Nodes come from /sys on Linux. Elsewhere, or with a single node, nothing
+// is copied or bound and every lease gets the shared SoundFont.
+class NumaReplicas {
+public:
+  struct Node {
+    int id = 0;
+    juce::Array<int> cpus; // empty if the thread can't be bound
+  };
+  static juce::Array<Node> findNodes();
+
+  explicit NumaReplicas(sfzero::SF2Sound *sharedSoundFont);
+
+  // Loads a copy on each node, all at once, each by calling load on a thread
+  // bound to that node. load should return a fully loaded sound with
+  // setPrivateSamples() on, or nullptr if it fails. Returns false if any
+  // copy fails.
+  using Loader = std::function<juce::ReferenceCountedObjectPtr<sfzero::SF2Sound>()>;
+  bool load(const Loader &load);
+  int getNumNodes() const { return juce::jmax(1, replicas.size()); }
+
+  class Lease {
+  public:
+    explicit Lease(NumaReplicas &owner);
+    ~Lease();
+    sfzero::SF2Sound *getSoundFont() const { return soundFont; }
+
+  private:
+    NumaReplicas &owner;
+    int index = -1;
+    sfzero::SF2Sound *soundFont = nullptr;
+    JUCE_DECLARE_NON_COPYABLE(Lease)
+  };
+
+private:
+  struct Replica {
+    Node node;
+    juce::ReferenceCountedObjectPtr<sfzero::SF2Sound> soundFont;
+    std::atomic<int> numJobs{0};
+  };
+  class LoaderThread;
+
+  // Binds the calling thread to node's CPUs; false if it can't
+  static bool bindCurrentThread(const Node &node);
+
+  sfzero::SF2Sound *shared;
+  juce::OwnedArray<Replica> replicas; // one per node once loaded, else none
+};
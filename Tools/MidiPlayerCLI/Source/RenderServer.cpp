@@ -0,0 +1,312 @@
+#include "RenderServer.h"
+#include "../../../Source/SmfReader.h"
+
+#include <csignal>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// No fetch_add on atomic<double> before C++20
+void addTo(std::atomic<double> &total, double amount) {
+  double value = total.load();
+  while (!total.compare_exchange_weak(value, value + amount)) {
+  }
+}
+
+// Writes straight to a connected socket. It can't seek, which the streamed
+// WAV doesn't need. A client that stops reading fails the write once the
+// socket has had no room for timeoutMs, rather than blocking it for good.
+class SocketOutputStream : public juce::OutputStream {
+public:
+  SocketOutputStream(juce::StreamingSocket &socketIn, int timeoutMsIn)
+      : socket(socketIn), timeoutMs(timeoutMsIn) {}
+
+  bool write(const void *data, size_t numBytes) override {
+    auto *bytes = static_cast<const char *>(data);
+    while (numBytes > 0) {
+      if (failed || socket.waitUntilReady(false, timeoutMs) != 1) {
+        failed = true;
+        return false;
+      }
+      const int chunk = static_cast<int>(juce::jmin<size_t>(numBytes, 1 << 20));
+      const int written = socket.write(bytes, chunk);
+      if (written <= 0) {
+        failed = true;
+        return false;
+      }
+      bytes += written;
+      numBytes -= static_cast<size_t>(written);
+      position += written;
+    }
+    return true;
+  }
+  void flush() override {}
+  bool setPosition(juce::int64) override { return false; }
+  juce::int64 getPosition() override { return position; }
+
+private:
+  juce::StreamingSocket &socket;
+  const int timeoutMs;
+  juce::int64 position = 0;
+  bool failed = false;
+};
+
+void sendResponse(juce::StreamingSocket &socket, int timeoutMs, int status,
+                  const juce::String &reason, const juce::String &contentType,
+                  const juce::String &body) {
+  const auto utf8 = body.toStdString();
+  const auto header = "HTTP/1.1 " + juce::String(status) + " " + reason +
+                      "\r\nContent-Type: " + contentType +
+                      "\r\nContent-Length: " + juce::String(static_cast<int>(utf8.size())) +
+                      "\r\nConnection: close\r\n\r\n";
+  SocketOutputStream out(socket, timeoutMs);
+  out.write(header.toRawUTF8(), header.getNumBytesAsUTF8());
+  out.write(utf8.data(), utf8.size());
+}
+
+} // namespace
+
+class RenderServer::Connection : public juce::ThreadPoolJob {
+public:
+  Connection(RenderServer &ownerIn, std::unique_ptr<juce::StreamingSocket> socketIn,
+             std::shared_ptr<PackedMidiFile> fileIn, const juce::String &queryIn)
+      : juce::ThreadPoolJob("Render request"), owner(ownerIn), socket(std::move(socketIn)),
+        file(std::move(fileIn)), query(queryIn) {}
+
+  JobStatus runJob() override {
+    --owner.queued;
+    ++owner.active;
+    handle();
+    socket->close();
+    --owner.active;
+    return jobHasFinished;
+  }
+
+private:
+  void handle() {
+    auto options = owner.options.render;
+    std::unique_ptr<NumaReplicas::Lease> lease;
+    if (owner.options.replicas != nullptr) {
+      lease = std::make_unique<NumaReplicas::Lease>(*owner.options.replicas);
+      options.soundFont = lease->getSoundFont();
+    }
+    for (const auto &parameter : juce::StringArray::fromTokens(query, "&", "")) {
+      const auto name = parameter.upToFirstOccurrenceOf("=", false, false);
+      const auto value = parameter.fromFirstOccurrenceOf("=", false, false);
+      if (name == "effects")
+        options.effects = value.getIntValue() != 0;
+      else if (name == "limit")
+        options.limiter = value.getIntValue() != 0;
+    }
+
+    // No length: the body runs to the close
+    const juce::String responseHeader =
+        "HTTP/1.1 200 OK\r\nContent-Type: audio/wav\r\nConnection: close\r\n\r\n";
+    SocketOutputStream out(*socket, owner.options.timeoutMs);
+    out.write(responseHeader.toRawUTF8(), responseHeader.getNumBytesAsUTF8());
+    const auto result = OfflineRenderer::renderToStream(*file, out, options);
+    if (result.succeeded) {
+      ++owner.completed;
+      addTo(owner.renderedSeconds, result.renderedSeconds);
+      addTo(owner.renderSeconds, result.elapsedSeconds);
+    } else {
+      ++owner.failed; // the client sees the stream end early
+      std::cerr << socket->getHostName() << ": " << result.errorMessage << std::endl;
+    }
+  }
+
+  RenderServer &owner;
+  std::unique_ptr<juce::StreamingSocket> socket;
+  std::shared_ptr<PackedMidiFile> file;
+  const juce::String query;
+};
+
+// Reads a request and answers it, unless it's a render, which it hands to the
+// job threads once the whole MIDI file has arrived. Runs on the request
+// threads, so health checks and scrapes never wait behind renders or count
+// against their queue, and a render job never waits on its client to send.
+class RenderServer::Request : public juce::ThreadPoolJob {
+public:
+  Request(RenderServer &ownerIn, juce::ThreadPool &rendersIn,
+          std::unique_ptr<juce::StreamingSocket> socketIn)
+      : juce::ThreadPoolJob("Request"), owner(ownerIn), renders(rendersIn),
+        socket(std::move(socketIn)) {}
+
+  JobStatus runJob() override {
+    deadline = juce::Time::getMillisecondCounter() +
+               static_cast<juce::uint32>(owner.options.timeoutMs);
+    handle();
+    if (socket != nullptr)
+      socket->close();
+    --owner.reading;
+    return jobHasFinished;
+  }
+
+private:
+  // Reads whatever has arrived, up to numBytes, or nothing once the request's
+  // time is up, so a client dripping bytes can't hold the thread for longer
+  int readSome(char *data, int numBytes) {
+    const int remainingMs = static_cast<int>(deadline - juce::Time::getMillisecondCounter());
+    if (remainingMs <= 0 || socket->waitUntilReady(true, remainingMs) != 1)
+      return 0;
+    return juce::jmax(0, socket->read(data, numBytes, false));
+  }
+
+  void respond(int status, const juce::String &reason, const juce::String &contentType,
+               const juce::String &body) {
+    sendResponse(*socket, owner.options.timeoutMs, status, reason, contentType, body);
+  }
+
+  // In chunks up to the blank line; whatever came after it is the start of
+  // the body
+  bool readHeader(juce::String &header, juce::MemoryBlock &bodyStart) {
+    juce::MemoryBlock bytes(16384);
+    size_t size = 0;
+    while (size < bytes.getSize()) {
+      const int count = readSome(static_cast<char *>(bytes.getData()) + size,
+                                 static_cast<int>(bytes.getSize() - size));
+      if (count == 0)
+        return false;
+      const auto *data = static_cast<const char *>(bytes.getData());
+      // The blank line may straddle the previous chunk
+      for (size_t i = size >= 3 ? size - 3 : 0; i + 4 <= size + static_cast<size_t>(count); ++i)
+        if (std::memcmp(data + i, "\r\n\r\n", 4) == 0) {
+          header = juce::String::fromUTF8(data, static_cast<int>(i + 4));
+          bodyStart.replaceAll(data + i + 4, size + static_cast<size_t>(count) - i - 4);
+          return true;
+        }
+      size += static_cast<size_t>(count);
+    }
+    return false;
+  }
+
+  void handle() {
+    juce::String header;
+    juce::MemoryBlock body;
+    if (!readHeader(header, body)) {
+      respond(400, "Bad Request", "text/plain", "Unreadable request\n");
+      return;
+    }
+    const auto lines = juce::StringArray::fromLines(header);
+    const auto requestLine = juce::StringArray::fromTokens(lines[0], " ", "");
+    const auto method = requestLine[0];
+    const auto target = requestLine[1];
+    const auto path = target.upToFirstOccurrenceOf("?", false, false);
+
+    if (method == "GET" && path == "/health") {
+      respond(200, "OK", "text/plain", "ok\n");
+      return;
+    }
+    if (method == "GET" && path == "/metrics") {
+      respond(200, "OK", "text/plain; version=0.0.4", owner.getMetrics());
+      return;
+    }
+    if (method != "POST" || path != "/render") {
+      respond(404, "Not Found", "text/plain", "Try POST /render\n");
+      return;
+    }
+    // Turned away at once, so the balancer can try another node
+    if (owner.queued.load() >= owner.options.maxQueued) {
+      ++owner.rejected;
+      respond(503, "Service Unavailable", "text/plain", "Queue full\n");
+      return;
+    }
+
+    int contentLength = -1;
+    for (const auto &line : lines)
+      if (line.startsWithIgnoreCase("Content-Length:"))
+        contentLength = line.fromFirstOccurrenceOf(":", false, false).trim().getIntValue();
+    if (contentLength <= 0 || contentLength > owner.options.maxMidiBytes) {
+      respond(contentLength > 0 ? 413 : 411,
+              contentLength > 0 ? "Payload Too Large" : "Length Required", "text/plain",
+              "Send the MIDI file as the body, with a Content-Length of up to " +
+                  juce::String(owner.options.maxMidiBytes) + " bytes\n");
+      return;
+    }
+    size_t size = juce::jmin(body.getSize(), static_cast<size_t>(contentLength));
+    body.setSize(static_cast<size_t>(contentLength));
+    while (size < body.getSize()) {
+      const int count = readSome(static_cast<char *>(body.getData()) + size,
+                                 static_cast<int>(body.getSize() - size));
+      if (count == 0) {
+        respond(400, "Bad Request", "text/plain", "Body cut short\n");
+        return;
+      }
+      size += static_cast<size_t>(count);
+    }
+
+    juce::String errorMessage;
+    auto file = SmfReader::read(body.getData(), body.getSize(), errorMessage);
+    if (file == nullptr) {
+      ++owner.failed;
+      respond(400, "Bad Request", "text/plain", errorMessage + "\n");
+      return;
+    }
+
+    ++owner.queued;
+    renders.addJob(new Connection(owner, std::move(socket), std::move(file),
+                                  target.fromFirstOccurrenceOf("?", false, false)),
+                   true);
+  }
+
+  RenderServer &owner;
+  juce::ThreadPool &renders;
+  std::unique_ptr<juce::StreamingSocket> socket;
+  juce::uint32 deadline = 0; // for the whole request, header and body
+};
+
+RenderServer::RenderServer(const Options &optionsIn) : options(optionsIn) {}
+
+bool RenderServer::run() {
+#if JUCE_LINUX || JUCE_MAC
+  // A client hanging up mid-render is a failed write, not the end of the
+  // process
+  std::signal(SIGPIPE, SIG_IGN);
+#endif
+  juce::StreamingSocket listener;
+  if (!listener.createListener(options.port)) {
+    std::cerr << "Couldn't listen on port " << options.port << std::endl;
+    return false;
+  }
+  std::cout << "Serving renders on port " << options.port << " with "
+            << options.numJobs << " jobs" << std::endl;
+
+  juce::ThreadPool renders(options.numJobs);
+  juce::ThreadPool requests(options.numRequestThreads);
+  for (;;) {
+    std::unique_ptr<juce::StreamingSocket> socket(listener.waitForNextConnection());
+    if (socket == nullptr)
+      continue;
+    // Requests are read off the accept thread, so a slow client can't hold up
+    // the next connection; past the limit they aren't read at all
+    if (reading.load() >= options.maxQueued) {
+      ++rejected;
+      sendResponse(*socket, options.timeoutMs, 503, "Service Unavailable", "text/plain",
+                   "Too many connections\n");
+      continue;
+    }
+    ++reading;
+    requests.addJob(new Request(*this, renders, std::move(socket)), true);
+  }
+}
+
+juce::String RenderServer::getMetrics() const {
+  const double uptimeSeconds = (juce::Time::getMillisecondCounterHiRes() - startMs) / 1000.0;
+  juce::String metrics;
+  auto add = [&metrics](const char *name, const juce::String &value) {
+    metrics << "midiplayer_" << name << " " << value << "\n";
+  };
+  add("queue_depth", juce::String(queued.load()));
+  add("queue_limit", juce::String(options.maxQueued));
+  add("requests_reading", juce::String(reading.load()));
+  add("active_jobs", juce::String(active.load()));
+  add("job_threads", juce::String(options.numJobs));
+  add("renders_completed_total", juce::String(completed.load()));
+  add("renders_failed_total", juce::String(failed.load()));
+  add("requests_rejected_total", juce::String(rejected.load()));
+  add("rendered_audio_seconds_total", juce::String(renderedSeconds.load(), 3));
+  add("render_seconds_total", juce::String(renderSeconds.load(), 3));
+  add("uptime_seconds", juce::String(uptimeSeconds, 3));
+  return metrics;
+}
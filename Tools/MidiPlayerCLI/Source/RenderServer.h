@@ -0,0 +1,54 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "../../../Source/OfflineRenderer.h"
+#include "NumaReplicas.h"
+
+#include <atomic>
+
+// A render service over plain HTTP, for farms of render boxes behind a load
+// balancer. The SoundFont stays loaded across requests, each render runs on
+// one of a fixed pool of job threads, and renders stream back as WAV while
+// they play, so a job holds one block of audio at a time. Requests are read,
+// and GETs answered, on a few threads of their own, so health checks and
+// scrapes get through however busy the jobs are.
+//
+//   POST /render   body: a standard MIDI file; query: effects=0|1, limit=0|1
+//                  200 with audio/wav, streamed until the connection closes
+//   GET /metrics   queue depth, jobs and throughput, in Prometheus text format
+//   GET /health    200 "ok"
+//
+// Renders over the queue limit, and connections over it waiting to be read,
+// get 503 at once rather than waiting.
+class RenderServer {
+public:
+  struct Options {
+    int port = 8080;
+    int numJobs = 1;         // requests rendering at once
+    int maxQueued = 64;      // renders waiting for a job thread
+    int numRequestThreads = 2; // reading requests and answering GETs
+    int maxMidiBytes = 64 << 20;
+    int timeoutMs = 10000;   // to read a whole request, or for room to write
+    OfflineRenderer::Options render; // with the shared, loaded SoundFont
+    NumaReplicas *replicas = nullptr; // copies of it to render from instead
+  };
+
+  explicit RenderServer(const Options &options);
+
+  // Listens on the port until the process is stopped. Returns false if it
+  // can't.
+  bool run();
+
+  // What /metrics reports
+  juce::String getMetrics() const;
+
+private:
+  class Request;
+  class Connection;
+
+  Options options;
+  std::atomic<int> reading{0}, queued{0}, active{0};
+  std::atomic<juce::int64> completed{0}, failed{0}, rejected{0};
+  std::atomic<double> renderedSeconds{0.0}, renderSeconds{0.0};
+  const double startMs = juce::Time::getMillisecondCounterHiRes();
+};
@@ -0,0 +1,88 @@
+#include "PluginProcessor.h"
+
+MidiPlayerProcessor::SharedSoundFont::SharedSoundFont() {
+  sound = new sfzero::SF2Sound(BinaryData::gm_sf2,
+                               static_cast<size_t>(BinaryData::gm_sf2Size));
+  sound->setRegionCacheDirectory(SynthAudioSource::getSoundFontCacheDirectory());
+  sound->loadRegions();
+  sound->loadSamples(nullptr);
+}
+
+MidiPlayerProcessor::SharedSoundFont::~SharedSoundFont() = default;
+
+MidiPlayerProcessor::MidiPlayerProcessor()
+    : juce::AudioProcessor(BusesProperties().withOutput(
+          "Output", juce::AudioChannelSet::stereo(), true)) {
+  synth = std::make_unique<SynthAudioSource>(soundFont->sound.get());
+
+  // The host spreads instances over its own threads, so each renders on
+  // the one it's called on. The effects stay in line with the dry signal;
+  // the only latency is the limiter's look-ahead, which the host compensates.
+  synth->setRenderThreads(0);
+  synth->setEffectsPipelined(false);
+  synth->setEffectsEnabled(true);
+  synth->setLimiterEnabled(true);
+}
+
+MidiPlayerProcessor::~MidiPlayerProcessor() = default;
+
+void MidiPlayerProcessor::prepareToPlay(double sampleRate,
+                                        int maximumExpectedSamplesPerBlock) {
+  maximumBlockSize = juce::jmax(1, maximumExpectedSamplesPerBlock);
+  synth->prepareToPlay(maximumBlockSize, sampleRate);
+  setLatencySamples(synth->getLatencySamples());
+
+  wasPlaying = false;
+  expectedTimeInSamples = -1;
+}
+
+void MidiPlayerProcessor::releaseResources() { synth->stopAllNotes(); }
+
+bool MidiPlayerProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const {
+  return layouts.getMainOutputChannelSet() == juce::AudioChannelSet::stereo();
+}
+
+void MidiPlayerProcessor::followTransport(int numSamples) {
+  auto *playHead = getPlayHead();
+  if (playHead == nullptr)
+    return;
+  const auto position = playHead->getPosition();
+  if (!position.hasValue())
+    return;
+
+  // Notes held over a stop, a loop back or a seek would never get their
+  // note-offs
+  const bool playing = position->getIsPlaying();
+  const auto time = position->getTimeInSamples();
+  const bool jumped = playing && wasPlaying && time.hasValue() &&
+                      expectedTimeInSamples >= 0 && *time != expectedTimeInSamples;
+  if ((wasPlaying && !playing) || jumped)
+    synth->stopAllNotes();
+
+  wasPlaying = playing;
+  expectedTimeInSamples = playing && time.hasValue() ? *time + numSamples : -1;
+}
+
+void MidiPlayerProcessor::processBlock(juce::AudioBuffer<float> &buffer,
+                                       juce::MidiBuffer &midiMessages) {
+  const juce::ScopedNoDenormals noDenormals;
+  const int numSamples = buffer.getNumSamples();
+  const sfzero::PerformanceCounters::ScopedCallback timing(
+      synth->getPerformanceCounters(), numSamples);
+
+  followTransport(numSamples);
+
+  // Each piece takes the events that fall inside it
+  const int pieceSize = maximumBlockSize > 0 ? maximumBlockSize : numSamples;
+  for (int start = 0; start < numSamples; start += pieceSize) {
+    const int count = juce::jmin(pieceSize, numSamples - start);
+    synth->renderNextBlock(buffer, midiMessages, start, count);
+  }
+
+  // An instrument's MIDI output is its own; the host's input isn't passed on
+  midiMessages.clear();
+}
+
+juce::AudioProcessor *JUCE_CALLTYPE createPluginFilter() {
+  return new MidiPlayerProcessor();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "../../../Source/SynthAudioSource.h"
+#include <JuceHeader.h>
+
+// The player's synth as an instrument plugin. The host sends the MIDI and
+// runs the transport; the processor only renders. Every instance plays the
+// one built-in GM bank, parsed once per process and read in place, so an
+// instance costs its voice pool and little else.
+class MidiPlayerProcessor : public juce::AudioProcessor {
+public:
+  MidiPlayerProcessor();
+  ~MidiPlayerProcessor() override;
+
+  void prepareToPlay(double sampleRate, int maximumExpectedSamplesPerBlock) override;
+  void releaseResources() override;
+  bool isBusesLayoutSupported(const BusesLayout &layouts) const override;
+  void processBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages) override;
+  using juce::AudioProcessor::processBlock;
+
+  juce::AudioProcessorEditor *createEditor() override { return nullptr; }
+  bool hasEditor() const override { return false; }
+
+  const juce::String getName() const override { return JucePlugin_Name; }
+  bool acceptsMidi() const override { return true; }
+  bool producesMidi() const override { return false; }
+  bool isMidiEffect() const override { return false; }
+  // Long enough for a release to ring out once the host stops
+  double getTailLengthSeconds() const override { return 2.0; }
+
+  int getNumPrograms() override { return 1; }
+  int getCurrentProgram() override { return 0; }
+  void setCurrentProgram(int) override {}
+  const juce::String getProgramName(int) override { return {}; }
+  void changeProgramName(int, const juce::String &) override {}
+
+  // Nothing to keep: the song sets programs and controllers as it plays
+  void getStateInformation(juce::MemoryBlock &) override {}
+  void setStateInformation(const void *, int) override {}
+
+private:
+  // The GM bank, loaded completely when the first instance is made and
+  // shared by every instance after it
+  struct SharedSoundFont {
+    SharedSoundFont();
+    ~SharedSoundFont();
+    juce::ReferenceCountedObjectPtr<sfzero::SF2Sound> sound;
+  };
+  juce::SharedResourcePointer<SharedSoundFont> soundFont;
+
+  // Made in the constructor, and prepared again for each prepareToPlay()
+  std::unique_ptr<SynthAudioSource> synth;
+
+  // Hosts may send more than they asked prepareToPlay() for, so blocks go
+  // through the synth in pieces no longer than it was prepared for, and its
+  // buffers never grow on the audio thread
+  int maximumBlockSize = 0;
+
+  // Where the host's transport was at the end of the last block, to see it
+  // stop or jump and silence the notes the song can no longer end
+  bool wasPlaying = false;
+  juce::int64 expectedTimeInSamples = -1;
+  void followTransport(int numSamples);
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MidiPlayerProcessor)
+};